@@ -0,0 +1,382 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#ifndef ADJACENCYLIST_H
+#define ADJACENCYLIST_H
+
+class AdjacencyList;
+
+#include <QVector>
+
+/**
+ * Compressed storage for adjacency information (node to node, node to cell, cell to cell, ...).
+ * All rows are kept in one contiguous item array and row i occupies the
+ * range [m_Start[i], m_End[i]) of this array. Compared to a QVector<QVector<int> >
+ * this avoids one heap allocation per row and keeps neighbouring rows close together in memory.
+ *
+ * Rows can be modified after the list has been built (see setRow). A row which
+ * does not grow is overwritten in place; a row which grows is moved to the end
+ * of the item array. The unused items are reclaimed once they make up half of the array.
+ */
+class AdjacencyList
+{
+
+public: // data-types
+
+  /**
+   * Read-only view of a single row.
+   * A row is only valid as long as the underlying AdjacencyList is not modified.
+   * It provides enough of the QVector interface to be used with foreach and
+   * the container helpers of EgVtkObject.
+   */
+  class Row
+  {
+
+  private: // attributes
+
+    const int *m_Begin;
+    const int *m_End;
+
+  public: // data-types
+
+    typedef int        value_type;
+    typedef const int* const_iterator;
+    typedef const int* iterator;
+
+  public: // methods
+
+    Row() : m_Begin(NULL), m_End(NULL) {}
+    Row(const int *begin, const int *end) : m_Begin(begin), m_End(end) {}
+
+    int  size()    const { return int(m_End - m_Begin); }
+    int  count()   const { return size(); }
+    bool isEmpty() const { return m_Begin == m_End; }
+
+    int operator[](int j) const { return m_Begin[j]; }
+    int at(int j)         const { return m_Begin[j]; }
+
+    const_iterator begin() const { return m_Begin; }
+    const_iterator end()   const { return m_End; }
+
+    int  indexOf(int item) const;
+    bool contains(int item) const { return indexOf(item) != -1; }
+
+    QVector<int> toVector() const;
+    operator QVector<int>() const { return toVector(); }
+
+  };
+
+private: // attributes
+
+  QVector<int> m_Start;   ///< start of each row in m_Item
+  QVector<int> m_End;     ///< end (one past the last item) of each row in m_Item
+  QVector<int> m_Item;    ///< the items of all rows
+  int          m_Garbage; ///< number of unused items in m_Item
+
+public: // methods
+
+  AdjacencyList() { clear(); }
+
+  /// Remove all rows.
+  void clear();
+
+  /// Get the number of rows.
+  int size() const { return m_Start.size(); }
+
+  /// Get the total number of items (all rows).
+  int numItems() const { return m_Item.size() - m_Garbage; }
+
+  int rowSize(int i)   const { return m_End[i] - m_Start[i]; }
+  int at(int i, int j) const { return m_Item[m_Start[i] + j]; }
+  Row operator[](int i) const { return row(i); }
+  Row row(int i) const;
+
+  /**
+   * Define the layout of the list. All items will be set to -1.
+   * @param row_size the number of items for each row
+   */
+  void setRowSizes(const QVector<int> &row_size);
+
+  /**
+   * Reduce the size of the rows and re-pack the item array.
+   * @param row_size the new number of items for each row (must not exceed the current size)
+   */
+  void shrinkRows(const QVector<int> &row_size);
+
+  /**
+   * Get write access to a row (only for building the list).
+   * @param i the index of the row
+   * @return a pointer to the first item of row i
+   */
+  int* rowData(int i) { return m_Item.data() + m_Start[i]; }
+
+  /**
+   * Get the raw array with the start of each row (size: number of rows).
+   * This is meant for building the list in parallel loops.
+   */
+  const int* offsets() const { return m_Start.constData(); }
+
+  /// Get write access to the raw item array (only for building the list).
+  int* items() { return m_Item.data(); }
+
+  /// Set up the list from a vector of vectors.
+  void fromVectors(const QVector<QVector<int> > &rows);
+
+  /// Copy the list into a vector of vectors.
+  void toVectors(QVector<QVector<int> > &rows) const;
+
+  /**
+   * Replace the items of a row.
+   * This invalidates all Row views of this list.
+   * @param i the index of the row
+   * @param row the new items of the row
+   */
+  void setRow(int i, const QVector<int> &row);
+
+  /**
+   * Insert an item into a row (without any temporary allocation).
+   * The row grows in place if it is the last one of the item array; otherwise it is moved to the end.
+   * This invalidates all Row views of this list.
+   * @param i the index of the row
+   * @param j the position of the new item in the row
+   * @param item the new item
+   */
+  void insertItem(int i, int j, int item);
+
+  /**
+   * Remove an item from a row (in place).
+   * This invalidates all Row views of this list.
+   * @param i the index of the row
+   * @param j the position of the item in the row
+   */
+  void removeItem(int i, int j);
+
+  /// Exchange the contents of two lists (nothing is copied).
+  void swap(AdjacencyList &list);
+
+  /**
+   * Append an empty row.
+   * @return the index of the new row
+   */
+  int addRow();
+
+  /**
+   * Remove a row by moving the last row into its place.
+   * The caller has to renumber references to the last row.
+   * @param i the index of the row to remove
+   */
+  void swapRemoveRow(int i);
+
+  /// Re-pack the item array in order to get rid of unused items.
+  void compact();
+
+};
+
+
+inline int AdjacencyList::Row::indexOf(int item) const
+{
+  for (const int *p = m_Begin; p != m_End; ++p) {
+    if (*p == item) {
+      return int(p - m_Begin);
+    }
+  }
+  return -1;
+}
+
+inline QVector<int> AdjacencyList::Row::toVector() const
+{
+  QVector<int> v(size());
+  for (int j = 0; j < v.size(); ++j) {
+    v[j] = m_Begin[j];
+  }
+  return v;
+}
+
+inline void AdjacencyList::clear()
+{
+  m_Start.clear();
+  m_End.clear();
+  m_Item.clear();
+  m_Garbage = 0;
+}
+
+inline AdjacencyList::Row AdjacencyList::row(int i) const
+{
+  const int *items = m_Item.constData();
+  return Row(items + m_Start[i], items + m_End[i]);
+}
+
+inline void AdjacencyList::setRowSizes(const QVector<int> &row_size)
+{
+  m_Start.resize(row_size.size());
+  m_End.resize(row_size.size());
+  int k = 0;
+  for (int i = 0; i < row_size.size(); ++i) {
+    m_Start[i] = k;
+    k += row_size[i];
+    m_End[i] = k;
+  }
+  m_Item.fill(-1, k);
+  m_Garbage = 0;
+}
+
+inline void AdjacencyList::shrinkRows(const QVector<int> &row_size)
+{
+  int k = 0;
+  for (int i = 0; i < size(); ++i) {
+    int start = m_Start[i];
+    m_Start[i] = k;
+    for (int j = 0; j < row_size[i]; ++j) {
+      m_Item[k] = m_Item[start + j];
+      ++k;
+    }
+    m_End[i] = k;
+  }
+  m_Item.resize(k);
+  m_Item.squeeze();
+  m_Garbage = 0;
+}
+
+inline void AdjacencyList::fromVectors(const QVector<QVector<int> > &rows)
+{
+  QVector<int> row_size(rows.size());
+  for (int i = 0; i < rows.size(); ++i) {
+    row_size[i] = rows[i].size();
+  }
+  setRowSizes(row_size);
+  for (int i = 0; i < rows.size(); ++i) {
+    int *data = rowData(i);
+    for (int j = 0; j < rows[i].size(); ++j) {
+      data[j] = rows[i][j];
+    }
+  }
+}
+
+inline void AdjacencyList::toVectors(QVector<QVector<int> > &rows) const
+{
+  rows.resize(size());
+  for (int i = 0; i < size(); ++i) {
+    rows[i] = row(i).toVector();
+  }
+}
+
+inline void AdjacencyList::setRow(int i, const QVector<int> &row)
+{
+  if (row.size() > rowSize(i)) {
+    m_Garbage += rowSize(i);
+    m_Start[i] = m_Item.size();
+    m_Item.resize(m_Item.size() + row.size());
+  } else {
+    m_Garbage += rowSize(i) - row.size();
+  }
+  m_End[i] = m_Start[i] + row.size();
+  int *data = rowData(i);
+  for (int j = 0; j < row.size(); ++j) {
+    data[j] = row[j];
+  }
+  if (2*m_Garbage > m_Item.size()) {
+    compact();
+  }
+}
+
+inline void AdjacencyList::insertItem(int i, int j, int item)
+{
+  int N = rowSize(i);
+  if (m_End[i] != m_Item.size()) {
+    // move the row to the end of the item array
+    int start = m_Start[i];
+    m_Garbage += N;
+    m_Start[i] = m_Item.size();
+    m_Item.resize(m_Item.size() + N + 1);
+    for (int k = 0; k < N; ++k) {
+      m_Item[m_Start[i] + k] = m_Item[start + k];
+    }
+  } else {
+    m_Item.resize(m_Item.size() + 1);
+  }
+  m_End[i] = m_Start[i] + N + 1;
+  int *data = rowData(i);
+  for (int k = N; k > j; --k) {
+    data[k] = data[k - 1];
+  }
+  data[j] = item;
+  if (2*m_Garbage > m_Item.size()) {
+    compact();
+  }
+}
+
+inline void AdjacencyList::removeItem(int i, int j)
+{
+  int *data = rowData(i);
+  for (int k = j + 1; k < rowSize(i); ++k) {
+    data[k - 1] = data[k];
+  }
+  --m_End[i];
+  ++m_Garbage;
+  if (2*m_Garbage > m_Item.size()) {
+    compact();
+  }
+}
+
+inline void AdjacencyList::swap(AdjacencyList &list)
+{
+  qSwap(m_Start, list.m_Start);
+  qSwap(m_End, list.m_End);
+  qSwap(m_Item, list.m_Item);
+  qSwap(m_Garbage, list.m_Garbage);
+}
+
+inline int AdjacencyList::addRow()
+{
+  m_Start.append(m_Item.size());
+  m_End.append(m_Item.size());
+  return size() - 1;
+}
+
+inline void AdjacencyList::swapRemoveRow(int i)
+{
+  int last = size() - 1;
+  m_Garbage += rowSize(i);
+  m_Start[i] = m_Start[last];
+  m_End[i]   = m_End[last];
+  m_Start.resize(last);
+  m_End.resize(last);
+}
+
+inline void AdjacencyList::compact()
+{
+  QVector<int> item(numItems());
+  int k = 0;
+  for (int i = 0; i < size(); ++i) {
+    int start = m_Start[i];
+    m_Start[i] = k;
+    for (int j = start; j < m_End[i]; ++j) {
+      item[k] = m_Item[j];
+      ++k;
+    }
+    m_End[i] = k;
+  }
+  m_Item = item;
+  m_Garbage = 0;
+}
+
+#endif // ADJACENCYLIST_H
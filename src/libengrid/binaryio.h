@@ -0,0 +1,118 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <QDataStream>
+#include <QIODevice>
+#include <QVector>
+
+#include <climits>
+
+/**
+ * @file binaryio.h
+ * Helpers to store plain data (no pointers, no virtual methods) with its native binary layout.
+ * Files written with these functions can only be read on the same platform; writers should store
+ * a byte order mark and the relevant type sizes in their header.
+ */
+
+template <class T>
+inline void writeRaw(QDataStream &s, const T &value)
+{
+  s.writeRawData(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T>
+inline bool readRaw(QDataStream &s, T &value)
+{
+  return s.readRawData(reinterpret_cast<char*>(&value), sizeof(T)) == int(sizeof(T));
+}
+
+/**
+ * Check if a stream can still provide N items of a given size.
+ * This protects against huge allocations for corrupted or truncated files.
+ */
+inline bool rawItemsAvailable(QDataStream &s, qint32 N, qint64 item_size)
+{
+  if (N < 0) {
+    return false;
+  }
+  if (!s.device()) {
+    return true;
+  }
+  return qint64(N) <= s.device()->bytesAvailable()/item_size;
+}
+
+template <class T>
+inline void writeRawVector(QDataStream &s, const QVector<T> &v)
+{
+  qint32 N = v.size();
+  s << N;
+  s.writeRawData(reinterpret_cast<const char*>(v.constData()), N*sizeof(T));
+}
+
+template <class T>
+inline bool readRawVector(QDataStream &s, QVector<T> &v)
+{
+  qint32 N;
+  s >> N;
+  if (s.status() != QDataStream::Ok || !rawItemsAvailable(s, N, sizeof(T))) {
+    return false;
+  }
+  qint64 num_bytes = qint64(N)*sizeof(T);
+  if (num_bytes > INT_MAX) {
+    return false;
+  }
+  v.resize(N);
+  return s.readRawData(reinterpret_cast<char*>(v.data()), int(num_bytes)) == num_bytes;
+}
+
+template <class T>
+inline void writeRawVectors(QDataStream &s, const QVector<QVector<T> > &v)
+{
+  qint32 N = v.size();
+  s << N;
+  for (int i = 0; i < v.size(); ++i) {
+    writeRawVector(s, v[i]);
+  }
+}
+
+template <class T>
+inline bool readRawVectors(QDataStream &s, QVector<QVector<T> > &v)
+{
+  qint32 N;
+  s >> N;
+  // every vector has at least its size stored
+  if (s.status() != QDataStream::Ok || !rawItemsAvailable(s, N, sizeof(qint32))) {
+    return false;
+  }
+  v.resize(N);
+  for (int i = 0; i < N; ++i) {
+    if (!readRawVector(s, v[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif // BINARYIO_H
@@ -0,0 +1,100 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#include "bucketoctree.h"
+
+BucketOctree::BucketOctree()
+{
+  m_TaskSize = 1000;
+}
+
+void BucketOctree::mergeSubtrees(subtree_t &tree, subtree_t *children)
+{
+  // The roots of the children become nodes 1 to 8 (they have to be consecutive);
+  // the remaining nodes of each child follow in their original order.
+  int node_offset[8];
+  int item_offset[8];
+  int N_nodes = 9;
+  int N_items = tree.items.size();
+  for (int k = 0; k < 8; ++k) {
+    node_offset[k] = N_nodes - 1;
+    N_nodes += children[k].nodes.size() - 1;
+    item_offset[k] = N_items;
+    N_items += children[k].items.size();
+  }
+  tree.nodes.resize(N_nodes);
+  tree.items.resize(N_items);
+  tree.nodes[0].child = 1;
+  for (int k = 0; k < 8; ++k) {
+    const QVector<node_t> &child_nodes = children[k].nodes;
+    for (int j = 0; j < child_nodes.size(); ++j) {
+      node_t node = child_nodes[j];
+      if (j == 0) {
+        node.parent = 0;
+      } else if (node.parent == 0) {
+        node.parent = 1 + k;
+      } else {
+        node.parent += node_offset[k];
+      }
+      if (node.child >= 0) {
+        node.child += node_offset[k];
+      }
+      node.first += item_offset[k];
+      tree.nodes[j == 0 ? 1 + k : node_offset[k] + j] = node;
+    }
+    qCopy(children[k].items.begin(), children[k].items.end(), tree.items.begin() + item_offset[k]);
+    children[k].nodes.clear();
+    children[k].items.clear();
+  }
+}
+
+bool BucketOctree::isInside(vec3_t x) const
+{
+  if (m_Nodes.isEmpty()) {
+    return false;
+  }
+  const node_t &root = m_Nodes[0];
+  for (int i = 0; i < 3; ++i) {
+    if (x[i] < root.x1[i] || x[i] > root.x1[i] + root.dx) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int BucketOctree::findLeaf(vec3_t x) const
+{
+  if (!isInside(x)) {
+    return -1;
+  }
+  int i_node = 0;
+  while (m_Nodes[i_node].child >= 0) {
+    const node_t &node = m_Nodes[i_node];
+    double h = 0.5*node.dx;
+    int k = 0;
+    if (x[0] >= node.x1[0] + h) k += 1;
+    if (x[1] >= node.x1[1] + h) k += 2;
+    if (x[2] >= node.x1[2] + h) k += 4;
+    i_node = node.child + k;
+  }
+  return i_node;
+}
@@ -0,0 +1,161 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#ifndef BUCKETOCTREE_H
+#define BUCKETOCTREE_H
+
+class BucketOctree;
+
+#include "engrid.h"
+
+#include <QVector>
+
+/**
+ * Octree of index buckets for FaceFinder and PointFinder.
+ * The tree is built top-down in one pass: every node decides on its own whether it has to be split
+ * and the sub-trees are built as independent (OpenMP) tasks and merged afterwards.
+ * All nodes are cubes and the buckets are stored in one flat index array.
+ *
+ * The splitting rule is defined by a policy class S with two methods:
+ *  - bool refine(double dx, const int *items, int num) const -- should a node with these items be split?
+ *  - bool contains(vec3_t x1, double dx, int item) const -- does an item belong into the child cube [x1, x1 + dx]?
+ * Items can belong to several children.
+ */
+class BucketOctree
+{
+
+public: // data-types
+
+  struct node_t
+  {
+    vec3_t x1;     ///< lower corner
+    double dx;     ///< edge length
+    int    parent; ///< parent node (-1 for the root)
+    int    child;  ///< first of the eight consecutive children (-1 for a leaf)
+    int    first;  ///< first entry of the bucket in m_Items
+    int    num;    ///< number of items in the bucket
+  };
+
+private: // data-types
+
+  struct subtree_t
+  {
+    QVector<node_t> nodes;
+    QVector<int>    items;
+  };
+
+private: // attributes
+
+  QVector<node_t> m_Nodes;
+  QVector<int>    m_Items;
+  int             m_TaskSize; ///< sub-trees with fewer items are built in the task of their parent
+
+private: // methods
+
+  template <class S>
+  static void buildSubtree(vec3_t x1, double dx, const QVector<int> &items, const S *split, int task_size, subtree_t *tree);
+
+  static void mergeSubtrees(subtree_t &tree, subtree_t *children);
+
+public: // methods
+
+  BucketOctree();
+
+  /**
+   * Build the tree.
+   * @param x1 the lower corner of the root cube
+   * @param dx the edge length of the root cube
+   * @param items the items of the root node
+   * @param split the splitting policy (see class description)
+   */
+  template <class S>
+  void build(vec3_t x1, double dx, const QVector<int> &items, const S &split);
+
+  bool isInside(vec3_t x) const;
+  int  findLeaf(vec3_t x) const; ///< the leaf which contains x (-1 if x is outside of the root cube)
+
+  const node_t& node(int i) const { return m_Nodes[i]; }
+  int  numNodes() const { return m_Nodes.size(); }
+  int  parent(int i) const { return m_Nodes[i].parent; }
+  bool isLeaf(int i) const { return m_Nodes[i].child < 0; }
+  int  bucketSize(int i) const { return m_Nodes[i].num; }
+  const int* bucket(int i) const { return m_Items.constData() + m_Nodes[i].first; }
+
+  void setTaskSize(int N) { m_TaskSize = N; }
+
+};
+
+
+template <class S>
+void BucketOctree::build(vec3_t x1, double dx, const QVector<int> &items, const S &split)
+{
+  subtree_t tree;
+  #pragma omp parallel
+  {
+    #pragma omp single
+    {
+      buildSubtree(x1, dx, items, &split, m_TaskSize, &tree);
+    }
+  }
+  m_Nodes = tree.nodes;
+  m_Items = tree.items;
+}
+
+template <class S>
+void BucketOctree::buildSubtree(vec3_t x1, double dx, const QVector<int> &items, const S *split, int task_size, subtree_t *tree)
+{
+  node_t root;
+  root.x1     = x1;
+  root.dx     = dx;
+  root.parent = -1;
+  root.child  = -1;
+  root.first  = 0;
+  root.num    = items.size();
+  tree->nodes.append(root);
+  tree->items = items;
+  if (!split->refine(dx, items.constData(), items.size())) {
+    return;
+  }
+
+  double dx_child = 0.5*dx;
+  QVector<int> child_items[8];
+  subtree_t    child_tree[8];
+  for (int k = 0; k < 8; ++k) {
+    vec3_t x1_child = x1 + vec3_t((k & 1)*dx_child, ((k >> 1) & 1)*dx_child, ((k >> 2) & 1)*dx_child);
+    for (int i = 0; i < items.size(); ++i) {
+      if (split->contains(x1_child, dx_child, items[i])) {
+        child_items[k].append(items[i]);
+      }
+    }
+  }
+  for (int k = 0; k < 8; ++k) {
+    vec3_t x1_child = x1 + vec3_t((k & 1)*dx_child, ((k >> 1) & 1)*dx_child, ((k >> 2) & 1)*dx_child);
+    #pragma omp task shared(child_items, child_tree) if(child_items[k].size() >= task_size)
+    {
+      buildSubtree(x1_child, dx_child, child_items[k], split, task_size, &child_tree[k]);
+    }
+  }
+  #pragma omp taskwait
+  mergeSubtrees(*tree, child_tree);
+}
+
+#endif // BUCKETOCTREE_H
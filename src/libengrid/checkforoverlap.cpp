@@ -77,7 +77,18 @@ void CheckForOverlap::operate()
     }
     ++N_buckets;
     N_faces += close_faces.size();
-    foreach (vtkIdType id_face2, close_faces) {
+
+    // An edge can only intersect a face which is closer to its centre than half its length.
+    // The distances of all close faces are computed in one batch for each edge.
+    QVector<QVector<double> > d2_edge(x1.size() - 1);
+    QVector<double> r2_edge(x1.size() - 1);
+    for (int i = 0; i < x1.size() - 1; ++i) {
+      d2_edge[i].resize(close_faces.size());
+      find.triangleStore().distances2(0.5*(x1[i] + x1[i+1]), close_faces, d2_edge[i].data());
+      r2_edge[i] = sqr(0.55*(x1[i+1] - x1[i]).abs());
+    }
+    for (int i_close = 0; i_close < close_faces.size(); ++i_close) {
+      vtkIdType id_face2 = close_faces[i_close];
       if (!neighbours.contains(id_face2)) {
         ++N_searches;
         vtkIdType N_pts, *pts;
@@ -87,6 +98,9 @@ void CheckForOverlap::operate()
           m_Grid->GetPoint(pts[i], x2[i].data());
         }
         for (int i = 0; i < x1.size() - 1; ++i) {
+          if (d2_edge[i][i_close] > r2_edge[i]) {
+            continue;
+          }
           vec3_t x, r;
           if (intersectEdgeAndTriangle(x2[0], x2[1], x2[2], x1[i], x1[i+1], x, r, 1e-6)) {
             is_overlap[id_face1] = true;
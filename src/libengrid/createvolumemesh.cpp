@@ -55,7 +55,7 @@ void CreateVolumeMesh::prepare()
   QVector<vtkIdType> cells, nodes;
   QVector<int>       _cells, _nodes;
   QVector<QVector< int > > c2c;
-  QVector<QVector<int> > n2c;
+  AdjacencyList            n2c;
   getAllCells(cells, m_Grid);
   createCellMapping(cells, _cells, m_Grid);
   getNodesFromCells(cells, nodes, m_Grid);
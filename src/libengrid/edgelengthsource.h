@@ -46,6 +46,14 @@ public:
   virtual void    config() = 0;
   virtual double  edgeLength(vec3_t x) = 0;
 
+  /**
+   * Get an axis aligned box around the region of influence.
+   * edgeLength returns a negative value for all points outside of this box.
+   * @param x1 on return the lower corner of the box
+   * @param x2 on return the upper corner of the box
+   */
+  virtual void getBounds(vec3_t &x1, vec3_t &x2) = 0;
+
   virtual void setName(QString name) = 0;
   QString name() { return m_Name; }
 
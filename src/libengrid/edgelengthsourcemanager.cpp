@@ -29,6 +29,22 @@
 #include "guiedgelengthsourcepipe.h"
 #include "guimainwindow.h"
 
+#include <algorithm>
+
+namespace
+{
+
+/// orders source indices by one coordinate of their centres
+struct CentreCompare
+{
+  const vec3_t *xc;
+  int i;
+  CentreCompare(const vec3_t *xc, int i) : xc(xc), i(i) {}
+  bool operator()(int s1, int s2) const { return xc[s1][i] < xc[s2][i]; }
+};
+
+}
+
 EdgeLengthSourceManager::EdgeLengthSourceManager()
 {
   m_Sources.clear();
@@ -38,6 +54,8 @@ EdgeLengthSourceManager::EdgeLengthSourceManager()
   m_Samples.push_back(new GuiEdgeLengthSourceBox);
   m_Samples.push_back(new GuiEdgeLengthSourcePipe);
   m_ListWidget = NULL;
+  m_TreeValid = false;
+  m_MaxLeafSize = 2;
 }
 
 EdgeLengthSourceManager::~EdgeLengthSourceManager()
@@ -66,6 +84,7 @@ void EdgeLengthSourceManager::read()
     //delete source;
   }
   m_Sources.clear();
+  m_TreeValid = false;
   QString xml_text = GuiMainWindow::pointer()->getXmlSection("engrid/sources");
   QStringList lines = xml_text.split("\n");
   foreach (QString line, lines) {
@@ -110,18 +129,133 @@ void EdgeLengthSourceManager::write()
   GuiMainWindow::pointer()->setXmlSection("engrid/sources", xml_text);
 }
 
-double EdgeLengthSourceManager::minEdgeLength(vec3_t x)
+void EdgeLengthSourceManager::buildTree()
+{
+  int N = m_Sources.size();
+  m_Nodes.clear();
+  m_Order.resize(N);
+  if (N > 0) {
+    QVector<vec3_t> x1(N), x2(N), xc(N);
+    for (int i = 0; i < N; ++i) {
+      m_Sources[i]->getBounds(x1[i], x2[i]);
+
+      // the sources check their borders inclusively; make sure rounding errors do not exclude them
+      double tol = 1e-6*(x2[i] - x1[i]).abs();
+      x1[i] -= vec3_t(tol, tol, tol);
+      x2[i] += vec3_t(tol, tol, tol);
+
+      xc[i] = 0.5*(x1[i] + x2[i]);
+      m_Order[i] = i;
+    }
+    m_Nodes.reserve(2*(N/m_MaxLeafSize + 1));
+    buildNode(x1, x2, xc, 0, N);
+  }
+  m_TreeValid = true;
+}
+
+int EdgeLengthSourceManager::buildNode(const QVector<vec3_t> &x1, const QVector<vec3_t> &x2, const QVector<vec3_t> &xc, int first, int num)
+{
+  int i_node = m_Nodes.size();
+  m_Nodes.append(node_t());
+  node_t node;
+  node.child1 = -1;
+  node.child2 = -1;
+  node.first  = first;
+  node.num    = num;
+
+  // bounding box of the sources and of their centres
+  node.x1 = x1[m_Order[first]];
+  node.x2 = x2[m_Order[first]];
+  vec3_t xc1 = xc[m_Order[first]];
+  vec3_t xc2 = xc1;
+  for (int i = first + 1; i < first + num; ++i) {
+    int s = m_Order[i];
+    for (int k = 0; k < 3; ++k) {
+      node.x1[k] = min(node.x1[k], x1[s][k]);
+      node.x2[k] = max(node.x2[k], x2[s][k]);
+      xc1[k] = min(xc1[k], xc[s][k]);
+      xc2[k] = max(xc2[k], xc[s][k]);
+    }
+  }
+
+  // split at the median of the longest extent of the centres
+  if (num > m_MaxLeafSize) {
+    vec3_t D = xc2 - xc1;
+    int i_dir = 0;
+    if (D[1] > D[i_dir]) i_dir = 1;
+    if (D[2] > D[i_dir]) i_dir = 2;
+    if (D[i_dir] > 0) {
+      int *order = m_Order.data();
+      int num1 = num/2;
+      std::nth_element(order + first, order + first + num1, order + first + num, CentreCompare(xc.constData(), i_dir));
+      node.child1 = buildNode(x1, x2, xc, first, num1);
+      node.child2 = buildNode(x1, x2, xc, first + num1, num - num1);
+      node.num = 0;
+    }
+  }
+  m_Nodes[i_node] = node;
+  return i_node;
+}
+
+double EdgeLengthSourceManager::queryTree(vec3_t x) const
 {
   double L_min = 1e99;
-  foreach (EdgeLengthSource* source, m_Sources) {
-    double L = source->edgeLength(x);
-    if (L > 0) {
-      L_min = min(L, L_min);
+  if (m_Nodes.isEmpty()) {
+    return L_min;
+  }
+  int stack[64];
+  int N_stack = 0;
+  stack[N_stack++] = 0;
+  while (N_stack > 0) {
+    const node_t &node = m_Nodes[stack[--N_stack]];
+    bool inside = true;
+    for (int k = 0; k < 3; ++k) {
+      if (x[k] < node.x1[k] || x[k] > node.x2[k]) {
+        inside = false;
+        break;
+      }
+    }
+    if (!inside) {
+      continue;
+    }
+    if (node.child1 < 0) {
+      for (int i = node.first; i < node.first + node.num; ++i) {
+        double L = m_Sources[m_Order[i]]->edgeLength(x);
+        if (L > 0) {
+          L_min = min(L, L_min);
+        }
+      }
+    } else {
+      stack[N_stack++] = node.child1;
+      stack[N_stack++] = node.child2;
     }
   }
   return L_min;
 }
 
+double EdgeLengthSourceManager::minEdgeLength(vec3_t x)
+{
+  if (!m_TreeValid) {
+    buildTree();
+  }
+  return queryTree(x);
+}
+
+void EdgeLengthSourceManager::minEdgeLength(const QVector<vec3_t> &x, QVector<double> &L)
+{
+  if (!m_TreeValid) {
+    buildTree();
+  }
+  L.resize(x.size());
+  const vec3_t *px = x.constData();
+  double *pL = L.data();
+  int N = x.size();
+  #pragma omp parallel for if(N > 1000)
+  for (int i = 0; i < N; ++i) {
+    pL[i] = queryTree(px[i]);
+  }
+}
+
 void EdgeLengthSourceManager::edit()
 {
   if (m_ListWidget->currentItem()) {
@@ -129,6 +263,7 @@ void EdgeLengthSourceManager::edit()
     foreach (EdgeLengthSource* source, m_Sources) {
       if (source->name() == selected_name) {
         source->config();
+        m_TreeValid = false;
         break;
       }
     }
@@ -149,6 +284,7 @@ void EdgeLengthSourceManager::remove()
       }
     }
     m_Sources = new_sources;
+    m_TreeValid = false;
     populateListWidget();
   }
 }
@@ -159,6 +295,7 @@ void EdgeLengthSourceManager::addSphere()
   GuiEdgeLengthSourceSphere *S = new GuiEdgeLengthSourceSphere;
   S->setName(name);
   m_Sources.append(S);
+  m_TreeValid = false;
   populateListWidget();
 }
 
@@ -168,6 +305,7 @@ void EdgeLengthSourceManager::addCone()
   GuiEdgeLengthSourceCone *S = new GuiEdgeLengthSourceCone;
   S->setName(name);
   m_Sources.append(S);
+  m_TreeValid = false;
   populateListWidget();
 }
 
@@ -177,6 +315,7 @@ void EdgeLengthSourceManager::addPipe()
   GuiEdgeLengthSourcePipe *S = new GuiEdgeLengthSourcePipe;
   S->setName(name);
   m_Sources.append(S);
+  m_TreeValid = false;
   populateListWidget();
 }
 
@@ -186,6 +325,7 @@ void EdgeLengthSourceManager::addBox()
   GuiEdgeLengthSourceBox *S = new GuiEdgeLengthSourceBox;
   S->setName(name);
   m_Sources.append(S);
+  m_TreeValid = false;
   populateListWidget();
 }
 
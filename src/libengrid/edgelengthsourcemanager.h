@@ -30,20 +30,45 @@
 #include "egvtkobject.h"
 #include "edgelengthsource.h"
 
+/**
+ * Manages the edge length sources of a grid.
+ * The bounding boxes of the sources are kept in a bounding volume hierarchy,
+ * so a query only evaluates the sources which can influence the point.
+ */
 class EdgeLengthSourceManager : public EgVtkObject
 {
 
+private: // data-types
+
+  struct node_t
+  {
+    vec3_t x1, x2; ///< bounding box
+    int    child1; ///< first child (-1 for a leaf)
+    int    child2; ///< second child (-1 for a leaf)
+    int    first;  ///< first entry in m_Order (leaves only)
+    int    num;    ///< number of sources (leaves only)
+  };
+
+
 private: // attributes
 
   QList<EdgeLengthSource*> m_Sources;
   QList<EdgeLengthSource*> m_Samples;
   QListWidget*             m_ListWidget;
+  QVector<node_t>          m_Nodes;       ///< the bounding volume hierarchy
+  QVector<int>             m_Order;       ///< source indices sorted by leaf
+  bool                     m_TreeValid;   ///< the hierarchy matches the current sources
+  int                      m_MaxLeafSize;
 
 
 private: // methods
 
   QString timeStamp() { return QDateTime::currentDateTime().toString("_yyyyMMddhhmmss"); }
 
+  void buildTree(); ///< rebuild the bounding volume hierarchy over the sources
+  int  buildNode(const QVector<vec3_t> &x1, const QVector<vec3_t> &x2, const QVector<vec3_t> &xc, int first, int num);
+  double queryTree(vec3_t x) const;
+
 
 public:
 
@@ -52,6 +77,14 @@ public:
 
   void   setListWidget(QListWidget *list_widget) { m_ListWidget = list_widget; }
   double minEdgeLength(vec3_t x);
+
+  /**
+   * Compute the minimal edge length for a set of points (in parallel).
+   * @param x the points
+   * @param L on return the minimal edge length of each point (1e99 if no source influences the point)
+   */
+  void minEdgeLength(const QVector<vec3_t> &x, QVector<double> &L);
+
   void   populateListWidget();
 
   void read();
@@ -31,6 +31,15 @@
 #include <vtkCell.h>
 #include <vtkCharArray.h>
 
+#include <algorithm>
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 int EgVtkObject::DebugLevel;
 
 void EgVtkObject::computeNormals
@@ -117,6 +126,44 @@ void EgVtkObject::createNodeToBcMapping
   }
 }
 
+bool EgVtkObject::SerialConnectivity = false;
+
+int EgVtkObject::numConnectivityThreads()
+{
+#ifdef _OPENMP
+  if (!SerialConnectivity) {
+    return omp_get_max_threads();
+  }
+#endif
+  return 1;
+}
+
+int EgVtkObject::connectivityThreadIndex()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+void EgVtkObject::sortRows(AdjacencyList &list, QVector<int> &row_size, bool remove_duplicates)
+{
+  const int *start = list.offsets();
+  int       *item  = list.items();
+  int       *size  = row_size.data();
+  int N = list.size();
+  #pragma omp parallel for if(!SerialConnectivity)
+  for (int i = 0; i < N; ++i) {
+    int *begin = item + start[i];
+    int *end   = begin + size[i];
+    std::sort(begin, end);
+    if (remove_duplicates) {
+      size[i] = std::unique(begin, end) - begin;
+    }
+  }
+}
+
 void EgVtkObject::createNodeToCell
 (
   QVector<vtkIdType>  &cells,
@@ -172,6 +219,58 @@ void EgVtkObject::createNodeToCell
   }
 }
 
+void EgVtkObject::createNodeToCell
+(
+  QVector<vtkIdType>  &cells,
+  QVector<vtkIdType>  &nodes,
+  QVector<int>        &_nodes,
+  AdjacencyList       &n2c,
+  vtkUnstructuredGrid *grid
+)
+{
+  // raw pointers are used inside the parallel loops to avoid implicit sharing checks
+  const vtkIdType *cell  = cells.constData();
+  const int       *lnode = _nodes.constData();
+  int N_cells = cells.size();
+
+  // pass 1: count the cells of every node
+  QVector<int> count(nodes.size(), 0);
+  int *cnt = count.data();
+  #pragma omp parallel for if(!SerialConnectivity)
+  for (int i_cells = 0; i_cells < N_cells; ++i_cells) {
+    vtkIdType *pts;
+    vtkIdType  Npts;
+    grid->GetCellPoints(cell[i_cells], Npts, pts);
+    for (int i_pts = 0; i_pts < Npts; ++i_pts) {
+      #pragma omp atomic
+      ++cnt[lnode[pts[i_pts]]];
+    }
+  }
+
+  // pass 2: fill the rows
+  n2c.setRowSizes(count);
+  count.fill(0);
+  cnt = count.data();
+  const int *start = n2c.offsets();
+  int       *item  = n2c.items();
+  #pragma omp parallel for if(!SerialConnectivity)
+  for (int i_cells = 0; i_cells < N_cells; ++i_cells) {
+    vtkIdType *pts;
+    vtkIdType  Npts;
+    grid->GetCellPoints(cell[i_cells], Npts, pts);
+    for (int i_pts = 0; i_pts < Npts; ++i_pts) {
+      int i_nodes = lnode[pts[i_pts]];
+      int k;
+      #pragma omp atomic capture
+      k = cnt[i_nodes]++;
+      item[start[i_nodes] + k] = i_cells;
+    }
+  }
+
+  // the order within a row depends on the thread schedule -- sort it to be deterministic
+  sortRows(n2c, count, false);
+}
+
 void EgVtkObject::addToN2N(QVector<QSet<int> > &n2n, int n1, int n2)
 {
   n2n[n1].insert(n2);
@@ -251,13 +350,91 @@ void EgVtkObject::createNodeToNode
   vtkUnstructuredGrid    *grid
 )
 {
-  QVector<QSet<int> > n2n_set;
-  createNodeToNode(cells, nodes, _nodes, n2n_set, grid);
-  n2n.resize(n2n_set.size());
-  for (int i = 0; i < n2n.size(); ++i) {
-    n2n[i].resize(n2n_set[i].size());
-    qCopy(n2n_set[i].begin(), n2n_set[i].end(), n2n[i].begin());
+  AdjacencyList n2n_list;
+  createNodeToNode(cells, nodes, _nodes, n2n_list, grid);
+  n2n_list.toVectors(n2n);
+}
+
+/// edges of the linear VTK cells as pairs of local corner indices
+static const int tri_edges[]   = { 0,1, 1,2, 2,0 };
+static const int quad_edges[]  = { 0,1, 1,2, 2,3, 3,0 };
+static const int tetra_edges[] = { 0,1, 0,2, 0,3, 1,2, 1,3, 2,3 };
+static const int pyra_edges[]  = { 0,1, 0,3, 0,4, 1,2, 1,4, 2,3, 2,4, 3,4 };
+static const int wedge_edges[] = { 0,1, 0,2, 0,3, 1,2, 1,4, 2,5, 3,4, 3,5, 4,5 };
+static const int hexa_edges[]  = { 0,1, 0,3, 0,4, 1,2, 1,5, 2,3, 2,6, 3,7, 4,5, 4,7, 5,6, 6,7 };
+
+int EgVtkObject::cellEdgeTable(vtkIdType type_cell, const int* &edges)
+{
+  if      (type_cell == VTK_TRIANGLE)   { edges = tri_edges;   return 3; }
+  else if (type_cell == VTK_QUAD)       { edges = quad_edges;  return 4; }
+  else if (type_cell == VTK_TETRA)      { edges = tetra_edges; return 6; }
+  else if (type_cell == VTK_PYRAMID)    { edges = pyra_edges;  return 8; }
+  else if (type_cell == VTK_WEDGE)      { edges = wedge_edges; return 9; }
+  else if (type_cell == VTK_HEXAHEDRON) { edges = hexa_edges;  return 12; }
+  edges = NULL;
+  return 0;
+}
+
+void EgVtkObject::createNodeToNode
+(
+  QVector<vtkIdType>  &cells,
+  QVector<vtkIdType>  &nodes,
+  QVector<int>        &_nodes,
+  AdjacencyList       &n2n,
+  vtkUnstructuredGrid *grid
+)
+{
+  const vtkIdType *cell  = cells.constData();
+  const int       *lnode = _nodes.constData();
+  int N_cells = cells.size();
+
+  // pass 1: count edge ends per node (including duplicates from shared edges)
+  QVector<int> count(nodes.size(), 0);
+  int *cnt = count.data();
+  #pragma omp parallel for if(!SerialConnectivity)
+  for (int i_cells = 0; i_cells < N_cells; ++i_cells) {
+    vtkIdType *pts;
+    vtkIdType  Npts;
+    grid->GetCellPoints(cell[i_cells], Npts, pts);
+    const int *edges;
+    int N = cellEdgeTable(grid->GetCellType(cell[i_cells]), edges);
+    for (int i = 0; i < N; ++i) {
+      #pragma omp atomic
+      ++cnt[lnode[pts[edges[2*i]]]];
+      #pragma omp atomic
+      ++cnt[lnode[pts[edges[2*i+1]]]];
+    }
+  }
+
+  // pass 2: fill the over-allocated rows
+  n2n.setRowSizes(count);
+  count.fill(0);
+  cnt = count.data();
+  const int *start = n2n.offsets();
+  int       *item  = n2n.items();
+  #pragma omp parallel for if(!SerialConnectivity)
+  for (int i_cells = 0; i_cells < N_cells; ++i_cells) {
+    vtkIdType *pts;
+    vtkIdType  Npts;
+    grid->GetCellPoints(cell[i_cells], Npts, pts);
+    const int *edges;
+    int N = cellEdgeTable(grid->GetCellType(cell[i_cells]), edges);
+    for (int i = 0; i < N; ++i) {
+      int n1 = lnode[pts[edges[2*i]]];
+      int n2 = lnode[pts[edges[2*i+1]]];
+      int k1, k2;
+      #pragma omp atomic capture
+      k1 = cnt[n1]++;
+      #pragma omp atomic capture
+      k2 = cnt[n2]++;
+      item[start[n1] + k1] = n2;
+      item[start[n2] + k2] = n1;
+    }
   }
+
+  // pass 3: sort each row and remove duplicates
+  sortRows(n2n, count, true);
+  n2n.shrinkRows(count);
 }
 
 void EgVtkObject::getAllCells
@@ -269,9 +446,12 @@ void EgVtkObject::getAllCells
   int N = 0;
   cells.resize(grid->GetNumberOfCells());
   for (vtkIdType id_cell = 0; id_cell < grid->GetNumberOfCells(); ++id_cell) {
-    cells[N] = id_cell;
-    ++N;
+    if (grid->GetCellType(id_cell) != VTK_EMPTY_CELL) {
+      cells[N] = id_cell;
+      ++N;
+    }
   }
+  cells.resize(N);
 }
 
 void EgVtkObject::getAllCellsOfType
@@ -370,16 +550,16 @@ void EgVtkObject::getSurfaceCells
   }
 }
 
-void EgVtkObject::addToC2C(vtkIdType id_cell, QVector<int> &_cells, QVector<QVector<int> > &c2c, int j, vtkIdList *nds, vtkIdList *cls, vtkUnstructuredGrid *grid)
+void EgVtkObject::addToC2C(vtkIdType id_cell, QVector<int> &_cells, int *c2c_row, int j, vtkIdList *nds, vtkIdList *cls, vtkUnstructuredGrid *grid)
 {
-  c2c[_cells[id_cell]][j] = -1;
+  c2c_row[j] = -1;
   grid->GetCellNeighbors(id_cell, nds, cls);
   if (isSurface(id_cell, grid)) {
     for (int i = 0; i < cls->GetNumberOfIds(); ++i) {
       if (cls->GetId(i) != id_cell) {
         if (_cells[cls->GetId(i)] != -1) {
           if (isSurface(cls->GetId(i), grid)) {
-            c2c[_cells[id_cell]][j] = _cells[cls->GetId(i)];
+            c2c_row[j] = _cells[cls->GetId(i)];
           }
         }
       }
@@ -388,8 +568,8 @@ void EgVtkObject::addToC2C(vtkIdType id_cell, QVector<int> &_cells, QVector<QVec
     for (int i = 0; i < cls->GetNumberOfIds(); ++i) {
       if (cls->GetId(i) != id_cell) {
         if (_cells[cls->GetId(i)] != -1) {
-          if (isVolume(cls->GetId(i), grid) || c2c[_cells[id_cell]][j] == -1) {
-            c2c[_cells[id_cell]][j] = _cells[cls->GetId(i)];
+          if (isVolume(cls->GetId(i), grid) || c2c_row[j] == -1) {
+            c2c_row[j] = _cells[cls->GetId(i)];
           }
         }
       }
@@ -397,175 +577,216 @@ void EgVtkObject::addToC2C(vtkIdType id_cell, QVector<int> &_cells, QVector<QVec
   }
 }
 
+int EgVtkObject::numFacesOfCell(vtkIdType type_cell)
+{
+  if      (type_cell == VTK_TRIANGLE)   return 3;
+  else if (type_cell == VTK_QUAD)       return 4;
+  else if (type_cell == VTK_TETRA)      return 4;
+  else if (type_cell == VTK_PYRAMID)    return 5;
+  else if (type_cell == VTK_WEDGE)      return 5;
+  else if (type_cell == VTK_HEXAHEDRON) return 6;
+  return 0;
+}
 
-void EgVtkObject::createCellToCell(QVector<vtkIdType> &cells, QVector<QVector<int> > &c2c, vtkUnstructuredGrid *grid)
+void EgVtkObject::fillC2CRow(vtkIdType id_cell, QVector<int> &_cells, int *c2c_row, vtkIdList *nds, vtkIdList *cls, vtkUnstructuredGrid *grid)
 {
   // GetCellNeighbors(vtkIdType id_cell, vtkIdList *ptIds, vtkIdList *id_cells)
-  grid->BuildLinks();
-  QVector<int> _cells;
-  createCellMapping(cells, _cells, grid);
-  c2c.fill(QVector<int>(), cells.size());
-  EG_VTKSP(vtkIdList, nds);
-  EG_VTKSP(vtkIdList, cls);
-  for (int i = 0; i < cells.size(); ++i) {
-    vtkIdType id_cell = cells[i];
+  {
     vtkIdType *pts;
     vtkIdType  Npts;
     grid->GetCellPoints(id_cell, Npts, pts);
     if (grid->GetCellType(id_cell) == VTK_TRIANGLE) {
-      c2c[i].resize(3);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[1]);
-      addToC2C(id_cell, _cells, c2c, 0, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 0, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[2]);
-      addToC2C(id_cell, _cells, c2c, 1, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 1, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[2]);
       nds->InsertNextId(pts[0]);
-      addToC2C(id_cell, _cells, c2c, 2, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 2, nds, cls, grid);
     } else if (grid->GetCellType(id_cell) == VTK_QUAD) {
-      c2c[i].resize(4);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[1]);
-      addToC2C(id_cell, _cells, c2c, 0, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 0, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[2]);
-      addToC2C(id_cell, _cells, c2c, 1, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 1, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[2]);
       nds->InsertNextId(pts[3]);
-      addToC2C(id_cell, _cells, c2c, 2, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 2, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[3]);
       nds->InsertNextId(pts[0]);
-      addToC2C(id_cell, _cells, c2c, 3, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 3, nds, cls, grid);
     } else if (grid->GetCellType(id_cell) == VTK_TETRA) {
-      c2c[i].resize(4);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[2]);
-      addToC2C(id_cell, _cells, c2c, 0, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 0, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[3]);
-      addToC2C(id_cell, _cells, c2c, 1, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 1, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[3]);
       nds->InsertNextId(pts[2]);
-      addToC2C(id_cell, _cells, c2c, 2, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 2, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[2]);
       nds->InsertNextId(pts[3]);
-      addToC2C(id_cell, _cells, c2c, 3, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 3, nds, cls, grid);
     } else if (grid->GetCellType(id_cell) == VTK_PYRAMID) {
-      c2c[i].resize(5);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[2]);
       nds->InsertNextId(pts[3]);
-      addToC2C(id_cell, _cells, c2c, 0, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 0, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[4]);
-      addToC2C(id_cell, _cells, c2c, 1, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 1, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[2]);
       nds->InsertNextId(pts[4]);
-      addToC2C(id_cell, _cells, c2c, 2, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 2, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[2]);
       nds->InsertNextId(pts[3]);
       nds->InsertNextId(pts[4]);
-      addToC2C(id_cell, _cells, c2c, 3, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 3, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[3]);
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[4]);
-      addToC2C(id_cell, _cells, c2c, 4, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 4, nds, cls, grid);
     } else if (grid->GetCellType(id_cell) == VTK_WEDGE) {
-      c2c[i].resize(5);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[2]);
-      addToC2C(id_cell, _cells, c2c, 0, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 0, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[3]);
       nds->InsertNextId(pts[4]);
       nds->InsertNextId(pts[5]);
-      addToC2C(id_cell, _cells, c2c, 1, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 1, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[4]);
       nds->InsertNextId(pts[3]);
-      addToC2C(id_cell, _cells, c2c, 2, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 2, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[4]);
       nds->InsertNextId(pts[5]);
       nds->InsertNextId(pts[2]);
-      addToC2C(id_cell, _cells, c2c, 3, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 3, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[2]);
       nds->InsertNextId(pts[5]);
       nds->InsertNextId(pts[3]);
-      addToC2C(id_cell, _cells, c2c, 4, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 4, nds, cls, grid);
     } else if (grid->GetCellType(id_cell) == VTK_HEXAHEDRON) {
-      c2c[i].resize(6);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[3]);
       nds->InsertNextId(pts[2]);
       nds->InsertNextId(pts[1]);
-      addToC2C(id_cell, _cells, c2c, 0, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 0, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[4]);
       nds->InsertNextId(pts[5]);
       nds->InsertNextId(pts[6]);
       nds->InsertNextId(pts[7]);
-      addToC2C(id_cell, _cells, c2c, 1, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 1, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[5]);
       nds->InsertNextId(pts[4]);
-      addToC2C(id_cell, _cells, c2c, 2, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 2, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[3]);
       nds->InsertNextId(pts[7]);
       nds->InsertNextId(pts[6]);
       nds->InsertNextId(pts[2]);
-      addToC2C(id_cell, _cells, c2c, 3, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 3, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[0]);
       nds->InsertNextId(pts[4]);
       nds->InsertNextId(pts[7]);
       nds->InsertNextId(pts[3]);
-      addToC2C(id_cell, _cells, c2c, 4, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 4, nds, cls, grid);
       nds->Reset();
       nds->InsertNextId(pts[1]);
       nds->InsertNextId(pts[2]);
       nds->InsertNextId(pts[6]);
       nds->InsertNextId(pts[5]);
-      addToC2C(id_cell, _cells, c2c, 5, nds, cls, grid);
+      addToC2C(id_cell, _cells, c2c_row, 5, nds, cls, grid);
     }
   }
 }
 
+void EgVtkObject::createCellToCell(QVector<vtkIdType> &cells, QVector<QVector<int> > &c2c, vtkUnstructuredGrid *grid)
+{
+  grid->BuildLinks();
+  QVector<int> _cells;
+  createCellMapping(cells, _cells, grid);
+  c2c.fill(QVector<int>(), cells.size());
+  EG_VTKSP(vtkIdList, nds);
+  EG_VTKSP(vtkIdList, cls);
+  for (int i = 0; i < cells.size(); ++i) {
+    c2c[i].resize(numFacesOfCell(grid->GetCellType(cells[i])));
+    fillC2CRow(cells[i], _cells, c2c[i].data(), nds, cls, grid);
+  }
+}
+
+void EgVtkObject::createCellToCell(QVector<vtkIdType> &cells, AdjacencyList &c2c, vtkUnstructuredGrid *grid)
+{
+  grid->BuildLinks();
+  QVector<int> _cells;
+  createCellMapping(cells, _cells, grid);
+  const vtkIdType *cell = cells.constData();
+  int N_cells = cells.size();
+  QVector<int> num_faces(N_cells);
+  for (int i = 0; i < N_cells; ++i) {
+    num_faces[i] = numFacesOfCell(grid->GetCellType(cell[i]));
+  }
+  c2c.setRowSizes(num_faces);
+  const int *start = c2c.offsets();
+  int       *item  = c2c.items();
+
+  // every row is independent; only the scratch lists need to be separate for each thread
+  int num_threads = numConnectivityThreads();
+  QVector<vtkSmartPointer<vtkIdList> > nds(num_threads);
+  QVector<vtkSmartPointer<vtkIdList> > cls(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    nds[i] = vtkSmartPointer<vtkIdList>::New();
+    cls[i] = vtkSmartPointer<vtkIdList>::New();
+  }
+  #pragma omp parallel for if(!SerialConnectivity)
+  for (int i = 0; i < N_cells; ++i) {
+    int i_thread = connectivityThreadIndex();
+    fillC2CRow(cell[i], _cells, item + start[i], nds[i_thread], cls[i_thread], grid);
+  }
+}
+
 bool EgVtkObject::isVolume(vtkIdType id_cell, vtkUnstructuredGrid *grid)
 {
   bool isVol = false;
@@ -977,6 +1198,9 @@ void EgVtkObject::createIndices(vtkUnstructuredGrid *grid)
   }
 }
 
+/// the settings are shared by all operations; getSet may be called from worker threads
+static QMutex settings_mutex;
+
 BoundaryCondition EgVtkObject::getBC(int bc)
 {
   return GuiMainWindow::pointer()->getBC(bc);
@@ -984,6 +1208,7 @@ BoundaryCondition EgVtkObject::getBC(int bc)
 
 int EgVtkObject::getSet(QString group, QString key, int value, int& variable)
 {
+  QMutexLocker locker(&settings_mutex);
   QSettings *qset = GuiMainWindow::settings();
   QString typed_key = "int/" + key;
   if(group!=QObject::tr("General")) qset->beginGroup(group);
@@ -997,6 +1222,7 @@ int EgVtkObject::getSet(QString group, QString key, int value, int& variable)
 
 double EgVtkObject::getSet(QString group, QString key, double value, double& variable)
 {
+  QMutexLocker locker(&settings_mutex);
   QSettings *qset = GuiMainWindow::settings();
   QString typed_key = "double/" + key;
   if(group!=QObject::tr("General")) qset->beginGroup(group);
@@ -1010,6 +1236,7 @@ double EgVtkObject::getSet(QString group, QString key, double value, double& var
 
 bool EgVtkObject::getSet(QString group, QString key, bool value, bool& variable)
 {
+  QMutexLocker locker(&settings_mutex);
   QSettings *qset = GuiMainWindow::settings();
   QString typed_key = "bool/" + key;
   if(group!=QObject::tr("General")) qset->beginGroup(group);
@@ -1024,6 +1251,7 @@ bool EgVtkObject::getSet(QString group, QString key, bool value, bool& variable)
 
 QString EgVtkObject::getSet(QString group, QString key, QString value, QString& variable)
 {
+  QMutexLocker locker(&settings_mutex);
   QSettings *qset = GuiMainWindow::settings();
   QString typed_key;
   typed_key = QObject::tr("QString/") + key;
@@ -1038,6 +1266,7 @@ QString EgVtkObject::getSet(QString group, QString key, QString value, QString&
 
 QString EgVtkObject::getSet(QString group, QString key, QString value, QString& variable, int type)
 {
+  QMutexLocker locker(&settings_mutex);
   QSettings *qset = GuiMainWindow::settings();
   QString typed_key;
   if (type == 0) {
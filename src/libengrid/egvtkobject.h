@@ -30,6 +30,7 @@ class BezierTriangle;
 #include "engrid.h"
 #include "utilities.h"
 #include "boundarycondition.h"
+#include "adjacencylist.h"
 
 #include <vtkUnstructuredGrid.h>
 #include <vtkPolyData.h>
@@ -56,7 +57,7 @@ public: // data-types
 
   typedef const QVector<vtkIdType>&     l2g_t;
   typedef const QVector<int>&           g2l_t;
-  typedef const QVector<QVector<int> >& l2l_t;
+  typedef const AdjacencyList&          l2l_t;
   
 private: // methods
   
@@ -64,12 +65,19 @@ private: // methods
     (
       vtkIdType               id_cell,
       QVector<int>           &_cells,
-      QVector<QVector<int> > &c2c,
+      int                    *c2c_row,
       int                     j,
       vtkIdList              *nds,
       vtkIdList              *cls,
       vtkUnstructuredGrid    *grid
     );
+
+  int  numFacesOfCell(vtkIdType type_cell);
+  void fillC2CRow(vtkIdType id_cell, QVector<int> &_cells, int *c2c_row, vtkIdList *nds, vtkIdList *cls, vtkUnstructuredGrid *grid);
+
+  static int  numConnectivityThreads();
+  static int  connectivityThreadIndex();
+  static void sortRows(AdjacencyList &list, QVector<int> &row_size, bool remove_duplicates);
   
   void addToN2N
     (
@@ -85,9 +93,18 @@ protected: // attributes
   
   QSet<int> m_BoundaryCodes;
   static int DebugLevel;
+  static bool SerialConnectivity; ///< build the connectivity lists (N2N, N2C, C2C) without threads
   
 protected: // methods
   
+  /**
+   * Get the edges of a linear cell type.
+   * @param type_cell the VTK cell type
+   * @param edges on return this will point to pairs of local corner indices (two entries per edge)
+   * @return the number of edges (0 for unsupported cell types)
+   */
+  static int cellEdgeTable(vtkIdType type_cell, const int* &edges);
+
   /**
    * if key=value pair not found in settings file, write it + read key value from settings file and assign it to variable
    * Version for int variables
@@ -187,6 +204,19 @@ protected: // methods
    */
   void createNodeToCell(QVector<vtkIdType> &cells, QVector<vtkIdType> &nodes, QVector<int> &_nodes, QVector<QVector<int> > &n2c, vtkUnstructuredGrid *grid);
 
+  /**
+   * Create a node to cell structure for a given set of cells and nodes.
+   * This creates a compressed adjacency list (one contiguous array for all nodes).
+   * The list is built in parallel (count pass, fill pass) unless SerialConnectivity is set;
+   * the cells of each node are sorted, so the result does not depend on the number of threads.
+   * @param cells  the subset of cells
+   * @param nodes  the subset of nodes
+   * @param _nodes the reverse mapping for the nodes
+   * @param n2c    On return, this will hold the node to cell structure
+   * @param grid   The grid to operate on
+   */
+  void createNodeToCell(QVector<vtkIdType> &cells, QVector<vtkIdType> &nodes, QVector<int> &_nodes, AdjacencyList &n2c, vtkUnstructuredGrid *grid);
+
   /**
    * Create a node to node structure for a given set of cells and nodes.
    * This creates a vector of sets which might have performance issues.
@@ -200,7 +230,7 @@ protected: // methods
   
   /**
    * Create a node to node structure for a given set of cells and nodes.
-   * This creates a vector of vectors.
+   * This creates a vector of vectors; the neighbours of each node are sorted.
    * @param cells  the subset of cells
    * @param nodes  the subset of nodes
    * @param _nodes the reverse mapping for the nodes
@@ -209,6 +239,18 @@ protected: // methods
    */
   void createNodeToNode(QVector<vtkIdType> &cells, QVector<vtkIdType> &nodes, QVector<int> &_nodes, QVector<QVector<int> > &n2n, vtkUnstructuredGrid *grid);
 
+  /**
+   * Create a node to node structure for a given set of cells and nodes.
+   * This creates a compressed adjacency list; the neighbours of each node are sorted.
+   * The list is built in parallel unless SerialConnectivity is set.
+   * @param cells  the subset of cells
+   * @param nodes  the subset of nodes
+   * @param _nodes the reverse mapping for the nodes
+   * @param n2n    On return, this will hold the node to node structure
+   * @param grid   The grid to operate on
+   */
+  void createNodeToNode(QVector<vtkIdType> &cells, QVector<vtkIdType> &nodes, QVector<int> &_nodes, AdjacencyList &n2n, vtkUnstructuredGrid *grid);
+
   /**
    * Extract the nodes which are part of a given set of cells.
    * @param cells the subset of cells
@@ -244,6 +286,7 @@ protected: // methods
   
   /**
    * Get all cells of a grid.
+   * Deleted cells (VTK_EMPTY_CELL, see GridEditor) are skipped.
    * @param cells On return this will hold the Ids of all cells.
    * @param grid  The grid to operate on.
    */
@@ -280,6 +323,16 @@ protected: // methods
    * @param grid  The grid to operate on.
    */
   void createCellToCell(QVector<vtkIdType> &cells, QVector<QVector<int> > &c2c, vtkUnstructuredGrid *grid);
+
+  /**
+   * Create a cell neighbourship list for a subset grid.
+   * This creates a compressed adjacency list (one contiguous array for all cells).
+   * The rows are independent and will be filled in parallel unless SerialConnectivity is set.
+   * @param cells the subset of cells
+   * @param c2c   On return this will hold the neighbourship list
+   * @param grid  The grid to operate on.
+   */
+  void createCellToCell(QVector<vtkIdType> &cells, AdjacencyList &c2c, vtkUnstructuredGrid *grid);
   
   /**
    * Insert a subset of a grid into a vtkPolyData structure.
@@ -551,6 +604,7 @@ public: // methods
   void setBoundaryCodes(const QSet<int> &bcs);
   QSet<int> getBoundaryCodes();
   void setDebugLevel(int a_DebugLevel) { DebugLevel = a_DebugLevel; }
+  void setSerialConnectivity(bool b) { SerialConnectivity = b; } ///< use the serial path to build connectivity lists (debugging)
   
   bool saveGrid( vtkUnstructuredGrid* a_grid, QString file_name );
 
@@ -43,13 +43,16 @@
 
 #ifdef WIN32
 typedef vtkLongLongArray vtkLongArray_t;
+typedef long long        vtkLongValue_t;
 #else
 
 #include <limits.h>
 #if ( __WORDSIZE == 64 )
 typedef vtkLongArray vtkLongArray_t;
+typedef long         vtkLongValue_t;
 #else
 typedef vtkLongLongArray vtkLongArray_t;
+typedef long long        vtkLongValue_t;
 #endif
 
 #endif
@@ -34,13 +34,17 @@ void FaceFinder::setGrid(vtkUnstructuredGrid *grid)
   m_Grid = grid;
   m_Triangles.resize(m_Grid->GetNumberOfCells());
   m_Centres.resize(m_Grid->GetNumberOfCells());
+  m_Store.clear();
+  m_Store.reserve(m_Grid->GetNumberOfCells());
   for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
     if (m_Grid->GetCellType(id_cell) != VTK_TRIANGLE) {
       EG_BUG;
     }
     m_Triangles[id_cell] = Triangle(m_Grid, id_cell);
     m_Centres[id_cell] = cellCentre(m_Grid, id_cell);
+    m_Store.append(m_Triangles[id_cell].a(), m_Triangles[id_cell].b(), m_Triangles[id_cell].c());
   }
+  m_Store.finalise();
   {
     double bounds[6];
     m_Grid->GetBounds(bounds);
@@ -55,26 +59,48 @@ void FaceFinder::setGrid(vtkUnstructuredGrid *grid)
     } else {
       Dx = vec3_t(Dx[2], Dx[2], Dx[2]);
     }
-    x1 = xc - 2*Dx;
-    x2 = xc + 2*Dx;
-    m_Octree.setBounds(x1, x2);
-    m_MinSize = 0.0001*Dx[0];
+    m_OctreeX1 = xc - 2*Dx;
+    m_OctreeDx = 4*Dx[0];
+    m_MinSize  = 0.0001*Dx[0];
   }
-  m_Faces.resize(1);
-  m_CritLength.fill(0.0, 1);
+  m_CritLength.resize(m_Grid->GetNumberOfCells());
+  QVector<int> faces(m_Grid->GetNumberOfCells());
   for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
-    m_Faces[0].append(id_cell);
+    m_CritLength[id_cell] = calcCritLength(id_cell);
+    faces[id_cell] = id_cell;
   }
-  foreach (vtkIdType id_cell, m_Faces[0]) {
-    m_CritLength[0] = max(m_CritLength[0], calcCritLength(id_cell));
-  }
-  int N;
-  cout << "refining octree for FaceFinder ..." << endl;
+  split_t split;
+  split.centres     = m_Centres.constData();
+  split.crit_length = m_CritLength.constData();
+  split.max_faces   = m_MaxFaces;
+  split.min_size    = m_MinSize;
+  cout << "building octree for FaceFinder ..." << endl;
   cout << "  minimal cell size: " << m_MinSize << endl;
-  cout << "  largest critical length: " << m_CritLength[0] << endl;
-  do {
-    N = refine();
-  } while (N > 0);
+  m_Octree.build(m_OctreeX1, m_OctreeDx, faces, split);
+  cout << "  " << m_Octree.numNodes() << " octree cells" << endl;
+}
+
+bool FaceFinder::split_t::refine(double dx, const int *faces, int num) const
+{
+  if (num <= max_faces || dx <= 2*min_size) {
+    return false;
+  }
+  double crit_length = 0;
+  for (int i = 0; i < num; ++i) {
+    crit_length = max(crit_length, this->crit_length[faces[i]]);
+  }
+  return dx > crit_length;
+}
+
+bool FaceFinder::split_t::contains(vec3_t x1, double dx, int face) const
+{
+  for (int node = 0; node < 8; ++node) {
+    vec3_t x = x1 + vec3_t((node & 1)*dx, ((node >> 1) & 1)*dx, ((node >> 2) & 1)*dx);
+    if ((x - centres[face]).abs() < dx) {
+      return true;
+    }
+  }
+  return false;
 }
 
 double FaceFinder::calcCritLength(vtkIdType id_cell)
@@ -94,89 +120,18 @@ double FaceFinder::calcCritLength(vtkIdType id_cell)
   return L;
 }
 
-int FaceFinder::refine()
-{
-  int N = m_Octree.getNumCells();
-  m_Octree.setSmoothTransitionOff();
-  int N_new = 0;
-  m_Octree.resetRefineMarks();
-  for (int cell = 0; cell < m_Octree.getNumCells(); ++cell) {
-    double dx = m_Octree.getDx(cell);
-    if (!m_Octree.hasChildren(cell)  && m_Faces[cell].size() > m_MaxFaces  && dx > 2*m_MinSize && dx > m_CritLength[cell]) {
-      m_Octree.markToRefine(cell);
-      ++N_new;
-    }
-  }
-  int N_mrk = 0;
-  for (int cell = 0; cell < m_Octree.getNumCells(); ++cell) {
-    if (m_Octree.markedForRefine(cell)) {
-      ++N_mrk;
-    }
-  }
-  N_new *= 8;
-  m_Octree.refineAll();
-  if (m_Octree.getNumCells() != N + N_new) {
-    EG_BUG;
-  }
-  m_Faces.insert(N, N_new, QList<vtkIdType>());
-  m_CritLength.insert(N, N_new, 0.0);
-  int N_min = m_Grid->GetNumberOfCells();
-  int N_max = 0;
-  int N_ave = 0;
-  for (int cell = N; cell < m_Octree.getNumCells(); ++cell) {
-    m_Timer << "  " << m_Octree.getNumCells() << " octree cells" << Timer::endl;
-    if (m_Octree.getNumCells() != N + N_new) {
-      EG_BUG;
-    }
-    int parent = m_Octree.getParent(cell);
-    if (parent < 0) {
-      EG_BUG;
-    }
-    foreach (vtkIdType id_cell, m_Faces[parent]) {
-      for (int node = 0; node < 8; ++node) {
-        vec3_t x = m_Octree.getNodePosition(cell, node);
-        double d;
-        d = (x - m_Centres[id_cell]).abs();
-        if (d < m_Octree.getDx(cell)) {
-          m_Faces[cell].append(id_cell);
-          m_CritLength[cell] = max(m_CritLength[cell], calcCritLength(id_cell));
-          break;
-        }
-      }
-    }
-    N_min = min(N_min, m_Faces[cell].size());
-    N_max = max(N_max, m_Faces[cell].size());
-    N_ave += m_Faces[cell].size();
-  }
-  int N_cells = 0;
-  int N_faces = 0;
-  for (int cell = 0; cell < m_Octree.getNumCells(); ++cell) {
-    if (!m_Octree.hasChildren(cell)) {
-      ++N_cells;
-      N_faces += m_Faces[cell].size();
-    }
-  }
-  if (N_faces == 0) {
-    EG_BUG;
-  }
-  return N_new;
-}
-
 void FaceFinder::getCloseFaces(vec3_t x, QVector<vtkIdType> &faces)
 {
-  if (m_Octree.isInsideBounds(x)) {
-    int cell = m_Octree.findCell(x);
+  if (m_Octree.isInside(x)) {
+    int cell = m_Octree.findLeaf(x);
     if (cell < 0) {
       EG_BUG;
     }
-    if (m_Octree.hasChildren(cell)) {
-      EG_BUG;
-    }
-    while (m_Faces[cell].size() == 0 && m_Octree.getParent(cell) >= 0) {
-      cell = m_Octree.getParent(cell);
+    while (m_Octree.bucketSize(cell) == 0 && m_Octree.parent(cell) >= 0) {
+      cell = m_Octree.parent(cell);
     }
-    faces.resize(m_Faces[cell].size());
-    qCopy(m_Faces[cell].begin(), m_Faces[cell].end(), faces.begin());
+    faces.resize(m_Octree.bucketSize(cell));
+    qCopy(m_Octree.bucket(cell), m_Octree.bucket(cell) + m_Octree.bucketSize(cell), faces.begin());
   } else {
     faces.clear();
   }
@@ -187,14 +142,13 @@ vtkIdType FaceFinder::getClosestFace(vec3_t x, double &L_min)
   QVector<vtkIdType> faces;
   getCloseFaces(x, faces);
   vtkIdType id_close = -1;
-  foreach (vtkIdType id_face, faces) {
-    vec3_t xi, ri;
-    int side;
-    double L;
-    m_Triangles[id_face].projectOnTriangle(x, xi, ri, L, side, true);
+  double d2;
+  int i = m_Store.closest(x, faces, d2);
+  if (i >= 0) {
+    double L = sqrt(d2);
     if (L < L_min) {
       L_min = L;
-      id_close = id_face;
+      id_close = faces[i];
     }
   }
   return id_close;
@@ -23,9 +23,9 @@
 #ifndef FACEFINDER_H
 #define FACEFINDER_H
 
-#include "octree.h"
+#include "bucketoctree.h"
 #include "triangle.h"
-#include "timer.h"
+#include "trianglestore.h"
 
 #include <QVector>
 #include <QList>
@@ -33,21 +33,36 @@
 class FaceFinder : public EgVtkObject
 {
 
-  Octree m_Octree;
+  BucketOctree m_Octree;
+  vec3_t       m_OctreeX1; ///< lower corner of the octree
+  double       m_OctreeDx; ///< edge length of the octree
   vtkUnstructuredGrid *m_Grid;
-  QVector<QList<vtkIdType> > m_Faces;
   double m_MinSize;
   int    m_MaxFaces;
   QVector<Triangle> m_Triangles;
+  TriangleStore     m_Store;
   QVector<vec3_t>   m_Centres;
-  QVector<double>   m_CritLength;
-  Timer m_Timer;
+  QVector<double>   m_CritLength; ///< longest edge of each face
+
+
+private: // data-types
+
+  /// splitting rule for the octree (see BucketOctree)
+  struct split_t
+  {
+    const vec3_t *centres;
+    const double *crit_length;
+    int           max_faces;
+    double        min_size;
+
+    bool refine(double dx, const int *faces, int num) const;
+    bool contains(vec3_t x1, double dx, int face) const;
+  };
 
 
 private: // methods
 
   double calcCritLength(vtkIdType id_cell);
-  int refine();
 
 
 public: // methods
@@ -58,6 +73,7 @@ public: // methods
   void setMaxNumFaces(int N) { m_MaxFaces = N; }
   void getCloseFaces(vec3_t x, QVector<vtkIdType> &faces);
   vtkIdType getClosestFace(vec3_t x, double &L);
+  const TriangleStore& triangleStore() const { return m_Store; } ///< all faces of the grid for batched distance queries
 
 };
 
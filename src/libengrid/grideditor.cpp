@@ -0,0 +1,180 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#include "grideditor.h"
+
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkPointData.h>
+#include <vtkUnsignedCharArray.h>
+
+GridEditor::GridEditor()
+{
+  m_Grid = NULL;
+  m_NumFreeCells = 0;
+}
+
+void GridEditor::setGrid(vtkUnstructuredGrid *grid)
+{
+  m_Grid = grid;
+  m_FreeNodes.clear();
+  m_FreeCells.clear();
+  m_NumFreeCells = 0;
+}
+
+void GridEditor::reserveArray(vtkDataArray *array, vtkIdType num_tuples)
+{
+  if (array->GetSize() < num_tuples*array->GetNumberOfComponents()) {
+    array->Resize(num_tuples);
+  }
+}
+
+void GridEditor::reserve(vtkIdType num_new_cells, vtkIdType num_new_nodes, int num_pts)
+{
+  vtkIdType num_nodes = m_Grid->GetNumberOfPoints() + max(vtkIdType(0), num_new_nodes - m_FreeNodes.size());
+  vtkIdType num_cells = m_Grid->GetNumberOfCells() + max(vtkIdType(0), num_new_cells - m_FreeCells.value(num_pts).size());
+  reserveArray(m_Grid->GetPoints()->GetData(), num_nodes);
+  for (int i = 0; i < m_Grid->GetPointData()->GetNumberOfArrays(); ++i) {
+    reserveArray(m_Grid->GetPointData()->GetArray(i), num_nodes);
+  }
+  for (int i = 0; i < m_Grid->GetCellData()->GetNumberOfArrays(); ++i) {
+    reserveArray(m_Grid->GetCellData()->GetArray(i), num_cells);
+  }
+  reserveArray(m_Grid->GetCellTypesArray(), num_cells);
+  reserveArray(m_Grid->GetCellLocationsArray(), num_cells);
+  vtkIdType num_conn = m_Grid->GetCells()->GetNumberOfConnectivityEntries() + (num_cells - m_Grid->GetNumberOfCells())*(num_pts + 1);
+  reserveArray(m_Grid->GetCells()->GetData(), num_conn);
+}
+
+vtkIdType GridEditor::addNode(vec3_t x, vtkIdType id_template)
+{
+  vtkPointData *pd = m_Grid->GetPointData();
+  vtkIdType id_node;
+  if (m_FreeNodes.size() > 0) {
+    id_node = m_FreeNodes.takeLast();
+    m_Grid->GetPoints()->SetPoint(id_node, x.data());
+    for (int i = 0; i < pd->GetNumberOfArrays(); ++i) {
+      pd->GetArray(i)->SetTuple(id_node, id_template, pd->GetArray(i));
+    }
+  } else {
+    id_node = m_Grid->GetPoints()->InsertNextPoint(x.data());
+    for (int i = 0; i < pd->GetNumberOfArrays(); ++i) {
+      pd->GetArray(i)->InsertTuple(id_node, id_template, pd->GetArray(i));
+    }
+  }
+  return id_node;
+}
+
+vtkIdType GridEditor::addCell(vtkIdType type_cell, vtkIdType num_pts, vtkIdType *pts, vtkIdType id_template)
+{
+  vtkCellData *cd = m_Grid->GetCellData();
+  vtkIdType id_cell;
+  QList<vtkIdType> &free_cells = m_FreeCells[num_pts];
+  if (free_cells.size() > 0) {
+    id_cell = free_cells.takeLast();
+    --m_NumFreeCells;
+    m_Grid->ReplaceCell(id_cell, num_pts, pts);
+    m_Grid->GetCellTypesArray()->SetValue(id_cell, type_cell);
+    for (int i = 0; i < cd->GetNumberOfArrays(); ++i) {
+      cd->GetArray(i)->SetTuple(id_cell, id_template, cd->GetArray(i));
+    }
+  } else {
+    id_cell = m_Grid->InsertNextCell(type_cell, num_pts, pts);
+    for (int i = 0; i < cd->GetNumberOfArrays(); ++i) {
+      cd->GetArray(i)->InsertTuple(id_cell, id_template, cd->GetArray(i));
+    }
+  }
+  return id_cell;
+}
+
+void GridEditor::deleteCell(vtkIdType id_cell)
+{
+  if (m_Grid->GetCellType(id_cell) == VTK_EMPTY_CELL) {
+    EG_BUG;
+  }
+  vtkIdType num_pts, *pts;
+  m_Grid->GetCellPoints(id_cell, num_pts, pts);
+  m_Grid->GetCellTypesArray()->SetValue(id_cell, VTK_EMPTY_CELL);
+  m_FreeCells[num_pts].append(id_cell);
+  ++m_NumFreeCells;
+}
+
+void GridEditor::deleteNode(vtkIdType id_node)
+{
+  m_FreeNodes.append(id_node);
+}
+
+void GridEditor::compact()
+{
+  if (m_FreeNodes.size() == 0 && m_NumFreeCells == 0) {
+    return;
+  }
+  QVector<bool> is_dead(m_Grid->GetNumberOfPoints(), false);
+  foreach (vtkIdType id_node, m_FreeNodes) {
+    is_dead[id_node] = true;
+  }
+  QVector<vtkIdType> old2new(m_Grid->GetNumberOfPoints(), -1);
+  vtkIdType num_nodes = 0;
+  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+    if (!is_dead[id_node]) {
+      old2new[id_node] = num_nodes;
+      ++num_nodes;
+    }
+  }
+  vtkIdType num_cells = 0;
+  for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
+    if (m_Grid->GetCellType(id_cell) != VTK_EMPTY_CELL) {
+      ++num_cells;
+    }
+  }
+  EG_VTKSP(vtkUnstructuredGrid, dst);
+  allocateGrid(dst, num_cells, num_nodes);
+  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+    if (!is_dead[id_node]) {
+      vec3_t x;
+      m_Grid->GetPoint(id_node, x.data());
+      dst->GetPoints()->SetPoint(old2new[id_node], x.data());
+      copyNodeData(m_Grid, id_node, dst, old2new[id_node]);
+    }
+  }
+  QVector<vtkIdType> new_pts;
+  for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
+    vtkIdType type_cell = m_Grid->GetCellType(id_cell);
+    if (type_cell != VTK_EMPTY_CELL) {
+      vtkIdType num_pts, *pts;
+      m_Grid->GetCellPoints(id_cell, num_pts, pts);
+      new_pts.resize(num_pts);
+      for (int i = 0; i < num_pts; ++i) {
+        if (is_dead[pts[i]]) {
+          EG_BUG;
+        }
+        new_pts[i] = old2new[pts[i]];
+      }
+      vtkIdType id_new_cell = dst->InsertNextCell(type_cell, num_pts, new_pts.data());
+      copyCellData(m_Grid, id_cell, dst, id_new_cell);
+    }
+  }
+  makeCopy(dst, m_Grid);
+  m_FreeNodes.clear();
+  m_FreeCells.clear();
+  m_NumFreeCells = 0;
+}
@@ -0,0 +1,112 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#ifndef GRIDEDITOR_H
+#define GRIDEDITOR_H
+
+class GridEditor;
+
+#include "egvtkobject.h"
+
+#include <QList>
+#include <QMap>
+
+/**
+ * In-place editing of an unstructured grid.
+ * Nodes and cells are added to and deleted from the grid directly instead of
+ * building a modified copy of the whole grid for every change.
+ * A deleted cell is turned into a VTK_EMPTY_CELL and a deleted node is simply
+ * left without any cells. Both are kept in free lists and will be re-used by
+ * subsequent calls to addNode and addCell. The grid is only renumbered once
+ * compact is called.
+ *
+ * Between two calls to compact the grid can contain empty cells and orphan nodes.
+ * EgVtkObject::getAllCells skips empty cells and all surface and volume loops
+ * check the cell type, so the surface operations are not affected by this.
+ */
+class GridEditor : public EgVtkObject
+{
+
+private: // attributes
+
+  vtkUnstructuredGrid*                 m_Grid;
+  QList<vtkIdType>                     m_FreeNodes; ///< deleted nodes which can be re-used
+  QMap<vtkIdType, QList<vtkIdType> >   m_FreeCells; ///< deleted cells (sorted by number of points) which can be re-used
+  int                                  m_NumFreeCells;
+
+
+private: // methods
+
+  void reserveArray(vtkDataArray *array, vtkIdType num_tuples);
+
+
+public: // methods
+
+  GridEditor();
+
+  void setGrid(vtkUnstructuredGrid *grid);
+  vtkUnstructuredGrid* getGrid() { return m_Grid; }
+
+  /**
+   * Make sure the grid can take the given number of additional nodes and cells
+   * without reallocating its arrays for every single insertion.
+   * @param num_new_cells the number of cells which will be added
+   * @param num_new_nodes the number of nodes which will be added
+   * @param num_pts the (maximal) number of points of the new cells
+   */
+  void reserve(vtkIdType num_new_cells, vtkIdType num_new_nodes, int num_pts = 3);
+
+  /**
+   * Add a new node to the grid. A deleted node is re-used if available.
+   * @param x the position of the new node
+   * @param id_template all node data of the new node will be copied from this node
+   * @return the id of the new node
+   */
+  vtkIdType addNode(vec3_t x, vtkIdType id_template);
+
+  /**
+   * Add a new cell to the grid. A deleted cell with the same number of points is re-used if available.
+   * @param type_cell the VTK type of the new cell
+   * @param num_pts the number of points of the new cell
+   * @param pts the points of the new cell
+   * @param id_template all cell data of the new cell will be copied from this cell
+   * @return the id of the new cell
+   */
+  vtkIdType addCell(vtkIdType type_cell, vtkIdType num_pts, vtkIdType *pts, vtkIdType id_template);
+
+  void deleteCell(vtkIdType id_cell); ///< turn id_cell into an empty cell and put it on the free list
+  void deleteNode(vtkIdType id_node); ///< put id_node on the free list; it must not be used by any cell any more
+
+  int numDeletedNodes() { return m_FreeNodes.size(); }
+  int numDeletedCells() { return m_NumFreeCells; }
+  int numNodes() { return m_Grid->GetNumberOfPoints() - numDeletedNodes(); } ///< number of live nodes
+  int numCells() { return m_Grid->GetNumberOfCells() - numDeletedCells(); } ///< number of live cells
+
+  /**
+   * Remove all deleted nodes and cells from the grid.
+   * This is the only operation of the editor which renumbers nodes and cells.
+   */
+  void compact();
+
+};
+
+#endif // GRIDEDITOR_H
@@ -0,0 +1,113 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#include "gridfields.h"
+
+#include <vtkIntArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkCharArray.h>
+
+GridFields::GridFields()
+{
+  m_Grid = NULL;
+  for (int i = 0; i < NumFields; ++i) {
+    m_Fields[i].data = NULL;
+    m_Fields[i].index = -1;
+  }
+}
+
+const char* GridFields::fieldName(int i)
+{
+  static const char* names[NumFields] = {
+    "vtk_type", "cell_code", "cell_index", "cell_orgdir", "cell_curdir", "cell_voldir",
+    "node_status", "node_layer", "node_index", "node_specified_density", "node_meshdensity_desired", "node_type", "node_pindex"
+  };
+  return names[i];
+}
+
+bool GridFields::isCellField(int i)
+{
+  return i < NodeStatus;
+}
+
+bool GridFields::hasValidType(int i, vtkDataArray *array)
+{
+  if (i == CellIndex || i == NodeIndex || i == NodePIndex) {
+    return dynamic_cast<vtkLongArray_t*>(array) != NULL;
+  }
+  if (i == NodeMeshDensityDesired) {
+    return dynamic_cast<vtkDoubleArray*>(array) != NULL;
+  }
+  if (i == NodeType) {
+    return dynamic_cast<vtkCharArray*>(array) != NULL;
+  }
+  return dynamic_cast<vtkIntArray*>(array) != NULL;
+}
+
+void GridFields::setGrid(vtkUnstructuredGrid *grid)
+{
+  if (grid != m_Grid) {
+    m_Grid = grid;
+    for (int i = 0; i < NumFields; ++i) {
+      m_Fields[i].array = NULL;
+      m_Fields[i].data = NULL;
+      m_Fields[i].index = -1;
+    }
+  }
+}
+
+bool GridFields::resolve(int i)
+{
+  if (!m_Grid) {
+    EG_BUG;
+  }
+  field_t &F = m_Fields[i];
+  vtkFieldData *fd = fieldData(i);
+  for (int j = 0; j < fd->GetNumberOfArrays(); ++j) {
+    vtkDataArray *a = fd->GetArray(j);
+    if (a && a->GetName() && QString(a->GetName()) == fieldName(i)) {
+      if (!hasValidType(i, a)) {
+        return false;
+      }
+      F.array = a;
+      F.index = j;
+      F.data  = a->GetVoidPointer(0);
+      return true;
+    }
+  }
+  F.array = NULL;
+  F.index = -1;
+  F.data  = NULL;
+  return true;
+}
+
+void GridFields::typeMismatch(int i)
+{
+  EG_ERR_RETURN(QString("type mismatch for field \"") + fieldName(i) + "\"");
+}
+
+void GridFields::prime()
+{
+  for (int i = 0; i < NumFields; ++i) {
+    data(i);
+  }
+}
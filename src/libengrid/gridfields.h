@@ -0,0 +1,189 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#ifndef GRIDFIELDS_H
+#define GRIDFIELDS_H
+
+class GridFields;
+
+#include "engrid.h"
+
+#include <vtkUnstructuredGrid.h>
+#include <vtkDataArray.h>
+#include <vtkCellData.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Typed raw-pointer view of a VTK data array.
+ * Accessing an entry is a plain array access without any look-up or virtual call.
+ * A view is only valid as long as the underlying array has not been reallocated
+ * (e.g. by adding nodes or cells to the grid); get a fresh view from GridFields afterwards.
+ */
+template <class T>
+class FieldView
+{
+
+private: // attributes
+
+  T* m_Data;
+
+public: // methods
+
+  FieldView() : m_Data(NULL) {}
+  FieldView(T* data) : m_Data(data) {}
+
+  T& operator[](vtkIdType i) const { return m_Data[i]; }
+  bool isNull() const { return m_Data == NULL; }
+
+};
+
+/**
+ * Registry of the standard enGrid fields of one grid.
+ * The fields are looked up by name and type-checked once; afterwards they are
+ * handed out as FieldView objects. Every request checks with a few pointer
+ * comparisons whether the array has been replaced or reallocated and
+ * resolves it again only if this is the case.
+ *
+ * Inside a parallel region the check and the resolution run in one critical section,
+ * so requests from several threads are safe; call prime() before such a region anyway,
+ * because the requests inside the region are serialised.
+ */
+class GridFields
+{
+
+private: // data-types
+
+  enum field_id_t {
+    CellVtkType = 0, CellCode, CellIndex, CellOrgDir, CellCurDir, CellVolDir,
+    NodeStatus, NodeLayer, NodeIndex, NodeSpecifiedDensity, NodeMeshDensityDesired, NodeType, NodePIndex,
+    NumFields
+  };
+
+  struct field_t
+  {
+    vtkSmartPointer<vtkDataArray> array; ///< keeps the array alive, so the pointer comparison in isValid is safe
+    void* data;
+    int   index;
+  };
+
+
+private: // attributes
+
+  vtkUnstructuredGrid* m_Grid;
+  field_t              m_Fields[NumFields];
+
+
+private: // methods
+
+  static const char* fieldName(int i);
+  static bool        isCellField(int i);
+  static bool        hasValidType(int i, vtkDataArray *array);
+
+  vtkFieldData* fieldData(int i);
+  bool  isValid(int i);
+  bool  resolve(int i); ///< returns false for a type mismatch (the entry is left unchanged then)
+  void* data(int i);
+  void  typeMismatch(int i);
+
+
+public: // methods
+
+  GridFields();
+
+  void setGrid(vtkUnstructuredGrid *grid);
+  vtkUnstructuredGrid* getGrid() { return m_Grid; }
+  void prime(); ///< resolve all fields now (call this before a parallel region which requests fields)
+
+  FieldView<int>            cellVtkType()             { return FieldView<int>(static_cast<int*>(data(CellVtkType))); }
+  FieldView<int>            cellCode()                { return FieldView<int>(static_cast<int*>(data(CellCode))); }
+  FieldView<vtkLongValue_t> cellIndex()               { return FieldView<vtkLongValue_t>(static_cast<vtkLongValue_t*>(data(CellIndex))); }
+  FieldView<int>            cellOrgDir()              { return FieldView<int>(static_cast<int*>(data(CellOrgDir))); }
+  FieldView<int>            cellCurDir()              { return FieldView<int>(static_cast<int*>(data(CellCurDir))); }
+  FieldView<int>            cellVolDir()              { return FieldView<int>(static_cast<int*>(data(CellVolDir))); }
+  FieldView<int>            nodeStatus()              { return FieldView<int>(static_cast<int*>(data(NodeStatus))); }
+  FieldView<int>            nodeLayer()               { return FieldView<int>(static_cast<int*>(data(NodeLayer))); }
+  FieldView<vtkLongValue_t> nodeIndex()               { return FieldView<vtkLongValue_t>(static_cast<vtkLongValue_t*>(data(NodeIndex))); }
+  FieldView<int>            nodeSpecifiedDensity()    { return FieldView<int>(static_cast<int*>(data(NodeSpecifiedDensity))); }
+  FieldView<double>         nodeMeshDensityDesired()  { return FieldView<double>(static_cast<double*>(data(NodeMeshDensityDesired))); }
+  FieldView<char>           nodeType()                { return FieldView<char>(static_cast<char*>(data(NodeType))); }
+  FieldView<vtkLongValue_t> nodePIndex()              { return FieldView<vtkLongValue_t>(static_cast<vtkLongValue_t*>(data(NodePIndex))); }
+
+};
+
+
+inline vtkFieldData* GridFields::fieldData(int i)
+{
+  if (isCellField(i)) {
+    return m_Grid->GetCellData();
+  }
+  return m_Grid->GetPointData();
+}
+
+inline bool GridFields::isValid(int i)
+{
+  field_t &F = m_Fields[i];
+  if (!F.array) {
+    return false;
+  }
+  vtkFieldData *fd = fieldData(i);
+  if (F.index >= fd->GetNumberOfArrays()) {
+    return false;
+  }
+  if (fd->GetAbstractArray(F.index) != F.array.GetPointer()) {
+    return false;
+  }
+  return F.array->GetVoidPointer(0) == F.data;
+}
+
+inline void* GridFields::data(int i)
+{
+  void *data = NULL;
+  bool ok = true;
+#ifdef _OPENMP
+  if (omp_in_parallel()) {
+    #pragma omp critical(gridfields_resolve)
+    {
+      if (!isValid(i)) {
+        ok = resolve(i);
+      }
+      data = m_Fields[i].data;
+    }
+  } else
+#endif
+  {
+    if (!isValid(i)) {
+      ok = resolve(i);
+    }
+    data = m_Fields[i].data;
+  }
+  if (!ok) {
+    typeMismatch(i);
+  }
+  return data;
+}
+
+#endif // GRIDFIELDS_H
@@ -105,4 +105,10 @@ double GuiEdgeLengthSourceBox::edgeLength(vec3_t x)
   return m_Length;
 }
 
-
+void GuiEdgeLengthSourceBox::getBounds(vec3_t &x1, vec3_t &x2)
+{
+  for (int i = 0; i < 3; ++i) {
+    x1[i] = min(m_X1[i], m_X2[i]);
+    x2[i] = max(m_X1[i], m_X2[i]);
+  }
+}
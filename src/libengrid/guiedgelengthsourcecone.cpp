@@ -121,4 +121,14 @@ double GuiEdgeLengthSourceCone::edgeLength(vec3_t x)
   return m_Length1 + r/R*(m_Length2 - m_Length1);
 }
 
-
+void GuiEdgeLengthSourceCone::getBounds(vec3_t &x1, vec3_t &x2)
+{
+  // a cone is the convex hull of its two end discs
+  vec3_t n = m_X2 - m_X1;
+  n.normalise();
+  for (int i = 0; i < 3; ++i) {
+    double e = sqrt(max(0.0, 1 - n[i]*n[i]));
+    x1[i] = min(m_X1[i] - fabs(m_R1)*e, m_X2[i] - fabs(m_R2)*e);
+    x2[i] = max(m_X1[i] + fabs(m_R1)*e, m_X2[i] + fabs(m_R2)*e);
+  }
+}
@@ -121,4 +121,15 @@ double GuiEdgeLengthSourcePipe::edgeLength(vec3_t x)
   return (1 - w)*m_Length1 + w*m_Length2;
 }
 
-
+void GuiEdgeLengthSourcePipe::getBounds(vec3_t &x1, vec3_t &x2)
+{
+  // the outer radius applies along the whole axis
+  vec3_t n = m_X2 - m_X1;
+  n.normalise();
+  double R = max(fabs(m_R1), fabs(m_R2));
+  for (int i = 0; i < 3; ++i) {
+    double e = R*sqrt(max(0.0, 1 - n[i]*n[i]));
+    x1[i] = min(m_X1[i], m_X2[i]) - e;
+    x2[i] = max(m_X1[i], m_X2[i]) + e;
+  }
+}
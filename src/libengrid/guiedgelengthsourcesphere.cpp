@@ -98,3 +98,9 @@ double GuiEdgeLengthSourceSphere::edgeLength(vec3_t x)
   return m_Length1 + r/m_Radius*(m_Length2 - m_Length1);
 }
 
+void GuiEdgeLengthSourceSphere::getBounds(vec3_t &x1, vec3_t &x2)
+{
+  vec3_t R(m_Radius, m_Radius, m_Radius);
+  x1 = m_Centre - R;
+  x2 = m_Centre + R;
+}
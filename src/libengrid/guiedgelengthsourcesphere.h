@@ -47,6 +47,7 @@ public: // methods
   virtual void    setDlgFields();
   virtual void    readDlgFields();
   virtual double  edgeLength(vec3_t x);
+  virtual void    getBounds(vec3_t &x1, vec3_t &x2);
 
 };
 
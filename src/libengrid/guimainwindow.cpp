@@ -210,6 +210,10 @@ void GuiMainWindow::setupGuiMainWindow()
   bool undo_redo_mode;
   getSet("General","use RAM for undo+redo operations",false,undo_redo_mode);
   getSet("General", "open last used file on startup", false, m_open_last);
+  bool serial_connectivity;
+  getSet("General", "build connectivity in serial mode (debugging)", false, serial_connectivity);
+  setSerialConnectivity(serial_connectivity);
+  getSet("General", "build all surface projections in parallel", false, m_ParallelSurfProj);
 
   ui.actionMirrorMesh->setEnabled(exp_features);
   ui.actionBooleanOperation->setEnabled(exp_features);
@@ -346,6 +350,7 @@ void GuiMainWindow::setupVtk()
   getSet("Colours", " hexes (3-blue)",     1.0, m_ColHexB);
 
   m_Grid = vtkUnstructuredGrid::New();
+  m_SurfProjGrid = vtkUnstructuredGrid::New();
   m_Renderer = vtkRenderer::New();
   getRenderWindow()->AddRenderer(m_Renderer);
 
@@ -1252,6 +1257,12 @@ void GuiMainWindow::open(QString file_name, bool update_current_filename)
     if (geo_file.exists()) {
       openGrid(file_name + ".geo");
       storeSurfaceProjection(true);
+      if (loadSurfaceProjections(file_name + ".geo.proj")) {
+        cout << "restored surface projection from " << qPrintable(file_name + ".geo.proj") << endl;
+      }
+      if (m_ParallelSurfProj) {
+        buildSurfaceProjections();
+      }
     }
   }
   openGrid(grid_file_name);
@@ -1290,6 +1301,9 @@ QString GuiMainWindow::saveAs(QString file_name, bool update_current_filename)
   saveBC();
   savePhysicalBoundaryConditions();
   m_XmlHandler->saveXml(file_name);
+  if (update_current_filename) {
+    saveSurfaceProjections(file_name + ".geo.proj");
+  }
   setWindowTitle(m_CurrentFilename + " - enGrid - " + QString("%1").arg(m_CurrentOperation) );
   setUnsaved(false);
   if(update_current_filename) {
@@ -2109,14 +2123,18 @@ void GuiMainWindow::storeSurfaceProjection(bool nosave)
 {
   try {
     resetSurfaceProjection();
+
+    // The projectors are built on first use (see getSurfProj), so the current geometry has to be kept.
+    // All projectors share this one copy; each of them only holds its own triangles and connectivity.
+    QVector<vtkIdType> surface_cells;
+    QVector<vtkIdType> src_nodes;
+    getAllSurfaceCells(surface_cells, m_Grid);
+    SurfaceProjection::copyGeometry(m_Grid, surface_cells, m_SurfProjGrid, src_nodes);
     foreach (int bc, m_AllBoundaryCodes) {
-      SurfaceProjection *proj = new SurfaceProjection();
-      m_SurfProj[bc] = proj;
-      QSet<int> bcs;
-      bcs.insert(bc);
-      QVector<vtkIdType> cls;
-      getSurfaceCells(bcs, cls, m_Grid);
-      proj->setBackgroundGrid(m_Grid, cls);
+      m_SurfProj[bc] = NULL;
+    }
+    if (m_ParallelSurfProj && !nosave) {
+      buildSurfaceProjections();
     }
     if (!nosave) {
       save();
@@ -2143,17 +2161,182 @@ void GuiMainWindow::resetSurfaceProjection()
   }
 }
 
+void GuiMainWindow::buildSurfaceProjections()
+{
+  QVector<int> bcs;
+  foreach (int bc, m_SurfProj.keys()) {
+    if (!m_SurfProj[bc]) {
+      bcs.append(bc);
+    }
+  }
+
+  // sort the surface cells by boundary code in one pass
+  QMap<int, int> bc_index;
+  for (int i = 0; i < bcs.size(); ++i) {
+    bc_index[bcs[i]] = i;
+  }
+  QVector<QVector<vtkIdType> > cls(bcs.size());
+  {
+    EG_VTKDCC(vtkIntArray, cell_code, m_SurfProjGrid, "cell_code");
+    for (vtkIdType id_cell = 0; id_cell < m_SurfProjGrid->GetNumberOfCells(); ++id_cell) {
+      int i = bc_index.value(cell_code->GetValue(id_cell), -1);
+      if (i >= 0) {
+        cls[i].append(id_cell);
+      }
+    }
+  }
+
+  // the constructors read the settings, so the objects are created in serial
+  QVector<SurfaceProjection*> projs(bcs.size());
+  for (int i = 0; i < bcs.size(); ++i) {
+    projs[i] = new SurfaceProjection();
+  }
+  SurfaceProjection **projs_ptr = projs.data();
+  const QVector<vtkIdType> *cls_ptr = cls.constData();
+  vtkUnstructuredGrid *grid = m_SurfProjGrid;
+  bool build_error = false;
+  Error err;
+
+  // the projectors only read the common geometry grid
+  #pragma omp parallel for schedule(dynamic, 1)
+  for (int i = 0; i < bcs.size(); ++i) {
+    try {
+      projs_ptr[i]->buildBackgroundGrid(grid, cls_ptr[i]);
+    } catch (Error E) {
+      #pragma omp critical
+      {
+        err = E;
+        build_error = true;
+      }
+    }
+  }
+  for (int i = 0; i < bcs.size(); ++i) {
+    projs[i]->setForegroundGrid(m_Grid);
+    m_SurfProj[bcs[i]] = projs[i];
+  }
+  if (build_error) {
+    throw err;
+  }
+}
+
+void GuiMainWindow::saveSurfaceProjections(QString file_name)
+{
+  if (m_SurfProj.isEmpty()) {
+    return;
+  }
+  // write to a temporary file first, so an interrupted save never leaves a truncated cache behind
+  QString tmp_name = file_name + ".tmp";
+  {
+    QFile file(tmp_name);
+    if (!file.open(QIODevice::WriteOnly)) {
+      cout << "unable to write surface projection cache " << qPrintable(file_name) << endl;
+      return;
+    }
+    QDataStream s(&file);
+    SurfaceProjection::writeCacheHeader(s, m_SurfProjGrid);
+    QList<int> bcs;
+    foreach (int bc, m_SurfProj.keys()) {
+      if (m_SurfProj[bc]) {
+        bcs.append(bc);
+      }
+    }
+    s << qint32(bcs.size());
+    foreach (int bc, bcs) {
+      s << qint32(bc);
+      m_SurfProj[bc]->writeCache(s);
+    }
+    file.close();
+    if (s.status() != QDataStream::Ok || file.error() != QFile::NoError) {
+      cout << "unable to write surface projection cache " << qPrintable(file_name) << endl;
+      QFile::remove(tmp_name);
+      return;
+    }
+  }
+  QFile::remove(file_name);
+  if (!QFile::rename(tmp_name, file_name)) {
+    cout << "unable to write surface projection cache " << qPrintable(file_name) << endl;
+    QFile::remove(tmp_name);
+  }
+}
+
+bool GuiMainWindow::loadSurfaceProjections(QString file_name)
+{
+  QFile file(file_name);
+  if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  // read straight from the mapped file; fall back to a buffered read if mapping is not possible
+  uchar *mapped = file.map(0, file.size());
+  QByteArray buffer;
+  if (mapped) {
+    buffer = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), file.size());
+  } else {
+    buffer = file.readAll();
+  }
+  QMap<int, SurfaceProjection*> loaded;
+  bool ok = true;
+  {
+    QDataStream s(buffer);
+    ok = SurfaceProjection::readCacheHeader(s, m_SurfProjGrid);
+    qint32 num_bcs = 0;
+    if (ok) {
+      s >> num_bcs;
+    }
+    for (int i = 0; ok && i < num_bcs; ++i) {
+      qint32 bc;
+      s >> bc;
+      if (!m_SurfProj.contains(bc) || loaded.contains(bc)) {
+        ok = false;
+        break;
+      }
+      SurfaceProjection *proj = new SurfaceProjection();
+      loaded[bc] = proj;
+      ok = proj->readCache(s, m_SurfProjGrid);
+    }
+  }
+  buffer.clear();
+  if (mapped) {
+    file.unmap(mapped);
+  }
+  if (!ok) {
+    foreach (SurfaceProjection *proj, loaded) {
+      delete proj;
+    }
+    cout << "ignoring outdated surface projection cache " << qPrintable(file_name) << endl;
+    return false;
+  }
+  foreach (int bc, loaded.keys()) {
+    delete m_SurfProj[bc];
+    loaded[bc]->setForegroundGrid(m_Grid);
+    m_SurfProj[bc] = loaded[bc];
+  }
+  return true;
+}
+
 SurfaceProjection* GuiMainWindow::getSurfProj(int bc)
 {
   QString bc_txt;
   bc_txt.setNum(bc);
+  QMutexLocker locker(&m_SurfProjMutex);
   if (!m_SurfProj.contains(bc)) {
     bc = 0;
   }
   if (!m_SurfProj.contains(bc)) {
     EG_ERR_RETURN("No surface projection found for boundary code " + bc_txt);
   }
-  return m_SurfProj[bc];
+  SurfaceProjection *proj = m_SurfProj.value(bc);
+  if (!proj) {
+    QSet<int> bcs;
+    bcs.insert(bc);
+    QVector<vtkIdType> cls;
+    getSurfaceCells(bcs, cls, m_SurfProjGrid);
+    proj = new SurfaceProjection();
+    proj->buildBackgroundGrid(m_SurfProjGrid, cls);
+    proj->setForegroundGrid(m_Grid);
+    m_SurfProj[bc] = proj;
+  }
+  return proj;
 }
 
 bool GuiMainWindow::checkSurfProj()
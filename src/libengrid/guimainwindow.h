@@ -195,7 +195,10 @@ class CLASS_LIBENGRID_DLL GuiMainWindow : public QMainWindow, public EgVtkObject
     QMap<QString, VolumeDefinition> m_VolMap;    ///< all volume definitions
     QMap<QString, PhysicalBoundaryCondition> m_PhysicalBoundaryConditionsMap;    ///< all physical boundary conditions definitions
 
-    QMap<int, SurfaceProjection*>   m_SurfProj;  ///< all surface projectors for surface meshing
+    QMap<int, SurfaceProjection*>   m_SurfProj;  ///< all surface projectors for surface meshing (NULL until first use)
+    QMutex                          m_SurfProjMutex; ///< protects the lazy construction in getSurfProj (it can be called from worker threads)
+    vtkUnstructuredGrid*            m_SurfProjGrid; ///< the geometry (surface triangles only) which is shared by all surface projectors
+    bool                            m_ParallelSurfProj; ///< build all surface projectors concurrently when the projection is stored
 
     QMap<QAction*, Operation*> m_PluginOperations;
     QAction* m_EscAction;
@@ -391,7 +394,7 @@ class CLASS_LIBENGRID_DLL GuiMainWindow : public QMainWindow, public EgVtkObject
     QString getFilename() { return( m_CurrentFilename ); }
     void setFilename(QString filename) { m_CurrentFilename = filename; }
 
-    SurfaceProjection* getSurfProj(int bc);
+    SurfaceProjection* getSurfProj(int bc); ///< the surface projector of a boundary code; it will be built on first use
     void setSurfProj(SurfaceProjection *surf_proj, int bc) { m_SurfProj[bc] = surf_proj; }
     bool checkSurfProj();
 
@@ -469,6 +472,9 @@ class CLASS_LIBENGRID_DLL GuiMainWindow : public QMainWindow, public EgVtkObject
 
     void storeSurfaceProjection(bool nosave = false);
     void resetSurfaceProjection();    
+    void buildSurfaceProjections(); ///< build all surface projectors which have not been used so far (in parallel)
+    void saveSurfaceProjections(QString file_name); ///< write all surface projectors which have been built to a cache file
+    bool loadSurfaceProjections(QString file_name); ///< restore surface projectors from a cache file (memory mapped)
 
     // SLOTS for all standard operations should be defined below;
     // entries should look like this:
@@ -34,12 +34,145 @@ InsertPoints::InsertPoints() : SurfaceOperation()
   getSet("surface meshing", "point insertion threshold", 1, m_Threshold);
 }
 
+void InsertPoints::fixNodes(const QVector<bool> &fixnodes)
+{
+  if (fixnodes.size() != m_Grid->GetNumberOfPoints()) {
+    EG_BUG;
+  }
+  m_Fixed = fixnodes;
+}
+
 void InsertPoints::operate()
 {
-  int N1 = m_Grid->GetNumberOfPoints();
-  insertPoints();
-  int N2 = m_Grid->GetNumberOfPoints();
-  m_NumInserted = N2 - N1;
+  m_NewNodes.clear();
+  m_NumInserted = insertPoints();
+}
+
+void InsertPoints::selectSplits(const QVector<edge_t> &edges, QVector<bool> &selected)
+{
+  int N_edges = edges.size();
+
+  // compact numbering of the cells touched by the edges (sorted (cell, edge) pairs)
+  QVector<QPair<vtkIdType, int> > cell_edge_pairs;
+  QVector<int> num_edge_cells(N_edges);
+  for (int i_edge = 0; i_edge < N_edges; ++i_edge) {
+    num_edge_cells[i_edge] = edges[i_edge].S.id_cell.size();
+    foreach (vtkIdType id_cell, edges[i_edge].S.id_cell) {
+      cell_edge_pairs.append(QPair<vtkIdType, int>(id_cell, i_edge));
+    }
+  }
+  qSort(cell_edge_pairs);
+  QVector<int> num_cell_edges;
+  for (int i = 0; i < cell_edge_pairs.size(); ++i) {
+    if (i == 0 || cell_edge_pairs[i].first != cell_edge_pairs[i-1].first) {
+      num_cell_edges.append(0);
+    }
+    ++num_cell_edges.last();
+  }
+
+  // all edges which touch a cell and all cells of an edge
+  AdjacencyList cell_edges;
+  AdjacencyList edge_cells;
+  cell_edges.setRowSizes(num_cell_edges);
+  edge_cells.setRowSizes(num_edge_cells);
+  num_edge_cells.fill(0);
+  {
+    int i_cells = -1;
+    int j = 0;
+    for (int i = 0; i < cell_edge_pairs.size(); ++i) {
+      if (i == 0 || cell_edge_pairs[i].first != cell_edge_pairs[i-1].first) {
+        ++i_cells;
+        j = 0;
+      }
+      int i_edge = cell_edge_pairs[i].second;
+      cell_edges.rowData(i_cells)[j] = i_edge;
+      ++j;
+      edge_cells.rowData(i_edge)[num_edge_cells[i_edge]] = i_cells;
+      ++num_edge_cells[i_edge];
+    }
+  }
+
+  // Select the edges in rounds: an undecided edge is selected if no undecided edge with
+  // a higher priority (lower index) shares a cell with it; edges sharing a cell with
+  // a selected edge are rejected. This gives exactly the same set as a greedy
+  // sequential selection in the order of the edges.
+  // An undecided edge can only become selectable once one of its neighbours has been rejected,
+  // so every round only revisits the undecided neighbours of the edges rejected in the round before.
+  QVector<char> state(N_edges, 0); // 0: undecided, 1: selected, 2: rejected
+  QVector<char> queued(N_edges, 0);
+  QVector<int> work(N_edges);
+  QVector<char> change;
+  char *st = state.data();
+  for (int i_edge = 0; i_edge < N_edges; ++i_edge) {
+    work[i_edge] = i_edge;
+  }
+  while (work.size() > 0) {
+    int N_work = work.size();
+    change.fill(0, N_work);
+    const int *wk = work.constData();
+    char *ch = change.data();
+    #pragma omp parallel for if(!m_Serial)
+    for (int i_work = 0; i_work < N_work; ++i_work) {
+      int i_edge = wk[i_work];
+      if (st[i_edge] == 0) {
+        bool local_max = true;
+        AdjacencyList::Row cells = edge_cells[i_edge];
+        for (int i = 0; i < cells.size() && local_max; ++i) {
+          AdjacencyList::Row row = cell_edges[cells[i]];
+          for (int j = 0; j < row.size(); ++j) {
+            if (row[j] < i_edge && st[row[j]] == 0) {
+              local_max = false;
+              break;
+            }
+          }
+        }
+        if (local_max) {
+          ch[i_work] = 1;
+        }
+      }
+    }
+
+    // the selected edges do not share any cells, so their neighbours can be rejected one after the other
+    QVector<int> rejected;
+    for (int i_work = 0; i_work < N_work; ++i_work) {
+      if (ch[i_work] == 1) {
+        st[wk[i_work]] = 1;
+      }
+    }
+    for (int i_work = 0; i_work < N_work; ++i_work) {
+      if (ch[i_work] == 1) {
+        foreach (int i_cells, edge_cells[wk[i_work]]) {
+          foreach (int j_edge, cell_edges[i_cells]) {
+            if (st[j_edge] == 0) {
+              st[j_edge] = 2;
+              rejected.append(j_edge);
+            }
+          }
+        }
+      }
+    }
+
+    // the next round only visits the undecided neighbours of the rejected edges
+    QVector<int> next_work;
+    foreach (int i_edge, rejected) {
+      foreach (int i_cells, edge_cells[i_edge]) {
+        foreach (int j_edge, cell_edges[i_cells]) {
+          if (st[j_edge] == 0 && !queued[j_edge]) {
+            queued[j_edge] = 1;
+            next_work.append(j_edge);
+          }
+        }
+      }
+    }
+    foreach (int i_edge, next_work) {
+      queued[i_edge] = 0;
+    }
+    work = next_work;
+  }
+  selected.resize(N_edges);
+  for (int i_edge = 0; i_edge < N_edges; ++i_edge) {
+    selected[i_edge] = st[i_edge] == 1;
+  }
 }
 
 ///\todo Adapt this code for multiple volumes.
@@ -47,32 +180,47 @@ int InsertPoints::insertPoints()
 {
   QTime start = QTime::currentTime();
 
-  setAllSurfaceCells();
-  l2g_t  cells = getPartCells();
+  if (m_Fixed.size() != m_Grid->GetNumberOfPoints()) {
+    m_Fixed.fill(false, m_Grid->GetNumberOfPoints());
+  }
+
+  prepareSurfacePartition();
+  l2g_t  cells = loopCells();
   g2l_t _cells = getPartLocalCells();
 
   UpdatePotentialSnapPoints(true);
 
-  EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
-  EG_VTKDCN(vtkDoubleArray, characteristic_length_desired, m_Grid, "node_meshdensity_desired");
-
-  int num_newpoints=0;
-  int num_newcells=0;
-
-  QVector <int> marked_cells(cells.size(), 0);
-  QVector <stencil_t> stencil_vector(cells.size());
-
-  // find potential edges for splitting
-  QList<edge_t> edges;
-  for (int i = 0; i < cells.size(); ++i) {
+  FieldView<int>    cell_code                     = fields().cellCode();
+  FieldView<double> characteristic_length_desired = fields().nodeMeshDensityDesired();
+
+  // the loops below only read the connectivity
+  m_Part.prepareParallelAccess();
+
+  // find potential edges for splitting (at most one per cell)
+  int N_cells = cells.size();
+  QVector<edge_t> cell_edge(N_cells);
+  QVector<char>   has_edge(N_cells, 0);
+  edge_t *cell_edge_ptr = cell_edge.data();
+  char   *has_edge_ptr  = has_edge.data();
+  const bool *fixed_ptr = m_Fixed.constData();
+  fields().prime(); // the helpers below request fields
+  #pragma omp parallel for if(!m_Serial)
+  for (int i = 0; i < N_cells; ++i) {
     vtkIdType id_cell = cells[i];
 
     // if cell is selected and a triangle
-    if (m_BoundaryCodes.contains(cell_code->GetValue(id_cell)) && (m_Grid->GetCellType(id_cell) == VTK_TRIANGLE)) {
+    if (m_BoundaryCodes.contains(cell_code[id_cell]) && (m_Grid->GetCellType(id_cell) == VTK_TRIANGLE)) {
       int j_split = -1;
       double L_max = 0;
       vtkIdType N_pts, *pts;
       m_Grid->GetCellPoints(id_cell, N_pts, pts);
+      bool fixed[3];
+      for (int j = 0; j < 3; ++j) {
+        fixed[j] = fixed_ptr[pts[j]] || !isActive(pts[j]);
+      }
+      if (fixed[0] && fixed[1] && fixed[2]) {
+        continue;
+      }
       //find best side to split (longest)
       for (int j = 0; j < 3; ++j) {
         //check if neighbour cell on this side is also selected
@@ -80,14 +228,17 @@ int InsertPoints::insertPoints()
         bool selected_edge = true;
         for(int i_cell_neighbour=1;i_cell_neighbour<S.id_cell.size();i_cell_neighbour++) {
           vtkIdType id_cell_neighbour = S.id_cell[i_cell_neighbour];
-          if( !m_BoundaryCodes.contains(cell_code->GetValue(id_cell_neighbour)) || S.type_cell[i_cell_neighbour] != VTK_TRIANGLE) selected_edge=false;
+          if( !m_BoundaryCodes.contains(cell_code[id_cell_neighbour]) || S.type_cell[i_cell_neighbour] != VTK_TRIANGLE) selected_edge=false;
         }// end of loop through neighbour cells
+        vtkIdType id_node1 = pts[j];
+        vtkIdType id_node2 = pts[(j+1)%N_pts];
+        if (fixed[j] && fixed[(j+1)%N_pts]) {
+          selected_edge = false;
+        }
         if(selected_edge) {
-          vtkIdType id_node1 = pts[j];
-          vtkIdType id_node2 = pts[(j+1)%N_pts];
           double L  = distance(m_Grid, id_node1, id_node2);
-          double L1 = characteristic_length_desired->GetValue(id_node1);
-          double L2 = characteristic_length_desired->GetValue(id_node2);
+          double L1 = characteristic_length_desired[id_node1];
+          double L2 = characteristic_length_desired[id_node2];
           if (L > m_Threshold*min(L1,L2)) {
             if (L > L_max) {
               j_split = j;
@@ -100,117 +251,169 @@ int InsertPoints::insertPoints()
         stencil_t S = getStencil(id_cell, j_split);
         edge_t E;
         E.S = S;
-        E.L1 = characteristic_length_desired->GetValue(S.p1);
-        E.L2 = characteristic_length_desired->GetValue(S.p2);
+        E.L1 = characteristic_length_desired[S.p1];
+        E.L2 = characteristic_length_desired[S.p2];
         E.L12 = distance(m_Grid, S.p1, S.p2);
-        edges.push_back(E);
+        cell_edge_ptr[i] = E;
+        has_edge_ptr[i] = 1;
       }
     }
   }
-
-  qSort(edges);
-
-  //counter
-  foreach (edge_t E, edges) {
-    int i_cells1 = _cells[E.S.id_cell[0]];
-    bool all_unmarked = true;
-    for(int i=0; i<E.S.id_cell.size();i++) {
-      int i_cells = _cells[E.S.id_cell[i]];
-      if (marked_cells[i_cells]) all_unmarked=false;
-    }
-    if(all_unmarked) {
-      stencil_vector[i_cells1] = E.S;
-      marked_cells[i_cells1] = 1;
-      for(int i=1; i<E.S.id_cell.size();i++) {
-        int i_cells = _cells[E.S.id_cell[i]];
-        marked_cells[i_cells] = 2;
-      }
-      ++num_newpoints;
-      num_newcells += E.S.id_cell.size();
+  QVector<edge_t> edges;
+  for (int i = 0; i < N_cells; ++i) {
+    if (has_edge[i]) {
+      edges.append(cell_edge[i]);
     }
   }
+  qSort(edges);
 
-  //initialize grid_tmp
-  int l_N_points=m_Grid->GetNumberOfPoints();
-  int l_N_cells=m_Grid->GetNumberOfCells();
-  EG_VTKSP(vtkUnstructuredGrid,grid_tmp);
-  allocateGrid(grid_tmp, l_N_cells + num_newcells, l_N_points + num_newpoints);
-  makeCopyNoAlloc(m_Grid, grid_tmp);
+  // independent set of splits (no two splits share a cell)
+  QVector<bool> selected;
+  selectSplits(edges, selected);
 
-  //initialize new node counter
-  vtkIdType id_new_node = l_N_points;
+  // the splits are applied in the order of the cells
+  QVector<QPair<int, int> > split_of_cell;
+  for (int i_edge = 0; i_edge < edges.size(); ++i_edge) {
+    if (selected[i_edge]) {
+      split_of_cell.append(QPair<int, int>(_cells[edges[i_edge].S.id_cell[0]], i_edge));
+    }
+  }
+  qSort(split_of_cell);
+  QVector<stencil_t> splits;
+  for (int i = 0; i < split_of_cell.size(); ++i) {
+    splits.append(edges[split_of_cell[i].second].S);
+  }
+  int num_newpoints = splits.size();
+  int num_newcells  = 0;
+  QVector<int> first_new_cell(num_newpoints + 1, 0);
+  for (int i_split = 0; i_split < num_newpoints; ++i_split) {
+    num_newcells += splits[i_split].id_cell.size();
+    first_new_cell[i_split + 1] = num_newcells;
+  }
 
-  //actor
-  for (int i = 0; i < cells.size(); i++) {
-    if (marked_cells[i] == 1) {
-      stencil_t S = stencil_vector[i];
+  // midpoints and types of the new nodes
+  const stencil_t *split = splits.constData();
+  QVector<vec3_t> x_new(num_newpoints);
+  QVector<char>   type_new(num_newpoints);
+  vec3_t *x_new_ptr    = x_new.data();
+  char   *type_new_ptr = type_new.data();
+  bool invalid_mesh = false;
+  FieldView<char> old_node_type = fields().nodeType();
+  #pragma omp parallel for if(!m_Serial)
+  for (int i_split = 0; i_split < num_newpoints; ++i_split) {
+    vec3_t A,B;
+    m_Grid->GetPoint(split[i_split].p1, A.data());
+    m_Grid->GetPoint(split[i_split].p2, B.data());
+    x_new_ptr[i_split] = 0.5*(A+B);
+    try {
+      // inserted edge point = type of the edge on which it is inserted
+      type_new_ptr[i_split] = getNewNodeType(split[i_split], old_node_type, cell_code);
+    } catch (Error) {
+      invalid_mesh = true;
+    }
+  }
+  if (invalid_mesh) {
+    EG_ERR_RETURN("Invalid surface mesh. Check this with 'Tools -> Check surface integrity'.");
+  }
 
-      //calculate midpoint
-      vec3_t A,B;
-      grid_tmp->GetPoint(S.p1,A.data());
-      grid_tmp->GetPoint(S.p2,B.data());
-      vec3_t M=0.5*(A+B);
+  // the grid is modified in place; new nodes and cells re-use deleted ones if possible
+  GridEditor local_editor;
+  GridEditor *editor = m_GridEditor;
+  if (!editor) {
+    local_editor.setGrid(m_Grid);
+    editor = &local_editor;
+  }
+  editor->reserve(num_newcells, num_newpoints);
+
+  // Allocate all new nodes and cells in a deterministic order.
+  // The new cells are copies of the cells they are split from and will be rewired below.
+  QVector<vtkIdType> new_node(num_newpoints);
+  QVector<vtkIdType> new_cell(num_newcells);
+  for (int i_split = 0; i_split < num_newpoints; ++i_split) {
+    new_node[i_split] = editor->addNode(x_new[i_split], splits[i_split].p1);
+    for (int i_triangle = 0; i_triangle < splits[i_split].id_cell.size(); ++i_triangle) {
+      vtkIdType id_cell = splits[i_split].id_cell[i_triangle];
+      vtkIdType N_pts, *pts;
+      m_Grid->GetCellPoints(id_cell, N_pts, pts);
+      vtkIdType old_pts[3] = { pts[0], pts[1], pts[2] };
+      new_cell[first_new_cell[i_split] + i_triangle] = editor->addCell(VTK_TRIANGLE, 3, old_pts, id_cell);
+    }
+  }
 
-      //add point
-      grid_tmp->GetPoints()->SetPoint(id_new_node, M.data());
-      copyNodeData(grid_tmp,S.p1,grid_tmp,id_new_node); ///\todo maybe trouble
+  // the node arrays might have been reallocated by addNode, so the view has to be requested here
+  FieldView<char> node_type = fields().nodeType();
+  for (int i_split = 0; i_split < num_newpoints; ++i_split) {
+    node_type[new_node[i_split]] = type_new[i_split];
+  }
 
-      // inserted edge point = type of the edge on which it is inserted
-      EG_VTKDCN(vtkCharArray, node_type, grid_tmp, "node_type");
-      node_type->SetValue(id_new_node, getNewNodeType(S) );
-
-      // insert new cells
-      //four new triangles
-      int N = S.id_cell.size();
-      QVector< QVector<vtkIdType> > pts_triangle(2*N,QVector<vtkIdType>(3));
-
-      for(int i_triangle=0; i_triangle<N; i_triangle++) {
-        vtkIdType *pts, N_pts;
-        grid_tmp->GetCellPoints(S.id_cell[i_triangle], N_pts, pts);
-
-        bool direct;
-        for(int i_pts = 0; i_pts<N_pts; i_pts++) {
-          if( pts[i_pts] == S.p1 ) {
-            if( pts[(i_pts+1)%N_pts] == S.p2 ) direct = true;
-            else direct = false;
-          }
-        }
-        if(direct) {
-          pts_triangle[i_triangle][0] = S.p1;
-          pts_triangle[i_triangle][1] = id_new_node;
-          pts_triangle[i_triangle][2] = S.id_node[i_triangle];
-
-          pts_triangle[i_triangle+N][0] = id_new_node;
-          pts_triangle[i_triangle+N][1] = S.p2;
-          pts_triangle[i_triangle+N][2] = S.id_node[i_triangle];
+  // compute the nodes of the split triangles in parallel (the splits do not share any cells) ...
+  QVector<vtkIdType> new_pts(6*num_newcells);
+  vtkIdType *new_pts_ptr = new_pts.data();
+  const vtkIdType *new_node_ptr = new_node.constData();
+  const int *first_new_cell_ptr = first_new_cell.constData();
+  #pragma omp parallel for if(!m_Serial)
+  for (int i_split = 0; i_split < num_newpoints; ++i_split) {
+    const stencil_t &S = split[i_split];
+    vtkIdType id_new_node = new_node_ptr[i_split];
+
+    //four new triangles
+    int N = S.id_cell.size();
+    for(int i_triangle=0; i_triangle<N; i_triangle++) {
+      vtkIdType *pts, N_pts;
+      m_Grid->GetCellPoints(S.id_cell[i_triangle], N_pts, pts);
+
+      bool direct;
+      for(int i_pts = 0; i_pts<N_pts; i_pts++) {
+        if( pts[i_pts] == S.p1 ) {
+          if( pts[(i_pts+1)%N_pts] == S.p2 ) direct = true;
+          else direct = false;
         }
-        else {
-          pts_triangle[i_triangle][0] = S.p2;
-          pts_triangle[i_triangle][1] = id_new_node;
-          pts_triangle[i_triangle][2] = S.id_node[i_triangle];
-
-          pts_triangle[i_triangle+N][0] = id_new_node;
-          pts_triangle[i_triangle+N][1] = S.p1;
-          pts_triangle[i_triangle+N][2] = S.id_node[i_triangle];
-        }
-
-        grid_tmp->ReplaceCell(S.id_cell[i_triangle] , 3, pts_triangle[i_triangle].data());
-        vtkIdType newCellId = grid_tmp->InsertNextCell(VTK_TRIANGLE,3,pts_triangle[i_triangle+N].data());
-        copyCellData(grid_tmp,S.id_cell[i_triangle],grid_tmp,newCellId);
       }
-
-      //increment ID
-      id_new_node++;
+      vtkIdType *pts_triangle1 = new_pts_ptr + 6*(first_new_cell_ptr[i_split] + i_triangle);
+      vtkIdType *pts_triangle2 = pts_triangle1 + 3;
+      if(direct) {
+        pts_triangle1[0] = S.p1;
+        pts_triangle1[1] = id_new_node;
+        pts_triangle1[2] = S.id_node[i_triangle];
+
+        pts_triangle2[0] = id_new_node;
+        pts_triangle2[1] = S.p2;
+        pts_triangle2[2] = S.id_node[i_triangle];
+      }
+      else {
+        pts_triangle1[0] = S.p2;
+        pts_triangle1[1] = id_new_node;
+        pts_triangle1[2] = S.id_node[i_triangle];
+
+        pts_triangle2[0] = id_new_node;
+        pts_triangle2[1] = S.p1;
+        pts_triangle2[2] = S.id_node[i_triangle];
+      }
     }
   }
 
-  //update grid
-  makeCopy(grid_tmp,m_Grid);
+  // ... and commit them serially, so the partition can be updated locally
+  for (int i_split = 0; i_split < num_newpoints; ++i_split) {
+    const stencil_t &S = splits[i_split];
+    for (int i_triangle = 0; i_triangle < S.id_cell.size(); ++i_triangle) {
+      int i_new = first_new_cell[i_split] + i_triangle;
+      m_Part.replaceCell(S.id_cell[i_triangle], 3, new_pts_ptr + 6*i_new);
+      m_Grid->ReplaceCell(new_cell[i_new], 3, new_pts_ptr + 6*i_new + 3);
+      m_Part.addCell(new_cell[i_new]);
+    }
+  }
+  m_Grid->Modified();
 
-  return(0);
+  m_NewNodes = new_node;
+  return(num_newpoints);
 }
 
 char InsertPoints::getNewNodeType(stencil_t S)
+{
+  return getNewNodeType(S, fields().nodeType(), fields().cellCode());
+}
+
+char InsertPoints::getNewNodeType(stencil_t S, FieldView<char> node_type, FieldView<int> cell_code)
 {
 //   cout<<"S="<<S<<endl;
 
@@ -223,20 +426,18 @@ char InsertPoints::getNewNodeType(stencil_t S)
   }
   */
   
-  EG_VTKDCN(vtkCharArray, node_type, m_Grid, "node_type");
-  if( node_type->GetValue(id_node1)==VTK_SIMPLE_VERTEX || node_type->GetValue(id_node2)==VTK_SIMPLE_VERTEX ) {
+  if( node_type[id_node1]==VTK_SIMPLE_VERTEX || node_type[id_node2]==VTK_SIMPLE_VERTEX ) {
     return VTK_SIMPLE_VERTEX;
   } else {
     QVector <vtkIdType> PSP = getPotentialSnapPoints(id_node1);
     if( PSP.contains(id_node2) ) {
-      EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
       if(S.id_cell.size()<1) {
         return VTK_BOUNDARY_EDGE_VERTEX;
       } else if (S.id_cell.size()==1) {
         EG_ERR_RETURN("Invalid surface mesh. Check this with 'Tools -> Check surface integrity'.")
         return VTK_FEATURE_EDGE_VERTEX; //at best, this would be a feature edge, since it's loose.
       } else {
-        if( cell_code->GetValue(S.id_cell[0]) != cell_code->GetValue(S.id_cell[1]) ) {
+        if( cell_code[S.id_cell[0]] != cell_code[S.id_cell[1]] ) {
           return VTK_BOUNDARY_EDGE_VERTEX;
         } else {
           return VTK_FEATURE_EDGE_VERTEX;
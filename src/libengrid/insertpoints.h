@@ -49,24 +49,50 @@ private: // data-types
     int i_edge;
     double L1, L2, L12;
     double quality() const { return 0.5*min(L1,L2)/L12; }
-    bool operator< (const edge_t& E) const { return quality() < E.quality(); }
+    bool operator< (const edge_t& E) const
+    {
+      // ties are broken by the cell, so the order does not depend on the sorting algorithm
+      if (quality() != E.quality()) {
+        return quality() < E.quality();
+      }
+      return S.id_cell[0] < E.S.id_cell[0];
+    }
   };
 
 private: // attributes
 
   int    m_NumInserted;
+  QVector<vtkIdType> m_NewNodes;
   double m_Threshold;
+  QVector<bool> m_Fixed;
 
 private: // methods
   
   char getNewNodeType(stencil_t S); ///< Returns the type of the node inserted on the edge S.p[1],S.p[3] from stencil_t S
 
+  /**
+   * Returns the type of the node inserted on the edge S.p1,S.p2 from stencil_t S.
+   * This version does not request any fields and can be called from a parallel region.
+   */
+  char getNewNodeType(stencil_t S, FieldView<char> node_type, FieldView<int> cell_code);
+
+  /**
+   * Select a maximal set of edges which do not share any cells.
+   * The result is identical to a greedy selection in the order of the edges,
+   * but the selection runs in parallel rounds.
+   * @param edges the candidate edges (sorted by priority)
+   * @param selected on return this will be true for all selected edges
+   */
+  void selectSplits(const QVector<edge_t> &edges, QVector<bool> &selected);
+
 public:
 
   InsertPoints();
   virtual void operate();
   int insertPoints();
   int getNumInserted() { return m_NumInserted; }
+  const QVector<vtkIdType>& getNewNodes() { return m_NewNodes; } ///< the nodes inserted by the last call
+  void fixNodes(const QVector<bool> &fixnodes); ///< edges between two fixed nodes and cells which only consist of fixed nodes will not be split
   
 };
 
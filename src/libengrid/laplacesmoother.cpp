@@ -38,6 +38,8 @@ LaplaceSmoother::LaplaceSmoother() : SurfaceOperation()
   m_NoCheck = false;
   m_ProjectionIterations = 50;
   m_FreeProjectionForEdges = false;
+  getSet("surface meshing", "use multi-coloured Jacobi smoothing (parallel)", false, m_JacobiMode);
+  getSet("surface meshing", "relative displacement of a node to count as moved", 0.05, m_MovedTolerance);
   m_AllowedCellTypes.clear();
   m_AllowedCellTypes.insert(VTK_TRIANGLE);
 }
@@ -165,6 +167,67 @@ bool LaplaceSmoother::setNewPosition(vtkIdType id_node, vec3_t x_new)
   */
 }
 
+vec3_t LaplaceSmoother::projectNode(vtkIdType id_node, vec3_t x_new)
+{
+  if (!m_UseProjection) {
+    return x_new;
+  }
+  int i_nodes = m_Part.localNode(id_node);
+  if (m_NodeToBc[i_nodes].size() == 1) {
+    int bc = m_NodeToBc[i_nodes][0];
+    x_new = GuiMainWindow::pointer()->getSurfProj(bc)->projectRestricted(x_new, id_node, m_CorrectCurvature);
+  } else {
+    for (int i_proj_iter = 0; i_proj_iter < m_ProjectionIterations; ++i_proj_iter) {
+      foreach (int bc, m_NodeToBc[i_nodes]) {
+        if (m_FreeProjectionForEdges) {
+          x_new = GuiMainWindow::pointer()->getSurfProj(bc)->projectFree(x_new, id_node, m_CorrectCurvature);
+        } else {
+          x_new = GuiMainWindow::pointer()->getSurfProj(bc)->projectRestricted(x_new, id_node, m_CorrectCurvature);
+        }
+      }
+    }
+
+    for (int i_proj_iter = 0; i_proj_iter < m_ProjectionIterations; ++i_proj_iter) {
+      if (m_CorrectCurvature) {
+        foreach (int bc, m_NodeToBc[i_nodes]) {
+          x_new = GuiMainWindow::pointer()->getSurfProj(bc)->correctCurvature(GuiMainWindow::pointer()->getSurfProj(bc)->lastProjTriangle(), x_new);
+        }
+      }
+    }
+
+  }
+  return x_new;
+}
+
+vec3_t LaplaceSmoother::projectNode(int i_nodes, vec3_t x_new, SurfaceProjection::Hint *hints)
+{
+  if (!m_UseProjection) {
+    return x_new;
+  }
+  const QVector<int> &bcs = m_NodeToBc.at(i_nodes);
+  if (bcs.size() == 1) {
+    x_new = m_SurfProj.value(bcs[0])->projectRestricted(x_new, hints[0], m_CorrectCurvature);
+  } else {
+    for (int i_proj_iter = 0; i_proj_iter < m_ProjectionIterations; ++i_proj_iter) {
+      for (int i = 0; i < bcs.size(); ++i) {
+        if (m_FreeProjectionForEdges) {
+          x_new = m_SurfProj.value(bcs[i])->projectFree(x_new, hints[i], m_CorrectCurvature);
+        } else {
+          x_new = m_SurfProj.value(bcs[i])->projectRestricted(x_new, hints[i], m_CorrectCurvature);
+        }
+      }
+    }
+    for (int i_proj_iter = 0; i_proj_iter < m_ProjectionIterations; ++i_proj_iter) {
+      if (m_CorrectCurvature) {
+        for (int i = 0; i < bcs.size(); ++i) {
+          x_new = m_SurfProj.value(bcs[i])->correctCurvature(hints[i].triangle, x_new);
+        }
+      }
+    }
+  }
+  return x_new;
+}
+
 bool LaplaceSmoother::moveNode(vtkIdType id_node, vec3_t &Dx)
 {
   if (!checkVector(Dx)) {
@@ -174,33 +237,7 @@ bool LaplaceSmoother::moveNode(vtkIdType id_node, vec3_t &Dx)
   m_Grid->GetPoint(id_node, x_old.data());
   bool moved = false;
   for (int i_relaxation = 0; i_relaxation < 1; ++i_relaxation) {
-    vec3_t x_new = x_old + Dx;
-    if (m_UseProjection) {
-      int i_nodes = m_Part.localNode(id_node);
-      if (m_NodeToBc[i_nodes].size() == 1) {
-        int bc = m_NodeToBc[i_nodes][0];
-        x_new = GuiMainWindow::pointer()->getSurfProj(bc)->projectRestricted(x_new, id_node, m_CorrectCurvature);
-      } else {
-        for (int i_proj_iter = 0; i_proj_iter < m_ProjectionIterations; ++i_proj_iter) {
-          foreach (int bc, m_NodeToBc[i_nodes]) {
-            if (m_FreeProjectionForEdges) {
-              x_new = GuiMainWindow::pointer()->getSurfProj(bc)->projectFree(x_new, id_node, m_CorrectCurvature);
-            } else {
-              x_new = GuiMainWindow::pointer()->getSurfProj(bc)->projectRestricted(x_new, id_node, m_CorrectCurvature);
-            }
-          }
-        }
-
-        for (int i_proj_iter = 0; i_proj_iter < m_ProjectionIterations; ++i_proj_iter) {
-          if (m_CorrectCurvature) {
-            foreach (int bc, m_NodeToBc[i_nodes]) {
-              x_new = GuiMainWindow::pointer()->getSurfProj(bc)->correctCurvature(GuiMainWindow::pointer()->getSurfProj(bc)->lastProjTriangle(), x_new);
-            }
-          }
-        }
-
-      }
-    }
+    vec3_t x_new = projectNode(id_node, x_old + Dx);
     if (setNewPosition(id_node, x_new)) {
       moved = true;
       Dx = x_new - x_old;
@@ -211,6 +248,182 @@ bool LaplaceSmoother::moveNode(vtkIdType id_node, vec3_t &Dx)
   return moved;
 }
 
+bool LaplaceSmoother::validPosition(vtkIdType id_node, vec3_t x_new)
+{
+  for (int i = 0; i < m_Part.n2cGSize(id_node); ++i) {
+    vtkIdType id_cell = m_Part.n2cGG(id_node, i);
+    vtkIdType N_pts, *pts;
+    m_Grid->GetCellPoints(id_cell, N_pts, pts);
+    vec3_t x_old[4], x[4];
+    if (N_pts != 3 && N_pts != 4) {
+      EG_BUG;
+    }
+    for (int j = 0; j < N_pts; ++j) {
+      m_Grid->GetPoint(pts[j], x_old[j].data());
+      x[j] = x_old[j];
+      if (pts[j] == id_node) {
+        x[j] = x_new;
+      }
+    }
+    vec3_t n_old, n_new;
+    if (N_pts == 3) {
+      n_old = GeometryTools::triNormal(x_old[0], x_old[1], x_old[2]);
+      n_new = GeometryTools::triNormal(x[0], x[1], x[2]);
+    } else {
+      n_old = GeometryTools::quadNormal(x_old[0], x_old[1], x_old[2], x_old[3]);
+      n_new = GeometryTools::quadNormal(x[0], x[1], x[2], x[3]);
+    }
+    if (n_new*n_old < 0.2*n_old.abs2()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LaplaceSmoother::computeDisplacement(vtkIdType id_node, vec3_t &Dx)
+{
+  QVector<vtkIdType> snap_points = getPotentialSnapPoints(id_node);
+  if (snap_points.size() == 0) {
+    return false;
+  }
+  vec3_t n(0,0,0);
+  vec3_t x_old;
+  vec3_t x;
+  vec3_t x_new(0,0,0);
+  m_Grid->GetPoint(id_node, x_old.data());
+  double w_tot = 0;
+  foreach (vtkIdType id_snap_node, snap_points) {
+    m_Grid->GetPoint(id_snap_node, x.data());
+    double w = 1.0;
+    w_tot += w;
+    x_new += w*x;
+    n += m_NodeNormal.at(id_snap_node);
+  }
+  n.normalise();
+  x_new *= 1.0/w_tot;
+
+  if (m_UseNormalCorrection) {
+    vec3_t dx = x_new - x_old;
+    double scal = dx*n;
+    x_new += scal*n;
+  }
+
+  Dx = x_new - x_old;
+  Dx *= m_UnderRelaxation;
+  return true;
+}
+
+void LaplaceSmoother::colourNodes(const QVector<int> &active_nodes, QVector<QVector<int> > &colour_nodes)
+{
+  QVector<int> colour(m_Part.getNumberOfNodes(), -1);
+  colour_nodes.clear();
+  foreach (int i_nodes, active_nodes) {
+    // smallest colour which is not used by any neighbour
+    QSet<int> used;
+    for (int j = 0; j < m_Part.n2nLSize(i_nodes); ++j) {
+      used.insert(colour[m_Part.n2nLL(i_nodes, j)]);
+    }
+    int c = 0;
+    while (used.contains(c)) {
+      ++c;
+    }
+    colour[i_nodes] = c;
+    if (c >= colour_nodes.size()) {
+      colour_nodes.resize(c + 1);
+    }
+    colour_nodes[c].append(i_nodes);
+  }
+}
+
+bool LaplaceSmoother::smoothColour(const QVector<int> &colour_nodes, QVector<bool> &moved)
+{
+  int N = colour_nodes.size();
+  const int *colour_nodes_ptr = colour_nodes.constData();
+  QVector<vec3_t> x_new(N);
+  QVector<char>   has_move(N, 0);
+  QVector<char>   valid(N, 0);
+  vec3_t *x_new_ptr    = x_new.data();
+  char   *has_move_ptr = has_move.data();
+  char   *valid_ptr    = valid.data();
+
+  // candidate positions (all nodes of one colour are independent of each other)
+  fields().prime(); // the helpers below request fields
+  #pragma omp parallel for if(!m_Serial)
+  for (int i = 0; i < N; ++i) {
+    vtkIdType id_node = m_Part.globalNode(colour_nodes_ptr[i]);
+    vec3_t Dx;
+    if (computeDisplacement(id_node, Dx)) {
+      has_move_ptr[i] = 1;
+      if (checkVector(Dx)) {
+        vec3_t x_old;
+        m_Grid->GetPoint(id_node, x_old.data());
+        x_new_ptr[i] = x_old + Dx;
+        valid_ptr[i] = 1;
+      }
+    }
+  }
+
+  // projection
+  // the stored projection triangles are fetched and written back in serial; the projection itself is reentrant
+  if (m_UseProjection) {
+    QVector<QVector<SurfaceProjection::Hint> > hints(N);
+    for (int i = 0; i < N; ++i) {
+      if (valid[i]) {
+        vtkIdType id_node = m_Part.globalNode(colour_nodes[i]);
+        foreach (int bc, m_NodeToBc[colour_nodes[i]]) {
+          hints[i].append(m_SurfProj[bc]->hint(id_node));
+        }
+      }
+    }
+    QVector<SurfaceProjection::Hint> *hints_ptr = hints.data();
+    bool invalid_mesh = false;
+    #pragma omp parallel for if(!m_Serial)
+    for (int i = 0; i < N; ++i) {
+      if (valid_ptr[i]) {
+        try {
+          x_new_ptr[i] = projectNode(colour_nodes_ptr[i], x_new_ptr[i], hints_ptr[i].data());
+        } catch (Error) {
+          invalid_mesh = true;
+        }
+      }
+    }
+    if (invalid_mesh) {
+      EG_ERR_RETURN("projection failed while smoothing the surface mesh");
+    }
+    for (int i = 0; i < N; ++i) {
+      if (valid[i]) {
+        vtkIdType id_node = m_Part.globalNode(colour_nodes[i]);
+        for (int j = 0; j < hints[i].size(); ++j) {
+          m_SurfProj[m_NodeToBc[colour_nodes[i]][j]]->storeHint(id_node, hints[i][j]);
+        }
+      }
+    }
+  }
+
+  // validation of the new cell normals
+  if (!m_NoCheck) {
+    #pragma omp parallel for if(!m_Serial)
+    for (int i = 0; i < N; ++i) {
+      if (valid_ptr[i]) {
+        vtkIdType id_node = m_Part.globalNode(colour_nodes_ptr[i]);
+        valid_ptr[i] = validPosition(id_node, x_new_ptr[i]);
+      }
+    }
+  }
+
+  // commit
+  bool success = true;
+  for (int i = 0; i < N; ++i) {
+    if (valid[i]) {
+      m_Grid->GetPoints()->SetPoint(m_Part.globalNode(colour_nodes[i]), x_new[i].data());
+      moved[colour_nodes[i]] = true;
+    } else if (has_move[i]) {
+      success = false;
+    }
+  }
+  return success;
+}
+
 void LaplaceSmoother::fixNodes(const QVector<bool> &fixnodes)
 {
   if (fixnodes.size() != m_Grid->GetNumberOfPoints()) {
@@ -224,28 +437,34 @@ void LaplaceSmoother::operate()
   if (m_Fixed.size() != m_Grid->GetNumberOfPoints()) {
     m_Fixed.fill(false, m_Grid->GetNumberOfPoints());
   }
-  QVector<int> bcs;
-  GuiMainWindow::pointer()->getAllBoundaryCodes(bcs);
-  if (m_UseProjection) {
-    foreach (int bc, bcs) {
-      GuiMainWindow::pointer()->getSurfProj(bc)->setForegroundGrid(m_Grid);
-    }
-  }
   UpdatePotentialSnapPoints(false, false);
   EG_VTKDCC(vtkIntArray,    cell_code, m_Grid, "cell_code");
   EG_VTKDCN(vtkCharArray,   node_type, m_Grid, "node_type" );
   EG_VTKDCN(vtkDoubleArray, cl,        m_Grid, "node_meshdensity_desired");
-  QVector<vtkIdType> smooth_node(m_Grid->GetNumberOfPoints(), false);
-  {
+  // a partition which is kept up to date contains all surface nodes and all of them can be smoothed
+  QVector<vtkIdType> smooth_node;
+  if (!partitionIsCurrent()) {
+    smooth_node.fill(false, m_Grid->GetNumberOfPoints());
     l2g_t nodes = m_Part.getNodes();
     foreach (vtkIdType id_node, nodes) {
       smooth_node[id_node] = true;
     }
   }
-  setAllSurfaceCells();
+  prepareSurfacePartition();
   l2g_t  nodes = m_Part.getNodes();
+
+  // the local nodes the loops run over
+  QVector<int> loop_nodes;
+  {
+    l2g_t region_nodes = loopNodes();
+    loop_nodes.resize(region_nodes.size());
+    for (int i = 0; i < region_nodes.size(); ++i) {
+      loop_nodes[i] = m_Part.localNode(region_nodes[i]);
+    }
+  }
+
   m_NodeToBc.resize(nodes.size());
-  for (int i_nodes = 0; i_nodes < nodes.size(); ++i_nodes) {
+  foreach (int i_nodes, loop_nodes) {
     QSet<int> bcs;
     for (int j = 0; j < m_Part.n2cLSize(i_nodes); ++j) {
       bcs.insert(cell_code->GetValue(m_Part.n2cLG(i_nodes, j)));
@@ -254,10 +473,14 @@ void LaplaceSmoother::operate()
     qCopy(bcs.begin(), bcs.end(), m_NodeToBc[i_nodes].begin());
   }
 
-  QVector<vec3_t> x_new(nodes.size());
+  QVector<bool> moved(nodes.size(), false);
+  QVector<vec3_t> x_old(nodes.size());
+  foreach (int i_nodes, loop_nodes) {
+    m_Grid->GetPoint(nodes[i_nodes], x_old[i_nodes].data());
+  }
 
   QVector<bool> blocked(nodes.size(), false);
-  for (int i_nodes = 0; i_nodes < nodes.size(); ++i_nodes) {
+  foreach (int i_nodes, loop_nodes) {
     for (int i = 0; i < m_Part.n2cLSize(i_nodes); ++i) {
       vtkIdType type = m_Grid->GetCellType(m_Part.n2cLG(i_nodes, i));
       if (!m_AllowedCellTypes.contains(type)) {
@@ -267,60 +490,80 @@ void LaplaceSmoother::operate()
     }
   }
 
+  QVector<int> active_nodes;
+  foreach (int i_nodes, loop_nodes) {
+    vtkIdType id_node = nodes[i_nodes];
+    if (!m_Fixed[id_node] && isActive(id_node) && !blocked[i_nodes]) {
+      if ((smooth_node.size() == 0 || smooth_node[id_node]) && node_type->GetValue(id_node) != VTK_FIXED_VERTEX) {
+        active_nodes.append(i_nodes);
+      }
+    }
+  }
+  qSort(active_nodes); // the same order as without a restricted region
+
+  // Only the projections of the boundary codes around nodes which can move are needed.
+  // They are built on first use, and other grids might use the other projections at the same time.
+  m_SurfProj.clear();
+  if (m_UseProjection) {
+    QSet<int> active_bcs;
+    foreach (int i_nodes, active_nodes) {
+      foreach (int bc, m_NodeToBc[i_nodes]) {
+        active_bcs.insert(bc);
+      }
+    }
+    foreach (int bc, active_bcs) {
+      SurfaceProjection *proj = GuiMainWindow::pointer()->getSurfProj(bc);
+      proj->setForegroundGrid(m_Grid);
+      m_SurfProj[bc] = proj;
+    }
+  }
+
+  QVector<QVector<int> > colour_nodes;
+  if (m_JacobiMode) {
+    colourNodes(active_nodes, colour_nodes);
+    m_Part.prepareParallelAccess();
+  }
+
   for (int i_iter = 0; i_iter < m_NumberOfIterations; ++i_iter) {
     m_Success = true;
     computeNormals();
     SurfaceProjection::Nfull = 0;
     SurfaceProjection::Nhalf = 0;
-    for (int i_nodes = 0; i_nodes < nodes.size(); ++i_nodes) {
-      vtkIdType id_node = nodes[i_nodes];
-      if (!m_Fixed[id_node] && !blocked[i_nodes]) {
-        if (smooth_node[id_node] && node_type->GetValue(id_node) != VTK_FIXED_VERTEX) {
-          if (node_type->GetValue(id_node) != VTK_FIXED_VERTEX) {
-            QVector<vtkIdType> snap_points = getPotentialSnapPoints(id_node);
-            vec3_t n(0,0,0);
-            if (snap_points.size() > 0) {
-              vec3_t x_old;
-              vec3_t x;
-              x_new[i_nodes] = vec3_t(0,0,0);
-              m_Grid->GetPoint(id_node, x_old.data());
-              double w_tot = 0;
-              double L_min = 1e99;
-              foreach (vtkIdType id_snap_node, snap_points) {
-                m_Grid->GetPoint(id_snap_node, x.data());
-                double w = 1.0;
-                w_tot += w;
-                x_new[i_nodes] += w*x;
-                n += m_NodeNormal[id_snap_node];
-                double L = (x - x_old).abs();
-                L_min = min(L, L_min);
-              }
-              n.normalise();
-              x_new[i_nodes] *= 1.0/w_tot;
-
-              if (m_UseNormalCorrection) {
-                vec3_t dx = x_new[i_nodes] - x_old;
-                double scal = dx*n;
-                x_new[i_nodes] += scal*n;
-              }
-
-              vec3_t Dx = x_new[i_nodes] - x_old;
-              Dx *= m_UnderRelaxation;
-              if (moveNode(id_node, Dx)) {
-                x_new[i_nodes] = x_old + Dx;
-              } else {
-                x_new[i_nodes] = x_old;
-                m_Success = false;
-              }
-            }
+    if (m_JacobiMode) {
+      for (int i_colour = 0; i_colour < colour_nodes.size(); ++i_colour) {
+        if (!smoothColour(colour_nodes[i_colour], moved)) {
+          m_Success = false;
+        }
+      }
+    } else {
+      foreach (int i_nodes, active_nodes) {
+        vtkIdType id_node = nodes[i_nodes];
+        vec3_t Dx;
+        if (computeDisplacement(id_node, Dx)) {
+          if (moveNode(id_node, Dx)) {
+            moved[i_nodes] = true;
+          } else {
+            m_Success = false;
           }
         }
+        //m_Timer << "    " << i_nodes+1 << " of " << nodes.size() << " nodes done." << Timer::endl;
       }
-      //m_Timer << "    " << i_nodes+1 << " of " << nodes.size() << " nodes done." << Timer::endl;
     }
     //cout << "    " << nodes.size() << " of " << nodes.size() << " nodes done." << endl;
     if (m_Success) {
       break;
     }
   }
+  // only nodes which have moved a significant distance count (otherwise the active set would never shrink)
+  m_MovedNodes.clear();
+  foreach (int i_nodes, active_nodes) {
+    if (moved[i_nodes]) {
+      vtkIdType id_node = nodes[i_nodes];
+      vec3_t x;
+      m_Grid->GetPoint(id_node, x.data());
+      if ((x - x_old[i_nodes]).abs() > m_MovedTolerance*cl->GetValue(id_node)) {
+        m_MovedNodes.append(id_node);
+      }
+    }
+  }
 }
@@ -41,17 +41,50 @@ private:
   bool      m_FreeProjectionForEdges;
 
   QVector<QVector<int> > m_NodeToBc;
+  QMap<int, SurfaceProjection*> m_SurfProj; ///< the projection for each boundary code (looked up once per operation)
 
   bool      m_CorrectCurvature;
   bool      m_NoCheck;
+  bool      m_JacobiMode;
 
   QSet<vtkIdType> m_AllowedCellTypes;
   QVector<bool> m_Fixed;
+  QVector<vtkIdType> m_MovedNodes;
+  double    m_MovedTolerance; ///< a node only counts as moved if its displacement exceeds this fraction of its desired edge length
   
 private: // methods
 
   bool setNewPosition(vtkIdType id_node, vec3_t x_new);
   bool moveNode(vtkIdType id_node, vec3_t &Dx);
+  vec3_t projectNode(vtkIdType id_node, vec3_t x_new); ///< project a new node position onto the surface (if projection is switched on)
+
+  /**
+   * Reentrant version of projectNode; several threads can call this at the same time.
+   * @param i_nodes the local index of the node
+   * @param x_new the position to project
+   * @param hints the projection hints of the node (one for each entry of m_NodeToBc[i_nodes]); they will be updated
+   * @return the projected position
+   */
+  vec3_t projectNode(int i_nodes, vec3_t x_new, SurfaceProjection::Hint *hints);
+
+  bool validPosition(vtkIdType id_node, vec3_t x_new); ///< check the cell normals for a new node position without moving the node
+  bool computeDisplacement(vtkIdType id_node, vec3_t &Dx); ///< Laplacian displacement of a node (false if it has no snap points)
+
+  /**
+   * Distribute the active nodes into colour classes; no two neighbour nodes share a colour.
+   * @param active_nodes the local nodes to smooth (in ascending order)
+   * @param colour_nodes on return the local nodes of each colour
+   */
+  void colourNodes(const QVector<int> &active_nodes, QVector<QVector<int> > &colour_nodes);
+
+  /**
+   * Smooth all nodes of one colour class in parallel (Jacobi step).
+   * Candidate positions, projections and normal checks are computed concurrently.
+   * @param colour_nodes the local nodes of the colour class
+   * @param moved will be set to true for each local node which has been moved
+   * @return false if at least one node could not be moved
+   */
+  bool smoothColour(const QVector<int> &colour_nodes, QVector<bool> &moved);
 
 
 public:
@@ -64,6 +97,7 @@ public:
   void setNormalCorrectionOn() { m_UseNormalCorrection = true; }
   void setNormalCorrectionOff() { m_UseNormalCorrection = false; }
   bool succeeded() { return m_Success; }
+  const QVector<vtkIdType>& getMovedNodes() { return m_MovedNodes; } ///< the nodes which have been moved significantly by the last call
   void fixNodes(const QVector<bool> &fixnodes);
 
 public:
@@ -72,6 +106,8 @@ public:
   bool getCorrectCurvature() { return m_CorrectCurvature; }
   void setNoCheck(bool b) { m_NoCheck = b; }
   bool getNoCheck() { return m_NoCheck; }
+  void setJacobiModeOn()  { m_JacobiMode = true; }
+  void setJacobiModeOff() { m_JacobiMode = false; }
   void setProjectionIterations(int n) { m_ProjectionIterations = n; }
   void setFreeProjectionForEdgesOn() { m_FreeProjectionForEdges = true; }
   void setFreeProjectionForEdgesOff() { m_FreeProjectionForEdges = false; }
@@ -28,9 +28,13 @@ win32-msvc* {
     QMAKE_CXXFLAGS += -Wno-deprecated
     QMAKE_CXXFLAGS += -Wl,--no-undefined
     QMAKE_CXXFLAGS += -Wl,--enable-runtime-pseudo-reloc
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS   += -fopenmp
 } else {
     QMAKE_CXXFLAGS += -Wall
     QMAKE_CXXFLAGS += -Wno-deprecated
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS   += -fopenmp
     QMAKE_CXXFLAGS += -fno-omit-frame-pointer
     QMAKE_CXXFLAGS += -g
 }
@@ -357,3 +361,17 @@ SOURCES += deletestraynodes.cpp
 HEADERS += guimirrormesh.h
 SOURCES += guimirrormesh.cpp
 FORMS += guimirrormesh.ui
+HEADERS += adjacencylist.h
+HEADERS += grideditor.h
+SOURCES += grideditor.cpp
+HEADERS += gridfields.h
+SOURCES += gridfields.cpp
+HEADERS += triangletree.h
+SOURCES += triangletree.cpp
+HEADERS += trianglestore.h
+SOURCES += trianglestore.cpp
+HEADERS += binaryio.h
+HEADERS += bucketoctree.h
+SOURCES += bucketoctree.cpp
+HEADERS += quadricedgecollapse.h
+SOURCES += quadricedgecollapse.cpp
@@ -27,6 +27,8 @@
 #include <vtkKdTreePointLocator.h>
 #include <vtkClipDataSet.h>
 
+#include <algorithm>
+
 MeshPartition::MeshPartition()
 {
   m_Grid = NULL;
@@ -38,11 +40,7 @@ MeshPartition::MeshPartition(vtkUnstructuredGrid *grid, bool use_all_cells)
   resetTimeStamps();
   m_Grid = grid;
   if (use_all_cells) {
-    QVector<vtkIdType> cls(grid->GetNumberOfCells());
-    for (vtkIdType id_cell = 0; id_cell < cls.size(); ++id_cell) {
-      cls[id_cell] = id_cell;
-    }
-    setCells(cls);
+    setAllCells();
   }
 }
 
@@ -62,6 +60,7 @@ void MeshPartition::resetTimeStamps()
   m_N2CStamp = 0;
   m_N2BCStamp = 0;
   m_C2CStamp = 0;
+  m_TwinStamp = 0;
 }
 
 void MeshPartition::setVolume(QString volume_name)
@@ -307,20 +306,10 @@ bool MeshPartition::hasNeighNode(vtkIdType id_node, vtkIdType id_neigh)
 
 void MeshPartition::createNodeToBC()
 {
-  EG_VTKDCC(vtkIntArray, cell_code,   m_Grid, "cell_code");
-  m_N2BC.resize(m_Nodes.size());
-  foreach (int i_node, m_Nodes) {
-    QSet<int> bcs;
-    for (int j = 0; j < n2cLSize(i_node); ++j) {
-      vtkIdType id_cell = n2cLG(i_node, j);
-      if (isSurface(id_cell, m_Grid)) {
-        bcs.insert(cell_code->GetValue(n2cLG(i_node, j)));
-      }
-    }
-    m_N2BC[i_node].resize(bcs.size());
-    foreach (int bc, bcs) {
-      m_N2BC[i_node].append(bc);
-    }
+  EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
+  m_N2BC.setRowSizes(QVector<int>(m_Nodes.size(), 0));
+  for (int i_nodes = 0; i_nodes < m_Nodes.size(); ++i_nodes) {
+    computeN2BCRow(i_nodes, cell_code);
   }
 }
 
@@ -370,3 +359,470 @@ double MeshPartition::getAverageSurfaceEdgeLength(vtkIdType id_node)
   }
   return L;
 }
+
+void MeshPartition::prepareLocalChange()
+{
+  checkLNodes();
+  checkLCells();
+  if (!isCurrentN2C()) {
+    // all local updates are based on N2C -- the other structures will be rebuilt on demand
+    m_N2NStamp  = 0;
+    m_N2BCStamp = 0;
+    m_C2CStamp  = 0;
+    m_TwinStamp = 0;
+  }
+}
+
+void MeshPartition::swap(MeshPartition &part)
+{
+  qSwap(m_Grid, part.m_Grid);
+  qSwap(m_Cells, part.m_Cells);
+  qSwap(m_LCells, part.m_LCells);
+  qSwap(m_Nodes, part.m_Nodes);
+  qSwap(m_LNodes, part.m_LNodes);
+  m_N2C.swap(part.m_N2C);
+  m_N2BC.swap(part.m_N2BC);
+  m_N2N.swap(part.m_N2N);
+  m_C2C.swap(part.m_C2C);
+  qSwap(m_Twin, part.m_Twin);
+  qSwap(m_CellsStamp, part.m_CellsStamp);
+  qSwap(m_LCellsStamp, part.m_LCellsStamp);
+  qSwap(m_NodesStamp, part.m_NodesStamp);
+  qSwap(m_LNodesStamp, part.m_LNodesStamp);
+  qSwap(m_N2NStamp, part.m_N2NStamp);
+  qSwap(m_N2CStamp, part.m_N2CStamp);
+  qSwap(m_N2BCStamp, part.m_N2BCStamp);
+  qSwap(m_C2CStamp, part.m_C2CStamp);
+  qSwap(m_TwinStamp, part.m_TwinStamp);
+}
+
+void MeshPartition::insertIntoRow(AdjacencyList &list, int i, int item)
+{
+  int j = 0;
+  while (j < list.rowSize(i) && list.at(i, j) < item) {
+    ++j;
+  }
+  if (j < list.rowSize(i) && list.at(i, j) == item) {
+    return;
+  }
+  list.insertItem(i, j, item);
+}
+
+void MeshPartition::removeFromRow(AdjacencyList &list, int i, int item)
+{
+  int j = list.row(i).indexOf(item);
+  if (j != -1) {
+    list.removeItem(i, j);
+  }
+}
+
+void MeshPartition::renumberInRow(AdjacencyList &list, int i, int old_item, int new_item)
+{
+  int *data = list.rowData(i);
+  for (int j = 0; j < list.rowSize(i); ++j) {
+    if (data[j] == old_item) {
+      data[j] = new_item;
+    }
+  }
+}
+
+void MeshPartition::computeN2NRow(int i_nodes)
+{
+  vtkIdType id_node = m_Nodes[i_nodes];
+  QVector<int> row;
+  for (int j = 0; j < m_N2C.rowSize(i_nodes); ++j) {
+    vtkIdType id_cell = m_Cells[m_N2C.at(i_nodes, j)];
+    vtkIdType N_pts, *pts;
+    m_Grid->GetCellPoints(id_cell, N_pts, pts);
+    const int *edges;
+    int N = cellEdgeTable(m_Grid->GetCellType(id_cell), edges);
+    for (int i = 0; i < N; ++i) {
+      if (pts[edges[2*i]] == id_node) {
+        row.append(m_LNodes[pts[edges[2*i+1]]]);
+      } else if (pts[edges[2*i+1]] == id_node) {
+        row.append(m_LNodes[pts[edges[2*i]]]);
+      }
+    }
+  }
+  qSort(row);
+  row.erase(std::unique(row.begin(), row.end()), row.end());
+  m_N2N.setRow(i_nodes, row);
+}
+
+void MeshPartition::computeN2BCRow(int i_nodes, vtkIntArray *cell_code)
+{
+  QSet<int> bcs;
+  for (int j = 0; j < m_N2C.rowSize(i_nodes); ++j) {
+    vtkIdType id_cell = m_Cells[m_N2C.at(i_nodes, j)];
+    if (isSurface(id_cell, m_Grid)) {
+      bcs.insert(cell_code->GetValue(id_cell));
+    }
+  }
+  QVector<int> row(bcs.size());
+  qCopy(bcs.begin(), bcs.end(), row.begin());
+  qSort(row);
+  m_N2BC.setRow(i_nodes, row);
+}
+
+void MeshPartition::computeC2CRow(int i_cells)
+{
+  if (!isCurrentC2C()) {
+    return;
+  }
+  vtkIdType id_cell = m_Cells[i_cells];
+  if (!isSurface(id_cell, m_Grid)) {
+    // volume cells are not updated locally
+    m_C2CStamp = 0;
+    return;
+  }
+  vtkIdType N_pts, *pts;
+  m_Grid->GetCellPoints(id_cell, N_pts, pts);
+  QVector<int> row(N_pts, -1);
+  for (int j = 0; j < N_pts; ++j) {
+    int i_nodes1 = m_LNodes[pts[j]];
+    int i_nodes2 = m_LNodes[pts[(j + 1) % N_pts]];
+    for (int k = 0; k < m_N2C.rowSize(i_nodes1); ++k) {
+      int i_neigh = m_N2C.at(i_nodes1, k);
+      if (i_neigh != i_cells && isSurface(m_Cells[i_neigh], m_Grid) && m_N2C[i_nodes2].contains(i_neigh)) {
+        row[j] = i_neigh;
+      }
+    }
+  }
+  m_C2C.setRow(i_cells, row);
+}
+
+void MeshPartition::computeTwins(int i_cells, int *twins)
+{
+  // only constant access to the members, since this is called from parallel loops
+  const vtkIdType *cells  = m_Cells.constData();
+  const int       *lnodes = m_LNodes.constData();
+  int *twin = twins + 4*i_cells;
+  for (int j = 0; j < 4; ++j) {
+    twin[j] = -1;
+  }
+  vtkIdType id_cell = cells[i_cells];
+  if (!isSurface(id_cell, m_Grid)) {
+    return;
+  }
+  vtkIdType N_pts, *pts;
+  m_Grid->GetCellPoints(id_cell, N_pts, pts);
+  for (int j = 0; j < N_pts; ++j) {
+    vtkIdType id_node1 = pts[j];
+    vtkIdType id_node2 = pts[(j + 1) % N_pts];
+    int i_nodes1 = lnodes[id_node1];
+    for (int k = 0; k < m_N2C.rowSize(i_nodes1); ++k) {
+      int i_neigh = m_N2C.at(i_nodes1, k);
+      if (i_neigh == i_cells) {
+        continue;
+      }
+      vtkIdType id_neigh = cells[i_neigh];
+      if (!isSurface(id_neigh, m_Grid)) {
+        continue;
+      }
+      vtkIdType N_neigh_pts, *neigh_pts;
+      m_Grid->GetCellPoints(id_neigh, N_neigh_pts, neigh_pts);
+      for (int l = 0; l < N_neigh_pts; ++l) {
+        vtkIdType id_neigh_node1 = neigh_pts[l];
+        vtkIdType id_neigh_node2 = neigh_pts[(l + 1) % N_neigh_pts];
+        if ((id_neigh_node1 == id_node1 && id_neigh_node2 == id_node2) || (id_neigh_node1 == id_node2 && id_neigh_node2 == id_node1)) {
+          if (twin[j] == -1) {
+            twin[j] = 4*i_neigh + l;
+          } else {
+            twin[j] = -2;
+          }
+        }
+      }
+    }
+  }
+}
+
+void MeshPartition::createTwins()
+{
+  m_Twin.resize(4*m_Cells.size());
+  int N_cells = m_Cells.size();
+  int *twins = m_Twin.data();
+  // the cells are independent of each other
+  #pragma omp parallel for if(!SerialConnectivity)
+  for (int i_cells = 0; i_cells < N_cells; ++i_cells) {
+    computeTwins(i_cells, twins);
+  }
+}
+
+int MeshPartition::findHalfEdge(vtkIdType id_node1, vtkIdType id_node2)
+{
+  checkN2C();
+  int i_nodes1 = m_LNodes[id_node1];
+  if (i_nodes1 < 0) {
+    return -1;
+  }
+  for (int k = 0; k < m_N2C.rowSize(i_nodes1); ++k) {
+    int i_cells = m_N2C.at(i_nodes1, k);
+    vtkIdType id_cell = m_Cells[i_cells];
+    if (isSurface(id_cell, m_Grid)) {
+      vtkIdType N_pts, *pts;
+      m_Grid->GetCellPoints(id_cell, N_pts, pts);
+      for (int j = 0; j < N_pts; ++j) {
+        vtkIdType p1 = pts[j];
+        vtkIdType p2 = pts[(j + 1) % N_pts];
+        if ((p1 == id_node1 && p2 == id_node2) || (p1 == id_node2 && p2 == id_node1)) {
+          return 4*i_cells + j;
+        }
+      }
+    }
+  }
+  return -1;
+}
+
+int MeshPartition::edgeCells(vtkIdType id_node1, vtkIdType id_node2, vtkIdType *id_cells, int max_cells)
+{
+  checkN2C();
+  int i_nodes1 = m_LNodes[id_node1];
+  int i_nodes2 = m_LNodes[id_node2];
+  if (i_nodes1 < 0 || i_nodes2 < 0) {
+    return 0;
+  }
+  int N = 0;
+  AdjacencyList::Row row2 = m_N2C[i_nodes2];
+  for (int k = 0; k < m_N2C.rowSize(i_nodes1); ++k) {
+    int i_cells = m_N2C.at(i_nodes1, k);
+    if (row2.contains(i_cells)) {
+      if (N < max_cells) {
+        id_cells[N] = m_Cells[i_cells];
+      }
+      ++N;
+    }
+  }
+  return N;
+}
+
+void MeshPartition::updateNodeNeighbourhood(const QVector<vtkIdType> &nodes)
+{
+  bool update_n2n   = isCurrentN2N();
+  bool update_n2bc  = isCurrentN2BC();
+  bool update_c2c   = isCurrentC2C();
+  bool update_twins = isCurrentTwins();
+  EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
+  QVector<int> cells;
+  foreach (vtkIdType id_node, nodes) {
+    int i_nodes = m_LNodes[id_node];
+    if (update_n2n) {
+      computeN2NRow(i_nodes);
+    }
+    if (update_n2bc) {
+      computeN2BCRow(i_nodes, cell_code);
+    }
+    if (update_c2c || update_twins) {
+      foreach (int i_cells, m_N2C[i_nodes]) {
+        cells.append(i_cells);
+      }
+    }
+  }
+  qSort(cells);
+  cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+  foreach (int i_cells, cells) {
+    computeC2CRow(i_cells);
+    if (update_twins) {
+      computeTwins(i_cells, m_Twin.data());
+    }
+  }
+}
+
+void MeshPartition::replaceCell(vtkIdType id_cell, vtkIdType N_pts, vtkIdType *pts)
+{
+  prepareLocalChange();
+  if (id_cell >= m_LCells.size() || m_LCells[id_cell] < 0) {
+    // the cell is not part of this partition
+    m_Grid->ReplaceCell(id_cell, N_pts, pts);
+    return;
+  }
+  int i_cells = m_LCells[id_cell];
+  vtkIdType N_old_pts, *old_pts;
+  m_Grid->GetCellPoints(id_cell, N_old_pts, old_pts);
+  QVector<vtkIdType> old_nodes(N_old_pts);
+  QVector<vtkIdType> new_nodes(N_pts);
+  for (int i = 0; i < N_old_pts; ++i) {
+    old_nodes[i] = old_pts[i];
+  }
+  for (int i = 0; i < N_pts; ++i) {
+    new_nodes[i] = pts[i];
+  }
+  m_Grid->ReplaceCell(id_cell, N_pts, pts);
+  foreach (vtkIdType id_node, new_nodes) {
+    addNode(id_node);
+  }
+  QVector<vtkIdType> nodes = old_nodes;
+  foreach (vtkIdType id_node, new_nodes) {
+    if (!old_nodes.contains(id_node)) {
+      nodes.append(id_node);
+    }
+  }
+  if (isCurrentN2C()) {
+    foreach (vtkIdType id_node, old_nodes) {
+      if (!new_nodes.contains(id_node)) {
+        removeFromRow(m_N2C, m_LNodes[id_node], i_cells);
+      }
+    }
+    foreach (vtkIdType id_node, new_nodes) {
+      if (!old_nodes.contains(id_node)) {
+        insertIntoRow(m_N2C, m_LNodes[id_node], i_cells);
+      }
+    }
+  }
+  updateNodeNeighbourhood(nodes);
+}
+
+void MeshPartition::addCell(vtkIdType id_cell)
+{
+  prepareLocalChange();
+  if (m_LCells.size() < m_Grid->GetNumberOfCells()) {
+    int N = m_LCells.size();
+    m_LCells.resize(m_Grid->GetNumberOfCells());
+    for (int i = N; i < m_LCells.size(); ++i) {
+      m_LCells[i] = -1;
+    }
+  }
+  if (m_LCells[id_cell] >= 0) {
+    return;
+  }
+  int i_cells = m_Cells.size();
+  m_Cells.append(id_cell);
+  m_LCells[id_cell] = i_cells;
+  vtkIdType N_pts, *pts;
+  m_Grid->GetCellPoints(id_cell, N_pts, pts);
+  QVector<vtkIdType> nodes(N_pts);
+  for (int i = 0; i < N_pts; ++i) {
+    nodes[i] = pts[i];
+    addNode(pts[i]);
+  }
+  if (isCurrentN2C()) {
+    foreach (vtkIdType id_node, nodes) {
+      insertIntoRow(m_N2C, m_LNodes[id_node], i_cells);
+    }
+  }
+  if (isCurrentC2C()) {
+    m_C2C.addRow();
+  }
+  if (isCurrentTwins()) {
+    m_Twin.resize(4*m_Cells.size());
+  }
+  updateNodeNeighbourhood(nodes);
+}
+
+void MeshPartition::removeCell(vtkIdType id_cell)
+{
+  prepareLocalChange();
+  if (id_cell >= m_LCells.size() || m_LCells[id_cell] < 0) {
+    return;
+  }
+  int i_cells = m_LCells[id_cell];
+  int i_last  = m_Cells.size() - 1;
+  vtkIdType id_last = m_Cells[i_last];
+  vtkIdType N_pts, *pts;
+  m_Grid->GetCellPoints(id_cell, N_pts, pts);
+  QVector<vtkIdType> nodes(N_pts);
+  for (int i = 0; i < N_pts; ++i) {
+    nodes[i] = pts[i];
+  }
+  if (isCurrentN2C()) {
+    foreach (vtkIdType id_node, nodes) {
+      removeFromRow(m_N2C, m_LNodes[id_node], i_cells);
+    }
+  }
+  updateNodeNeighbourhood(nodes);
+
+  // move the last cell into the gap
+  if (i_last != i_cells && isCurrentN2C()) {
+    m_Grid->GetCellPoints(id_last, N_pts, pts);
+    for (int i = 0; i < N_pts; ++i) {
+      removeFromRow(m_N2C, m_LNodes[pts[i]], i_last);
+      insertIntoRow(m_N2C, m_LNodes[pts[i]], i_cells);
+    }
+  }
+  if (isCurrentC2C()) {
+    m_C2C.swapRemoveRow(i_cells);
+    if (i_last != i_cells) {
+      for (int j = 0; j < m_C2C.rowSize(i_cells); ++j) {
+        int i_neigh = m_C2C.at(i_cells, j);
+        if (i_neigh >= 0) {
+          renumberInRow(m_C2C, i_neigh, i_last, i_cells);
+        }
+      }
+    }
+  }
+  if (isCurrentTwins()) {
+    if (i_last != i_cells) {
+      for (int j = 0; j < 4; ++j) {
+        int twin = m_Twin[4*i_last + j];
+        m_Twin[4*i_cells + j] = twin;
+        if (twin >= 0) {
+          m_Twin[twin] = 4*i_cells + j;
+        }
+      }
+    }
+    m_Twin.resize(4*i_last);
+  }
+  m_Cells[i_cells] = id_last;
+  m_LCells[id_last] = i_cells;
+  m_Cells.resize(i_last);
+  m_LCells[id_cell] = -1;
+}
+
+void MeshPartition::addNode(vtkIdType id_node)
+{
+  prepareLocalChange();
+  if (m_LNodes.size() < m_Grid->GetNumberOfPoints()) {
+    int N = m_LNodes.size();
+    m_LNodes.resize(m_Grid->GetNumberOfPoints());
+    for (int i = N; i < m_LNodes.size(); ++i) {
+      m_LNodes[i] = -1;
+    }
+  }
+  if (m_LNodes[id_node] >= 0) {
+    return;
+  }
+  m_LNodes[id_node] = m_Nodes.size();
+  m_Nodes.append(id_node);
+  if (isCurrentN2N()) {
+    m_N2N.addRow();
+  }
+  if (isCurrentN2BC()) {
+    m_N2BC.addRow();
+  }
+  if (isCurrentN2C()) {
+    m_N2C.addRow();
+  }
+}
+
+void MeshPartition::removeNode(vtkIdType id_node)
+{
+  prepareLocalChange();
+  if (id_node >= m_LNodes.size() || m_LNodes[id_node] < 0) {
+    return;
+  }
+  int i_nodes = m_LNodes[id_node];
+  if (isCurrentN2C() && m_N2C.rowSize(i_nodes) > 0) {
+    EG_BUG; // the node is still used by cells of this partition
+  }
+  int i_last = m_Nodes.size() - 1;
+  vtkIdType id_last = m_Nodes[i_last];
+  if (isCurrentN2N()) {
+    m_N2N.swapRemoveRow(i_nodes);
+    if (i_last != i_nodes) {
+      QVector<int> neigh = m_N2N[i_nodes];
+      foreach (int j, neigh) {
+        removeFromRow(m_N2N, j, i_last);
+        insertIntoRow(m_N2N, j, i_nodes);
+      }
+    }
+  }
+  if (isCurrentN2BC()) {
+    m_N2BC.swapRemoveRow(i_nodes);
+  }
+  if (isCurrentN2C()) {
+    m_N2C.swapRemoveRow(i_nodes);
+  }
+  m_Nodes[i_nodes] = id_last;
+  m_LNodes[id_last] = i_nodes;
+  m_Nodes.resize(i_last);
+  m_LNodes[id_node] = -1;
+}
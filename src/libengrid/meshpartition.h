@@ -39,10 +39,11 @@ private: // attributes
   QVector<int>           m_LCells; ///< inverse indexing for the cells
   QVector<vtkIdType>     m_Nodes;  ///< all nodes of the mesh partition
   QVector<int>           m_LNodes; ///< inverse indexing for the nodes
-  QVector<QVector<int> > m_N2C;    ///< node to cell information
-  QVector<QVector<int> > m_N2BC;   ///< node to boundary code information
-  QVector<QVector<int> > m_N2N;    ///< node to node information
-  QVector<QVector<int> > m_C2C;    ///< cell to cell information
+  AdjacencyList          m_N2C;    ///< node to cell information
+  AdjacencyList          m_N2BC;   ///< node to boundary code information
+  AdjacencyList          m_N2N;    ///< node to node information
+  AdjacencyList          m_C2C;    ///< cell to cell information
+  QVector<int>           m_Twin;   ///< half-edge twins of the surface cells (see twinHalfEdge)
 
   int m_CellsStamp;  ///< "time"-stamp
   int m_LCellsStamp; ///< "time"-stamp
@@ -52,6 +53,7 @@ private: // attributes
   int m_N2CStamp;    ///< "time"-stamp
   int m_N2BCStamp;   ///< "time"-stamp
   int m_C2CStamp;    ///< "time"-stamp
+  int m_TwinStamp;   ///< "time"-stamp
 
 private: // methods
 
@@ -65,6 +67,24 @@ private: // methods
   void checkN2C();
   void checkN2BC();
   void checkC2C();
+  void checkTwins();
+
+  bool isCurrentN2N()  { return m_N2NStamp >= m_LNodesStamp; }
+  bool isCurrentN2C()  { return m_N2CStamp >= m_LNodesStamp; }
+  bool isCurrentN2BC() { return isCurrentN2C() && m_N2BCStamp >= m_N2CStamp; }
+  bool isCurrentC2C()  { return m_C2CStamp >= m_CellsStamp; }
+  bool isCurrentTwins() { return isCurrentN2C() && m_TwinStamp >= m_N2CStamp; }
+
+  void prepareLocalChange();
+  void insertIntoRow(AdjacencyList &list, int i, int item);
+  void removeFromRow(AdjacencyList &list, int i, int item);
+  void renumberInRow(AdjacencyList &list, int i, int old_item, int new_item);
+  void computeN2NRow(int i_nodes);
+  void computeN2BCRow(int i_nodes, vtkIntArray *cell_code);
+  void computeC2CRow(int i_cells);
+  void computeTwins(int i_cells, int *twins);
+  void createTwins();
+  void updateNodeNeighbourhood(const QVector<vtkIdType> &nodes);
 
 public: // methods
 
@@ -139,9 +159,9 @@ public: // methods
   const QVector<int>&           getLocalCells();  ///< Access to the local cell indices
   const QVector<vtkIdType>&     getNodes();       ///< Access to the node indices
   const QVector<int>&           getLocalNodes();  ///< Access to the local node indices
-  const QVector<QVector<int> >& getN2N();         ///< Access to the local node to node structure
-  const QVector<QVector<int> >& getN2C();         ///< Access to the local node to cell structure
-  const QVector<QVector<int> >& getC2C();         ///< Access to the local cell to cell structure
+  const AdjacencyList&          getN2N();         ///< Access to the local node to node structure
+  const AdjacencyList&          getN2C();         ///< Access to the local node to cell structure
+  const AdjacencyList&          getC2C();         ///< Access to the local cell to cell structure
 
   void setVolumeOrientation();   ///< change the face orientation to match the volume definition
   void setOriginalOrientation(); ///< change the orientation to match the original orientation
@@ -222,6 +242,92 @@ public: // methods
   bool hasNeighNode(vtkIdType id_node, vtkIdType id_neigh);
   bool hasBC(vtkIdType id_node, int bc);
 
+  /**
+   * Get the twin of a half-edge of a surface cell.
+   * Half-edge j of a cell goes from node j to node j+1 of the cell and it is encoded as 4*i_cells + j.
+   * The twin table is built from the surface cells on first use and kept up to date by
+   * replaceCell, addCell and removeCell.
+   * @param i_cells the local index of the cell
+   * @param j the side of the cell
+   * @return the twin half-edge, -1 for a boundary edge, or -2 for an edge with more than two surface cells
+   */
+  int twinHalfEdge(int i_cells, int j);
+
+  /**
+   * Find a half-edge of a surface cell which connects two nodes (in either direction).
+   * This only scans the cells around id_node1 and does not allocate memory.
+   * @return the half-edge (4*i_cells + j) or -1 if there is no such edge
+   */
+  int findHalfEdge(vtkIdType id_node1, vtkIdType id_node2);
+
+  /// check if two nodes are connected by an edge of a surface cell
+  bool isEdge(vtkIdType id_node1, vtkIdType id_node2) { return findHalfEdge(id_node1, id_node2) != -1; }
+
+  /**
+   * Get the cells of the partition around an edge without allocating memory.
+   * @param id_node1 first node of the edge
+   * @param id_node2 second node of the edge
+   * @param id_cells on return this will hold the first max_cells cells around the edge
+   * @param max_cells the capacity of id_cells
+   * @return the total number of cells around the edge (can be larger than max_cells)
+   */
+  int edgeCells(vtkIdType id_node1, vtkIdType id_node2, vtkIdType *id_cells, int max_cells);
+
+  /**
+   * Build all connectivity information which is not up to date.
+   * Afterwards the query methods only read data and can be called from several threads,
+   * as long as the partition is not modified.
+   */
+  void prepareParallelAccess();
+
+  /**
+   * Replace the nodes of a cell and update the connectivity locally.
+   * This calls vtkUnstructuredGrid::ReplaceCell for the underlying grid.
+   * Only the rows of the cell's old and new nodes (and of their cells) are touched.
+   * Nodes which are not part of the partition yet will be added.
+   * @param id_cell the cell to change
+   * @param N_pts the number of nodes of the cell (must not change)
+   * @param pts the new nodes of the cell
+   */
+  void replaceCell(vtkIdType id_cell, vtkIdType N_pts, vtkIdType *pts);
+
+  /**
+   * Add an existing cell of the grid to the partition and update the connectivity locally.
+   * Nodes which are not part of the partition yet will be added.
+   * @param id_cell the cell to add
+   */
+  void addCell(vtkIdType id_cell);
+
+  /**
+   * Remove a cell from the partition (not from the grid) and update the connectivity locally.
+   * The last cell of the partition takes the local index of the removed cell.
+   * Nodes which are not used any more will stay in the partition (see removeNode).
+   * @param id_cell the cell to remove
+   */
+  void removeCell(vtkIdType id_cell);
+
+  /**
+   * Add a node of the grid to the partition (e.g. after vtkPoints::InsertNextPoint).
+   * The node gets empty connectivity rows until cells using it are added.
+   * @param id_node the node to add
+   */
+  void addNode(vtkIdType id_node);
+
+  /**
+   * Remove a node from the partition (not from the grid).
+   * The node must not be used by any cell of the partition.
+   * The last node of the partition takes the local index of the removed node.
+   * @param id_node the node to remove
+   */
+  void removeNode(vtkIdType id_node);
+
+  /**
+   * Exchange the contents (including the connectivity) with another partition.
+   * Nothing is copied; this can be used to hand a partition over to an operation and to take it back.
+   * @param part the other partition
+   */
+  void swap(MeshPartition &part);
+
 };
 
 
@@ -340,6 +446,33 @@ inline void MeshPartition::checkC2C()
   }
 }
 
+inline void MeshPartition::checkTwins()
+{
+  checkN2C();
+  checkLCells();
+  if (m_N2CStamp > m_TwinStamp) {
+    createTwins();
+    m_TwinStamp = m_N2CStamp;
+  }
+}
+
+inline void MeshPartition::prepareParallelAccess()
+{
+  checkLCells();
+  checkLNodes();
+  checkN2C();
+  checkN2N();
+  checkN2BC();
+  checkC2C();
+  checkTwins();
+}
+
+inline int MeshPartition::twinHalfEdge(int i_cells, int j)
+{
+  checkTwins();
+  return m_Twin[4*i_cells + j];
+}
+
 inline const QVector<vtkIdType>& MeshPartition::getCells() const
 {
   return m_Cells;
@@ -363,19 +496,19 @@ inline const QVector<int>& MeshPartition::getLocalNodes()
   return m_LNodes;
 }
 
-inline const QVector<QVector<int> >& MeshPartition::getN2N()
+inline const AdjacencyList& MeshPartition::getN2N()
 {
   checkN2N();
   return m_N2N;
 }
 
-inline const QVector<QVector<int> >& MeshPartition::getN2C()
+inline const AdjacencyList& MeshPartition::getN2C()
 {
   checkN2C();
   return m_N2C;
 }
 
-inline const QVector<QVector<int> >& MeshPartition::getC2C()
+inline const AdjacencyList& MeshPartition::getC2C()
 {
   checkC2C();
   return m_C2C;
@@ -384,55 +517,55 @@ inline const QVector<QVector<int> >& MeshPartition::getC2C()
 inline int MeshPartition::n2nLSize(int i_nodes)
 {
   checkN2N();
-  return m_N2N[i_nodes].size();
+  return m_N2N.rowSize(i_nodes);
 }
 
 inline int MeshPartition::n2nLL(int i_nodes, int j)
 {
   checkN2N();
-  return m_N2N[i_nodes][j];
+  return m_N2N.at(i_nodes, j);
 }
 
 inline vtkIdType MeshPartition::n2nLG(int i_nodes, int j)
 {
   checkN2N();
-  return m_Nodes[m_N2N[i_nodes][j]];
+  return m_Nodes[m_N2N.at(i_nodes, j)];
 }
 
 inline int MeshPartition::n2nGSize(vtkIdType id_node)
 {
   checkN2N();
-  return m_N2N[m_LNodes[id_node]].size();
+  return m_N2N.rowSize(m_LNodes[id_node]);
 }
 
 inline int MeshPartition::n2nGL(vtkIdType id_node, int j)
 {
   checkN2N();
-  return m_N2N[m_LNodes[id_node]][j];
+  return m_N2N.at(m_LNodes[id_node], j);
 }
 
 inline vtkIdType MeshPartition::n2nGG(vtkIdType id_node, int j)
 {
   checkN2N();
-  return m_Nodes[m_N2N[m_LNodes[id_node]][j]];
+  return m_Nodes[m_N2N.at(m_LNodes[id_node], j)];
 }
 
 inline int MeshPartition::n2cLSize(int i_nodes)
 {
   checkN2C();
-  return m_N2C[i_nodes].size();
+  return m_N2C.rowSize(i_nodes);
 }
 
 inline int MeshPartition::n2cLL(int i_nodes, int j)
 {
   checkN2C();
-  return m_N2C[i_nodes][j];
+  return m_N2C.at(i_nodes, j);
 }
 
 inline vtkIdType MeshPartition::n2cLG(int i_nodes, int j)
 {
   checkN2C();
-  int i_cell = m_N2C[i_nodes][j];
+  int i_cell = m_N2C.at(i_nodes, j);
   if(i_cell<0) return(-1);
   else return m_Cells[i_cell];
 }
@@ -440,19 +573,19 @@ inline vtkIdType MeshPartition::n2cLG(int i_nodes, int j)
 inline int MeshPartition::n2cGSize(vtkIdType id_node)
 {
   checkN2C();
-  return m_N2C[m_LNodes[id_node]].size();
+  return m_N2C.rowSize(m_LNodes[id_node]);
 }
 
 inline int MeshPartition::n2cGL(vtkIdType id_node, int j)
 {
   checkN2C();
-  return m_N2C[m_LNodes[id_node]][j];
+  return m_N2C.at(m_LNodes[id_node], j);
 }
 
 inline vtkIdType MeshPartition::n2cGG(vtkIdType id_node, int j)
 {
   checkN2C();
-  int i_cell = m_N2C[m_LNodes[id_node]][j];
+  int i_cell = m_N2C.at(m_LNodes[id_node], j);
   if(i_cell<0) return(-1);
   else return m_Cells[i_cell];
 }
@@ -460,19 +593,19 @@ inline vtkIdType MeshPartition::n2cGG(vtkIdType id_node, int j)
 inline int MeshPartition::c2cLSize(int i_cells)
 {
   checkC2C();
-  return m_C2C[i_cells].size();
+  return m_C2C.rowSize(i_cells);
 }
 
 inline int MeshPartition::c2cLL(int i_cells, int j)
 {
   checkC2C();
-  return m_C2C[i_cells][j];
+  return m_C2C.at(i_cells, j);
 }
 
 inline vtkIdType MeshPartition::c2cLG(int i_cells, int j)
 {
   checkC2C();
-  int i_cell = m_C2C[i_cells][j];
+  int i_cell = m_C2C.at(i_cells, j);
   if(i_cell<0) return(-1);
   else return m_Cells[i_cell];
 }
@@ -481,21 +614,21 @@ inline int MeshPartition::c2cGSize(vtkIdType id_cell)
 {
   checkC2C();
   checkLCells();
-  return m_C2C[m_LCells[id_cell]].size();
+  return m_C2C.rowSize(m_LCells[id_cell]);
 }
 
 inline int MeshPartition::c2cGL(vtkIdType id_cell, int j)
 {
   checkC2C();
   checkLCells();
-  return m_C2C[m_LCells[id_cell]][j];
+  return m_C2C.at(m_LCells[id_cell], j);
 }
 
 inline vtkIdType MeshPartition::c2cGG(vtkIdType id_cell, int j)
 {
   checkC2C();
   checkLCells();
-  int i_cell = m_C2C[m_LCells[id_cell]][j];
+  int i_cell = m_C2C.at(m_LCells[id_cell], j);
   if(i_cell<0) return(-1);
   else return m_Cells[i_cell];
 }
@@ -538,25 +671,25 @@ inline vtkIdType MeshPartition::globalCell(int i)
 inline int MeshPartition::n2bcLSize(int i_nodes)
 {
   checkN2BC();
-  return m_N2BC[i_nodes].size();
+  return m_N2BC.rowSize(i_nodes);
 }
 
 inline int MeshPartition::n2bcL(int i_nodes, int j)
 {
   checkN2BC();
-  return m_N2BC[i_nodes][j];
+  return m_N2BC.at(i_nodes, j);
 }
 
 inline int MeshPartition::n2bcGSize(vtkIdType id_node)
 {
   checkN2BC();
-  return m_N2BC[m_LNodes[id_node]].size();
+  return m_N2BC.rowSize(m_LNodes[id_node]);
 }
 
 inline int MeshPartition::n2bcG(vtkIdType id_node, int j)
 {
   checkN2BC();
-  return m_N2BC[m_LNodes[id_node]][j];
+  return m_N2BC.at(m_LNodes[id_node], j);
 }
 
 #endif // MESHPARTITION_H
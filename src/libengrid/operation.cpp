@@ -185,8 +185,7 @@ void Operation::setVolume(QString volume_name)
 
 void Operation::setMeshPartition(const MeshPartition &part)
 {
-  m_Part.setGrid(part.getGrid());
-  m_Part.setCells(part.getCells());
+  m_Part = part;
   m_Grid = m_Part.getGrid();
 }
 
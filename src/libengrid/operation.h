@@ -29,6 +29,7 @@ class GuiMainWindow;
 #include "egvtkobject.h"
 #include "vertexmeshdensity.h"
 #include "meshpartition.h"
+#include "gridfields.h"
 #include "timer.h"
 
 #include <vtkUnstructuredGrid.h>
@@ -100,6 +101,7 @@ protected: // attributes
   vtkUnstructuredGrid* m_Grid;     ///< The main grid the operation operates on.
   vtkUnstructuredGrid* m_RestGrid; ///< The remainder grid (not part of the selected volume)
   MeshPartition        m_Part;     ///< the partition containing the subset of cells and nodes
+  GridFields           m_Fields;   ///< typed views of the standard fields of m_Grid (use fields() to access)
   Timer                m_Timer;    ///< Timer object for periodic output
   QString              m_MenuText; ///< The menu entry (mainly for plugins)
 
@@ -126,6 +128,9 @@ protected: // methods
   l2l_t getPartN2C()         { return m_Part.getN2C(); }
   l2l_t getPartC2C()         { return m_Part.getC2C(); }
 
+  /// typed views of the standard fields of m_Grid; get them outside of the inner loops
+  GridFields& fields() { m_Fields.setGrid(m_Grid); return m_Fields; }
+
 public: // methods
   
   Operation();
@@ -138,7 +143,8 @@ public: // methods
   void setAllSurfaceCells();
   void setVolume(QString volume_name);
   template <class T> void setCells(const T &cls);
-  void setMeshPartition(const MeshPartition &part);
+  void setMeshPartition(const MeshPartition &part); ///< use a copy of part (including its connectivity)
+  const MeshPartition& getMeshPartition() const { return m_Part; }
 
   void setLockGui() { lock_gui = true; }
   OperationThread& getThread() { return thread; }
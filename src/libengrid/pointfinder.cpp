@@ -40,6 +40,8 @@ void PointFinder::setGrid(vtkUnstructuredGrid *grid)
 void PointFinder::setPoints(const QVector<vec3_t> &points)
 {
   m_Points = points;
+  vec3_t x_octree;
+  double dx_octree;
   {
     vec3_t x1(1e99, 1e99, 1e99);
     vec3_t x2(-1e99, -1e99, -1e99);
@@ -72,101 +74,78 @@ void PointFinder::setPoints(const QVector<vec3_t> &points)
     if (Dx2.abs() > Dx1.abs()) {
       Dx = Dx2;
     }
-    x1 = xc - 2*Dx;
-    x2 = xc + 2*Dx;
-    m_Octree.setBounds(x1, x2);
+    x_octree  = xc - 2*Dx;
+    dx_octree = 4*Dx[0];
     m_MinSize = 0.0001*Dx[0];
   }
-  m_Buckets.resize(1);
-  for (int i_points = 0; i_points < points.size(); ++i_points) {
-    m_Buckets[0].append(i_points);
+  QVector<int> points(m_Points.size());
+  for (int i_points = 0; i_points < m_Points.size(); ++i_points) {
+    points[i_points] = i_points;
   }
-  int N;
-  do {
-    N = refine();
-  } while (N > 0);
+  split_t split;
+  split.points     = m_Points.constData();
+  split.max_points = m_MaxPoints;
+  split.min_size   = m_MinSize;
+  m_Octree.build(x_octree, dx_octree, points, split);
   m_MaxBucketSize = 0;
-  m_MinBucketSize = points.size();
-  for (int i = 0; i < m_Buckets.size(); ++i) {
-    m_MinBucketSize = min(m_MinBucketSize, m_Buckets[i].size());
-    m_MaxBucketSize = max(m_MaxBucketSize, m_Buckets[i].size());
+  m_MinBucketSize = m_Points.size();
+  for (int cell = 0; cell < m_Octree.numNodes(); ++cell) {
+    m_MinBucketSize = min(m_MinBucketSize, m_Octree.bucketSize(cell));
+    m_MaxBucketSize = max(m_MaxBucketSize, m_Octree.bucketSize(cell));
   }
 }
 
-int PointFinder::refine()
+bool PointFinder::split_t::contains(vec3_t x1, double dx, int point) const
 {
-  int N = m_Octree.getNumCells();
-  m_Octree.setSmoothTransitionOff();
-  int N_new = 0;
-  m_Octree.resetRefineMarks();
-  for (int cell = 0; cell < m_Octree.getNumCells(); ++cell) {
-    double dx = m_Octree.getDx(cell);
-    if (!m_Octree.hasChildren(cell) && m_Buckets[cell].size() > m_MaxPoints  && dx > 2*m_MinSize) {
-      m_Octree.markToRefine(cell);
-      ++N_new;
+  vec3_t xc = x1 + vec3_t(0.5*dx, 0.5*dx, 0.5*dx);
+  const vec3_t &x = points[point];
+  for (int i = 0; i < 3; ++i) {
+    if (x[i] < xc[i] - 1.5*dx || x[i] > xc[i] + 1.5*dx) {
+      return false;
     }
   }
-  int N_mrk = 0;
-  for (int cell = 0; cell < m_Octree.getNumCells(); ++cell) {
-    if (m_Octree.markedForRefine(cell)) {
-      ++N_mrk;
-    }
-  }
-  N_new *= 8;
-  m_Octree.refineAll();
-  if (m_Octree.getNumCells() != N + N_new) {
-    EG_BUG;
-  }
-  m_Buckets.insert(N, N_new, QList<int>());
-  for (int cell = N; cell < m_Octree.getNumCells(); ++cell) {
-    m_Timer << "  " << m_Octree.getNumCells() << " octree cells" << Timer::endl;
-    if (m_Octree.getNumCells() != N + N_new) {
-      EG_BUG;
-    }
-    int parent = m_Octree.getParent(cell);
-    if (parent < 0) {
-      EG_BUG;
-    }
-    foreach (int i_points, m_Buckets[parent]) {
-      vec3_t xcell = m_Octree.getCellCentre(cell);
-      vec3_t x = m_Points[i_points];
-      bool append = true;
-      {
-        double Dx = m_Octree.getDx(cell);
-        double Dy = m_Octree.getDy(cell);
-        double Dz = m_Octree.getDz(cell);
-        if      (x[0] < xcell[0] - 1.5*Dx || x[0] > xcell[0] + 1.5*Dx) append = false;
-        else if (x[1] < xcell[1] - 1.5*Dy || x[1] > xcell[1] + 1.5*Dy) append = false;
-        else if (x[2] < xcell[2] - 1.5*Dz || x[2] > xcell[2] + 1.5*Dz) append = false;
-      }
-      if (append) {
-        m_Buckets[cell].append(i_points);
-      }
-    }
-  }
-  return N_new;
+  return true;
 }
 
 void PointFinder::getClosePoints(vec3_t x, QVector<int> &points, double dist)
 {
-  int cell = m_Octree.findCell(x);
+  int cell = m_Octree.findLeaf(x);
   if (cell < 0) {
     EG_BUG;
   }
-  if (m_Octree.hasChildren(cell)) {
-    EG_BUG;
-  }
-  while ((m_Buckets[cell].size() == 0  || dist > m_Octree.getDx(cell)) && m_Octree.getParent(cell) >= 0) {
-    cell = m_Octree.getParent(cell);
+  while ((m_Octree.bucketSize(cell) == 0  || dist > m_Octree.node(cell).dx) && m_Octree.parent(cell) >= 0) {
+    cell = m_Octree.parent(cell);
   }
-  points.resize(m_Buckets[cell].size());
-  qCopy(m_Buckets[cell].begin(), m_Buckets[cell].end(), points.begin());
-
+  points.resize(m_Octree.bucketSize(cell));
+  qCopy(m_Octree.bucket(cell), m_Octree.bucket(cell) + m_Octree.bucketSize(cell), points.begin());
 }
 
 void PointFinder::writeOctreeMesh(QString file_name)
 {
+  int N_leaves = 0;
+  for (int cell = 0; cell < m_Octree.numNodes(); ++cell) {
+    if (m_Octree.isLeaf(cell)) {
+      ++N_leaves;
+    }
+  }
   EG_VTKSP(vtkUnstructuredGrid, otg);
-  m_Octree.toVtkGrid(otg);
+  allocateGrid(otg, N_leaves, 8*N_leaves);
+  vtkIdType id_node = 0;
+  for (int cell = 0; cell < m_Octree.numNodes(); ++cell) {
+    if (m_Octree.isLeaf(cell)) {
+      const BucketOctree::node_t &node = m_Octree.node(cell);
+      vtkIdType pts[8];
+      for (int i = 0; i < 8; ++i) {
+        vec3_t x = node.x1;
+        if (i == 1 || i == 2 || i == 5 || i == 6) x[0] += node.dx;
+        if (i == 2 || i == 3 || i == 6 || i == 7) x[1] += node.dx;
+        if (i >= 4)                               x[2] += node.dx;
+        otg->GetPoints()->SetPoint(id_node, x.data());
+        pts[i] = id_node;
+        ++id_node;
+      }
+      otg->InsertNextCell(VTK_HEXAHEDRON, 8, pts);
+    }
+  }
   writeGrid(otg, file_name);
 }
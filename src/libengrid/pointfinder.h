@@ -23,9 +23,8 @@
 #ifndef POINTFINDER_H
 #define POINTFINDER_H
 
-#include "octree.h"
+#include "bucketoctree.h"
 #include "triangle.h"
-#include "timer.h"
 
 #include <QVector>
 #include <QList>
@@ -33,19 +32,26 @@
 class PointFinder : public EgVtkObject
 {
 
-  Octree               m_Octree;
+  BucketOctree         m_Octree;
   QVector<vec3_t>      m_Points;
   double               m_MinSize;
   int                  m_MaxPoints;
-  Timer                m_Timer;
-  QVector<QList<int> > m_Buckets;
   int                  m_MinBucketSize;
   int                  m_MaxBucketSize;
 
 
-private: // methods
+private: // data-types
 
-  int refine();
+  /// splitting rule for the octree (see BucketOctree)
+  struct split_t
+  {
+    const vec3_t *points;
+    int           max_points;
+    double        min_size;
+
+    bool refine(double dx, const int*, int num) const { return num > max_points && dx > 2*min_size; }
+    bool contains(vec3_t x1, double dx, int point) const;
+  };
 
 
 public: // methods
@@ -0,0 +1,485 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#include "quadricedgecollapse.h"
+
+#include "geometrytools.h"
+using namespace GeometryTools;
+
+#include <queue>
+
+QuadricEdgeCollapse::quadric_t::quadric_t()
+{
+  for (int i = 0; i < 10; ++i) {
+    a[i] = 0;
+  }
+}
+
+void QuadricEdgeCollapse::quadric_t::addPlane(vec3_t n, vec3_t x)
+{
+  double p[4] = {n[0], n[1], n[2], -(n*x)};
+  int k = 0;
+  for (int i = 0; i < 4; ++i) {
+    for (int j = i; j < 4; ++j) {
+      a[k] += p[i]*p[j];
+      ++k;
+    }
+  }
+}
+
+void QuadricEdgeCollapse::quadric_t::operator+=(const quadric_t &q)
+{
+  for (int i = 0; i < 10; ++i) {
+    a[i] += q.a[i];
+  }
+}
+
+double QuadricEdgeCollapse::quadric_t::error(vec3_t x) const
+{
+  double v[4] = {x[0], x[1], x[2], 1.0};
+  double e = 0;
+  int k = 0;
+  for (int i = 0; i < 4; ++i) {
+    for (int j = i; j < 4; ++j) {
+      if (i == j) {
+        e += a[k]*v[i]*v[j];
+      } else {
+        e += 2*a[k]*v[i]*v[j];
+      }
+      ++k;
+    }
+  }
+  return e;
+}
+
+QuadricEdgeCollapse::QuadricEdgeCollapse() : SurfaceOperation()
+{
+  EG_TYPENAME;
+  setQuickSave(true);
+  getSet("surface meshing", "maximal relative error for edge collapse", 0.25, m_MaxRelativeError);
+  m_MaxAngle = deg2rad(45);
+  m_NumRemoved = 0;
+}
+
+void QuadricEdgeCollapse::fixNodes(const QVector<bool> &fixnodes)
+{
+  if (fixnodes.size() != m_Grid->GetNumberOfPoints()) {
+    EG_BUG;
+  }
+  m_Fixed = fixnodes;
+}
+
+void QuadricEdgeCollapse::buildStructures()
+{
+  setAllSurfaceCells();
+  UpdatePotentialSnapPoints(false);
+
+  EG_VTKDCN(vtkCharArray,   node_type, m_Grid, "node_type");
+  EG_VTKDCC(vtkIntArray,    cell_code, m_Grid, "cell_code");
+  EG_VTKDCN(vtkDoubleArray, characteristic_length_desired, m_Grid, "node_meshdensity_desired");
+
+  int N_nodes = m_Grid->GetNumberOfPoints();
+  m_X.resize(N_nodes);
+  m_CL.resize(N_nodes);
+  m_NodeType.resize(N_nodes);
+  m_Removable.resize(N_nodes);
+  m_Removed.fill(false, N_nodes);
+  m_Q.fill(quadric_t(), N_nodes);
+  m_Cost.fill(-1, N_nodes);
+  m_PSP.fill(QVector<vtkIdType>(), N_nodes);
+  m_FixedN2N.fill(QVector<vtkIdType>(), N_nodes);
+  m_N2T.fill(QVector<int>(), N_nodes);
+  for (vtkIdType id_node = 0; id_node < N_nodes; ++id_node) {
+    m_Grid->GetPoint(id_node, m_X[id_node].data());
+    m_CL[id_node] = characteristic_length_desired->GetValue(id_node);
+    m_NodeType[id_node] = node_type->GetValue(id_node);
+    m_Removable[id_node] = !m_Fixed[id_node] && m_NodeType[id_node] != VTK_FIXED_VERTEX;
+    if (id_node < m_PotentialSnapPoints.size()) {
+      m_PSP[id_node] = m_PotentialSnapPoints[id_node];
+    }
+  }
+
+  // selected triangles and their quadrics; the nodes of all other cells stay where they are
+  m_Tri.clear();
+  m_TriCell.clear();
+  m_CellTri.fill(-1, m_Grid->GetNumberOfCells());
+  for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
+    vtkIdType N_pts, *pts;
+    m_Grid->GetCellPoints(id_cell, N_pts, pts);
+    if (m_Grid->GetCellType(id_cell) == VTK_TRIANGLE && m_BoundaryCodes.contains(cell_code->GetValue(id_cell))) {
+      int i_tri = m_TriCell.size();
+      m_TriCell.append(id_cell);
+      m_CellTri[id_cell] = i_tri;
+      for (int i = 0; i < 3; ++i) {
+        m_Tri.append(pts[i]);
+        m_N2T[pts[i]].append(i_tri);
+      }
+      vec3_t n = triNormal(m_X[pts[0]], m_X[pts[1]], m_X[pts[2]]);
+      if (n.abs() > 0) {
+        n.normalise();
+        for (int i = 0; i < 3; ++i) {
+          m_Q[pts[i]].addPlane(n, m_X[pts[0]]);
+        }
+      }
+    } else {
+      bool surface = isSurface(id_cell, m_Grid);
+      for (int i = 0; i < N_pts; ++i) {
+        m_Removable[pts[i]] = false;
+        for (int j = 0; j < N_pts; ++j) {
+          bool neighbour = j != i;
+          if (surface) {
+            neighbour = j == (i + 1) % N_pts || j == (i + N_pts - 1) % N_pts;
+          }
+          if (neighbour && !m_FixedN2N[pts[i]].contains(pts[j])) {
+            m_FixedN2N[pts[i]].append(pts[j]);
+          }
+        }
+      }
+    }
+  }
+  m_TriAlive.fill(true, m_TriCell.size());
+}
+
+void QuadricEdgeCollapse::getNeighbours(vtkIdType id_node, QVector<vtkIdType> &neighbours)
+{
+  neighbours.clear();
+  foreach (int i_tri, m_N2T[id_node]) {
+    for (int i = 0; i < 3; ++i) {
+      vtkIdType id_neigh = m_Tri[3*i_tri + i];
+      if (id_neigh != id_node && !neighbours.contains(id_neigh)) {
+        neighbours.append(id_neigh);
+      }
+    }
+  }
+  foreach (vtkIdType id_neigh, m_FixedN2N[id_node]) {
+    if (!neighbours.contains(id_neigh)) {
+      neighbours.append(id_neigh);
+    }
+  }
+}
+
+bool QuadricEdgeCollapse::checkCollapse(vtkIdType id_node1, vtkIdType id_node2, double &cost)
+{
+  // the third nodes of the triangles around the edge
+  QVector<vtkIdType> opposite;
+  foreach (int i_tri, m_N2T[id_node1]) {
+    bool edge_tri = false;
+    vtkIdType id_third = -1;
+    for (int i = 0; i < 3; ++i) {
+      vtkIdType id_node = m_Tri[3*i_tri + i];
+      if (id_node == id_node2) {
+        edge_tri = true;
+      } else if (id_node != id_node1) {
+        id_third = id_node;
+      }
+    }
+    if (edge_tri) {
+      opposite.append(id_third);
+    }
+  }
+  if (opposite.size() == 0 || opposite.size() > 2) {
+    return false;
+  }
+
+  // topology: the common neighbours have to be the third nodes and every node keeps at least three neighbours
+  QVector<vtkIdType> neighbours1;
+  QVector<vtkIdType> neighbours2;
+  getNeighbours(id_node1, neighbours1);
+  getNeighbours(id_node2, neighbours2);
+  int N_common = 0;
+  foreach (vtkIdType id_node, neighbours1) {
+    if (neighbours2.contains(id_node)) {
+      if (!opposite.contains(id_node)) {
+        return false;
+      }
+      ++N_common;
+    }
+  }
+  if (N_common != opposite.size()) {
+    return false;
+  }
+  if (neighbours1.size() + neighbours2.size() - 2 - N_common < 3) {
+    return false;
+  }
+  foreach (vtkIdType id_node, opposite) {
+    QVector<vtkIdType> neighbours;
+    getNeighbours(id_node, neighbours);
+    if (neighbours.size() < 4) {
+      return false;
+    }
+  }
+
+  // desired edge length
+  double cl = min(m_CL[id_node1], m_CL[id_node2]);
+  foreach (vtkIdType id_node, neighbours1) {
+    if (id_node != id_node2) {
+      double L = (m_X[id_node2] - m_X[id_node]).abs();
+      if (L > min(cl, m_CL[id_node])) {
+        return false;
+      }
+    }
+  }
+
+  // quadric error
+  quadric_t Q = m_Q[id_node1];
+  Q += m_Q[id_node2];
+  cost = max(0.0, Q.error(m_X[id_node2]));
+  double e_max = m_MaxRelativeError*cl;
+  if (cost > e_max*e_max) {
+    return false;
+  }
+
+  // the remaining triangles of id_node1 must not turn too much
+  double cos_max = cos(m_MaxAngle);
+  foreach (int i_tri, m_N2T[id_node1]) {
+    vec3_t x_old[3];
+    vec3_t x_new[3];
+    bool edge_tri = false;
+    for (int i = 0; i < 3; ++i) {
+      vtkIdType id_node = m_Tri[3*i_tri + i];
+      if (id_node == id_node2) {
+        edge_tri = true;
+      }
+      x_old[i] = m_X[id_node];
+      x_new[i] = x_old[i];
+      if (id_node == id_node1) {
+        x_new[i] = m_X[id_node2];
+      }
+    }
+    if (!edge_tri) {
+      vec3_t n_old = triNormal(x_old[0], x_old[1], x_old[2]);
+      vec3_t n_new = triNormal(x_new[0], x_new[1], x_new[2]);
+      double A_old = n_old.abs();
+      double A_new = n_new.abs();
+      if (A_new <= 0) {
+        return false;
+      }
+      if (A_old > 0 && n_old*n_new < cos_max*A_old*A_new) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+vtkIdType QuadricEdgeCollapse::bestCollapse(vtkIdType id_node, double &cost)
+{
+  vtkIdType id_best = -1;
+  cost = -1;
+  if (!m_Removable[id_node] || m_Removed[id_node]) {
+    return -1;
+  }
+  foreach (vtkIdType id_snap, m_PSP[id_node]) {
+    double c;
+    if (!m_Removed[id_snap] && checkCollapse(id_node, id_snap, c)) {
+      if (id_best == -1 || c < cost) {
+        id_best = id_snap;
+        cost = c;
+      }
+    }
+  }
+  return id_best;
+}
+
+void QuadricEdgeCollapse::replaceSnapPoint(vtkIdType id_node, vtkIdType id_old, vtkIdType id_new)
+{
+  int i = m_PSP[id_node].indexOf(id_old);
+  if (i >= 0) {
+    m_PSP[id_node].remove(i);
+    if (id_new != id_node && !m_PSP[id_node].contains(id_new)) {
+      m_PSP[id_node].append(id_new);
+    }
+  }
+}
+
+void QuadricEdgeCollapse::collapse(vtkIdType id_node1, vtkIdType id_node2)
+{
+  QVector<vtkIdType> neighbours;
+  getNeighbours(id_node1, neighbours);
+
+  // the triangles around the edge disappear, all other triangles of id_node1 are attached to id_node2
+  foreach (int i_tri, m_N2T[id_node1]) {
+    bool edge_tri = false;
+    for (int i = 0; i < 3; ++i) {
+      if (m_Tri[3*i_tri + i] == id_node2) {
+        edge_tri = true;
+      }
+    }
+    if (edge_tri) {
+      m_TriAlive[i_tri] = false;
+      for (int i = 0; i < 3; ++i) {
+        vtkIdType id_node = m_Tri[3*i_tri + i];
+        if (id_node != id_node1) {
+          m_N2T[id_node].remove(m_N2T[id_node].indexOf(i_tri));
+        }
+      }
+    } else {
+      for (int i = 0; i < 3; ++i) {
+        if (m_Tri[3*i_tri + i] == id_node1) {
+          m_Tri[3*i_tri + i] = id_node2;
+        }
+      }
+      m_N2T[id_node2].append(i_tri);
+    }
+  }
+  m_N2T[id_node1].clear();
+  m_Removed[id_node1] = true;
+  m_Q[id_node2] += m_Q[id_node1];
+  m_CL[id_node2] = min(m_CL[id_node2], m_CL[id_node1]);
+
+  // potential snap points; feature and boundary nodes continue along their edges
+  foreach (vtkIdType id_node, neighbours) {
+    if (id_node != id_node2) {
+      replaceSnapPoint(id_node, id_node1, id_node2);
+    }
+  }
+  if (m_NodeType[id_node2] == VTK_SIMPLE_VERTEX) {
+    getNeighbours(id_node2, m_PSP[id_node2]);
+  } else {
+    int i = m_PSP[id_node2].indexOf(id_node1);
+    if (i >= 0) {
+      m_PSP[id_node2].remove(i);
+    }
+    if (m_NodeType[id_node1] != VTK_SIMPLE_VERTEX) {
+      foreach (vtkIdType id_snap, m_PSP[id_node1]) {
+        if (id_snap != id_node2 && !m_PSP[id_node2].contains(id_snap)) {
+          m_PSP[id_node2].append(id_snap);
+        }
+      }
+    }
+  }
+  m_PSP[id_node1].clear();
+  ++m_NumRemoved;
+}
+
+void QuadricEdgeCollapse::rebuildGrid()
+{
+  QVector<vtkIdType> old2new(m_Grid->GetNumberOfPoints(), -1);
+  vtkIdType N_nodes = 0;
+  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+    if (!m_Removed[id_node]) {
+      old2new[id_node] = N_nodes;
+      ++N_nodes;
+    }
+  }
+  vtkIdType N_cells = 0;
+  for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
+    if (m_CellTri[id_cell] == -1 || m_TriAlive[m_CellTri[id_cell]]) {
+      ++N_cells;
+    }
+  }
+
+  EG_VTKSP(vtkUnstructuredGrid, new_grid);
+  allocateGrid(new_grid, N_cells, N_nodes);
+  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+    if (old2new[id_node] != -1) {
+      new_grid->GetPoints()->SetPoint(old2new[id_node], m_X[id_node].data());
+      copyNodeData(m_Grid, id_node, new_grid, old2new[id_node]);
+    }
+  }
+  EG_VTKDCN(vtkDoubleArray, characteristic_length_desired, new_grid, "node_meshdensity_desired");
+  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+    if (old2new[id_node] != -1) {
+      characteristic_length_desired->SetValue(old2new[id_node], m_CL[id_node]);
+    }
+  }
+  for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
+    int i_tri = m_CellTri[id_cell];
+    if (i_tri != -1 && !m_TriAlive[i_tri]) {
+      continue;
+    }
+    vtkIdType N_pts, *pts;
+    m_Grid->GetCellPoints(id_cell, N_pts, pts);
+    QVector<vtkIdType> new_pts(N_pts);
+    for (int i = 0; i < N_pts; ++i) {
+      vtkIdType id_node = pts[i];
+      if (i_tri != -1) {
+        id_node = m_Tri[3*i_tri + i];
+      }
+      new_pts[i] = old2new[id_node];
+      if (new_pts[i] == -1) {
+        EG_BUG;
+      }
+    }
+    vtkIdType id_new_cell = new_grid->InsertNextCell(m_Grid->GetCellType(id_cell), N_pts, new_pts.data());
+    copyCellData(m_Grid, id_cell, new_grid, id_new_cell);
+  }
+  makeCopy(new_grid, m_Grid);
+}
+
+void QuadricEdgeCollapse::operate()
+{
+  if (m_Fixed.size() != m_Grid->GetNumberOfPoints()) {
+    m_Fixed.fill(false, m_Grid->GetNumberOfPoints());
+  }
+  m_NumRemoved = 0;
+  buildStructures();
+
+  // the cheapest collapse first; outdated entries are skipped (lazy deletion)
+  typedef pair<double, vtkIdType> entry_t;
+  priority_queue<entry_t, vector<entry_t>, greater<entry_t> > queue;
+  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+    double cost;
+    if (bestCollapse(id_node, cost) != -1) {
+      m_Cost[id_node] = cost;
+      queue.push(entry_t(cost, id_node));
+    }
+  }
+  while (!queue.empty()) {
+    double cost = queue.top().first;
+    vtkIdType id_node = queue.top().second;
+    queue.pop();
+    if (m_Removed[id_node] || cost != m_Cost[id_node]) {
+      continue;
+    }
+
+    // changes further away might have made the collapse invalid or more expensive
+    double new_cost;
+    vtkIdType id_snap = bestCollapse(id_node, new_cost);
+    if (id_snap == -1) {
+      m_Cost[id_node] = -1;
+      continue;
+    }
+    if (new_cost > cost) {
+      m_Cost[id_node] = new_cost;
+      queue.push(entry_t(new_cost, id_node));
+      continue;
+    }
+
+    collapse(id_node, id_snap);
+    QVector<vtkIdType> neighbours;
+    getNeighbours(id_snap, neighbours);
+    neighbours.append(id_snap);
+    foreach (vtkIdType id_neigh, neighbours) {
+      double c;
+      if (bestCollapse(id_neigh, c) != -1) {
+        m_Cost[id_neigh] = c;
+        queue.push(entry_t(c, id_neigh));
+      } else {
+        m_Cost[id_neigh] = -1;
+      }
+    }
+  }
+
+  rebuildGrid();
+}
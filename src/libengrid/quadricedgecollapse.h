@@ -0,0 +1,124 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#ifndef QUADRICEDGECOLLAPSE_H
+#define QUADRICEDGECOLLAPSE_H
+
+#include "surfaceoperation.h"
+
+#include <QVector>
+
+/**
+ * Reduce a surface triangulation by collapsing edges in the order of increasing quadric error.
+ * Every node of the selected boundary codes can be merged into one of its potential snap points
+ * (see UpdatePotentialSnapPoints), so feature edges, boundary edges and the borders between boundary
+ * codes are respected in the same way as by RemovePoints. A collapse is only carried out if
+ * <ul>
+ * <li>no edge becomes longer than the desired edge length (node_meshdensity_desired),</li>
+ * <li>the quadric error stays below a fraction of the desired edge length,</li>
+ * <li>no triangle is turned by more than the maximal angle and</li>
+ * <li>the surface stays a valid (manifold) triangulation.</li>
+ * </ul>
+ * All collapses are carried out in a single pass with a priority queue; the grid is rebuilt once at the end.
+ */
+class QuadricEdgeCollapse : public SurfaceOperation
+{
+
+private: // data types
+
+  /// the quadric error metric of a node (symmetric 4x4 matrix)
+  struct quadric_t
+  {
+    double a[10];
+
+    quadric_t();
+    void   addPlane(vec3_t n, vec3_t x); ///< add the squared distance to the plane through x with the unit normal n
+    void   operator+=(const quadric_t &q);
+    double error(vec3_t x) const;        ///< the squared distance error at x
+  };
+
+
+protected: // attributes
+
+  double m_MaxRelativeError; ///< maximal square root of the quadric error relative to the desired edge length
+  double m_MaxAngle;         ///< maximal change of the normal of a triangle by a collapse
+  int    m_NumRemoved;
+
+  QVector<bool> m_Fixed;
+
+  QVector<vec3_t>               m_X;         ///< the node coordinates
+  QVector<double>               m_CL;        ///< the desired edge lengths
+  QVector<char>                 m_NodeType;  ///< the node types
+  QVector<bool>                 m_Removable; ///< nodes which may be merged into one of their potential snap points
+  QVector<bool>                 m_Removed;   ///< nodes which have been merged into another node
+  QVector<quadric_t>            m_Q;         ///< the quadric of each node
+  QVector<double>               m_Cost;      ///< the cost of the best collapse of each node (-1 if there is none)
+  QVector<QVector<vtkIdType> >  m_PSP;       ///< the potential snap points of each node
+  QVector<QVector<vtkIdType> >  m_FixedN2N;  ///< neighbours through cells which are not collapsed
+  QVector<vtkIdType>            m_Tri;       ///< the three nodes of each selected triangle
+  QVector<vtkIdType>            m_TriCell;   ///< the cell of each selected triangle
+  QVector<bool>                 m_TriAlive;  ///< false for the triangles around collapsed edges
+  QVector<int>                  m_CellTri;   ///< the triangle of each cell (-1 for cells which stay as they are)
+  QVector<QVector<int> >        m_N2T;       ///< the triangles around each node
+
+
+protected: // methods
+
+  void buildStructures();
+  void getNeighbours(vtkIdType id_node, QVector<vtkIdType> &neighbours);
+
+  /**
+   * Check a collapse and compute its cost.
+   * @param id_node1 the node which will be removed
+   * @param id_node2 the node which id_node1 will be merged into
+   * @param cost on return the quadric error of the collapse
+   * @return true if the collapse is allowed
+   */
+  bool checkCollapse(vtkIdType id_node1, vtkIdType id_node2, double &cost);
+
+  /**
+   * Find the allowed collapse with the smallest cost for a node.
+   * @param id_node the node to remove
+   * @param cost on return the cost of the best collapse
+   * @return the potential snap point of the best collapse (-1 if no collapse is allowed)
+   */
+  vtkIdType bestCollapse(vtkIdType id_node, double &cost);
+
+  void collapse(vtkIdType id_node1, vtkIdType id_node2);
+  void replaceSnapPoint(vtkIdType id_node, vtkIdType id_old, vtkIdType id_new);
+  void rebuildGrid();
+
+
+public: // methods
+
+  QuadricEdgeCollapse();
+
+  virtual void operate();
+
+  int  getNumRemoved() { return m_NumRemoved; }
+  void setMaxRelativeError(double e) { m_MaxRelativeError = e; }
+  void setMaxAngle(double a) { m_MaxAngle = a; }
+  void fixNodes(const QVector<bool> &fixnodes); ///< fixed nodes will not be removed
+
+};
+
+#endif // QUADRICEDGECOLLAPSE_H
@@ -23,6 +23,7 @@
 
 #include "reducesurfacetriangulation.h"
 #include "surfaceprojection.h"
+#include "quadricedgecollapse.h"
 
 ReduceSurfaceTriangulation::ReduceSurfaceTriangulation()
 {
@@ -36,6 +37,7 @@ ReduceSurfaceTriangulation::ReduceSurfaceTriangulation()
 
   m_NumDelaunaySweeps = 10;
   m_NumSmoothSteps = 1;
+  getSet("surface meshing", "use quadric edge collapse for surface reduction", true, m_UseEdgeCollapse);
 }
 
 void ReduceSurfaceTriangulation::pass1()
@@ -69,6 +71,28 @@ void ReduceSurfaceTriangulation::pass1()
   }
 }
 
+void ReduceSurfaceTriangulation::collapseEdges()
+{
+  cout << "\nSurface reduction by quadric edge collapse:" << endl;
+  m_UseNormalCorrectionForSmoothing = true;
+  computeMeshDensity();
+  QuadricEdgeCollapse collapse;
+  collapse.setGrid(m_Grid);
+  collapse.setBoundaryCodes(m_BoundaryCodes);
+  collapse.setFeatureAngle(m_FeatureAngle);
+  collapse.setMaxAngle(m_FeatureAngleForDeleteNodes);
+  collapse();
+  cout << "deleted nodes  : " << collapse.getNumRemoved() << endl;
+  updateNodeInfo(false);
+  for (int i = 0; i < m_NumSmoothSteps; ++i) {
+    cout << "  smoothing    : " << i+1 << "/" << m_NumSmoothSteps << endl;
+    smooth(1);
+    swap();
+  }
+  cout << "total nodes : " << m_Grid->GetNumberOfPoints() << endl;
+  cout << "total cells : " << m_Grid->GetNumberOfCells() << endl;
+}
+
 void ReduceSurfaceTriangulation::pass2()
 {
   cout << "\n\nSecond pass of surface reduction:\n(This should be quick...)" << endl;
@@ -83,7 +107,11 @@ void ReduceSurfaceTriangulation::operate()
   //writeGrid(m_Grid, "take1");
   updateNodeInfo(true);
   //writeGrid(m_Grid, "take2");
-  pass1();
+  if (m_UseEdgeCollapse) {
+    collapseEdges();
+  } else {
+    pass1();
+  }
   //pass2();
   createIndices(m_Grid);
   updateNodeInfo(false);
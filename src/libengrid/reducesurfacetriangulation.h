@@ -29,9 +29,19 @@
 class ReduceSurfaceTriangulation : public SurfaceAlgorithm
 {
 
+protected: // attributes
+
+  bool m_UseEdgeCollapse; ///< reduce the triangulation with QuadricEdgeCollapse instead of repeated calls of deleteNodes
+
 protected: // methods
 
   void pass1();
+
+  /**
+   * Reduce the triangulation in a single pass by collapsing edges in the order of increasing quadric error.
+   * This replaces pass1, followed by the same smoothing and swapping steps as one iteration of pass1.
+   */
+  void collapseEdges();
   void pass2();
   virtual void operate();
 
@@ -30,6 +30,8 @@ using namespace GeometryTools;
 #include <cmath>
 using namespace std;
 
+#include <QHash>
+
 #include <iostream>
 using namespace std;
 
@@ -39,6 +41,7 @@ RemovePoints::RemovePoints() : SurfaceOperation() {
   m_ProtectFeatureEdges = false;
   m_PerformGeometricChecks = true;
   m_UpdatePSP = false;
+  m_Verbose = true;
 }
 
 void RemovePoints::markFeatureEdges()
@@ -46,9 +49,9 @@ void RemovePoints::markFeatureEdges()
   EG_VTKDCN(vtkDoubleArray, characteristic_length_desired, m_Grid, "node_meshdensity_desired");
   m_IsFeatureNode.fill(false, m_Part.getNumberOfNodes());
   if(m_ProtectFeatureEdges) {
-    for (int i_nodes = 0; i_nodes < m_Part.getNumberOfNodes(); ++i_nodes) {
+    foreach (vtkIdType id_node1, loopNodes()) {
+      int i_nodes = m_Part.localNode(id_node1);
       if (!m_IsFeatureNode[i_nodes]) {
-        vtkIdType id_node1 = m_Part.globalNode(i_nodes);
         for (int j = 0; j < m_Part.n2nLSize(i_nodes); ++j) {
           vtkIdType id_node2 = m_Part.n2nLG(i_nodes, j);
           QSet<vtkIdType> edge_cells;
@@ -77,7 +80,7 @@ void RemovePoints::markFeatureEdges()
         ++N;
       }
     }
-    cout << N << " nodes on feature edges (angle >= " << GeometryTools::rad2deg(m_FeatureAngle) << "deg)" << endl;
+    if (m_Verbose) cout << N << " nodes on feature edges (angle >= " << GeometryTools::rad2deg(m_FeatureAngle) << "deg)" << endl;
   }
 }
 
@@ -89,6 +92,53 @@ void RemovePoints::fixNodes(const QVector<bool> &fixnodes)
   m_Fixed = fixnodes;
 }
 
+bool RemovePoints::removalWanted(vtkIdType id_node, vtkDoubleArray *characteristic_length_desired, l2g_t cells_all, g2l_t _nodes_all, l2l_t n2c_all)
+{
+  int i_node = m_Part.localNode(id_node);
+  vec3_t xi;
+  m_Grid->GetPoint(id_node, xi.data());
+  double cl_node = characteristic_length_desired->GetValue(id_node);
+  bool remove_node = false;
+
+  // check if node is worth removing
+  for (int j = 0; j < m_Part.n2nLSize(i_node); ++j) {
+    vtkIdType id_neigh = m_Part.n2nLG(i_node, j);
+    double cl_neigh = characteristic_length_desired->GetValue(id_neigh);
+    vec3_t xj;
+    m_Grid->GetPoint(id_neigh, xj.data());
+    double L = (xi - xj).abs();
+    double cl_crit = max(cl_node, cl_neigh) / m_Threshold;
+    if(L < cl_crit) {
+      remove_node = true;
+      break;
+    }
+  }
+
+  // force removal of "tripod" nodes
+  if (m_Part.n2cGSize(id_node) == 3) {
+    bool tri_only = true;
+    for (int j = 0; j < 3; ++j) {
+      if (m_Grid->GetCellType(m_Part.n2cGG(id_node, j)) != VTK_TRIANGLE) {
+        tri_only = false;
+        break;
+      }
+    }
+    if (tri_only) {
+      remove_node = true;
+    }
+  }
+
+  // check that node is only surrounded by triangles
+  foreach(int i_cell, n2c_all[_nodes_all[id_node]]) {
+    vtkIdType id_cell = cells_all[i_cell];
+    if(m_Grid->GetCellType(id_cell) != VTK_TRIANGLE) {
+      remove_node = false;
+    }
+  }
+
+  return remove_node;
+}
+
 void RemovePoints::operate()
 {
   if (m_Fixed.size() != m_Grid->GetNumberOfPoints()) {
@@ -97,22 +147,37 @@ void RemovePoints::operate()
 
   /////////////////////
 
-  MeshPartition full_partition(m_Grid, true);
-  full_partition.setAllCells();
-  l2g_t cells_all = full_partition.getCells();
-  g2l_t _nodes_all = full_partition.getLocalNodes();
-  l2l_t  n2c_all   = full_partition.getN2C();
+  MeshPartition full_partition;
+  MeshPartition *full_part = &full_partition;
+  if (partitionIsCurrent() && m_Part.getNumberOfCells() == m_GridEditor->numCells()) {
+    // the grid only contains surface cells; the checks below are done before the partition is changed
+    full_part = &m_Part;
+  } else {
+    full_partition.setGrid(m_Grid);
+    full_partition.setAllCells();
+  }
+  l2g_t cells_all = full_part->getCells();
+  g2l_t _nodes_all = full_part->getLocalNodes();
+  l2l_t  n2c_all   = full_part->getN2C();
 
   /////////////////////
 
-  int N1 = m_Grid->GetNumberOfPoints();
-
   QVector<vtkIdType> selected_cells;
-  getSurfaceCells(m_BoundaryCodes, selected_cells, m_Grid);
+  if (m_RegionCells) {
+    // only the nodes of the active region are candidates
+    EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
+    foreach (vtkIdType id_cell, *m_RegionCells) {
+      if (m_BoundaryCodes.contains(cell_code->GetValue(id_cell))) {
+        selected_cells.append(id_cell);
+      }
+    }
+  } else {
+    getSurfaceCells(m_BoundaryCodes, selected_cells, m_Grid);
+  }
   QVector<vtkIdType> selected_nodes;
   getNodesFromCells(selected_cells, selected_nodes, m_Grid);
 
-  setAllSurfaceCells();
+  prepareSurfacePartition();
   l2l_t  n2n   = getPartN2N();
   g2l_t _nodes = getPartLocalNodes();
   l2g_t  nodes = getPartNodes(); // only surface nodes
@@ -137,87 +202,98 @@ void RemovePoints::operate()
   QVector <vtkIdType> deadnode_vector;
   QVector <vtkIdType> snappoint_vector;
 
-  //count
-  for(int i_selected_nodes = 0; i_selected_nodes < selected_nodes.size(); ++i_selected_nodes) {
-    vtkIdType id_node = selected_nodes[i_selected_nodes];
-
-    int i_node = _nodes[id_node];
-    if(node_type->GetValue(id_node) != VTK_FIXED_VERTEX && !m_Fixed[id_node]) {
-      if (!marked_nodes[i_node]) {
-
-        // preparations
-        vec3_t xi;
-        m_Grid->GetPoint(id_node, xi.data());
-        double cl_node = characteristic_length_desired->GetValue(id_node);
-        bool remove_node = false;
-
-        // check if node is worth removing
-        for (int j = 0; j < n2n[i_node].size(); ++j) {
-          vtkIdType id_neigh = nodes[n2n[i_node][j]];
-          double cl_neigh = characteristic_length_desired->GetValue(id_neigh);
-          vec3_t xj;
-          m_Grid->GetPoint(id_neigh, xj.data());
-          double L = (xi - xj).abs();
-          //double cl_crit = 0.5 *(cl_node + cl_neigh) / m_Threshold;
-          double cl_crit = max(cl_node, cl_neigh) / m_Threshold;
-          if(L < cl_crit) {
-            remove_node = true;
-            break;
-          }
-        }
-
-        // force removal of "tripod" nodes
-        if (m_Part.n2cGSize(id_node) == 3) {
-          bool tri_only = true;
-          for (int j = 0; j < 3; ++j) {
-            if (m_Grid->GetCellType(m_Part.n2cGG(id_node, j)) != VTK_TRIANGLE) {
-              tri_only = false;
-              break;
-            }
-          }
-          if (tri_only) {
-            remove_node = true;
-          }
+  // Candidates are evaluated in parallel against the unmodified mesh. FindSnapPoint only ever rejects
+  // additional snap points if nodes are marked; hence a candidate without a snap point can be
+  // discarded straight away and the snap point found without marks is the one the serial search would
+  // find, as long as it has not been marked in the meantime.
+  m_Part.prepareParallelAccess();
+  int num_selected = selected_nodes.size();
+  QVector<vtkIdType>          candidate_snappoint(num_selected, -1);
+  QVector<QVector<vtkIdType> > candidate_deadcells(num_selected);
+  QVector<QVector<vtkIdType> > candidate_mutatedcells(num_selected);
+  const QVector<bool> no_marked_nodes(nodes.size(), false);
+  const vtkIdType *selected_nodes_ptr = selected_nodes.constData();
+  const bool      *fixed_ptr          = m_Fixed.constData();
+  vtkIdType          *snappoint_ptr   = candidate_snappoint.data();
+  QVector<vtkIdType> *deadcells_ptr   = candidate_deadcells.data();
+  QVector<vtkIdType> *mutatedcells_ptr = candidate_mutatedcells.data();
+  bool invalid_mesh = false;
+  fields().prime(); // the helpers below request fields
+  #pragma omp parallel for schedule(dynamic, 64) if(!m_Serial)
+  for (int i_selected_nodes = 0; i_selected_nodes < num_selected; ++i_selected_nodes) {
+    vtkIdType id_node = selected_nodes_ptr[i_selected_nodes];
+    if (node_type->GetValue(id_node) != VTK_FIXED_VERTEX && !fixed_ptr[id_node] && isActive(id_node)) {
+      try {
+        if (removalWanted(id_node, characteristic_length_desired, cells_all, _nodes_all, n2c_all)) {
+          int l_num_newpoints = 0;
+          int l_num_newcells = 0;
+          snappoint_ptr[i_selected_nodes] = FindSnapPoint(id_node, deadcells_ptr[i_selected_nodes], mutatedcells_ptr[i_selected_nodes],
+                                                          l_num_newpoints, l_num_newcells, no_marked_nodes);
         }
+      } catch (Error) {
+        invalid_mesh = true;
+      }
+    }
+  }
+  if (invalid_mesh) {
+    EG_ERR_RETURN("Invalid surface mesh. Check this with 'Tools -> Check surface integrity'.");
+  }
 
-        // check that node is only surrounded by triangles
-        foreach(int i_cell, n2c_all[_nodes_all[id_node]]) {   //loop through potentially dead cells
-          vtkIdType id_cell = cells_all[i_cell];
+  // Commit the candidates in the order of selection; a node is only removed if none of its neighbours
+  // has been removed already. This yields the same set of removals as a purely serial sweep.
+  QVector<bool> cl_modified(nodes.size(), false);
+  for (int i_selected_nodes = 0; i_selected_nodes < num_selected; ++i_selected_nodes) {
+    vtkIdType snap_point = candidate_snappoint[i_selected_nodes];
+    if (snap_point < 0) {
+      continue;
+    }
+    vtkIdType id_node = selected_nodes[i_selected_nodes];
+    int i_node = _nodes[id_node];
+    if (marked_nodes[i_node]) {
+      continue;
+    }
 
-          if(m_Grid->GetCellType(id_cell) != VTK_TRIANGLE) {
-            remove_node = false;
-          }
-        }
+    // reducing the mesh density of a snap point can veto the removal of its neighbours
+    bool recheck = false;
+    foreach (int i_node_neighbour, n2n[i_node]) {
+      if (cl_modified[i_node_neighbour]) {
+        recheck = true;
+        break;
+      }
+    }
+    if (recheck && !removalWanted(id_node, characteristic_length_desired, cells_all, _nodes_all, n2c_all)) {
+      continue;
+    }
 
-        if(remove_node) {
-          // local values
-          QVector <vtkIdType> dead_cells;
-          QVector <vtkIdType> mutated_cells;
-          int l_num_newpoints = 0;
-          int l_num_newcells = 0;
-          vtkIdType snap_point = FindSnapPoint(id_node, dead_cells, mutated_cells, l_num_newpoints, l_num_newcells, marked_nodes);
-          if(snap_point >= 0) {
-            // add deadnode/snappoint pair
-            deadnode_vector.push_back(id_node);
-            snappoint_vector.push_back(snap_point);
-            double cl1 = characteristic_length_desired->GetValue(id_node);
-            double cl2 = characteristic_length_desired->GetValue(snap_point);
-            if (cl1 < cl2) {
-              characteristic_length_desired->SetValue(snap_point, cl1);
-            }
-            // update global values
-            num_newpoints += l_num_newpoints;
-            num_newcells  += l_num_newcells;
-            all_deadcells += dead_cells;
-            all_mutatedcells += mutated_cells;
-            // mark neighbour nodes
-            foreach(int i_node_neighbour, n2n[_nodes[id_node]]) {
-              marked_nodes[i_node_neighbour] = true;
-            }
-          }
-        }
+    QVector<vtkIdType> dead_cells = candidate_deadcells[i_selected_nodes];
+    QVector<vtkIdType> mutated_cells = candidate_mutatedcells[i_selected_nodes];
+    if (marked_nodes[_nodes[snap_point]]) {
+      int l_num_newpoints = 0;
+      int l_num_newcells = 0;
+      snap_point = FindSnapPoint(id_node, dead_cells, mutated_cells, l_num_newpoints, l_num_newcells, marked_nodes);
+      if (snap_point < 0) {
+        continue;
       }
     }
+
+    // add deadnode/snappoint pair
+    deadnode_vector.push_back(id_node);
+    snappoint_vector.push_back(snap_point);
+    double cl1 = characteristic_length_desired->GetValue(id_node);
+    double cl2 = characteristic_length_desired->GetValue(snap_point);
+    if (cl1 < cl2) {
+      characteristic_length_desired->SetValue(snap_point, cl1);
+      cl_modified[_nodes[snap_point]] = true;
+    }
+    // update global values
+    num_newpoints -= 1;
+    num_newcells  -= dead_cells.size();
+    all_deadcells += dead_cells;
+    all_mutatedcells += mutated_cells;
+    // mark neighbour nodes
+    foreach(int i_node_neighbour, n2n[i_node]) {
+      marked_nodes[i_node_neighbour] = true;
+    }
   }
 
   //delete
@@ -225,8 +301,8 @@ void RemovePoints::operate()
   if(num_newcells != -all_deadcells.size()) EG_BUG;
   DeleteSetOfPoints(deadnode_vector, snappoint_vector, all_deadcells, all_mutatedcells);
 
-  int N2 = m_Grid->GetNumberOfPoints();
-  m_NumRemoved = N1 - N2;
+  m_NumRemoved = deadnode_vector.size();
+  m_SnapPoints = snappoint_vector;
 }
 
 /// \todo finish this function and optimize it.
@@ -702,162 +778,137 @@ bool RemovePoints::DeleteSetOfPoints(const QVector<vtkIdType>& deadnode_vector,
                                      const QVector<vtkIdType>& snappoint_vector,
                                      const QVector<vtkIdType>& all_deadcells,
                                      const QVector<vtkIdType>& all_mutatedcells) {
-  int initial_num_points = m_Grid->GetNumberOfPoints();
-
-  //src grid info
-  int num_points = m_Grid->GetNumberOfPoints();
-  int num_cells = m_Grid->GetNumberOfCells();
-
-  int num_newcells = -all_deadcells.size();
-  int num_newpoints = -deadnode_vector.size();
-
-//  if ( num_newcells != 2*num_newpoints ) {
-//    EG_BUG;
-//  }
-
-  //allocate
-  EG_VTKSP(vtkUnstructuredGrid, dst);
-  allocateGrid(dst, num_cells + num_newcells, num_points + num_newpoints);
-
-  //vector used to redefine the new point IDs
-  QVector <vtkIdType> OffSet(num_points);
+  // the grid is modified in place; dead nodes and cells are only removed by GridEditor::compact
+  GridEditor local_editor;
+  GridEditor *editor = m_GridEditor;
+  if (!editor) {
+    local_editor.setGrid(m_Grid);
+    editor = &local_editor;
+  }
 
-  //copy undead points
-  QVector<bool> is_deadnode(m_Grid->GetNumberOfPoints(), false);
-  QVector<int> glob2dead(m_Grid->GetNumberOfPoints(), -1);
+  // only the dead and mutated cells and the cells around the dead nodes are touched;
+  // hashes are used to keep the cost independent of the size of the grid
+  QHash<vtkIdType, int> glob2dead;
   for(int i_deadnodes = 0; i_deadnodes < deadnode_vector.size(); ++i_deadnodes) {
     vtkIdType id_node = deadnode_vector[i_deadnodes];
     if(id_node > m_Grid->GetNumberOfPoints()) {
       EG_BUG;
     }
-    is_deadnode[id_node] = true;
     glob2dead[id_node] = i_deadnodes;
   }
-  vtkIdType dst_id_node = 0;
-  for(vtkIdType src_id_node = 0; src_id_node < num_points; ++src_id_node) { //loop through src points
-    OffSet[src_id_node] = src_id_node - dst_id_node;
-    if(!is_deadnode[src_id_node]) {  //if the node isn't dead, copy it
-      vec3_t x;
-      m_Grid->GetPoints()->GetPoint(src_id_node, x.data());
-      dst->GetPoints()->SetPoint(dst_id_node, x.data());
-      copyNodeData(m_Grid, src_id_node, dst, dst_id_node);
-      dst_id_node++;
-    } else {
-      if(DebugLevel > 0) {
-        cout << "dead node encountered: src_id_node=" << src_id_node << " dst_id_node=" << dst_id_node << endl;
-      }
-    }
-  }
-
-  //Copy undead cells
 
   // Fill is_deadcell
-  QVector<bool> is_deadcell(m_Grid->GetNumberOfCells(), false);
+  QSet<vtkIdType> is_deadcell;
   foreach(vtkIdType id_cell, all_deadcells) {
     if( m_Grid->GetCellType(id_cell) == VTK_WEDGE ) EG_BUG;
-    is_deadcell[id_cell] = true;
+    is_deadcell.insert(id_cell);
   }
 
   // Fill is_mutatedcell
-  QVector<bool> is_mutatedcell(m_Grid->GetNumberOfCells(), false);
+  QSet<vtkIdType> is_mutatedcell;
   foreach(vtkIdType id_cell, all_mutatedcells) {
     if( m_Grid->GetCellType(id_cell) == VTK_WEDGE ) EG_BUG;
-    is_mutatedcell[id_cell] = true;
+    is_mutatedcell.insert(id_cell);
   }
 
-  for(vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) { //loop through src cells
-//    if( m_Grid->GetCellType(id_cell) == VTK_WEDGE ) continue;
-//    if(isVolume(id_cell, m_Grid)) continue;
-
-    if(!is_deadcell[id_cell]) {  //if the cell isn't dead
-      vtkIdType src_num_pts, *src_pts;
-      m_Grid->GetCellPoints(id_cell, src_num_pts, src_pts);
-      vtkIdType type_cell = m_Grid->GetCellType(id_cell);
-
-      vtkIdType dst_num_pts = src_num_pts;
-      QVector<vtkIdType> dst_pts(dst_num_pts);
-
-      if(is_mutatedcell[id_cell]) {  //mutated cell
-        if(dst_num_pts != 3) {
-          // Not fully supported yet
-          qWarning() << "all_mutatedcells=" << all_mutatedcells;
-          qWarning() << "A non-triangle cell was mutated!";
-          EG_BUG;
+  // The cells which can contain dead nodes: the mutated cells and the cells around the dead nodes.
+  // m_Part contains all surface cells; if there are other cells (e.g. volume cells), all cells have to be checked.
+  QVector<vtkIdType> check_cells;
+  if (m_Part.getNumberOfCells() == editor->numCells()) {
+    QSet<vtkIdType> cells = is_mutatedcell;
+    foreach(vtkIdType id_node, deadnode_vector) {
+      for (int j = 0; j < m_Part.n2cGSize(id_node); ++j) {
+        vtkIdType id_cell = m_Part.n2cGG(id_node, j);
+        if (id_cell >= 0) {
+          cells.insert(id_cell);
         }
-        int num_deadnode = 0;
-        for(int i = 0; i < src_num_pts; i++) {
-          int DeadIndex = glob2dead[src_pts[i]];
-          if(DeadIndex != -1) { // It is a dead node.
-            dst_pts[i] = snappoint_vector[DeadIndex] - OffSet[snappoint_vector[DeadIndex]]; // dead node
-            num_deadnode++;
-          } else {
-            dst_pts[i] = src_pts[i] - OffSet[src_pts[i]]; // not a dead node
-          }
-        }
-        if(num_deadnode != 1) {
-          qWarning() << "FATAL ERROR: Mutated cell has more than one dead node!";
-          qWarning() << "num_deadnode=" << num_deadnode;
-          qWarning() << "type_cell=" << type_cell << " VTK_TRIANGLE=" << VTK_TRIANGLE << " VTK_QUAD=" << VTK_QUAD;
-          EG_BUG;
-        }
-      } else { //normal cell
+      }
+    }
+    check_cells.reserve(cells.size());
+    foreach(vtkIdType id_cell, cells) {
+      check_cells.append(id_cell);
+    }
+    qSort(check_cells);
+  } else {
+    check_cells.resize(m_Grid->GetNumberOfCells());
+    for(vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
+      check_cells[id_cell] = id_cell;
+    }
+  }
 
-        if(DebugLevel > 10) {
-          cout << "processing normal cell " << id_cell << endl;
-        }
+  // replace the dead nodes of mutated and volume cells by their snap points
+  QVector<vtkIdType> dst_pts;
+  foreach(vtkIdType id_cell, check_cells) {
+    vtkIdType type_cell = m_Grid->GetCellType(id_cell);
+    if(is_deadcell.contains(id_cell) || type_cell == VTK_EMPTY_CELL) {
+      continue;
+    }
+    vtkIdType src_num_pts, *src_pts;
+    m_Grid->GetCellPoints(id_cell, src_num_pts, src_pts);
+    dst_pts.resize(src_num_pts);
+    int num_deadnode = 0;
+    for(int i = 0; i < src_num_pts; i++) {
+      int DeadIndex = glob2dead.value(src_pts[i], -1);
+      if(DeadIndex != -1) { // It is a dead node.
+        dst_pts[i] = snappoint_vector[DeadIndex];
+        num_deadnode++;
+      } else {
+        dst_pts[i] = src_pts[i];
+      }
+    }
 
-        if(isVolume(id_cell, m_Grid)) {
-            int num_deadnode = 0;
-            for(int i = 0; i < src_num_pts; i++) {
-              int DeadIndex = glob2dead[src_pts[i]];
-              if(DeadIndex != -1) { // It is a dead node.
-                dst_pts[i] = snappoint_vector[DeadIndex] - OffSet[snappoint_vector[DeadIndex]]; // dead node
-                num_deadnode++;
-              } else {
-                dst_pts[i] = src_pts[i] - OffSet[src_pts[i]]; // not a dead node
-              }
-            }
-            if(num_deadnode > 1) {
-              qWarning() << "FATAL ERROR: Mutated cell has more than one dead node!";
-              qWarning() << "num_deadnode=" << num_deadnode;
-              qWarning() << "type_cell=" << type_cell << " VTK_TRIANGLE=" << VTK_TRIANGLE << " VTK_QUAD=" << VTK_QUAD;
-              for(int k = 0; k < src_num_pts; k++) {
-                int DeadIndex = glob2dead[src_pts[k]];
-                qWarning()<<"k="<<k<<" DeadIndex="<<"glob2dead["<<src_pts[k]<<"]="<<DeadIndex;
-              }
-              EG_BUG;
-            }
-        }
-        else {
-            for(int j = 0; j < src_num_pts; j++) {
-              if(is_deadnode[src_pts[j]]) {
-                  qWarning() << "FATAL ERROR: Normal cell contains a dead node!";
-                  qWarning() << "is_deadnode=" << is_deadnode;
-                  qWarning() << "src_pts[" << j << "]=" << src_pts[j];
-                  qWarning() << "type_cell=" << type_cell << " VTK_TRIANGLE=" << VTK_TRIANGLE << " VTK_QUAD=" << VTK_QUAD;
-                  saveGrid(m_Grid, "crash");
-                  EG_BUG;
-              }
-              dst_pts[j] = src_pts[j] - OffSet[src_pts[j]];
-            }
+    if(is_mutatedcell.contains(id_cell)) {  //mutated cell
+      if(src_num_pts != 3) {
+        // Not fully supported yet
+        qWarning() << "all_mutatedcells=" << all_mutatedcells;
+        qWarning() << "A non-triangle cell was mutated!";
+        EG_BUG;
+      }
+      if(num_deadnode != 1) {
+        qWarning() << "FATAL ERROR: Mutated cell has more than one dead node!";
+        qWarning() << "num_deadnode=" << num_deadnode;
+        qWarning() << "type_cell=" << type_cell << " VTK_TRIANGLE=" << VTK_TRIANGLE << " VTK_QUAD=" << VTK_QUAD;
+        EG_BUG;
+      }
+    } else if(isVolume(id_cell, m_Grid)) {
+      if(num_deadnode > 1) {
+        qWarning() << "FATAL ERROR: Mutated cell has more than one dead node!";
+        qWarning() << "num_deadnode=" << num_deadnode;
+        qWarning() << "type_cell=" << type_cell << " VTK_TRIANGLE=" << VTK_TRIANGLE << " VTK_QUAD=" << VTK_QUAD;
+        for(int k = 0; k < src_num_pts; k++) {
+          int DeadIndex = glob2dead.value(src_pts[k], -1);
+          qWarning()<<"k="<<k<<" DeadIndex="<<"glob2dead["<<src_pts[k]<<"]="<<DeadIndex;
         }
+        EG_BUG;
+      }
+    } else if(num_deadnode > 0) {
+      qWarning() << "FATAL ERROR: Normal cell contains a dead node!";
+      qWarning() << "type_cell=" << type_cell << " VTK_TRIANGLE=" << VTK_TRIANGLE << " VTK_QUAD=" << VTK_QUAD;
+      saveGrid(m_Grid, "crash");
+      EG_BUG;
+    }
 
-      } // end of normal cell processing
-
-      // copy the cell
+    if(num_deadnode > 0) {
       //\todo adapt type_cell in the case of mutilated cells!
-      vtkIdType id_new_cell = dst->InsertNextCell(type_cell, dst_num_pts, dst_pts.data());
-      copyCellData(m_Grid, id_cell, dst, id_new_cell);
-    } //end of undead cell processing
-  } //end of loop through src cells
-
-  // update m_Grid
-  makeCopy(dst, m_Grid);
+      m_Part.replaceCell(id_cell, src_num_pts, dst_pts.data());
+    }
+  }
 
-  int final_num_points = m_Grid->GetNumberOfPoints();
-  if(initial_num_points - final_num_points != deadnode_vector.size()) {
-    EG_BUG;
+  // the partition (and its half-edge twins) is kept up to date
+  foreach(vtkIdType id_cell, all_deadcells) {
+    m_Part.removeCell(id_cell);
+    editor->deleteCell(id_cell);
+  }
+  foreach(vtkIdType id_node, deadnode_vector) {
+    m_Part.removeNode(id_node);
+    editor->deleteNode(id_node);
+  }
+  if (!m_GridEditor) {
+    // compact renumbers nodes and cells, so the partition has to be rebuilt
+    editor->compact();
+    setAllSurfaceCells();
   }
+  m_Grid->Modified();
 
   return(true);
 }
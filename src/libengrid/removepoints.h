@@ -28,6 +28,7 @@
 #include <vtkUnstructuredGrid.h>
 #include <vtkPolyData.h>
 #include <vtkCharArray.h>
+#include <vtkDoubleArray.h>
 
 #include <QVector>
 #include <QString>
@@ -40,10 +41,12 @@ class RemovePoints : public SurfaceOperation
 protected:
 
   int    m_NumRemoved;
+  QVector<vtkIdType> m_SnapPoints;
   double m_Threshold;
   bool   m_ProtectFeatureEdges;
   bool   m_PerformGeometricChecks;
   bool   m_UpdatePSP;
+  bool   m_Verbose;
 
   QVector<bool> m_IsFeatureNode;
   QVector<bool> m_Fixed;
@@ -55,6 +58,9 @@ public:
   virtual void operate();
 
   int getNumRemoved() { return m_NumRemoved; }
+  const QVector<vtkIdType>& getSnapPoints() { return m_SnapPoints; } ///< the nodes the removed nodes have been merged into (node IDs are only valid for in-place editing)
+  void setVerboseOn()  { m_Verbose = true; }
+  void setVerboseOff() { m_Verbose = false; }
   void setProtectFeatureEdgesOn()  { m_ProtectFeatureEdges = true; }
   void setProtectFeatureEdgesOff() { m_ProtectFeatureEdges = false; }
   void setPerformGeometricChecksOn()  { m_PerformGeometricChecks = true; }
@@ -68,6 +74,9 @@ protected:
 
   void markFeatureEdges();
 
+  /// checks if a node is worth removing (too short edges or "tripod" node) and only surrounded by triangles
+  bool removalWanted(vtkIdType id_node, vtkDoubleArray *characteristic_length_desired, l2g_t cells_all, g2l_t _nodes_all, l2l_t n2c_all);
+
   /// deletes set of points DeadNodes
   bool DeleteSetOfPoints(const QVector<vtkIdType>& deadnode_vector,
                          const QVector<vtkIdType>& snappoint_vector,
@@ -30,6 +30,8 @@
 #include "laplacesmoother.h"
 #include "guimainwindow.h"
 
+#include <algorithm>
+
 
 SurfaceAlgorithm::SurfaceAlgorithm()
 {
@@ -37,6 +39,8 @@ SurfaceAlgorithm::SurfaceAlgorithm()
   getSet("surface meshing", "maximal number of iterations",  5, m_NumMaxIter);
   getSet("surface meshing", "number of smoothing steps"   ,  2, m_NumSmoothSteps);
   getSet("surface meshing", "number of Delaunay sweeps"   ,  1, m_NumDelaunaySweeps);
+  getSet("surface meshing", "restrict iterations to changed regions", false, m_UseActiveSet);
+  getSet("surface meshing", "number of halo layers for changed regions", 2, m_ActiveSetHalo);
   m_NodesPerQuarterCircle = 0;
   m_RespectFeatureEdgesForDeleteNodes = false;
   m_FeatureAngleForDeleteNodes = deg2rad(45);
@@ -45,9 +49,28 @@ SurfaceAlgorithm::SurfaceAlgorithm()
   m_UseNormalCorrectionForSmoothing = false;
   m_AllowFeatureEdgeSwapping = true;
   m_AllowSmallAreaSwapping = false;
+  m_AllNodesModified = true;
   m_GrowthFactor = 1.5;
   m_FeatureResolution2D = 0;
   m_FeatureResolution3D = 0;
+  m_DensityEngine = NULL;
+  m_ActiveSetOn = false;
+  m_RegionOn = false;
+  m_VMDLookupValid = false;
+  m_BufferLog = false;
+}
+
+std::ostream& SurfaceAlgorithm::log()
+{
+  if (m_BufferLog) {
+    return m_Log;
+  }
+  return cout;
+}
+
+SurfaceAlgorithm::~SurfaceAlgorithm()
+{
+  delete m_DensityEngine;
 }
 
 void SurfaceAlgorithm::readVMD()
@@ -56,6 +79,7 @@ void SurfaceAlgorithm::readVMD()
   int row_count = 0;
   int column_count = 0;
   m_VMDvector.clear();
+  m_VMDLookupValid = false;
   
   if(!buffer.isEmpty()) {
     QTextStream in(&buffer, QIODevice::ReadOnly);
@@ -128,42 +152,133 @@ void SurfaceAlgorithm::prepare()
 
 }
 
+UpdateDesiredMeshDensity* SurfaceAlgorithm::densityEngine()
+{
+  if (!m_DensityEngine) {
+    m_DensityEngine = new UpdateDesiredMeshDensity();
+  }
+  m_DensityEngine->setGrid(m_Grid);
+  m_DensityEngine->setVertexMeshDensityVector(m_VMDvector);
+  m_DensityEngine->setMaxEdgeLength(m_MaxEdgeLength);
+  m_DensityEngine->setMinEdgeLength(m_MinEdgeLength);
+  m_DensityEngine->setNodesPerQuarterCircle(m_NodesPerQuarterCircle);
+  m_DensityEngine->setCellGrowthFactor(m_GrowthFactor);
+  m_DensityEngine->setBoundaryCodes(m_BoundaryCodes);
+  m_DensityEngine->setFeatureResolution2D(m_FeatureResolution2D);
+  m_DensityEngine->setFeatureResolution3D(m_FeatureResolution3D);
+  m_DensityEngine->fixNodes(m_FrozenNodes);
+  m_DensityEngine->setGridEditor(m_GridEditor);
+  return m_DensityEngine;
+}
+
 void SurfaceAlgorithm::computeMeshDensity()
 {
-  ///\todo Optimize by using only one loop through nodes!
-  UpdateDesiredMeshDensity update_desired_mesh_density;
-  update_desired_mesh_density.setGrid(m_Grid);
-  update_desired_mesh_density.setVertexMeshDensityVector(m_VMDvector);
-  update_desired_mesh_density.setMaxEdgeLength(m_MaxEdgeLength);
-  update_desired_mesh_density.setMinEdgeLength(m_MinEdgeLength);
-  update_desired_mesh_density.setNodesPerQuarterCircle(m_NodesPerQuarterCircle);
-  update_desired_mesh_density.setCellGrowthFactor(m_GrowthFactor);
-  update_desired_mesh_density.setBoundaryCodes(m_BoundaryCodes);
-  update_desired_mesh_density.setFeatureResolution2D(m_FeatureResolution2D);
-  update_desired_mesh_density.setFeatureResolution3D(m_FeatureResolution3D);
-  update_desired_mesh_density();
+  densityEngine();
+  if (m_GridEditor) {
+    // the persistent partition is up to date; no need to rebuild it for the density
+    m_DensityEngine->swapMeshPartition(m_Part);
+  }
+  (*m_DensityEngine)();
+  if (m_GridEditor) {
+    m_DensityEngine->swapMeshPartition(m_Part);
+  }
+  log() << "  mesh density : features " << m_DensityEngine->timeFeatures() << "s, sources " << m_DensityEngine->timeSources() << "s, nodes " << m_DensityEngine->timeNodes()
+       << "s, growth " << m_DensityEngine->timeGrowth() << "s" << endl;
+}
+
+bool SurfaceAlgorithm::vmd_key_t::operator<(const vmd_key_t &key) const
+{
+  if (type != key.type) {
+    return type < key.type;
+  }
+  return std::lexicographical_compare(bcs.begin(), bcs.end(), key.bcs.begin(), key.bcs.end());
+}
+
+int SurfaceAlgorithm::findVMD(vtkIdType id_node)
+{
+  if (!m_VMDLookupValid) {
+    m_VMDLookup.clear();
+    m_VMDNodeSetRows.clear();
+    for (int i = 0; i < m_VMDvector.size(); ++i) {
+      if (m_VMDvector[i].nodeset.size() > 0) {
+        m_VMDNodeSetRows.append(i);
+      }
+    }
+    m_VMDLookupValid = true;
+  }
+  VertexMeshDensity node_vmd = getVMD(id_node);
+
+  // rows which select nodes by their properties (the same for all nodes with the same key)
+  vmd_key_t key;
+  key.type = node_vmd.type;
+  key.bcs  = node_vmd.BCmap.keys();
+  int idx = -1;
+  if (m_VMDLookup.contains(key)) {
+    idx = m_VMDLookup[key];
+  } else {
+    for (int i = 0; i < m_VMDvector.size(); ++i) {
+      if (m_VMDvector[i].nodeset.size() == 0 && m_VMDvector[i] == node_vmd) {
+        if (idx == -1 || m_VMDvector[i].density < m_VMDvector[idx].density) {
+          idx = i;
+        }
+      }
+    }
+    m_VMDLookup[key] = idx;
+  }
+
+  // rows which select nodes by their IDs; the smallest density wins and the first row on a tie
+  foreach (int i, m_VMDNodeSetRows) {
+    if (m_VMDvector[i].nodeset.contains(id_node)) {
+      if (idx == -1 || m_VMDvector[i].density < m_VMDvector[idx].density || (m_VMDvector[i].density == m_VMDvector[idx].density && i < idx)) {
+        idx = i;
+      }
+    }
+  }
+  return idx;
 }
 
 void SurfaceAlgorithm::updateNodeInfo(bool update_type)
 {
-  setAllCells();
-  l2g_t nodes = getPartNodes();
-  foreach (vtkIdType id_node, nodes) {
-    if(update_type) {
-      EG_VTKDCN(vtkCharArray, node_type, m_Grid, "node_type");//node type
-      node_type->SetValue(id_node, getNodeType(id_node, true));
+  // while the grid is edited in place, m_Part is the persistent partition of all surface cells
+  if (!m_GridEditor) {
+    setAllCells();
+  }
+  l2g_t  nodes = getPartNodes();
+  g2l_t _nodes = getPartLocalNodes();
+  l2l_t  n2n   = getPartN2N();
+  FieldView<char> node_type              = fields().nodeType();
+  FieldView<int>  node_specified_density = fields().nodeSpecifiedDensity(); //density index from table
+
+  // node IDs are only stable while the grid is edited in place
+  if (update_type || !m_GridEditor) {
+    m_NodeInfoValid.clear();
+  }
+  int N_old = m_NodeInfoValid.size();
+  m_NodeInfoValid.resize(m_Grid->GetNumberOfPoints());
+  for (int id_node = N_old; id_node < m_NodeInfoValid.size(); ++id_node) {
+    m_NodeInfoValid[id_node] = false;
+  }
+  foreach (vtkIdType id_node, m_NodeInfoChanged) {
+    if (id_node < m_NodeInfoValid.size()) {
+      m_NodeInfoValid[id_node] = false;
+      if (_nodes[id_node] >= 0) {
+        foreach (int j_nodes, n2n[_nodes[id_node]]) {
+          m_NodeInfoValid[nodes[j_nodes]] = false;
+        }
+      }
     }
-    //EG_VTKDCN(vtkDoubleArray, node_meshdensity_current, m_Grid, "node_meshdensity_current");//what we have
-    //node_meshdensity_current->SetValue(id_node, currentVertexAvgDist(id_node));
+  }
+  m_NodeInfoChanged.clear();
 
-    EG_VTKDCN(vtkIntArray, node_specified_density, m_Grid, "node_specified_density");//density index from table
-    VertexMeshDensity nodeVMD = getVMD(id_node);
-//     int idx = m_VMDvector.indexOf(nodeVMD);
-    int idx = nodeVMD.findSmallestVMD(m_VMDvector);
-//     qWarning()<<"idx="<<idx;
-    node_specified_density->SetValue(id_node, idx);
+  foreach (vtkIdType id_node, nodes) {
+    if (!m_NodeInfoValid[id_node]) {
+      if (update_type) {
+        node_type[id_node] = getNodeType(id_node, true);
+      }
+      node_specified_density[id_node] = findVMD(id_node);
+      m_NodeInfoValid[id_node] = m_GridEditor != NULL;
+    }
   }
-//   writeGrid(m_Grid, "info");
 }
 
 void SurfaceAlgorithm::swap()
@@ -178,16 +293,38 @@ void SurfaceAlgorithm::swap()
   QSet<int> rest_bcs = GuiMainWindow::pointer()->getAllBoundaryCodes();
   rest_bcs -= m_BoundaryCodes;
   swap.setBoundaryCodes(rest_bcs);
+  if (m_GridEditor) {
+    swap.setGridEditor(m_GridEditor);
+    swap.swapMeshPartition(m_Part);
+    swap.setWorkQueueOn();
+    if (!m_AllNodesModified) {
+      swap.setSeedNodes(m_ModifiedNodes);
+    }
+  }
   swap();
+  if (m_GridEditor) {
+    swap.swapMeshPartition(m_Part);
+  }
+  m_ModifiedNodes.clear();
+  m_AllNodesModified = false;
 }
 
 void SurfaceAlgorithm::smooth(int N_iter, bool correct_curveture)
 {
   LaplaceSmoother lap;
   lap.setGrid(m_Grid);
-  QVector<vtkIdType> cls;
-  getSurfaceCells(m_BoundaryCodes, cls, m_Grid);
-  lap.setCells(cls);
+  if (m_GridEditor) {
+    lap.setQuickSave(false);
+    lap.setGridEditor(m_GridEditor);
+    lap.swapMeshPartition(m_Part);
+  }
+  // all nodes outside of the active set stay where they are
+  restrictToActiveSet(lap);
+  if (!m_GridEditor) {
+    QVector<vtkIdType> cls;
+    getSurfaceCells(m_BoundaryCodes, cls, m_Grid);
+    lap.setCells(cls);
+  }
   lap.setNumberOfIterations(N_iter);
   lap.setBoundaryCodes(m_BoundaryCodes);//IMPORTANT: so that unselected nodes become fixed when node types are updated!
   lap.setCorrectCurvature(correct_curveture);
@@ -203,6 +340,46 @@ void SurfaceAlgorithm::smooth(int N_iter, bool correct_curveture)
   }
   lap();
   m_SmoothSuccess = lap.succeeded();
+  if (m_GridEditor) {
+    lap.swapMeshPartition(m_Part);
+    m_ModifiedNodes += lap.getMovedNodes();
+    m_ChangedNodes  += lap.getMovedNodes();
+  }
+}
+
+void SurfaceAlgorithm::beginInPlaceEditing()
+{
+  m_InPlaceEditor.setGrid(m_Grid);
+  setGridEditor(&m_InPlaceEditor);
+
+  // the persistent partition of all surface cells; it is handed to the sub-operations and updated locally by them
+  setAllSurfaceCells();
+  m_ModifiedNodes.clear();
+  m_AllNodesModified = true;
+  clearActiveSet();
+  m_NodeInfoValid.clear();
+  m_NodeInfoChanged.clear();
+  if (m_FrozenNodes.size() > 0) {
+    m_ActiveNodes.fill(true, m_Grid->GetNumberOfPoints());
+    for (int id_node = 0; id_node < m_FrozenNodes.size(); ++id_node) {
+      if (m_FrozenNodes[id_node]) {
+        m_ActiveNodes[id_node] = false;
+      }
+    }
+    m_ActiveSetOn = true;
+  }
+}
+
+void SurfaceAlgorithm::endInPlaceEditing()
+{
+  if (m_GridEditor) {
+    m_GridEditor->compact();
+    setGridEditor(NULL);
+  }
+  clearActiveSet();
+  m_FrozenNodes.clear();
+  m_NodeInfoValid.clear();
+  m_NodeInfoChanged.clear();
 }
 
 int SurfaceAlgorithm::insertNodes()
@@ -210,7 +387,35 @@ int SurfaceAlgorithm::insertNodes()
   InsertPoints insert_points;
   insert_points.setGrid(m_Grid);
   insert_points.setBoundaryCodes(m_BoundaryCodes);
+  insert_points.setGridEditor(m_GridEditor);
+  if (m_GridEditor) {
+    // the grid contains deleted nodes and cells until endInPlaceEditing has been called
+    insert_points.setQuickSave(false);
+    insert_points.swapMeshPartition(m_Part);
+  }
+  restrictToActiveSet(insert_points);
   insert_points();
+  if (m_GridEditor) {
+    insert_points.swapMeshPartition(m_Part);
+    m_ModifiedNodes   += insert_points.getNewNodes();
+    m_ChangedNodes    += insert_points.getNewNodes();
+    m_NodeInfoChanged += insert_points.getNewNodes();
+  }
+  if (m_ActiveSetOn) {
+    // new nodes might re-use the IDs of deleted (inactive) nodes
+    foreach (vtkIdType id_node, insert_points.getNewNodes()) {
+      if (id_node < m_ActiveNodes.size()) {
+        m_ActiveNodes[id_node] = true;
+      }
+      if (m_RegionOn) {
+        // the neighbourhood of the new node has changed
+        addCoreNode(id_node);
+        for (int i = 0; i < m_Part.n2nGSize(id_node); ++i) {
+          addCoreNode(m_Part.n2nGG(id_node, i));
+        }
+      }
+    }
+  }
   return insert_points.getNumInserted();
 }
 
@@ -219,6 +424,14 @@ int SurfaceAlgorithm::deleteNodes()
   RemovePoints remove_points;
   remove_points.setGrid(m_Grid);
   remove_points.setBoundaryCodes(m_BoundaryCodes);
+  remove_points.setGridEditor(m_GridEditor);
+  if (m_GridEditor) {
+    remove_points.setQuickSave(false);
+    remove_points.swapMeshPartition(m_Part);
+  }
+  if (m_BufferLog) {
+    remove_points.setVerboseOff();
+  }
   remove_points.setStretchingFactor(m_StretchingFactor);
   remove_points.setFeatureAngle(m_FeatureAngle);
   if (m_RespectFeatureEdgesForDeleteNodes) {
@@ -232,6 +445,134 @@ int SurfaceAlgorithm::deleteNodes()
   } else {
     remove_points.setPerformGeometricChecksOff();
   }
+  restrictToActiveSet(remove_points);
   remove_points();
+  if (m_GridEditor) {
+    remove_points.swapMeshPartition(m_Part);
+    m_ModifiedNodes   += remove_points.getSnapPoints();
+    m_ChangedNodes    += remove_points.getSnapPoints();
+    m_NodeInfoChanged += remove_points.getSnapPoints();
+  }
   return remove_points.getNumRemoved();
 }
+
+void SurfaceAlgorithm::clearActiveSet()
+{
+  m_ChangedNodes.clear();
+  m_ActiveNodes.clear();
+  m_ActiveSetOn = false;
+  m_RegionOn = false;
+  m_CoreNodeList.clear();
+  m_CoreNodes.clear();
+  m_RegionCellList.clear();
+  m_RegionNodeList.clear();
+  m_RegionCellFlags.clear();
+  m_RegionNodeFlags.clear();
+}
+
+void SurfaceAlgorithm::addCoreNode(vtkIdType id_node)
+{
+  if (id_node >= m_CoreNodes.size()) {
+    m_CoreNodes.resize(m_Grid->GetNumberOfPoints());
+  }
+  if (!m_CoreNodes[id_node] && m_Part.localNode(id_node) != -1) {
+    m_CoreNodes[id_node] = true;
+    m_CoreNodeList.append(id_node);
+  }
+}
+
+int SurfaceAlgorithm::updateActiveNodes()
+{
+  if (!m_GridEditor || !m_UseActiveSet) {
+    m_ChangedNodes.clear();
+    return m_Grid->GetNumberOfPoints();
+  }
+
+  // reset the flags of the last active set
+  m_ActiveNodes.resize(m_Grid->GetNumberOfPoints());
+  m_CoreNodes.resize(m_Grid->GetNumberOfPoints());
+  if (m_RegionOn) {
+    foreach (vtkIdType id_node, m_CoreNodeList) {
+      m_ActiveNodes[id_node] = false;
+      m_CoreNodes[id_node] = false;
+    }
+  } else {
+    m_ActiveNodes.fill(false);
+    m_CoreNodes.fill(false);
+  }
+  m_CoreNodeList.clear();
+
+  // breadth-first search: m_ActiveSetHalo layers around the changed nodes are active,
+  // one more layer completes the neighbourhood of the active nodes
+  foreach (vtkIdType id_node, m_ChangedNodes) {
+    addCoreNode(id_node);
+  }
+  int layer_start = 0;
+  for (int layer = 0; layer <= m_ActiveSetHalo; ++layer) {
+    int layer_end = m_CoreNodeList.size();
+    for (int i = layer_start; i < layer_end; ++i) {
+      vtkIdType id_node = m_CoreNodeList[i];
+      for (int j = 0; j < m_Part.n2nGSize(id_node); ++j) {
+        addCoreNode(m_Part.n2nGG(id_node, j));
+      }
+    }
+    layer_start = layer_end;
+  }
+  int N_active = 0;
+  for (int i = 0; i < layer_start; ++i) {
+    vtkIdType id_node = m_CoreNodeList[i];
+    if (id_node >= m_FrozenNodes.size() || !m_FrozenNodes[id_node]) {
+      m_ActiveNodes[id_node] = true;
+      ++N_active;
+    }
+  }
+  m_ActiveSetOn = true;
+  m_RegionOn = true;
+  m_ChangedNodes.clear();
+  return N_active;
+}
+
+void SurfaceAlgorithm::updateRegion()
+{
+  foreach (vtkIdType id_cell, m_RegionCellList) {
+    m_RegionCellFlags[id_cell] = false;
+  }
+  foreach (vtkIdType id_node, m_RegionNodeList) {
+    m_RegionNodeFlags[id_node] = false;
+  }
+  m_RegionCellList.clear();
+  m_RegionNodeList.clear();
+  m_RegionCellFlags.resize(m_Grid->GetNumberOfCells());
+  m_RegionNodeFlags.resize(m_Grid->GetNumberOfPoints());
+  foreach (vtkIdType id_node, m_CoreNodeList) {
+    if (m_Part.localNode(id_node) == -1) {
+      continue; // deleted
+    }
+    for (int i = 0; i < m_Part.n2cGSize(id_node); ++i) {
+      vtkIdType id_cell = m_Part.n2cGG(id_node, i);
+      if (!m_RegionCellFlags[id_cell]) {
+        m_RegionCellFlags[id_cell] = true;
+        m_RegionCellList.append(id_cell);
+        vtkIdType N_pts, *pts;
+        m_Grid->GetCellPoints(id_cell, N_pts, pts);
+        for (int j = 0; j < N_pts; ++j) {
+          if (!m_RegionNodeFlags[pts[j]]) {
+            m_RegionNodeFlags[pts[j]] = true;
+            m_RegionNodeList.append(pts[j]);
+          }
+        }
+      }
+    }
+  }
+}
+
+void SurfaceAlgorithm::restrictToActiveSet(SurfaceOperation &op)
+{
+  if (m_ActiveSetOn) {
+    op.setActiveNodes(&m_ActiveNodes);
+  }
+  if (m_RegionOn) {
+    updateRegion();
+    op.setActiveRegion(&m_RegionCellList, &m_RegionNodeList, &m_CoreNodes);
+  }
+}
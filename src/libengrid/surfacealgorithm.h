@@ -28,6 +28,7 @@
 #include <vtkCharArray.h>
 
 #include <QSet>
+#include <QMap>
 #include <QVector>
 #include <QString>
 #include <QTextStream>
@@ -39,10 +40,25 @@
 
 #include <cmath>
 #include <iostream>
+#include <sstream>
+
+class UpdateDesiredMeshDensity;
 
 class SurfaceAlgorithm : public SurfaceOperation
 {
 
+private: // data-types
+
+  /// the properties of a node which decide about its row in the mesh density table
+  struct vmd_key_t
+  {
+    char       type; ///< node type
+    QList<int> bcs;  ///< boundary codes of the adjacent cells (sorted)
+
+    bool operator<(const vmd_key_t &key) const;
+  };
+
+
 protected: // attributes
 
   QVector <VertexMeshDensity> m_VMDvector;
@@ -64,30 +80,124 @@ protected: // attributes
   int    m_NumDelaunaySweeps;
   bool   m_AllowSmallAreaSwapping;
 
+  GridEditor m_InPlaceEditor; ///< keeps deleted nodes and cells between iterations (see beginInPlaceEditing)
+
+  QVector<vtkIdType> m_ModifiedNodes;    ///< nodes touched since the last call of swap (in-place editing only)
+  bool               m_AllNodesModified; ///< swap has to check all cells
+
+  bool               m_UseActiveSet;     ///< restrict iterations to the regions which changed in the previous iteration
+  int                m_ActiveSetHalo;    ///< number of node layers around the changed nodes which stay active
+  bool               m_ActiveSetOn;      ///< m_ActiveNodes is in use (otherwise all nodes are active)
+  QVector<bool>      m_ActiveNodes;      ///< nodes which may still be changed (see updateActiveNodes)
+  bool               m_RegionOn;         ///< the sub-operations only loop over the region around the active nodes
+  QVector<vtkIdType> m_CoreNodeList;     ///< the active nodes and their neighbours (see updateActiveNodes)
+  QVector<bool>      m_CoreNodes;        ///< flags for m_CoreNodeList
+  QVector<vtkIdType> m_RegionCellList;   ///< all cells around the core nodes (see updateRegion)
+  QVector<vtkIdType> m_RegionNodeList;   ///< all nodes of m_RegionCellList
+  QVector<bool>      m_RegionCellFlags;  ///< flags for m_RegionCellList
+  QVector<bool>      m_RegionNodeFlags;  ///< flags for m_RegionNodeList
+  QVector<vtkIdType> m_ChangedNodes;     ///< nodes changed since the last call of updateActiveNodes (in-place editing only)
+  QVector<bool>      m_FrozenNodes;      ///< nodes which are never changed and keep their mesh density while the grid is edited in place (see beginInPlaceEditing)
+
+  QMap<vmd_key_t, int> m_VMDLookup;       ///< mesh density table row for each combination of node type and boundary codes found so far
+  QVector<int>         m_VMDNodeSetRows;  ///< rows of the mesh density table which select nodes by their IDs
+  bool                 m_VMDLookupValid;  ///< m_VMDLookup and m_VMDNodeSetRows match m_VMDvector
+  QVector<bool>        m_NodeInfoValid;   ///< node_specified_density is up to date (in-place editing only)
+  QVector<vtkIdType>   m_NodeInfoChanged; ///< nodes whose neighbourhood has changed since the last call of updateNodeInfo
+
+  UpdateDesiredMeshDensity* m_DensityEngine; ///< computes the mesh density; kept between iterations (see computeMeshDensity)
+
+  bool               m_BufferLog; ///< collect the output in m_Log instead of writing it to cout (e.g. on a worker thread)
+  std::ostringstream m_Log;       ///< the buffered output (see m_BufferLog)
+
 
 protected: // methods
 
   void readSettings();
   void readVMD();
 
+  std::ostream& log(); ///< the stream for progress output (cout or m_Log)
+
 
 protected: // methods
 
   void prepare();
+
+  /**
+   * Swap edges of the selected triangles.
+   * While the grid is edited in place, only the edges around nodes which have been touched by
+   * insertNodes, deleteNodes or smooth since the last call are checked (work-queue mode).
+   */
   void swap();
   void smooth(int N_iter, bool correct_curvature = false);
   int  insertNodes();
   int  deleteNodes();
+
+  /**
+   * Update the desired mesh density of all nodes.
+   * The same UpdateDesiredMeshDensity object is used for all calls, so the edge length sources
+   * and the boundary codes are only read once per operation.
+   */
   void computeMeshDensity();
+
+  /** The object used by computeMeshDensity, set up with the current settings (created on first use). */
+  UpdateDesiredMeshDensity* densityEngine();
   
-  /** Updates node_type (if update_type = true), node_meshdensity_current, node_specified_density for all nodes. */
+  /**
+   * Updates node_type (if update_type = true) and node_specified_density.
+   * While the grid is edited in place, node_specified_density is only recomputed for nodes
+   * whose neighbourhood has changed since the last call (inserted nodes, snap points and their neighbours).
+   * update_type = true always updates all nodes.
+   */
   void updateNodeInfo(bool update_type = false);
 
+  /**
+   * Find the row of the mesh density table for a node.
+   * The result is the same as VertexMeshDensity::findSmallestVMD, but the table is only searched
+   * once for every combination of node type and adjacent boundary codes.
+   * @param id_node the node
+   * @return the row of m_VMDvector (-1 if no row matches)
+   */
+  int findVMD(vtkIdType id_node);
+
+  /**
+   * From now on insertNodes and deleteNodes modify the grid in place and
+   * re-use deleted nodes and cells instead of compacting the grid after every call.
+   * If m_FrozenNodes has been set, these nodes will be excluded from all changes until endInPlaceEditing is called.
+   */
+  void beginInPlaceEditing();
+
+  /** Removes all deleted nodes and cells from the grid (one single compaction); this also clears m_FrozenNodes. */
+  void endInPlaceEditing();
+
+  /**
+   * Restrict the following calls of insertNodes, deleteNodes and smooth to the nodes which have been
+   * changed since the last call (plus m_ActiveSetHalo layers of neighbours).
+   * The layers are found by a breadth-first search through the persistent partition,
+   * so the effort only depends on the size of the changed region.
+   * This has no effect unless the grid is edited in place and the active set has been switched on.
+   * @return the number of active nodes
+   */
+  int updateActiveNodes();
+
+  /** Switch the active set off and release its memory (all nodes are active afterwards). */
+  void clearActiveSet();
+
+  /** Add a node to the core of the active region (see updateActiveNodes). */
+  void addCoreNode(vtkIdType id_node);
+
+  /** Collect the cells and nodes around the core nodes (see updateActiveNodes). */
+  void updateRegion();
+
+  /** Pass the active nodes and the region around them to a sub-operation. */
+  void restrictToActiveSet(SurfaceOperation &op);
+
 public:
 
   SurfaceAlgorithm();
+  virtual ~SurfaceAlgorithm();
 
-  void setVertexMeshDensityVector(QVector <VertexMeshDensity> a_VMDvector) { m_VMDvector = a_VMDvector; }
+  void setVertexMeshDensityVector(QVector <VertexMeshDensity> a_VMDvector) { m_VMDvector = a_VMDvector; m_VMDLookupValid = false; }
   void setMaxEdgeLength(double l)         { m_MaxEdgeLength = l; }
   void setNodesPerQuarterCircle(double N) { m_NodesPerQuarterCircle = N; }
   void setCellGrowthFactor(double cgf)    { m_GrowthFactor = cgf; }
@@ -25,6 +25,7 @@
 #include "guimainwindow.h"
 
 #include "laplacesmoother.h"
+#include "updatedesiredmeshdensity.h"
 
 SurfaceMesher::SurfaceMesher() : SurfaceAlgorithm()
 {
@@ -34,75 +35,362 @@ SurfaceMesher::SurfaceMesher() : SurfaceAlgorithm()
   getSet("surface meshing", "use normal correction for smoothing",  false, m_UseNormalCorrectionForSmoothing);
   getSet("surface meshing", "allow feature edge swapping",          false, m_AllowFeatureEdgeSwapping);
   getSet("surface meshing", "correct curvature",                    false, m_CorrectCurvature);
+  getSet("surface meshing", "converged if change ratio below [%] (< 0 = off)",      -1.0, m_MaxChangeRatio);
+  getSet("surface meshing", "converged if fluctuation ratio below [%] (< 0 = off)", -1.0, m_MaxFluctuationRatio);
+  getSet("surface meshing", "time budget [s] (0 = unlimited)",          0.0,  m_TimeBudget);
+  getSet("surface meshing", "adapt number of smoothing steps",          false, m_AdaptiveSmoothSteps);
+  getSet("surface meshing", "fluctuation ratio for all smoothing steps [%]", 10.0, m_FullSmoothFluctuation);
+  getSet("surface meshing", "mesh patches in parallel",                 false, m_MeshPatchesInParallel);
+  getSet("surface meshing", "number of iterations for patch interfaces", 3,    m_NumInterfaceIter);
   m_EdgeAngle = m_FeatureAngle;
 }
 
-void SurfaceMesher::operate()
+int SurfaceMesher::numSmoothSteps(double fluctuation_ratio)
 {
-  if (!GuiMainWindow::pointer()->checkSurfProj()) {
-    GuiMainWindow::pointer()->storeSurfaceProjection();
+  if (!m_AdaptiveSmoothSteps || fluctuation_ratio < 0 || fluctuation_ratio >= m_FullSmoothFluctuation) {
+    return m_NumSmoothSteps;
   }
-  prepare();
-  //computeMeshDensity(); //!!
-  //prepare(); //!!
-  if (m_BoundaryCodes.size() == 0) {
-    return;
-  }
-  EG_VTKDCN(vtkDoubleArray, characteristic_length_desired, m_Grid, "node_meshdensity_desired");
-  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
-    characteristic_length_desired->SetValue(id_node, 1e-6);
+  int N = int(ceil(m_NumSmoothSteps*fluctuation_ratio/m_FullSmoothFluctuation));
+  return max(min(N, m_NumSmoothSteps), min(1, m_NumSmoothSteps));
+}
+
+bool SurfaceMesher::timeBudgetExhausted(const QTime &start)
+{
+  if (m_TimeBudget <= 0) {
+    return false;
   }
-  updateNodeInfo(true);
+  return 1e-3*start.msecsTo(QTime::currentTime()) >= m_TimeBudget;
+}
+
+void SurfaceMesher::iterate(const QTime &start, int num_max_iter, bool fixed_active_set)
+{
   int num_inserted = 0;
   int num_deleted = 0;
   int iter = 0;
-  bool done = (iter >= m_NumMaxIter);
+  double last_fluctuation_ratio = -1;
+  bool done = (iter >= num_max_iter);
   //int Nfull = 0;
   //int Nhalf = 0;
   while (!done) {
     ++iter;
-    cout << "surface mesher iteration " << iter << ":" << endl;
+    log() << "surface mesher iteration " << iter << ":" << endl;
     computeMeshDensity();
     //return;
     num_inserted = insertNodes();
-    cout << "  inserted nodes : " << num_inserted << endl;
+    log() << "  inserted nodes : " << num_inserted << endl;
     updateNodeInfo();
     swap();
     //computeMeshDensity(); //!!
     num_deleted = deleteNodes();
-    cout << "  deleted nodes : " << num_deleted << endl;
+    log() << "  deleted nodes : " << num_deleted << endl;
     //computeMeshDensity(); // !!
-    for (int i = 0; i < m_NumSmoothSteps; ++i) {
+    int num_smooth_steps = numSmoothSteps(last_fluctuation_ratio);
+    log() << "  smoothing steps : " << num_smooth_steps << endl;
+    for (int i = 0; i < num_smooth_steps; ++i) {
       SurfaceProjection::Nfull = 0;
       SurfaceProjection::Nhalf = 0;
       smooth(1, m_CorrectCurvature);
       swap();
     }
     //int N_crit = m_Grid->GetNumberOfPoints()/100;
-    done = (iter >= m_NumMaxIter);
-    cout << "  total nodes : " << m_Grid->GetNumberOfPoints() << endl;
-    cout << "  total cells : " << m_Grid->GetNumberOfCells() << endl;
+    done = (iter >= num_max_iter);
+    log() << "  total nodes : " << m_InPlaceEditor.numNodes() << endl;
+    log() << "  total cells : " << m_InPlaceEditor.numCells() << endl;
     double change_ratio = 0;
     double fluctuation_ratio = 0;
     {
-      double N_new = m_Grid->GetNumberOfPoints();
+      double N_new = m_InPlaceEditor.numNodes();
       double N_chg = num_inserted - num_deleted;
       double N_max = max(num_inserted, num_deleted);
       double N_old = N_new - N_chg;
-      change_ratio = 0.1*int(1000*N_chg/N_old);
-      fluctuation_ratio = 0.1*int(1000*N_max/N_old);
+      change_ratio = 100*N_chg/N_old;
+      fluctuation_ratio = 100*N_max/N_old;
+    }
+    log() << "  change ratio : " << 0.1*int(10*change_ratio) << "%" << endl;
+    log() << "  fluctuation ratio : " << 0.1*int(10*fluctuation_ratio) << "%" << endl;
+    last_fluctuation_ratio = fluctuation_ratio;
+
+    // convergence and time budget
+    if (!done && m_MaxChangeRatio >= 0 && m_MaxFluctuationRatio >= 0) {
+      if (fabs(change_ratio) < m_MaxChangeRatio && fluctuation_ratio < m_MaxFluctuationRatio) {
+        log() << "  converged after " << iter << " iterations" << endl;
+        done = true;
+      }
+    }
+    if (!done && timeBudgetExhausted(start)) {
+      log() << "  time budget of " << m_TimeBudget << "s exhausted after " << iter << " iterations" << endl;
+      done = true;
+    }
+    if (m_UseActiveSet && !fixed_active_set && !done) {
+      int N_active = updateActiveNodes();
+      log() << "  active nodes : " << N_active << endl;
+    }
+  }
+}
+
+void SurfaceMesher::findInterfaceNodes(QVector<bool> &interface_nodes)
+{
+  EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
+  QVector<int> first_bc(m_Grid->GetNumberOfPoints(), -1);
+  interface_nodes.fill(false, m_Grid->GetNumberOfPoints());
+  for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
+    if (isSurface(id_cell, m_Grid)) {
+      int bc = cell_code->GetValue(id_cell);
+      vtkIdType N_pts, *pts;
+      m_Grid->GetCellPoints(id_cell, N_pts, pts);
+      for (int i = 0; i < N_pts; ++i) {
+        if (first_bc[pts[i]] == -1) {
+          first_bc[pts[i]] = bc;
+        } else if (first_bc[pts[i]] != bc) {
+          interface_nodes[pts[i]] = true;
+        }
+      }
     }
-    cout << "  change ratio : " << change_ratio << "%" << endl;
-    cout << "  fluctuation ratio : " << fluctuation_ratio << "%" << endl;
   }
+}
+
+void SurfaceMesher::meshPatch(const QTime &start)
+{
+  m_BufferLog = true;
+  beginInPlaceEditing();
+  iterate(start, m_NumMaxIter);
+  setGridEditor(NULL);
+}
+
+void SurfaceMesher::meshPatches(const QTime &start)
+{
+  // interfaces and their neighbourhood in serial
+  QVector<bool> interface_nodes;
+  findInterfaceNodes(interface_nodes);
+  beginInPlaceEditing();
+  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+    if (interface_nodes[id_node]) {
+      m_ChangedNodes.append(id_node);
+    }
+  }
+  bool use_active_set = m_UseActiveSet;
+  m_UseActiveSet = true;
+  int N_band = updateActiveNodes();
+  m_UseActiveSet = use_active_set;
+  cout << "patch interfaces : " << N_band << " nodes" << endl;
+  iterate(start, m_NumInterfaceIter, true);
+  endInPlaceEditing();
   createIndices(m_Grid);
+  if (timeBudgetExhausted(start)) {
+    return;
+  }
+
+  // the desired mesh density of the interface nodes depends on all patches around them
   updateNodeInfo(false);
+  computeMeshDensity();
+
+  // one patch for each surface projection; the projections have to be complete before the threads start
+  findInterfaceNodes(interface_nodes);
+  GuiMainWindow::pointer()->buildSurfaceProjections();
+  QMap<SurfaceProjection*, QSet<int> > bcs_of_proj;
+  foreach (int bc, m_BoundaryCodes) {
+    bcs_of_proj[GuiMainWindow::pointer()->getSurfProj(bc)].insert(bc);
+  }
+  QVector<patch_t> patches;
+  foreach (SurfaceProjection *proj, bcs_of_proj.keys()) {
+    patch_t P;
+    P.proj = proj;
+    P.bcs  = bcs_of_proj[proj];
+    QVector<vtkIdType> cells;
+    getSurfaceCells(P.bcs, cells, m_Grid);
+    getNodesFromCells(cells, P.nodes, m_Grid); // makeCopy numbers the nodes in the same order
+    P.grid = vtkUnstructuredGrid::New();
+    makeCopy(m_Grid, P.grid, cells);
+    P.frozen.resize(P.nodes.size());
+    for (int i = 0; i < P.nodes.size(); ++i) {
+      P.frozen[i] = interface_nodes[P.nodes[i]];
+    }
+
+    // all settings and inputs are read here, because they are not thread-safe
+    P.mesher = new SurfaceMesher();
+    P.mesher->setGrid(P.grid);
+    P.mesher->setMaxNumIterations(m_NumMaxIter);
+    P.mesher->setNumDelaunaySweeps(m_NumDelaunaySweeps);
+    P.mesher->setNumSmoothSteps(m_NumSmoothSteps);
+    P.mesher->setCorrectCurvature(m_CorrectCurvature);
+    P.mesher->prepare();
+    P.mesher->setBoundaryCodes(P.bcs);
+    P.mesher->m_FrozenNodes = P.frozen;
+    P.mesher->densityEngine()->readInputs();
+    proj->setForegroundGrid(P.grid);
+    patches.append(P);
+  }
+  cout << "meshing " << patches.size() << " patches in parallel" << endl;
+
+  patch_t *patches_ptr = patches.data();
+  bool patch_error = false;
+  Error err;
+  #pragma omp parallel for schedule(dynamic, 1)
+  for (int i = 0; i < patches.size(); ++i) {
+    try {
+      patches_ptr[i].mesher->meshPatch(start);
+    } catch (Error E) {
+      #pragma omp critical
+      {
+        err = E;
+        patch_error = true;
+      }
+    }
+  }
+
+  // the output of the patches (the threads must not write to cout concurrently)
+  for (int i_patch = 0; i_patch < patches.size(); ++i_patch) {
+    cout << "patch " << i_patch + 1 << " of " << patches.size() << ":" << endl;
+    cout << patches[i_patch].mesher->m_Log.str();
+  }
+
+  if (!patch_error) {
+
+    // the cells and nodes of the main grid which have not been meshed
+    EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
+    QVector<bool> keep_cell(m_Grid->GetNumberOfCells(), false);
+    QVector<vtkIdType> old2new(m_Grid->GetNumberOfPoints(), -1);
+    vtkIdType N_cells = 0;
+    vtkIdType N_nodes = 0;
+    for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
+      if (!m_BoundaryCodes.contains(cell_code->GetValue(id_cell))) {
+        keep_cell[id_cell] = true;
+        ++N_cells;
+        vtkIdType N_pts, *pts;
+        m_Grid->GetCellPoints(id_cell, N_pts, pts);
+        for (int i = 0; i < N_pts; ++i) {
+          old2new[pts[i]] = 0;
+        }
+      }
+    }
+    for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+      if (old2new[id_node] == 0 || interface_nodes[id_node]) {
+        old2new[id_node] = N_nodes;
+        ++N_nodes;
+      } else {
+        old2new[id_node] = -1;
+      }
+    }
+
+    // the cells and nodes of the patches; frozen nodes are the interface nodes of the main grid
+    QVector<QVector<vtkIdType> > sub2new(patches.size());
+    for (int i_patch = 0; i_patch < patches.size(); ++i_patch) {
+      const patch_t &P = patches[i_patch];
+      sub2new[i_patch].fill(-1, P.grid->GetNumberOfPoints());
+      for (vtkIdType id_cell = 0; id_cell < P.grid->GetNumberOfCells(); ++id_cell) {
+        if (P.grid->GetCellType(id_cell) == VTK_EMPTY_CELL) {
+          continue;
+        }
+        ++N_cells;
+        vtkIdType N_pts, *pts;
+        P.grid->GetCellPoints(id_cell, N_pts, pts);
+        for (int i = 0; i < N_pts; ++i) {
+          if (sub2new[i_patch][pts[i]] == -1) {
+            if (pts[i] < P.frozen.size() && P.frozen[pts[i]]) {
+              sub2new[i_patch][pts[i]] = old2new[P.nodes[pts[i]]];
+            } else {
+              sub2new[i_patch][pts[i]] = N_nodes;
+              ++N_nodes;
+            }
+          }
+        }
+      }
+    }
+
+    EG_VTKSP(vtkUnstructuredGrid, new_grid);
+    allocateGrid(new_grid, N_cells, N_nodes);
+    for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+      if (old2new[id_node] != -1) {
+        vec3_t x;
+        m_Grid->GetPoint(id_node, x.data());
+        new_grid->GetPoints()->SetPoint(old2new[id_node], x.data());
+        copyNodeData(m_Grid, id_node, new_grid, old2new[id_node]);
+      }
+    }
+    for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
+      if (keep_cell[id_cell]) {
+        vtkIdType N_pts, *pts;
+        m_Grid->GetCellPoints(id_cell, N_pts, pts);
+        QVector<vtkIdType> new_pts(N_pts);
+        for (int i = 0; i < N_pts; ++i) {
+          new_pts[i] = old2new[pts[i]];
+        }
+        vtkIdType id_new_cell = new_grid->InsertNextCell(m_Grid->GetCellType(id_cell), N_pts, new_pts.data());
+        copyCellData(m_Grid, id_cell, new_grid, id_new_cell);
+      }
+    }
+    for (int i_patch = 0; i_patch < patches.size(); ++i_patch) {
+      const patch_t &P = patches[i_patch];
+      for (vtkIdType id_node = 0; id_node < P.grid->GetNumberOfPoints(); ++id_node) {
+        vtkIdType id_new_node = sub2new[i_patch][id_node];
+        if (id_new_node != -1 && (id_node >= P.frozen.size() || !P.frozen[id_node])) {
+          vec3_t x;
+          P.grid->GetPoint(id_node, x.data());
+          new_grid->GetPoints()->SetPoint(id_new_node, x.data());
+          copyNodeData(P.grid, id_node, new_grid, id_new_node);
+        }
+      }
+      for (vtkIdType id_cell = 0; id_cell < P.grid->GetNumberOfCells(); ++id_cell) {
+        if (P.grid->GetCellType(id_cell) == VTK_EMPTY_CELL) {
+          continue;
+        }
+        vtkIdType N_pts, *pts;
+        P.grid->GetCellPoints(id_cell, N_pts, pts);
+        QVector<vtkIdType> new_pts(N_pts);
+        for (int i = 0; i < N_pts; ++i) {
+          new_pts[i] = sub2new[i_patch][pts[i]];
+        }
+        vtkIdType id_new_cell = new_grid->InsertNextCell(P.grid->GetCellType(id_cell), N_pts, new_pts.data());
+        copyCellData(P.grid, id_cell, new_grid, id_new_cell);
+      }
+    }
+    makeCopy(new_grid, m_Grid);
+  }
+
+  foreach (const patch_t &P, patches) {
+    P.proj->setForegroundGrid(m_Grid);
+    delete P.mesher;
+    P.grid->Delete();
+  }
+  if (patch_error) {
+    throw err;
+  }
+}
+
+void SurfaceMesher::operate()
+{
+  QTime start = QTime::currentTime();
+  if (!GuiMainWindow::pointer()->checkSurfProj()) {
+    GuiMainWindow::pointer()->storeSurfaceProjection();
+  }
+  prepare();
   //computeMeshDensity(); //!!
-  {
-    QVector<int> bcs;
-    GuiMainWindow::pointer()->getAllBoundaryCodes(bcs);
-    foreach (int bc, bcs) {
-      SurfaceProjection* proj = GuiMainWindow::pointer()->getSurfProj(bc);
+  //prepare(); //!!
+  if (m_BoundaryCodes.size() == 0) {
+    return;
+  }
+  EG_VTKDCN(vtkDoubleArray, characteristic_length_desired, m_Grid, "node_meshdensity_desired");
+  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
+    characteristic_length_desired->SetValue(id_node, 1e-6);
+  }
+  updateNodeInfo(true);
+  bool mesh_patches = m_MeshPatchesInParallel && m_BoundaryCodes.size() > 1;
+  if (mesh_patches) {
+    QVector<vtkIdType> surface_cells;
+    getAllSurfaceCells(surface_cells, m_Grid);
+    if (surface_cells.size() < m_Grid->GetNumberOfCells()) {
+      cout << "the grid contains volume cells; the patches will not be meshed in parallel" << endl;
+      mesh_patches = false;
     }
   }
+  if (mesh_patches) {
+    meshPatches(start);
+  } else {
+    beginInPlaceEditing();
+    iterate(start, m_NumMaxIter);
+    endInPlaceEditing();
+  }
+  createIndices(m_Grid);
+  updateNodeInfo(false);
+  //computeMeshDensity(); //!!
 }
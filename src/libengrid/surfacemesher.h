@@ -24,16 +24,80 @@
 #define SURFACEMESHER_H
 
 #include "surfacealgorithm.h"
+#include "surfaceprojection.h"
 
 class SurfaceMesher : public SurfaceAlgorithm
 {
 
+private: // data types
+
+  /// a group of boundary codes which is meshed on its own grid (see meshPatches)
+  struct patch_t
+  {
+    QSet<int>            bcs;    ///< the boundary codes of this patch (all of them use the same surface projection)
+    SurfaceProjection*   proj;   ///< the surface projection of the boundary codes
+    vtkUnstructuredGrid* grid;   ///< the surface grid of this patch
+    QVector<vtkIdType>   nodes;  ///< the node in the main grid of each node of the patch grid (before meshing)
+    QVector<bool>        frozen; ///< the interface nodes of the patch grid (before meshing)
+    SurfaceMesher*       mesher; ///< the mesher for this patch
+  };
+
+
 protected: // attributes
 
+  double m_MaxChangeRatio;       ///< stop if the relative change of the number of nodes is below this value [%] (off if < 0)
+  double m_MaxFluctuationRatio;  ///< stop if the relative number of inserted or deleted nodes is below this value [%] (off if < 0)
+  double m_TimeBudget;           ///< stop after this time [s] (no limit if <= 0)
+  bool   m_AdaptiveSmoothSteps;  ///< scale the number of smoothing steps with the fluctuation of the last iteration
+  double m_FullSmoothFluctuation; ///< fluctuation ratio [%] for which all m_NumSmoothSteps smoothing steps are performed
+  bool   m_MeshPatchesInParallel; ///< mesh the boundary codes concurrently with frozen interfaces (see meshPatches)
+  int    m_NumInterfaceIter;      ///< number of iterations for the band around the patch interfaces (see meshPatches)
+
 protected: // methods
 
   virtual void operate();
 
+  /**
+   * Number of smoothing (and swapping) steps for the next iteration.
+   * @param fluctuation_ratio the fluctuation ratio of the last iteration [%] (negative for the first iteration)
+   */
+  int numSmoothSteps(double fluctuation_ratio);
+
+  /// true if the time budget has been used up since start
+  bool timeBudgetExhausted(const QTime &start);
+
+  /**
+   * The meshing iterations (insert, delete, smooth and swap) on a grid which is edited in place.
+   * @param start the start time of the operation (for the time budget)
+   * @param num_max_iter the maximal number of iterations
+   * @param fixed_active_set do not update the active set between the iterations
+   */
+  void iterate(const QTime &start, int num_max_iter, bool fixed_active_set = false);
+
+  /**
+   * Find the nodes which are shared by more than one boundary code.
+   * @param interface_nodes true for all interface nodes
+   */
+  void findInterfaceNodes(QVector<bool> &interface_nodes);
+
+  /**
+   * Mesh the selected boundary codes concurrently.
+   * The interfaces between the boundary codes are meshed first (in serial) together with a few layers
+   * of neighbours; this band does not grow and is only iterated m_NumInterfaceIter times. After that each group of boundary codes with the same surface projection is copied to
+   * its own grid and meshed on its own thread, while the interface nodes are frozen.
+   * Finally the patches are copied back into the main grid.
+   * @param start the start time of the operation (for the time budget)
+   */
+  void meshPatches(const QTime &start);
+
+  /**
+   * Mesh the grid of a single patch (called from a worker thread).
+   * The deleted nodes and cells are kept, so that the frozen nodes keep their IDs.
+   * All output is collected in m_Log and printed by meshPatches after all patches are done.
+   * @param start the start time of the operation (for the time budget)
+   */
+  void meshPatch(const QTime &start);
+
 public:
 
   SurfaceMesher();
@@ -47,6 +47,34 @@ SurfaceOperation::SurfaceOperation() : Operation()
   setEdgeAngle(m_EdgeAngle);
   m_BoundarySmoothing = 1;
   m_StretchingFactor = 0;
+  m_GridEditor = NULL;
+  m_PartitionHandedOver = false;
+  m_Active = NULL;
+  m_RegionCells = NULL;
+  m_RegionNodes = NULL;
+  m_RegionCore = NULL;
+  getSet("surface meshing", "run surface operations in serial mode (debugging)", false, m_Serial);
+}
+
+void SurfaceOperation::swapMeshPartition(MeshPartition &part)
+{
+  m_Part.swap(part);
+  m_Grid = m_Part.getGrid();
+  m_PartitionHandedOver = true;
+}
+
+void SurfaceOperation::setActiveRegion(const QVector<vtkIdType> *cells, const QVector<vtkIdType> *nodes, const QVector<bool> *core)
+{
+  m_RegionCells = cells;
+  m_RegionNodes = nodes;
+  m_RegionCore = core;
+}
+
+void SurfaceOperation::prepareSurfacePartition()
+{
+  if (!partitionIsCurrent()) {
+    setAllSurfaceCells();
+  }
 }
 
 void SurfaceOperation::operate()
@@ -77,6 +105,50 @@ stencil_t SurfaceOperation::getStencil(vtkIdType id_cell1, int j1)
       S.p2 = pts[j1 + 1];
     }
   }
+  FieldView<int> cell_code = fields().cellCode();
+
+  // use the half-edge twins if the edge is not shared by more than two cells
+  int i_cells1 = -1;
+  if (id_cell1 < m_Part.getLocalCells().size()) {
+    i_cells1 = m_Part.localCell(id_cell1);
+  }
+  int twin = -2;
+  if (i_cells1 >= 0 && isSurface(id_cell1, m_Grid)) {
+    twin = m_Part.twinHalfEdge(i_cells1, j1);
+  }
+  if (twin != -2) {
+    S.sameBC = true;
+    S.id_cell.resize(1);
+    S.id_cell[0] = id_cell1;
+    if (twin >= 0) {
+      vtkIdType id_cell2 = m_Part.globalCell(twin/4);
+      S.id_cell.push_back(id_cell2);
+      if (cell_code[id_cell2] != cell_code[id_cell1]) {
+        S.sameBC = false;
+      }
+    }
+  } else {
+    getStencilCells(id_cell1, S);
+  }
+
+  S.id_node.resize(S.id_cell.size());
+  S.type_cell.resize(S.id_cell.size());
+  for (int i = 0; i < S.id_cell.size(); ++i) {
+    vtkIdType N_pts, *pts;
+    m_Grid->GetCellPoints(S.id_cell[i], N_pts, pts);
+    S.type_cell[i] = m_Grid->GetCellType(S.id_cell[i]);
+    for (int j = 0; j < N_pts; ++j) {
+      if (pts[j] != S.p1 && pts[j] != S.p2) {
+        S.id_node[i] = pts[j];
+        break;
+      }
+    }
+  }
+  return S;
+}
+
+void SurfaceOperation::getStencilCells(vtkIdType id_cell1, stencil_t &S)
+{
   QSet<vtkIdType> cells_p1;
   for (int i = 0; i < m_Part.n2cGSize(S.p1); ++i) {
     vtkIdType id_cell = m_Part.n2cGG(S.p1, i);
@@ -92,32 +164,18 @@ stencil_t SurfaceOperation::getStencil(vtkIdType id_cell1, int j1)
     }
   }
   QSet<vtkIdType> cells = cells_p1.intersect(cells_p2);
-  EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
+  FieldView<int> cell_code = fields().cellCode();
   S.sameBC = true;
   S.id_cell.resize(1);
   S.id_cell[0] = id_cell1;
   foreach (vtkIdType id_cell, cells) {
     if (isSurface(id_cell, m_Grid)) {
       S.id_cell.push_back(id_cell);
-      if (cell_code->GetValue(id_cell) != cell_code->GetValue(id_cell1)) {
+      if (cell_code[id_cell] != cell_code[id_cell1]) {
         S.sameBC = false;
       }
     }
   }
-  S.id_node.resize(S.id_cell.size());
-  S.type_cell.resize(S.id_cell.size());
-  for (int i = 0; i < S.id_cell.size(); ++i) {
-    vtkIdType N_pts, *pts;
-    m_Grid->GetCellPoints(S.id_cell[i], N_pts, pts);
-    S.type_cell[i] = m_Grid->GetCellType(S.id_cell[i]);
-    for (int j = 0; j < N_pts; ++j) {
-      if (pts[j] != S.p1 && pts[j] != S.p2) {
-        S.id_node[i] = pts[j];
-        break;
-      }
-    }
-  }
-  return S;
 }
 
 int SurfaceOperation::UpdateCurrentMeshDensity()
@@ -147,18 +205,21 @@ int SurfaceOperation::UpdateCurrentMeshDensity()
 
 int SurfaceOperation::UpdatePotentialSnapPoints( bool update_node_types, bool fix_unselected)
 {
-  setAllSurfaceCells();
+  prepareSurfacePartition();
 
-  l2g_t nodes  = getPartNodes();
-  l2g_t cells  = getPartCells();
+  // in a restricted region only the core nodes are updated, because all their edges are part of the region
+  l2g_t nodes  = loopNodes();
+  l2g_t cells  = loopCells();
 
   m_PotentialSnapPoints.resize(m_Grid->GetNumberOfPoints());
 
   //initialize default values
   EG_VTKDCN( vtkCharArray, node_type, m_Grid, "node_type" );
   foreach( vtkIdType id_node, nodes ) {
-    if ( update_node_types ) node_type->SetValue( id_node, VTK_SIMPLE_VERTEX );
-    m_PotentialSnapPoints[id_node].clear();
+    if (isRegionCore(id_node)) {
+      if ( update_node_types ) node_type->SetValue( id_node, VTK_SIMPLE_VERTEX );
+      m_PotentialSnapPoints[id_node].clear();
+    }
   }
 
   //cout<<"===pre-processing==="<<endl;
@@ -191,31 +252,35 @@ int SurfaceOperation::UpdatePotentialSnapPoints( bool update_node_types, bool fi
       char edge = getEdgeType( id_node2, id_node1, fix_unselected );
       //-----------------------
       //determine node type pre-processing (count nb of complex edges if the node is complex, otherwise, just count the nb of edges)
-      if ( edge && node_type->GetValue( id_node1 ) == VTK_SIMPLE_VERTEX ) {
-        m_PotentialSnapPoints[id_node1].clear();
-        m_PotentialSnapPoints[id_node1].push_back( id_node2 );
-        if ( update_node_types ) node_type->SetValue( id_node1, edge );
-      }
-      else if (( edge && node_type->GetValue( id_node1 ) == VTK_BOUNDARY_EDGE_VERTEX ) ||
-               ( edge && node_type->GetValue( id_node1 ) == VTK_FEATURE_EDGE_VERTEX ) ||
-               ( !edge && node_type->GetValue( id_node1 ) == VTK_SIMPLE_VERTEX ) ) {
-        m_PotentialSnapPoints[id_node1].push_back( id_node2 );
-        if ( node_type->GetValue( id_node1 ) && edge == VTK_BOUNDARY_EDGE_VERTEX ) {
-          if ( update_node_types ) node_type->SetValue( id_node1, VTK_BOUNDARY_EDGE_VERTEX );//VTK_BOUNDARY_EDGE_VERTEX has priority over VTK_FEATURE_EDGE_VERTEX
+      if (isRegionCore(id_node1)) {
+        if ( edge && node_type->GetValue( id_node1 ) == VTK_SIMPLE_VERTEX ) {
+          m_PotentialSnapPoints[id_node1].clear();
+          m_PotentialSnapPoints[id_node1].push_back( id_node2 );
+          if ( update_node_types ) node_type->SetValue( id_node1, edge );
+        }
+        else if (( edge && node_type->GetValue( id_node1 ) == VTK_BOUNDARY_EDGE_VERTEX ) ||
+                 ( edge && node_type->GetValue( id_node1 ) == VTK_FEATURE_EDGE_VERTEX ) ||
+                 ( !edge && node_type->GetValue( id_node1 ) == VTK_SIMPLE_VERTEX ) ) {
+          m_PotentialSnapPoints[id_node1].push_back( id_node2 );
+          if ( node_type->GetValue( id_node1 ) && edge == VTK_BOUNDARY_EDGE_VERTEX ) {
+            if ( update_node_types ) node_type->SetValue( id_node1, VTK_BOUNDARY_EDGE_VERTEX );//VTK_BOUNDARY_EDGE_VERTEX has priority over VTK_FEATURE_EDGE_VERTEX
+          }
         }
       }
 
-      if ( edge && node_type->GetValue( id_node2 ) == VTK_SIMPLE_VERTEX ) {
-        m_PotentialSnapPoints[id_node2].clear();
-        m_PotentialSnapPoints[id_node2].push_back( id_node1 );
-        if ( update_node_types ) node_type->SetValue( id_node2, edge );
-      }
-      else if (( edge && node_type->GetValue( id_node2 ) == VTK_BOUNDARY_EDGE_VERTEX ) ||
-               ( edge && node_type->GetValue( id_node2 ) == VTK_FEATURE_EDGE_VERTEX ) ||
-               ( !edge && node_type->GetValue( id_node2 ) == VTK_SIMPLE_VERTEX ) ) {
-        m_PotentialSnapPoints[id_node2].push_back( id_node1 );
-        if ( node_type->GetValue( id_node2 ) && edge == VTK_BOUNDARY_EDGE_VERTEX ) {
-          if ( update_node_types ) node_type->SetValue( id_node2, VTK_BOUNDARY_EDGE_VERTEX );//VTK_BOUNDARY_EDGE_VERTEX has priority over VTK_FEATURE_EDGE_VERTEX
+      if (isRegionCore(id_node2)) {
+        if ( edge && node_type->GetValue( id_node2 ) == VTK_SIMPLE_VERTEX ) {
+          m_PotentialSnapPoints[id_node2].clear();
+          m_PotentialSnapPoints[id_node2].push_back( id_node1 );
+          if ( update_node_types ) node_type->SetValue( id_node2, edge );
+        }
+        else if (( edge && node_type->GetValue( id_node2 ) == VTK_BOUNDARY_EDGE_VERTEX ) ||
+                 ( edge && node_type->GetValue( id_node2 ) == VTK_FEATURE_EDGE_VERTEX ) ||
+                 ( !edge && node_type->GetValue( id_node2 ) == VTK_SIMPLE_VERTEX ) ) {
+          m_PotentialSnapPoints[id_node2].push_back( id_node1 );
+          if ( node_type->GetValue( id_node2 ) && edge == VTK_BOUNDARY_EDGE_VERTEX ) {
+            if ( update_node_types ) node_type->SetValue( id_node2, VTK_BOUNDARY_EDGE_VERTEX );//VTK_BOUNDARY_EDGE_VERTEX has priority over VTK_FEATURE_EDGE_VERTEX
+          }
         }
       }
     }
@@ -229,6 +294,9 @@ int SurfaceOperation::UpdatePotentialSnapPoints( bool update_node_types, bool fi
   //cout<<"===post-processing==="<<endl;
   //This time, we loop through nodes
   foreach( vtkIdType id_node, nodes ) {
+    if (!isRegionCore(id_node)) {
+      continue;
+    }
     if ( node_type->GetValue( id_node ) == VTK_FEATURE_EDGE_VERTEX || node_type->GetValue( id_node ) == VTK_BOUNDARY_EDGE_VERTEX ) { //see how many edges; if two, what the angle is
 
       if ( !this->m_BoundarySmoothing && node_type->GetValue( id_node ) == VTK_BOUNDARY_EDGE_VERTEX ) {
@@ -334,42 +402,25 @@ char SurfaceOperation::getNodeType(vtkIdType id_node, bool fix_unselected)
 
 int SurfaceOperation::getEdgeCells(vtkIdType id_node1, vtkIdType id_node2, QVector <vtkIdType> &EdgeCells)
 {
-  g2l_t _nodes = getPartLocalNodes();
-  l2g_t cells  = getPartCells();
-  l2l_t n2c    = getPartN2C();
-
-  QSet<vtkIdType> S1;
-  foreach (int i, n2c[_nodes[id_node1]]) {
-    S1.insert(cells[i]);
-  }
-
-  QSet<vtkIdType> S2;
-  foreach( int i, n2c[_nodes[id_node2]] ) {
-    S2.insert(cells[i]);
+  vtkIdType edge_cells[4];
+  int N = m_Part.edgeCells(id_node1, id_node2, edge_cells, 4);
+  EdgeCells.resize(N);
+  if (N <= 4) {
+    qCopy(edge_cells, edge_cells + N, EdgeCells.begin());
+  } else {
+    m_Part.edgeCells(id_node1, id_node2, EdgeCells.data(), N);
   }
-
-  S2.intersect(S1);
-  EdgeCells = Set2Vector(S2, false);
-  return EdgeCells.size();
+  return N;
 }
 
 int SurfaceOperation::getEdgeCells( vtkIdType id_node1, vtkIdType id_node2, QSet <vtkIdType> &EdgeCells )
 {
-  g2l_t _nodes = getPartLocalNodes();
-  l2g_t cells  = getPartCells();
-  l2l_t n2c    = getPartN2C();
-
-  QSet<vtkIdType> S1;
-  foreach( int i, n2c[_nodes[id_node1]] ) {
-    S1.insert( cells[i] );
-  }
-
-  QSet<vtkIdType> S2;
-  foreach( int i, n2c[_nodes[id_node2]] ) {
-    S2.insert( cells[i] );
+  QVector<vtkIdType> edge_cells;
+  getEdgeCells(id_node1, id_node2, edge_cells);
+  EdgeCells.clear();
+  foreach (vtkIdType id_cell, edge_cells) {
+    EdgeCells.insert(id_cell);
   }
-
-  EdgeCells = S2.intersect( S1 );
   return EdgeCells.size();
 }
 
@@ -379,8 +430,8 @@ char SurfaceOperation::getEdgeType(vtkIdType a_node1, vtkIdType a_node2, bool fi
   bool feature_edges_disabled = m_FeatureAngle >= M_PI;
 
   //compute number of cells around edge [a_node,p2] and put them into neighbour_cells
-  QVector <vtkIdType> neighbour_cells;
-  int numNei = getEdgeCells(a_node1, a_node2, neighbour_cells) - 1;
+  vtkIdType neighbour_cells[2];
+  int numNei = m_Part.edgeCells(a_node1, a_node2, neighbour_cells, 2) - 1;
 
   //set default value
   char edge = VTK_SIMPLE_VERTEX;
@@ -400,9 +451,9 @@ char SurfaceOperation::getEdgeType(vtkIdType a_node1, vtkIdType a_node2, bool fi
       edge = VTK_FEATURE_EDGE_VERTEX;
     }
     //check the boundary codes
-    EG_VTKDCC( vtkIntArray, cell_code, m_Grid, "cell_code" );
-    int cell_code_0 = cell_code->GetValue( neighbour_cells[0] );
-    int cell_code_1 = cell_code->GetValue( neighbour_cells[1] );
+    FieldView<int> cell_code = fields().cellCode();
+    int cell_code_0 = cell_code[neighbour_cells[0]];
+    int cell_code_1 = cell_code[neighbour_cells[1]];
     if ( cell_code_0 !=  cell_code_1 ) {
       edge = VTK_BOUNDARY_EDGE_VERTEX;
     }
@@ -426,17 +477,17 @@ VertexMeshDensity SurfaceOperation::getVMD( vtkIdType id_node )
   l2g_t  cells = getPartCells();
   l2l_t  n2c   = getPartN2C();
 
-  EG_VTKDCN( vtkCharArray, node_type, m_Grid, "node_type" );
-  EG_VTKDCC( vtkIntArray, cell_code, m_Grid, "cell_code" );
+  FieldView<char> node_type = fields().nodeType();
+  FieldView<int>  cell_code = fields().cellCode();
 
   VertexMeshDensity VMD;
-  VMD.type = node_type->GetValue( id_node );
+  VMD.type = node_type[id_node];
   VMD.density = 0;
   VMD.CurrentNode = id_node;
 
   foreach( int i_cell, n2c[_nodes[id_node]] ) {
     vtkIdType id_cell = cells[i_cell];
-    VMD.BCmap[cell_code->GetValue( id_cell )] = 2;
+    VMD.BCmap[cell_code[id_cell]] = 2;
   }
   return( VMD );
 }
@@ -473,8 +524,7 @@ double SurfaceOperation::CurrentMeshDensity( vtkIdType id_node )
 /// desired edge length for id_node
 double SurfaceOperation::desiredEdgeLength( vtkIdType id_node )
 {
-  EG_VTKDCN( vtkDoubleArray, characteristic_length_desired, m_Grid, "node_meshdensity_desired" );
-  return( 1.0 / characteristic_length_desired->GetValue( id_node ) );
+  return( 1.0 / fields().nodeMeshDensityDesired()[id_node] );
 }
 
 /// mean desired edge length for id_cell
@@ -495,7 +545,7 @@ QVector <vtkIdType> SurfaceOperation::getPotentialSnapPoints( vtkIdType id_node
     // UpdatePotentialSnapPoints should probably be called before using this function.
     EG_BUG;
   }
-  return m_PotentialSnapPoints[id_node];
+  return m_PotentialSnapPoints.at(id_node);
 }
 
 bool SurfaceOperation::isCell(vtkIdType id_node1, vtkIdType id_node2, vtkIdType id_node3)
@@ -527,82 +577,88 @@ bool SurfaceOperation::isCell(vtkIdType id_node1, vtkIdType id_node2, vtkIdType
 void SurfaceOperation::computeNormals()
 {
   EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
-  m_NodeNormal.fill(vec3_t(0,0,0), m_Grid->GetNumberOfPoints());
-  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
-    if (m_Part.localNode(id_node) != -1) {
-      QSet<int> bcs;
-      for (int i = 0; i < m_Part.n2cGSize(id_node); ++i) {
-        vtkIdType id_cell = m_Part.n2cGG(id_node, i);
-        if (isSurface(id_cell, m_Grid)) {
-          int bc = cell_code->GetValue(id_cell);
-          if (m_BoundaryCodes.contains(bc)) {
-            bcs.insert(bc);
-          }
+  if (m_RegionNodes) {
+    // only the normals of the region are needed
+    m_NodeNormal.resize(m_Grid->GetNumberOfPoints());
+    foreach (vtkIdType id_node, *m_RegionNodes) {
+      m_NodeNormal[id_node] = vec3_t(0,0,0);
+    }
+  } else {
+    m_NodeNormal.fill(vec3_t(0,0,0), m_Grid->GetNumberOfPoints());
+  }
+  foreach (vtkIdType id_node, loopNodes()) {
+    QSet<int> bcs;
+    for (int i = 0; i < m_Part.n2cGSize(id_node); ++i) {
+      vtkIdType id_cell = m_Part.n2cGG(id_node, i);
+      if (isSurface(id_cell, m_Grid)) {
+        int bc = cell_code->GetValue(id_cell);
+        if (m_BoundaryCodes.contains(bc)) {
+          bcs.insert(bc);
         }
       }
-      int num_bcs = bcs.size();
-      QVector<vec3_t> normal(num_bcs, vec3_t(0,0,0));
-      QMap<int,int> bcmap;
-      int i_bc = 0;
-      foreach (int bc, bcs) {
-        bcmap[bc] = i_bc;
-        ++i_bc;
-      }
-      for (int i = 0; i < m_Part.n2cGSize(id_node); ++i) {
-        vtkIdType id_cell = m_Part.n2cGG(id_node, i);
-        if (isSurface(id_cell, m_Grid)) {
-          int bc = cell_code->GetValue(id_cell);
-          if (m_BoundaryCodes.contains(bc)) {
-            vtkIdType N_pts, *pts;
-            m_Grid->GetCellPoints(id_cell, N_pts, pts);
-            vec3_t a, b, c;
-            for (int j = 0; j < N_pts; ++j) {
-              if (pts[j] == id_node) {
-                m_Grid->GetPoint(pts[j], a.data());
-                if (j > 0) {
-                  m_Grid->GetPoint(pts[j-1], b.data());
-                } else {
-                  m_Grid->GetPoint(pts[N_pts-1], b.data());
-                }
-                if (j < N_pts - 1) {
-                  m_Grid->GetPoint(pts[j+1], c.data());
-                } else {
-                  m_Grid->GetPoint(pts[0], c.data());
-                }
+    }
+    int num_bcs = bcs.size();
+    QVector<vec3_t> normal(num_bcs, vec3_t(0,0,0));
+    QMap<int,int> bcmap;
+    int i_bc = 0;
+    foreach (int bc, bcs) {
+      bcmap[bc] = i_bc;
+      ++i_bc;
+    }
+    for (int i = 0; i < m_Part.n2cGSize(id_node); ++i) {
+      vtkIdType id_cell = m_Part.n2cGG(id_node, i);
+      if (isSurface(id_cell, m_Grid)) {
+        int bc = cell_code->GetValue(id_cell);
+        if (m_BoundaryCodes.contains(bc)) {
+          vtkIdType N_pts, *pts;
+          m_Grid->GetCellPoints(id_cell, N_pts, pts);
+          vec3_t a, b, c;
+          for (int j = 0; j < N_pts; ++j) {
+            if (pts[j] == id_node) {
+              m_Grid->GetPoint(pts[j], a.data());
+              if (j > 0) {
+                m_Grid->GetPoint(pts[j-1], b.data());
+              } else {
+                m_Grid->GetPoint(pts[N_pts-1], b.data());
+              }
+              if (j < N_pts - 1) {
+                m_Grid->GetPoint(pts[j+1], c.data());
+              } else {
+                m_Grid->GetPoint(pts[0], c.data());
               }
             }
-            vec3_t u = b - a;
-            vec3_t v = c - a;
-            double alpha = GeometryTools::angle(u, v);
-            vec3_t n = u.cross(v);
-            n.normalise();
-            normal[bcmap[bc]] += alpha*n;
           }
+          vec3_t u = b - a;
+          vec3_t v = c - a;
+          double alpha = GeometryTools::angle(u, v);
+          vec3_t n = u.cross(v);
+          n.normalise();
+          normal[bcmap[bc]] += alpha*n;
         }
       }
-      for (int i = 0; i < num_bcs; ++i) {
-        normal[i].normalise();
-      }
-      if (num_bcs > 0) {
-        if (num_bcs > 1) {
-          if (num_bcs == 3) {
-            for (int i = 0; i < num_bcs; ++i) {
-              for (int j = i + 1; j < num_bcs; ++j) {
-                vec3_t n = normal[i] + normal[j];
-                n.normalise();
-                m_NodeNormal[id_node] += n;
-              }
-            }
-          } else {
-            for (int i = 0; i < num_bcs; ++i) {
-              m_NodeNormal[id_node] += normal[i];
+    }
+    for (int i = 0; i < num_bcs; ++i) {
+      normal[i].normalise();
+    }
+    if (num_bcs > 0) {
+      if (num_bcs > 1) {
+        if (num_bcs == 3) {
+          for (int i = 0; i < num_bcs; ++i) {
+            for (int j = i + 1; j < num_bcs; ++j) {
+              vec3_t n = normal[i] + normal[j];
+              n.normalise();
+              m_NodeNormal[id_node] += n;
             }
           }
         } else {
-          m_NodeNormal[id_node] = normal[0];
+          for (int i = 0; i < num_bcs; ++i) {
+            m_NodeNormal[id_node] += normal[i];
+          }
         }
-        m_NodeNormal[id_node].normalise();
+      } else {
+        m_NodeNormal[id_node] = normal[0];
       }
+      m_NodeNormal[id_node].normalise();
     }
   }
 }
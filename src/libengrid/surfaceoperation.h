@@ -24,6 +24,7 @@
 #define SURFACEOPERATION_H
 
 #include "operation.h"
+#include "grideditor.h"
 
 //==============================================
 
@@ -60,12 +61,43 @@ protected: // attributes
   QVector<vec3_t> m_NodeNormal; ///< node normal vectors
   double m_StretchingFactor;
 
+  GridEditor* m_GridEditor; ///< editor for in-place changes of m_Grid (NULL if the operation uses its own editor)
+  bool        m_Serial;     ///< run the parallel loops with one thread only (the result does not depend on this)
+  bool        m_PartitionHandedOver; ///< m_Part has been handed over with swapMeshPartition and contains all surface cells
+
+  const QVector<bool>*      m_Active;      ///< nodes which may be changed (see setActiveNodes); NULL if all nodes may be changed
+  const QVector<vtkIdType>* m_RegionCells; ///< the loops only run over these cells (see setActiveRegion); NULL for all cells of m_Part
+  const QVector<vtkIdType>* m_RegionNodes; ///< all nodes of *m_RegionCells
+  const QVector<bool>*      m_RegionCore;  ///< nodes whose cells are all part of the region
+
 
 protected: // methods
 
   void computeNormals();
+
+  /// true if m_Part is kept up to date by the in-place changes and must not be rebuilt
+  bool partitionIsCurrent() { return m_GridEditor && m_PartitionHandedOver; }
+
+  /// select all surface cells for m_Part, unless the partition is kept up to date (see swapMeshPartition)
+  void prepareSurfacePartition();
+
+  /// false if a node must not be changed, because it is outside of the active set (see setActiveNodes)
+  bool isActive(vtkIdType id_node) const { return !m_Active || id_node >= m_Active->size() || (*m_Active)[id_node]; }
+
+  /// false if some cells of a node are outside of the region the loops run over (see setActiveRegion)
+  bool isRegionCore(vtkIdType id_node) const { return !m_RegionCore || id_node >= m_RegionCore->size() || (*m_RegionCore)[id_node]; }
+
+  /// the cells the loops run over: the active region or all cells of m_Part (see setActiveRegion)
+  l2g_t loopCells() const { return m_RegionCells ? *m_RegionCells : m_Part.getCells(); }
+
+  /// the nodes the loops run over: the active region or all nodes of m_Part (see setActiveRegion)
+  l2g_t loopNodes() { return m_RegionNodes ? *m_RegionNodes : m_Part.getNodes(); }
+
   double normalIrregularity(vtkIdType id_node);
 
+  /// find the cells of a stencil from the node to cell information (for edges with more than two cells)
+  void getStencilCells(vtkIdType id_cell1, stencil_t &S);
+
 public:
 
   SurfaceOperation();
@@ -117,6 +149,39 @@ public:
   bool isCell(vtkIdType id_node1, vtkIdType id_node2, vtkIdType id_node3);
 
   void setStretchingFactor(double sf) { m_StretchingFactor = sf; }
+  void setSerial(bool serial) { m_Serial = serial; }
+
+  /**
+   * Use an external editor for the in-place changes of the grid.
+   * Deleted nodes and cells will then remain in the grid until the owner
+   * of the editor calls GridEditor::compact.
+   */
+  void setGridEditor(GridEditor *editor) { m_GridEditor = editor; }
+
+  /**
+   * Hand over a partition of all surface cells of the grid by exchanging it with m_Part (nothing is copied).
+   * If a grid editor has been set as well, the operation keeps this partition up to date
+   * instead of rebuilding it; the caller takes it back by calling this method again afterwards.
+   */
+  void swapMeshPartition(MeshPartition &part);
+
+  /**
+   * Only allow changes of some nodes.
+   * The vector is not copied and has to stay alive and unchanged while the operation runs.
+   * @param active true for all nodes which may be changed; nodes beyond the end of the vector (e.g. new nodes) may be changed as well
+   */
+  void setActiveNodes(const QVector<bool> *active) { m_Active = active; }
+
+  /**
+   * Restrict the loops of the operation to a region of the grid.
+   * This requires a partition which is kept up to date (see swapMeshPartition); all active nodes
+   * and their neighbours have to be core nodes of the region.
+   * The vectors are not copied and have to stay alive and unchanged while the operation runs.
+   * @param cells all surface cells around the core nodes
+   * @param nodes all nodes of these cells
+   * @param core true for the core nodes; nodes beyond the end of the vector (e.g. new nodes) are core nodes as well
+   */
+  void setActiveRegion(const QVector<vtkIdType> *cells, const QVector<vtkIdType> *nodes, const QVector<bool> *core);
 
 };
 
@@ -21,6 +21,12 @@
 // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 // 
 #include "surfaceprojection.h"
+#include "binaryio.h"
+
+#include <vtkIntArray.h>
+#include <vtkPoints.h>
+
+#include <QHash>
 
 #include <math.h>
 
@@ -30,14 +36,16 @@ vtkIdType SurfaceProjection::m_LastPindex = 0;
 
 SurfaceProjection::SurfaceProjection() : SurfaceAlgorithm()
 {
-  m_BGrid = vtkUnstructuredGrid::New();
+  m_OwnBGrid = vtkUnstructuredGrid::New();
+  m_BGrid = m_OwnBGrid;
   this->setGrid(m_BGrid);
   m_CritDistance = 0.1;
+  m_LastProjTriangle = -1;
 }
 
 SurfaceProjection::~SurfaceProjection()
 {
-  m_BGrid->Delete();
+  m_OwnBGrid->Delete();
 }
 
 void SurfaceProjection::setForegroundGrid(vtkUnstructuredGrid *grid)
@@ -45,162 +53,327 @@ void SurfaceProjection::setForegroundGrid(vtkUnstructuredGrid *grid)
   m_FGrid = grid;
 }
 
-void SurfaceProjection::searchNewTriangle(vec3_t xp, vtkIdType &id_tri, vec3_t &x_proj, vec3_t &r_proj, bool neigh_mode, bool &on_triangle)
+void SurfaceProjection::searchNewTriangle(vec3_t xp, vtkIdType &id_tri, vec3_t &x_proj, vec3_t &r_proj, bool neigh_mode, bool &on_triangle) const
 {
   x_proj = vec3_t(1e99, 1e99, 1e99);
   r_proj = vec3_t(0, 0, 0);
-  vec3_t xi, ri;
   double d_min      = 1e99;
   bool   x_proj_set = false;
   on_triangle = false;
-  QVector<vtkIdType> candidate_faces;
-  if (neigh_mode) {
-    if (id_tri == -1) {
+  if (!neigh_mode) {
+    // exact closest triangle; the current triangle is a good start for the search
+    id_tri = m_TriangleTree.findClosest(xp, id_tri, d_min);
+    if (id_tri < 0) {
+      qWarning() << "No projection found for point xp=" << xp[0] << xp[1] << xp[2] << endl;
       EG_BUG;
     }
-    QSet<vtkIdType> raw;
-    QSet<vtkIdType> src;
-    src.insert(id_tri);
-    for (int level = 0; level < 2; ++level) {
-      foreach (vtkIdType id_src, src) {
-        vtkIdType N_pts, *pts;
-        m_BGrid->GetCellPoints(id_src, N_pts, pts);
-        for (int i = 0; i < N_pts; ++i) {
-          for (int j = 0; j < m_BPart.n2cGSize(pts[i]); ++j) {
-            raw.insert(m_BPart.n2cGG(pts[i], j));
-          }
+    on_triangle = projectOnTriangle(id_tri, xp, x_proj, r_proj, d_min, true);
+    return;
+  }
+  if (id_tri == -1) {
+    EG_BUG;
+  }
+  QVector<vtkIdType> candidate_faces;
+  QSet<vtkIdType> raw;
+  QSet<vtkIdType> src;
+  src.insert(id_tri);
+  for (int level = 0; level < 2; ++level) {
+    foreach (vtkIdType id_src, src) {
+      for (int i = 0; i < 3; ++i) {
+        foreach (int i_tri, m_N2T[m_TriNodes[3*id_src + i]]) {
+          raw.insert(i_tri);
         }
       }
-      src = raw;
-    }
-    int i = 0;
-    candidate_faces.resize(raw.size());
-    foreach (vtkIdType id_cell, raw) {
-      candidate_faces[i] = id_cell;
-      ++i;
     }
-  } else {
-    m_FaceFinder.getCloseFaces(xp, candidate_faces);
+    src = raw;
   }
-  if (candidate_faces.size() == 0) {
-    // backup method -- really inefficient!
-    candidate_faces.resize(m_Triangles.size());
-    for (vtkIdType id_triangle = 0; id_triangle < m_Triangles.size(); ++id_triangle) {
-      candidate_faces[id_triangle] = id_triangle;
-    }
+  int i = 0;
+  candidate_faces.resize(raw.size());
+  foreach (vtkIdType id_cell, raw) {
+    candidate_faces[i] = id_cell;
+    ++i;
   }
-  foreach (vtkIdType id_triangle, candidate_faces) {
-    Triangle T = m_Triangles[id_triangle];
-    double d;
-    int side;
-    bool intersects = T.projectOnTriangle(xp, xi, ri, d, side, true);
-    if (d >= 1e99) {
-      EG_BUG;
-    }
-    if (d < d_min) {
-      x_proj = xi;
-      x_proj_set = true;
-      r_proj = ri;
-      d_min = d;
-      id_tri = id_triangle;
-      on_triangle = intersects;
-    }
+  vtkIdType id_closest = m_TriangleTree.findClosest(xp, candidate_faces, d_min);
+  if (id_closest >= 0) {
+    on_triangle = projectOnTriangle(id_closest, xp, x_proj, r_proj, d_min, true);
+    x_proj_set = true;
+    id_tri = id_closest;
   }
   if (!x_proj_set) { // should never happen
+    checkVector(xp);
+    qWarning() << "No projection found for point xp=" << xp[0] << xp[1] << xp[2] << endl;
     EG_BUG;
-    for (vtkIdType id_triangle = 0; id_triangle < m_BGrid->GetNumberOfCells(); ++id_triangle) {
-      Triangle T = m_Triangles[id_triangle];
-      double d;
-      int side;
-      bool intersects = T.projectOnTriangle(xp, xi, ri, d, side, true);
-      if (d >= 1e99) {
-        EG_BUG;
+  }
+}
+
+bool SurfaceProjection::projectOnTriangle(int i_tri, vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, bool restrict_to_triangle) const
+{
+  int side;
+  return Triangle::projectOnTriangle(triNode(i_tri, 0), triNode(i_tri, 1), triNode(i_tri, 2), m_Frames[i_tri].g3, xp, xi, ri, d, side, restrict_to_triangle);
+}
+
+void SurfaceProjection::copyGeometry(vtkUnstructuredGrid *src, const QVector<vtkIdType> &cells, vtkUnstructuredGrid *dst, QVector<vtkIdType> &src_nodes)
+{
+  EG_VTKDCC(vtkIntArray, src_code, src, "cell_code");
+  QVector<vtkIdType> dst_node(src->GetNumberOfPoints(), -1);
+  src_nodes.clear();
+  int num_triangles = 0;
+  foreach (vtkIdType id_cell, cells) {
+    vtkIdType type_cell = src->GetCellType(id_cell);
+    if (type_cell == VTK_TRIANGLE) {
+      ++num_triangles;
+    } else if (type_cell == VTK_QUAD) {
+      num_triangles += 2;
+    } else {
+      EG_BUG;
+    }
+    vtkIdType N_pts, *pts;
+    src->GetCellPoints(id_cell, N_pts, pts);
+    for (int i = 0; i < N_pts; ++i) {
+      if (dst_node[pts[i]] < 0) {
+        dst_node[pts[i]] = src_nodes.size();
+        src_nodes.append(pts[i]);
       }
-      if (d < 0) {
-        EG_BUG;
+    }
+  }
+  vtkPoints *points = vtkPoints::New();
+  points->SetNumberOfPoints(src_nodes.size());
+  for (int i = 0; i < src_nodes.size(); ++i) {
+    vec3_t x;
+    src->GetPoint(src_nodes[i], x.data());
+    points->SetPoint(i, x.data());
+  }
+  vtkIntArray *cell_code = vtkIntArray::New();
+  cell_code->SetName("cell_code");
+  cell_code->SetNumberOfValues(num_triangles);
+  dst->Initialize();
+  dst->SetPoints(points);
+  dst->Allocate(num_triangles);
+  foreach (vtkIdType id_cell, cells) {
+    vtkIdType N_pts, *pts;
+    src->GetCellPoints(id_cell, N_pts, pts);
+    vtkIdType new_pts[3];
+    new_pts[0] = dst_node[pts[0]];
+    new_pts[1] = dst_node[pts[1]];
+    new_pts[2] = dst_node[pts[2]];
+    cell_code->SetValue(dst->InsertNextCell(VTK_TRIANGLE, 3, new_pts), src_code->GetValue(id_cell));
+    if (N_pts == 4) {
+      new_pts[0] = dst_node[pts[2]];
+      new_pts[1] = dst_node[pts[3]];
+      new_pts[2] = dst_node[pts[0]];
+      cell_code->SetValue(dst->InsertNextCell(VTK_TRIANGLE, 3, new_pts), src_code->GetValue(id_cell));
+    }
+  }
+  dst->GetCellData()->AddArray(cell_code);
+  points->Delete();
+  cell_code->Delete();
+}
+
+void SurfaceProjection::buildBackgroundGrid(vtkUnstructuredGrid *grid, const QVector<vtkIdType> &cells)
+{
+  m_BGrid = grid;
+  setGrid(m_BGrid);
+  m_Cells = cells;
+  updateBackgroundGridInfo();
+}
+
+namespace
+{
+  const quint32 cache_magic   = 0x45475052; // "EGPR"
+  const quint32 cache_version = 3;
+  const quint32 cache_bom     = 0x01020304;
+
+  double gridChecksum(vtkUnstructuredGrid *grid)
+  {
+    double sum = 0;
+    for (vtkIdType id_node = 0; id_node < grid->GetNumberOfPoints(); ++id_node) {
+      vec3_t x;
+      grid->GetPoint(id_node, x.data());
+      sum += (id_node%7 + 1)*(x[0] + 2*x[1] + 3*x[2]);
+    }
+    // the boundary codes define which cells belong to which projection
+    EG_VTKDCC(vtkIntArray, cell_code, grid, "cell_code");
+    for (vtkIdType id_cell = 0; id_cell < grid->GetNumberOfCells(); ++id_cell) {
+      vtkIdType N_pts, *pts;
+      grid->GetCellPoints(id_cell, N_pts, pts);
+      for (int i = 0; i < N_pts; ++i) {
+        sum += (i + 1)*pts[i];
       }
-      if (d < d_min) {
-        x_proj = xi;
-        x_proj_set = true;
-        r_proj = ri;
-        d_min = d;
-        id_tri = id_triangle;
-        on_triangle = intersects;
+      sum += (id_cell%5 + 1)*cell_code->GetValue(id_cell);
+    }
+    return sum;
+  }
+}
+
+void SurfaceProjection::writeCacheHeader(QDataStream &s, vtkUnstructuredGrid *grid)
+{
+  s << cache_magic << cache_version;
+  writeRaw(s, cache_bom);
+  s << quint32(sizeof(vtkIdType)) << quint32(sizeof(vec3_t)) << quint32(sizeof(Frame));
+  s << qint64(grid->GetNumberOfPoints()) << qint64(grid->GetNumberOfCells()) << gridChecksum(grid);
+}
+
+bool SurfaceProjection::readCacheHeader(QDataStream &s, vtkUnstructuredGrid *grid)
+{
+  quint32 magic, version, bom, size_id, size_vec, size_frame;
+  s >> magic >> version;
+  if (s.status() != QDataStream::Ok || magic != cache_magic || version != cache_version) {
+    return false;
+  }
+  if (!readRaw(s, bom) || bom != cache_bom) {
+    return false;
+  }
+  s >> size_id >> size_vec >> size_frame;
+  if (size_id != sizeof(vtkIdType) || size_vec != sizeof(vec3_t) || size_frame != sizeof(Frame)) {
+    return false;
+  }
+  qint64 num_nodes, num_cells;
+  double checksum;
+  s >> num_nodes >> num_cells >> checksum;
+  if (s.status() != QDataStream::Ok) {
+    return false;
+  }
+  return num_nodes == grid->GetNumberOfPoints() && num_cells == grid->GetNumberOfCells() && checksum == gridChecksum(grid);
+}
+
+void SurfaceProjection::writeCache(QDataStream &s) const
+{
+  writeRawVector(s, m_Cells);
+  writeRawVector(s, m_Nodes);
+  writeRawVector(s, m_X);
+  writeRawVector(s, m_TriNodes);
+  writeRawVectors(s, m_N2T);
+  writeRawVectors(s, m_N2N);
+  writeRawVector(s, m_NodeNormals);
+  writeRawVector(s, m_Radius);
+  writeRawVector(s, m_Frames);
+  m_TriangleTree.write(s);
+}
+
+bool SurfaceProjection::readCache(QDataStream &s, vtkUnstructuredGrid *grid)
+{
+  m_BGrid = grid;
+  setGrid(m_BGrid);
+  bool ok = true;
+  ok = ok && readRawVector(s, m_Cells) && readRawVector(s, m_Nodes) && readRawVector(s, m_X) && readRawVector(s, m_TriNodes);
+  ok = ok && readRawVectors(s, m_N2T) && readRawVectors(s, m_N2N);
+  ok = ok && readRawVector(s, m_NodeNormals) && readRawVector(s, m_Radius) && readRawVector(s, m_Frames);
+  ok = ok && m_TriNodes.size() == 3*m_Cells.size() && m_Frames.size() == m_Cells.size();
+  ok = ok && m_X.size() == m_Nodes.size() && m_NodeNormals.size() == m_Nodes.size() && m_Radius.size() == m_Nodes.size();
+  for (int i = 0; ok && i < m_Cells.size(); ++i) {
+    ok = m_Cells[i] >= 0 && m_Cells[i] < grid->GetNumberOfCells();
+  }
+  for (int i = 0; ok && i < m_TriNodes.size(); ++i) {
+    ok = m_TriNodes[i] >= 0 && m_TriNodes[i] < m_Nodes.size();
+  }
+  for (int i = 0; ok && i < m_Nodes.size(); ++i) {
+    ok = m_Nodes[i] >= 0 && m_Nodes[i] < grid->GetNumberOfPoints();
+  }
+  ok = ok && m_N2T.size() == m_Nodes.size() && m_N2N.size() == m_Nodes.size();
+  for (int i = 0; ok && i < m_N2T.size(); ++i) {
+    foreach (int i_tri, m_N2T[i]) {
+      if (i_tri < 0 || i_tri >= m_Cells.size()) {
+        ok = false;
       }
     }
-    if (!x_proj_set) { // should never happen
-      checkVector(xp);
-      qWarning() << "No projection found for point xp=" << xp[0] << xp[1] << xp[2] << endl;
-      writeGrid(GuiMainWindow::pointer()->getGrid(), "griddump");
-      EG_BUG;
+    foreach (int i_node, m_N2N[i]) {
+      if (i_node < 0 || i_node >= m_Nodes.size()) {
+        ok = false;
+      }
     }
   }
+  ok = ok && m_TriangleTree.read(s) && m_TriangleTree.numTriangles() == m_Cells.size();
+  return ok;
 }
 
 void SurfaceProjection::updateBackgroundGridInfo()
 {
-  getAllCells(m_Cells, m_BGrid);
-  getNodesFromCells(m_Cells, m_Nodes, m_BGrid);
-  setBoundaryCodes(GuiMainWindow::pointer()->getAllBoundaryCodes());
-  setAllCells();
-  readVMD();
-  UpdatePotentialSnapPoints(true, false);
-  l2l_t  c2c   = getPartC2C();
-  g2l_t _cells = getPartLocalCells();
-  QVector<int> m_LNodes(m_Nodes.size());
-  for (int i = 0; i < m_LNodes.size(); ++i) {
-    m_LNodes[i] = i;
-  }
-  createNodeToNode(m_Cells, m_Nodes, m_LNodes, m_N2N, m_BGrid);
-
-  // create m_Triangles
-  m_Triangles.resize(m_BGrid->GetNumberOfCells());
-  for (vtkIdType id_cell = 0; id_cell < m_BGrid->GetNumberOfCells(); ++id_cell) {
-    m_Triangles[id_cell] = Triangle(m_BGrid, id_cell);
-    for (int i = 0; i < 3; i++) {
-      int i_cell = _cells[id_cell];
-      if (c2c[i_cell][i] < 0) {
-        m_Triangles[id_cell].setNeighbourFalse(i);
-      } else {
-        m_Triangles[id_cell].setNeighbourTrue(i);
+  // local nodes and connectivity of the triangles
+  QHash<vtkIdType, int> local_node;
+  m_Nodes.clear();
+  m_TriNodes.resize(3*m_Cells.size());
+  for (int i_tri = 0; i_tri < m_Cells.size(); ++i_tri) {
+    vtkIdType N_pts, *pts;
+    m_BGrid->GetCellPoints(m_Cells[i_tri], N_pts, pts);
+    if (N_pts != 3) {
+      EG_ERR_RETURN("only triangles allowed in the background grid");
+    }
+    for (int i = 0; i < 3; ++i) {
+      if (!local_node.contains(pts[i])) {
+        local_node[pts[i]] = m_Nodes.size();
+        m_Nodes.append(pts[i]);
+      }
+      m_TriNodes[3*i_tri + i] = local_node[pts[i]];
+    }
+  }
+  m_N2T.fill(QVector<int>(), m_Nodes.size());
+  m_N2N.fill(QVector<int>(), m_Nodes.size());
+  for (int i_tri = 0; i_tri < m_Cells.size(); ++i_tri) {
+    for (int i = 0; i < 3; ++i) {
+      int i_node1 = m_TriNodes[3*i_tri + i];
+      int i_node2 = m_TriNodes[3*i_tri + (i + 1)%3];
+      m_N2T[i_node1].append(i_tri);
+      if (!m_N2N[i_node1].contains(i_node2)) {
+        m_N2N[i_node1].append(i_node2);
+        m_N2N[i_node2].append(i_node1);
       }
     }
   }
 
-  // compute node normals
-  m_NodeNormals.resize(m_BGrid->GetNumberOfPoints());
-  for (vtkIdType id_node = 0; id_node < m_BGrid->GetNumberOfPoints(); ++id_node) {
-    m_NodeNormals[id_node] = vec3_t(0, 0, 0);
+  // coordinates of the nodes and local frames of the triangles
+  m_X.resize(m_Nodes.size());
+  for (int i_node = 0; i_node < m_Nodes.size(); ++i_node) {
+    m_BGrid->GetPoints()->GetPoint(m_Nodes[i_node], m_X[i_node].data());
+  }
+  m_Frames.resize(m_Cells.size());
+  for (int i_tri = 0; i_tri < m_Cells.size(); ++i_tri) {
+    vec3_t a = triNode(i_tri, 0);
+    vec3_t b = triNode(i_tri, 1);
+    vec3_t c = triNode(i_tri, 2);
+    vec3_t g1 = b - a;
+    vec3_t g2 = c - a;
+    vec3_t g3 = g1.cross(g2);
+    if (g3.abs2() > 0) {
+      g3.normalise();
+    }
+    if (!checkVector(g3)) {
+      qWarning() << "g3 = " << g3;
+      EG_BUG;
+    }
+    mat3_t G;
+    G.column(0, g1);
+    G.column(1, g2);
+    G.column(2, g3);
+    Frame &F = m_Frames[i_tri];
+    F.g3 = g3;
+    F.gi = G.inverse();
+    F.smallest_length = min(g1.abs(), min((c - b).abs(), (a - c).abs()));
   }
 
-  foreach(Triangle T, m_Triangles) {
-    double angle_a = GeometryTools::angle(m_BGrid, T.idC(), T.idA(), T.idB());
-    double angle_b = GeometryTools::angle(m_BGrid, T.idA(), T.idB(), T.idC());
-    double angle_c = GeometryTools::angle(m_BGrid, T.idB(), T.idC(), T.idA());
+  // compute node normals
+  m_NodeNormals.fill(vec3_t(0, 0, 0), m_Nodes.size());
+  for (int i_tri = 0; i_tri < m_Cells.size(); ++i_tri) {
+    vec3_t g3 = m_Frames[i_tri].g3;
+    int i_a = m_TriNodes[3*i_tri];
+    int i_b = m_TriNodes[3*i_tri + 1];
+    int i_c = m_TriNodes[3*i_tri + 2];
+    double angle_a = GeometryTools::angle(m_BGrid, m_Nodes[i_c], m_Nodes[i_a], m_Nodes[i_b]);
+    double angle_b = GeometryTools::angle(m_BGrid, m_Nodes[i_a], m_Nodes[i_b], m_Nodes[i_c]);
+    double angle_c = GeometryTools::angle(m_BGrid, m_Nodes[i_b], m_Nodes[i_c], m_Nodes[i_a]);
     if (isnan(angle_a) || isinf(angle_a)) EG_BUG;
     if (isnan(angle_b) || isinf(angle_b)) EG_BUG;
     if (isnan(angle_c) || isinf(angle_c)) EG_BUG;
-    if (!checkVector(T.g3())) {
-      qWarning() << "T.g3 = " << T.g3();
-      EG_BUG;
-    }
-    m_NodeNormals[T.idA()] += angle_a * T.g3();
-    m_NodeNormals[T.idB()] += angle_b * T.g3();
-    m_NodeNormals[T.idC()] += angle_c * T.g3();
-    if (!checkVector(m_NodeNormals[T.idA()])) EG_BUG;
-    if (!checkVector(m_NodeNormals[T.idB()])) EG_BUG;
-    if (!checkVector(m_NodeNormals[T.idC()])) EG_BUG;
+    m_NodeNormals[i_a] += angle_a * g3;
+    m_NodeNormals[i_b] += angle_b * g3;
+    m_NodeNormals[i_c] += angle_c * g3;
+    if (!checkVector(m_NodeNormals[i_a])) EG_BUG;
+    if (!checkVector(m_NodeNormals[i_b])) EG_BUG;
+    if (!checkVector(m_NodeNormals[i_c])) EG_BUG;
   }
-  for (vtkIdType id_node = 0; id_node < m_BGrid->GetNumberOfPoints(); ++id_node) {
-    m_NodeNormals[id_node].normalise();
+  for (int i_node = 0; i_node < m_Nodes.size(); ++i_node) {
+    m_NodeNormals[i_node].normalise();
   }
-  for (int i = 0; i < m_Triangles.size(); ++i) {
-    Triangle &T = m_Triangles[i];
-    T.setNormals(m_NodeNormals[T.idA()], m_NodeNormals[T.idB()], m_NodeNormals[T.idC()]);
-  }
-
-  m_BPart.setGrid(m_BGrid);
-  m_BPart.setAllCells();
+  m_TriangleTree.build(m_X, m_TriNodes);
   computeSurfaceCurvature();
 }
 
@@ -211,9 +384,13 @@ vtkIdType SurfaceProjection::getProjTriangle(vtkIdType id_node)
   vtkIdType pindex = pi->GetValue(id_node);
   vtkIdType proj_triangle = -1;
   if (pindex < 0) {
-    pindex = m_LastPindex;
+    // the counter is shared by all projections, which might be used by several threads (patch meshing)
+    #pragma omp critical(surfaceprojection_pindex)
+    {
+      pindex = m_LastPindex;
+      ++m_LastPindex;
+    }
     pi->SetValue(id_node, pindex);
-    ++m_LastPindex;
     m_Pindex[pindex] = -1;
   } else {
     proj_triangle = m_Pindex[pindex];
@@ -226,14 +403,32 @@ void SurfaceProjection::setProjTriangle(vtkIdType id_node, vtkIdType proj_triang
   EG_VTKDCN(vtkLongArray_t, pi, m_FGrid, "node_pindex");
   vtkIdType pindex = pi->GetValue(id_node);
   if (pindex < 0) {
-    pindex = m_LastPindex;
+    #pragma omp critical(surfaceprojection_pindex)
+    {
+      pindex = m_LastPindex;
+      ++m_LastPindex;
+    }
     pi->SetValue(id_node, pindex);
-    ++m_LastPindex;
   }
   m_Pindex[pindex] = proj_triangle;
 }
 
 
+SurfaceProjection::Hint SurfaceProjection::hint(vtkIdType id_node) const
+{
+  EG_VTKDCN(vtkLongArray_t, pi, m_FGrid, "node_pindex");
+  vtkIdType pindex = pi->GetValue(id_node);
+  if (pindex < 0) {
+    return Hint();
+  }
+  return Hint(m_Pindex.value(pindex, -1));
+}
+
+void SurfaceProjection::storeHint(vtkIdType id_node, const Hint &hint)
+{
+  setProjTriangle(id_node, hint.triangle);
+}
+
 vec3_t SurfaceProjection::project(vec3_t xp, vtkIdType id_node,  bool correct_curvature)
 {
   if (!checkVector(xp)) {
@@ -241,53 +436,52 @@ vec3_t SurfaceProjection::project(vec3_t xp, vtkIdType id_node,  bool correct_cu
     writeGrid(GuiMainWindow::pointer()->getGrid(), "griddump");
     EG_BUG;
   }
+  Hint hint;
+  if (id_node != -1) {
+    hint.triangle = getProjTriangle(id_node);
+  }
+  vtkIdType old_triangle = hint.triangle;
+  vec3_t x_proj = project(xp, hint, m_RestrictToTriangle, correct_curvature);
+  if (id_node != -1 && hint.triangle != old_triangle) {
+    setProjTriangle(id_node, hint.triangle);
+  }
+  m_LastProjTriangle = hint.triangle;
+  return x_proj;
+}
+
+vec3_t SurfaceProjection::project(vec3_t xp, Hint &hint, bool restrict_to_triangle, bool correct_curvature) const
+{
+  if (!checkVector(xp)) {
+    qWarning() << "No projection found for point xp=" << xp[0] << xp[1] << xp[2] << endl;
+    EG_BUG;
+  }
 
   vec3_t x_proj(1e99, 1e99, 1e99);
   vec3_t r_proj(0, 0, 0);
-  bool x_proj_set = false;
-
-  // initilizing booleans
   bool on_triangle = false;
-
-  vtkIdType proj_triangle = -1;
-  if (id_node != -1) {
-    proj_triangle = getProjTriangle(id_node);
-  }
+  vtkIdType proj_triangle = hint.triangle;
 
   if (proj_triangle == -1) {
     searchNewTriangle(xp, proj_triangle, x_proj, r_proj, false, on_triangle);
-    if (id_node != -1) {
-      setProjTriangle(id_node, proj_triangle);
-    }
   }
-  if (proj_triangle >= m_Triangles.size()) {
+  if (proj_triangle >= m_Cells.size()) {
     EG_BUG;
   }
-  Triangle T = m_Triangles[proj_triangle];
   vec3_t xi, ri;
   double d;
-  int side;
-  bool intersects = T.projectOnTriangle(xp, xi, ri, d, side, m_RestrictToTriangle);
-  if (!intersects || (d > m_CritDistance*T.smallestLength())) {
+  bool intersects = projectOnTriangle(proj_triangle, xp, xi, ri, d, restrict_to_triangle);
+  if (!intersects || (d > m_CritDistance*m_Frames[proj_triangle].smallest_length)) {
     searchNewTriangle(xp, proj_triangle, x_proj, r_proj, true, on_triangle);
     if (!on_triangle) {
       searchNewTriangle(xp, proj_triangle, x_proj, r_proj, false, on_triangle);
     }
-    T = m_Triangles[proj_triangle];
-    T.projectOnTriangle(xp, xi, ri, d, side, m_RestrictToTriangle);
-    if (id_node != -1) {
-      setProjTriangle(id_node, proj_triangle);
-    }
+    projectOnTriangle(proj_triangle, xp, xi, ri, d, restrict_to_triangle);
   }
   x_proj = xi;
-  x_proj_set = true;
   if (x_proj[0] > 1e98) { // should never happen
     EG_BUG;
   }
-  r_proj = ri;
-  on_triangle = intersects;
   if (!checkVector(x_proj)) {
-    //EG_BUG;
     x_proj = xp;
   } else if (correct_curvature) {
     vec3_t x_corr = correctCurvature(proj_triangle, x_proj);
@@ -295,7 +489,7 @@ vec3_t SurfaceProjection::project(vec3_t xp, vtkIdType id_node,  bool correct_cu
       x_proj = x_corr;
     }
   }
-  m_LastProjTriangle = proj_triangle;
+  hint.triangle = proj_triangle;
   return x_proj;
 }
 
@@ -311,22 +505,22 @@ vec3_t SurfaceProjection::projectRestricted(vec3_t x, vtkIdType id_node, bool co
   return project(x, id_node, correct_curvature);
 }
 
-vec3_t SurfaceProjection::correctCurvature(vtkIdType proj_triangle, vec3_t x)
+vec3_t SurfaceProjection::correctCurvature(vtkIdType proj_triangle, vec3_t x) const
 {
   vec3_t x_corr = x;
   if (proj_triangle != -1) {
-    Triangle &T = m_Triangles[proj_triangle];
-    vec3_t rx = T.global3DToLocal3D(x);
+    vec3_t g3 = m_Frames[proj_triangle].g3;
+    vec3_t rx = toLocal(proj_triangle, x);
     double w1 = 1.0 - rx[0] - rx[1];
     double w2 = rx[0];
     double w3 = rx[1];
-    double k1 = GeometryTools::intersection(x, T.g3(), T.a(), T.nA());
-    double k2 = GeometryTools::intersection(x, T.g3(), T.b(), T.nB());
-    double k3 = GeometryTools::intersection(x, T.g3(), T.c(), T.nC());
+    double k1 = GeometryTools::intersection(x, g3, triNode(proj_triangle, 0), m_NodeNormals[m_TriNodes[3*proj_triangle]]);
+    double k2 = GeometryTools::intersection(x, g3, triNode(proj_triangle, 1), m_NodeNormals[m_TriNodes[3*proj_triangle + 1]]);
+    double k3 = GeometryTools::intersection(x, g3, triNode(proj_triangle, 2), m_NodeNormals[m_TriNodes[3*proj_triangle + 2]]);
     double S = 0.5;
     double k = w1*k1 + w2*k2 + w3*k3;
     k -= rx[2];
-    x_corr = x + S*k*T.g3();
+    x_corr = x + S*k*g3;
     if (!checkVector(x_corr)) {
       x_corr = x;
     }
@@ -336,56 +530,55 @@ vec3_t SurfaceProjection::correctCurvature(vtkIdType proj_triangle, vec3_t x)
 
 void SurfaceProjection::computeSurfaceCurvature()
 {
-  m_Radius.fill(1e99, m_BGrid->GetNumberOfPoints());
-  for (vtkIdType id_node = 0; id_node < m_BGrid->GetNumberOfPoints(); ++id_node) {
+  m_Radius.fill(1e99, m_Nodes.size());
+  for (int i_node = 0; i_node < m_Nodes.size(); ++i_node) {
     vec3_t x1;
-    m_BGrid->GetPoint(id_node, x1.data());
-    for (int i = 0; i < m_BPart.n2nGSize(id_node); ++i) {
-      vtkIdType id_neigh = m_BPart.n2nGG(id_node, i);
-      double scal_prod = max(-1.0, min(1.0, m_NodeNormals[id_node]*m_NodeNormals[id_neigh]));
+    m_BGrid->GetPoint(m_Nodes[i_node], x1.data());
+    foreach (int i_neigh, m_N2N[i_node]) {
+      double scal_prod = max(-1.0, min(1.0, m_NodeNormals[i_node]*m_NodeNormals[i_neigh]));
       double alpha = max(1e-3, acos(scal_prod));
       if (alpha > 1e-3) {
         vec3_t x2;
-        m_BGrid->GetPoint(id_neigh, x2.data());
+        m_BGrid->GetPoint(m_Nodes[i_neigh], x2.data());
         double a = (x1 - x2).abs();
-        m_Radius[id_node] = min(m_Radius[id_node], a/alpha);
+        m_Radius[i_node] = min(m_Radius[i_node], a/alpha);
       }
     }
   }
 
   // compute weighted (distance) average of radii
-  QVector<double> R_new(m_BGrid->GetNumberOfPoints(), 1e99);
-  for (vtkIdType id_node = 0; id_node < m_BGrid->GetNumberOfPoints(); ++id_node) {
+  QVector<double> R_new(m_Nodes.size(), 1e99);
+  for (int i_node = 0; i_node < m_Nodes.size(); ++i_node) {
     vec3_t x1;
-    m_BGrid->GetPoint(id_node, x1.data());
-    int N = m_BPart.n2nGSize(id_node);
+    m_BGrid->GetPoint(m_Nodes[i_node], x1.data());
+    int N = m_N2N[i_node].size();
     QVector<double> L(N);
     QVector<double> R(N, -1);
     double Lmax = 0;
     bool average = false;
     for (int i = 0; i < N; ++i) {
-      vtkIdType id_neigh = m_BPart.n2nGG(id_node, i);
+      int i_neigh = m_N2N[i_node][i];
       vec3_t x2;
-      m_BGrid->GetPoint(id_neigh, x2.data());
+      m_BGrid->GetPoint(m_Nodes[i_neigh], x2.data());
       L[i] = (x2 - x1).abs();
-      if (m_Radius[id_neigh] < 1e90 && L[i] > 0) {
-        R[i] = m_Radius[id_neigh];
+      if (m_Radius[i_neigh] < 1e90 && L[i] > 0) {
+        R[i] = m_Radius[i_neigh];
         Lmax = max(Lmax, L[i]);
         average = true;
       }
     }
     if (average) {
-      R_new[id_node] = 0;
+      R_new[i_node] = 0;
       double total_weight = 0;
       for (int i = 0; i < N; ++i) {
         if (R[i] > 0) {
-          R_new[id_node] += Lmax/L[i] * R[i];
+          R_new[i_node] += Lmax/L[i] * R[i];
           total_weight += Lmax/L[i];
           //R_new[id_node] += R[i];
           //total_weight += 1.0;
         }
       }
-      R_new[id_node] /= total_weight;
+      R_new[i_node] /= total_weight;
     }
   }
   m_Radius = R_new;
@@ -400,11 +593,10 @@ double SurfaceProjection::getRadius(vtkIdType id_node)
   if (id_tri == -1) {
     EG_BUG;
   }
-  Triangle &T = m_Triangles[id_tri];
-  vec2_t r = T.global3DToLocal2D(x);
-  double Ra   = m_Radius[T.idA()];
-  double Rb   = m_Radius[T.idB()];
-  double Rc   = m_Radius[T.idC()];
+  vec3_t r = toLocal(id_tri, x);
+  double Ra   = m_Radius[m_TriNodes[3*id_tri]];
+  double Rb   = m_Radius[m_TriNodes[3*id_tri + 1]];
+  double Rc   = m_Radius[m_TriNodes[3*id_tri + 2]];
   double R    = min(Ra, min(Rb, Rc));
   double Rmax = max(Ra, max(Rb, Rc));
   if (Rmax < 1e90) {
@@ -32,11 +32,25 @@ class SurfaceProjection;
 #include "surfaceoperation.h"
 #include "surfacealgorithm.h"
 #include "triangle.h"
-#include "facefinder.h"
+#include "triangletree.h"
+
+#include <QDataStream>
 
 class SurfaceProjection : public SurfaceAlgorithm
 {
 
+public: // data-types
+
+  /**
+   * Caller-owned state for the reentrant projection methods.
+   * Keep one for each node (or thread) and pass it on to the next projection of the same point.
+   */
+  struct Hint
+  {
+    vtkIdType triangle; ///< the last projection triangle (-1 if unknown)
+    Hint(vtkIdType id_tri = -1) : triangle(id_tri) {}
+  };
+
 private: // data-types
 
   struct Edge
@@ -47,27 +61,32 @@ private: // data-types
     double La, Lb;
   };
 
-private: // methods
-
-  template <class C>
-  void setBackgroundGrid_setupGrid(vtkUnstructuredGrid* grid, const C& cells); ///< copy the cells from grid to m_BGrid
+  /// Everything the projection needs to know about a triangle besides its nodes.
+  struct Frame
+  {
+    vec3_t g3;              ///< unit normal vector
+    mat3_t gi;              ///< inverse of [b-a, c-a, g3]; transforms to local coordinates
+    double smallest_length; ///< length of the shortest edge
+  };
 
 protected: // attributes
 
-  vtkUnstructuredGrid*      m_BGrid; ///< the background grid defining the geometry
-  MeshPartition             m_BPart;
-  vtkUnstructuredGrid*      m_FGrid; ///< the foreground grid to project
-  QVector<double>           m_EdgeLength;
-  QVector<vtkIdType>        m_Cells;
-  QVector<vtkIdType>        m_Nodes;
-  QVector<vec3_t>           m_NodeNormals; ///< The surface normal at each node of m_BGrid
-  QVector<Triangle>         m_Triangles; ///< All triangles of m_BGrid. One for each triangle cell of m_BGrid.
-  QVector<double>           m_Radius; ///< Surface radius for mesh resolution.
-  QVector<QVector<int> >    m_N2N;
+  vtkUnstructuredGrid*      m_BGrid;    ///< the background grid defining the geometry (can be shared with other projections)
+  vtkUnstructuredGrid*      m_OwnBGrid; ///< private copy of the geometry if the background grid has been set with setBackgroundGrid
+  vtkUnstructuredGrid*      m_FGrid;    ///< the foreground grid to project
+  QVector<vtkIdType>        m_Cells;    ///< the cells of m_BGrid which define this projection (one for each triangle)
+  QVector<vtkIdType>        m_Nodes;    ///< the nodes of m_BGrid which are used by m_Cells
+  QVector<vec3_t>           m_X;        ///< the coordinates of the nodes of m_Nodes
+  QVector<int>              m_TriNodes; ///< local nodes (index in m_Nodes) of the triangles; three for each triangle
+  QVector<QVector<int> >    m_N2T;      ///< local node to triangle connectivity
+  QVector<QVector<int> >    m_N2N;      ///< local node to node connectivity
+  QVector<vec3_t>           m_NodeNormals; ///< The surface normal at each node of m_Nodes
+  QVector<Frame>            m_Frames;   ///< local coordinate frame of each triangle
+  QVector<double>           m_Radius; ///< Surface radius for mesh resolution (for each node of m_Nodes).
   bool                      m_RestrictToTriangle;
   double                    m_CritDistance;
   QMap<vtkIdType,vtkIdType> m_Pindex;
-  FaceFinder                m_FaceFinder;
+  TriangleTree              m_TriangleTree; ///< nearest-triangle search structure for the triangles
   vtkIdType                 m_LastProjTriangle;
 
 protected: // static attributes
@@ -79,11 +98,17 @@ protected: // methods
 
   virtual void   updateBackgroundGridInfo();      ///< Set up the background grid (triangles, bezier triangles, etc)
 
-  void      searchNewTriangle(vec3_t xp, vtkIdType &id_tri, vec3_t &x_proj, vec3_t &r_proj, bool neigh_mode, bool &on_triangle);
+  void      searchNewTriangle(vec3_t xp, vtkIdType &id_tri, vec3_t &x_proj, vec3_t &r_proj, bool neigh_mode, bool &on_triangle) const;
   vtkIdType getProjTriangle(vtkIdType id_node);
   void      setProjTriangle(vtkIdType id_node, vtkIdType proj_triangle);
   void      computeSurfaceCurvature();
 
+  vec3_t triNode(int i_tri, int i) const { return m_X[m_TriNodes[3*i_tri + i]]; } ///< coordinates of node i (0, 1, 2) of a triangle
+  vec3_t toLocal(int i_tri, vec3_t x) const { return m_Frames[i_tri].gi*(x - triNode(i_tri, 0)); } ///< local 3D coordinates of a point (see Triangle::global3DToLocal3D)
+
+  /// Project a point onto a triangle (see Triangle::projectOnTriangle).
+  bool projectOnTriangle(int i_tri, vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, bool restrict_to_triangle) const;
+
 public: // methods
 
   static long int Nfull;
@@ -92,91 +117,111 @@ public: // methods
   SurfaceProjection();
   ~SurfaceProjection();
   
-  template <class C> void setBackgroundGrid(vtkUnstructuredGrid* grid, const C& cells); ///< Set the background grid to use + set it up
+  template <class C> void setBackgroundGrid(vtkUnstructuredGrid* grid, const C& cells); ///< Set the background grid to use (private copy) + set it up
+
+  /**
+   * Use a subset of a shared background grid; nothing will be copied.
+   * The grid is only read, so this can be called concurrently for different SurfaceProjection objects
+   * sharing the same grid. The grid has to stay unchanged as long as the projection is in use.
+   * @param grid the shared background grid (triangles only, see copyGeometry)
+   * @param cells the cells of grid which define the geometry
+   */
+  void buildBackgroundGrid(vtkUnstructuredGrid* grid, const QVector<vtkIdType>& cells);
+
+  /**
+   * Write the complete set-up (triangles, normals, curvature, search tree) of a projection
+   * which has been created with buildBackgroundGrid.
+   * @param s the stream to write to (see writeCacheHeader)
+   */
+  void writeCache(QDataStream &s) const;
+
+  /**
+   * Restore a projection from data written by writeCache; this replaces buildBackgroundGrid.
+   * @param s the stream to read from
+   * @param grid the shared background grid (it has to be the grid the data have been created for)
+   * @return false if the data are corrupt
+   */
+  bool readCache(QDataStream &s, vtkUnstructuredGrid* grid);
 
   void    setForegroundGrid(vtkUnstructuredGrid* grid);
   virtual vec3_t projectRestricted(vec3_t x, vtkIdType id_node = -1, bool correct_curvature = false);
   virtual vec3_t projectFree(vec3_t x, vtkIdType id_node = -1, bool correct_curvature = false);
 
+  /**
+   * Reentrant projection of a point.
+   * No attribute of the projection is changed, so any number of threads can project with the same object.
+   * @param x the point to project
+   * @param hint the projection triangle of the last call for this point; it will be updated
+   * @param restrict_to_triangle restrict the projection to the interior of the triangles
+   * @param correct_curvature apply the curvature correction
+   * @return the projected point
+   */
+  vec3_t project(vec3_t x, Hint &hint, bool restrict_to_triangle, bool correct_curvature = false) const;
+
+  vec3_t projectRestricted(vec3_t x, Hint &hint, bool correct_curvature = false) const { return project(x, hint, true, correct_curvature); }
+  vec3_t projectFree(vec3_t x, Hint &hint, bool correct_curvature = false) const { return project(x, hint, false, correct_curvature); }
+
+  Hint hint(vtkIdType id_node) const; ///< the stored projection triangle of a node of the foreground grid (read only)
+  void storeHint(vtkIdType id_node, const Hint &hint); ///< store the projection triangle of a node (not thread-safe)
+
   vtkUnstructuredGrid* getBGrid() { return m_BGrid; }
   double getRadius(vtkIdType id_node);
 
-  vec3_t    correctCurvature(vtkIdType proj_triangle, vec3_t x);
+  vec3_t    correctCurvature(vtkIdType proj_triangle, vec3_t x) const;
   vtkIdType lastProjTriangle() { return m_LastProjTriangle; }
-  vec3_t    lastProjNormal() { return GeometryTools::cellNormal(m_BGrid, m_LastProjTriangle); }
+  vec3_t    lastProjNormal() { return GeometryTools::cellNormal(m_BGrid, m_Cells[m_LastProjTriangle]); }
 
 public: // static methods
 
   static void resetPindex() { m_LastPindex = 0; }
 
+  /**
+   * Copy the geometry of surface cells into a new (shared) background grid.
+   * Only the points, the triangles (quadrilaterals are split) and the boundary codes are copied.
+   * @param src the source grid
+   * @param cells the surface cells of src to copy
+   * @param dst the background grid; it will be re-initialised
+   * @param src_nodes on return the node of src for each node of dst
+   */
+  static void copyGeometry(vtkUnstructuredGrid *src, const QVector<vtkIdType> &cells, vtkUnstructuredGrid *dst, QVector<vtkIdType> &src_nodes);
+
+  /**
+   * Write the header of a projection cache file.
+   * It contains a format version, the binary layout of the platform and a signature of the background grid.
+   * @param s the stream to write to
+   * @param grid the shared background grid
+   */
+  static void writeCacheHeader(QDataStream &s, vtkUnstructuredGrid *grid);
+
+  /**
+   * Check the header of a projection cache file.
+   * @param s the stream to read from
+   * @param grid the shared background grid
+   * @return true if the cache has been written for this grid with the current format on this platform
+   */
+  static bool readCacheHeader(QDataStream &s, vtkUnstructuredGrid *grid);
+
 };
 
 
 template <class C>
 void SurfaceProjection::setBackgroundGrid(vtkUnstructuredGrid* grid, const C& cells)
 {
-  setBackgroundGrid_setupGrid(grid, cells);
-  updateBackgroundGridInfo();
-  setForegroundGrid(grid);
-  for (vtkIdType id_cell = 0; id_cell < m_BGrid->GetNumberOfCells(); ++id_cell) {
-    vtkIdType N_pts, *pts;
-    m_BGrid->GetCellPoints(id_cell, N_pts, pts);
-    for (int i = 0; i < N_pts; ++i) {
-      setProjTriangle(pts[i], id_cell);
-    }
-  }
-  m_FaceFinder.setMaxNumFaces(10);
-  m_FaceFinder.setGrid(m_BGrid);
-}
-
-template <class C>
-void SurfaceProjection::setBackgroundGrid_setupGrid(vtkUnstructuredGrid* grid, const C& cells)
-{
-  QVector<vtkIdType> nodes;
-  getNodesFromCells(cells, nodes, grid);
-  int num_new_cells = cells.size();
+  QVector<vtkIdType> src_cells;
   foreach (vtkIdType id_cell, cells) {
-    vtkIdType type_cell = grid->GetCellType(id_cell);
-    if (type_cell == VTK_QUAD) {
-      ++num_new_cells;
-    }
+    src_cells.append(id_cell);
   }
-  allocateGrid(m_BGrid, num_new_cells, nodes.size());
-  
-  QVector<vtkIdType> _nodes(grid->GetNumberOfPoints());
-  vtkIdType id_new_node = 0;
-  foreach (vtkIdType id_node, nodes) {
-    vec3_t x;
-    grid->GetPoints()->GetPoint(id_node, x.data());
-    m_BGrid->GetPoints()->SetPoint(id_new_node, x.data());
-    copyNodeData(grid,id_node,m_BGrid,id_new_node);
-    _nodes[id_node] = id_new_node;
-    ++id_new_node;
+  QVector<vtkIdType> src_nodes;
+  copyGeometry(grid, src_cells, m_OwnBGrid, src_nodes);
+  QVector<vtkIdType> bg_cells(m_OwnBGrid->GetNumberOfCells());
+  for (vtkIdType id_cell = 0; id_cell < m_OwnBGrid->GetNumberOfCells(); ++id_cell) {
+    bg_cells[id_cell] = id_cell;
   }
-  foreach (vtkIdType id_cell, cells) {
-    vtkIdType N_pts, *pts;
-    vtkIdType type_cell = grid->GetCellType(id_cell);
-    grid->GetCellPoints(id_cell, N_pts, pts);
-    QVector<vtkIdType> new_pts(3);
-    if (type_cell == VTK_TRIANGLE) {
-      new_pts[0] = _nodes[pts[0]];
-      new_pts[1] = _nodes[pts[1]];
-      new_pts[2] = _nodes[pts[2]];
-      vtkIdType id_new_cell = m_BGrid->InsertNextCell(VTK_TRIANGLE, 3, new_pts.data());
-      copyCellData(grid, id_cell, m_BGrid, id_new_cell);
-    } else if (type_cell == VTK_QUAD) {
-      new_pts[0] = _nodes[pts[0]];
-      new_pts[1] = _nodes[pts[1]];
-      new_pts[2] = _nodes[pts[2]];
-      vtkIdType id_new_cell1 = m_BGrid->InsertNextCell(VTK_TRIANGLE, 3, new_pts.data());
-      copyCellData(grid, id_cell, m_BGrid, id_new_cell1);
-      new_pts[0] = _nodes[pts[2]];
-      new_pts[1] = _nodes[pts[3]];
-      new_pts[2] = _nodes[pts[0]];
-      vtkIdType id_new_cell2 = m_BGrid->InsertNextCell(VTK_TRIANGLE, 3, new_pts.data());
-      copyCellData(grid, id_cell, m_BGrid, id_new_cell2);
-    } else {
-      EG_BUG;
+  buildBackgroundGrid(m_OwnBGrid, bg_cells);
+  setForegroundGrid(grid);
+  for (int i_tri = 0; i_tri < m_Cells.size(); ++i_tri) {
+    for (int i = 0; i < 3; ++i) {
+      setProjTriangle(src_nodes[m_Nodes[m_TriNodes[3*i_tri + i]]], i_tri);
     }
   }
 }
@@ -38,6 +38,8 @@ SwapTriangles::SwapTriangles() : SurfaceOperation()
   m_SmallAreaSwap = false;
   m_SmallAreaRatio = 1e-3;
   m_Verbose = false;
+  m_UseWorkQueue = false;
+  m_SeedNodesSet = false;
   getSet("surface meshing", "small area ratio for edge-swapping", 1e-3, m_SmallAreaRatio);
   getSet("surface meshing", "threshold for surface errors", 10.0, m_SurfErrorThreshold);
 }
@@ -94,22 +96,96 @@ bool SwapTriangles::testSwap(stencil_t S)
 
 bool SwapTriangles::isEdge(vtkIdType id_node1, vtkIdType id_node2)
 {
-  l2g_t  nodes = getPartNodes();
-  g2l_t _nodes = getPartLocalNodes();
-  l2l_t  n2n   = getPartN2N();
+  return m_Part.isEdge(id_node1, id_node2);
+}
+
+bool SwapTriangles::swapWanted(const stencil_t &S)
+{
+  if (S.id_cell.size() != 2 || !S.sameBC) {
+    return false;
+  }
+  if (S.type_cell[1] != VTK_TRIANGLE) {
+    return false;
+  }
+  if (isEdge(S.id_node[0], S.id_node[1])) {
+    return false;
+  }
+  bool swap = false;
+  QVector<vec3_t> x3(4);
+  vec2_t x[4];
 
-  bool ret = false;
-  foreach(int i_node, n2n[_nodes[id_node1]]) {
-    vtkIdType id_node = nodes[i_node];
-    if( id_node == id_node2 ) ret = true;
+  m_Grid->GetPoint(S.id_node[0], x3[0].data());
+  m_Grid->GetPoint(S.p1,         x3[1].data());
+  m_Grid->GetPoint(S.id_node[1], x3[2].data());
+  m_Grid->GetPoint(S.p2,         x3[3].data());
+
+  vec3_t n1 = triNormal(x3[0], x3[1], x3[3]);
+  vec3_t n2 = triNormal(x3[1], x3[2], x3[3]);
+
+  bool force_swap = false;
+  if (m_SmallAreaSwap) {
+    double A1 = n1.abs();
+    double A2 = n2.abs();
+    if (isnan(A1) || isnan(A2)) {
+      force_swap = true;
+    } else {
+      force_swap = A1 < m_SmallAreaRatio*A2 || A2 < m_SmallAreaRatio*A1;
+    }
   }
-  return(ret);
+  if (m_FeatureSwap || GeometryTools::angle(n1, n2) < m_FeatureAngle || force_swap) {
+    vec3_t n = n1 + n2;
+    n.normalise();
+    vec3_t ex = orthogonalVector(n);
+    vec3_t ey = ex.cross(n);
+    for (int k = 0; k < 4; ++k) {
+      x[k] = vec2_t(x3[k]*ex, x3[k]*ey);
+    }
+    vec2_t r1, r2, r3, u1, u2, u3;
+    r1 = 0.5*(x[0] + x[1]); u1 = turnLeft(x[1] - x[0]);
+    r2 = 0.5*(x[1] + x[2]); u2 = turnLeft(x[2] - x[1]);
+    r3 = 0.5*(x[1] + x[3]); u3 = turnLeft(x[3] - x[1]);
+    double k, l;
+    vec2_t xm1, xm2;
+    bool ok = true;
+    if (intersection(k, l, r1, u1, r3, u3)) {
+      xm1 = r1 + k*u1;
+      if (intersection(k, l, r2, u2, r3, u3)) {
+        xm2 = r2 + k*u2;
+      } else {
+        ok = false;
+      }
+    } else {
+      ok = false;
+      swap = true;
+    }
+    if (ok) {
+      if ((xm1 - x[2]).abs() < (xm1 - x[0]).abs()) {
+        swap = true;
+      }
+      if ((xm2 - x[0]).abs() < (xm2 - x[2]).abs()) {
+        swap = true;
+      }
+    }
+  } //end of if feature angle
+  return swap;
+}
+
+void SwapTriangles::swapStencil(const stencil_t &S)
+{
+  vtkIdType new_pts1[3], new_pts2[3];
+  new_pts1[0] = S.p1;
+  new_pts1[1] = S.id_node[1];
+  new_pts1[2] = S.id_node[0];
+  new_pts2[0] = S.id_node[1];
+  new_pts2[1] = S.p2;
+  new_pts2[2] = S.id_node[0];
+  m_Part.replaceCell(S.id_cell[0], 3, new_pts1);
+  m_Part.replaceCell(S.id_cell[1], 3, new_pts2);
 }
 
 int SwapTriangles::swap()
 {
   int N_swaps = 0;
-  setAllSurfaceCells();
   EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
   QVector<bool> marked(m_Grid->GetNumberOfCells(), false);
   for (int i = 0; i < m_Part.getNumberOfCells(); ++i) {
@@ -118,78 +194,11 @@ int SwapTriangles::swap()
     if (!m_BoundaryCodes.contains(cell_code->GetValue(id_cell)) && m_Grid->GetCellType(id_cell) == VTK_TRIANGLE) { //if it is a selected triangle
       if (!marked[id_cell] && !m_Swapped[id_cell]) {
         for (int j = 0; j < 3; ++j) {
-          bool swap = false;
           stencil_t S = getStencil(id_cell, j);
-          if(S.id_cell.size() == 2 && S.sameBC) {
-            if (S.type_cell[1] == VTK_TRIANGLE) {
-              if(!isEdge(S.id_node[0], S.id_node[1]) ) {
-                if (!marked[S.id_cell[1]] && !m_Swapped[S.id_cell[1]]) {
-                  QVector<vec3_t> x3(4);
-                  vec3_t x3_0(0,0,0);
-                  vec2_t x[4];
-
-                  m_Grid->GetPoint(S.id_node[0], x3[0].data());
-                  m_Grid->GetPoint(S.p1,         x3[1].data());
-                  m_Grid->GetPoint(S.id_node[1], x3[2].data());
-                  m_Grid->GetPoint(S.p2,         x3[3].data());
-
-                  vec3_t n1 = triNormal(x3[0], x3[1], x3[3]);
-                  vec3_t n2 = triNormal(x3[1], x3[2], x3[3]);
-
-                  bool force_swap = false;
-                  if (m_SmallAreaSwap) {
-                    double A1 = n1.abs();
-                    double A2 = n2.abs();
-                    if (isnan(A1) || isnan(A2)) {
-                      force_swap = true;
-                    } else {
-                      force_swap = A1 < m_SmallAreaRatio*A2 || A2 < m_SmallAreaRatio*A1;
-                    }
-                  }
-                  if (m_FeatureSwap || GeometryTools::angle(n1, n2) < m_FeatureAngle || force_swap) {
-
-                    if (!swap) {
-                      vec3_t n = n1 + n2;
-                      n.normalise();
-                      vec3_t ex = orthogonalVector(n);
-                      vec3_t ey = ex.cross(n);
-                      for (int k = 0; k < 4; ++k) {
-                        x[k] = vec2_t(x3[k]*ex, x3[k]*ey);
-                      }
-                      vec2_t r1, r2, r3, u1, u2, u3;
-                      r1 = 0.5*(x[0] + x[1]); u1 = turnLeft(x[1] - x[0]);
-                      r2 = 0.5*(x[1] + x[2]); u2 = turnLeft(x[2] - x[1]);
-                      r3 = 0.5*(x[1] + x[3]); u3 = turnLeft(x[3] - x[1]);
-                      double k, l;
-                      vec2_t xm1, xm2;
-                      bool ok = true;
-                      if (intersection(k, l, r1, u1, r3, u3)) {
-                        xm1 = r1 + k*u1;
-                        if (intersection(k, l, r2, u2, r3, u3)) {
-                          xm2 = r2 + k*u2;
-                        } else {
-                          ok = false;
-                        }
-                      } else {
-                        ok = false;
-                        swap = true;
-                      }
-                      if (ok) {
-                        if ((xm1 - x[2]).abs() < (xm1 - x[0]).abs()) {
-                          swap = true;
-                        }
-                        if ((xm2 - x[0]).abs() < (xm2 - x[2]).abs()) {
-                          swap = true;
-                        }
-                      }
-                    }
-                  //}// end of testswap
-                  } //end of if feature angle
-                } //end of if l_marked
-              } //end of if TestSwap
-            }
-          } //end of S valid
-
+          bool swap = false;
+          if (S.id_cell.size() == 2 && !marked[S.id_cell[1]] && !m_Swapped[S.id_cell[1]]) {
+            swap = swapWanted(S);
+          }
           if (swap) {
             if (testSwap(S)) {
               marked[S.id_cell[0]] = true;
@@ -210,22 +219,7 @@ int SwapTriangles::swap()
                 vtkIdType id_neigh = m_Part.n2cGG(S.p2, k);
                 marked[id_neigh] = true;
               }
-              vtkIdType new_pts1[3], new_pts2[3];
-              new_pts1[0] = S.p1;
-              new_pts1[1] = S.id_node[1];
-              new_pts1[2] = S.id_node[0];
-              new_pts2[0] = S.id_node[1];
-              new_pts2[1] = S.p2;
-              new_pts2[2] = S.id_node[0];
-              vtkIdType old_pts1[3], old_pts2[3];
-              old_pts1[0] = S.id_node[0];
-              old_pts1[1] = S.p1;
-              old_pts1[2] = S.p2;
-              old_pts2[0] = S.id_node[1];
-              old_pts2[1] = S.p2;
-              old_pts2[2] = S.p1;
-              m_Grid->ReplaceCell(S.id_cell[0], 3, new_pts1);
-              m_Grid->ReplaceCell(S.id_cell[1], 3, new_pts2);
+              swapStencil(S);
               m_Swapped[S.id_cell[0]] = true;
               m_Swapped[S.id_cell[1]] = true;
               ++N_swaps;
@@ -239,9 +233,106 @@ int SwapTriangles::swap()
   return N_swaps;
 }
 
+void SwapTriangles::enqueueEdge(vtkIdType id_node1, vtkIdType id_node2)
+{
+  QPair<vtkIdType, vtkIdType> edge(min(id_node1, id_node2), max(id_node1, id_node2));
+  if (!m_QueuedEdges.contains(edge)) {
+    m_QueuedEdges.insert(edge);
+    m_EdgeQueue.enqueue(edge);
+  }
+}
+
+int SwapTriangles::swapQueue(const QVector<vtkIdType> &seed_cells)
+{
+  EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
+  m_EdgeQueue.clear();
+  m_QueuedEdges.clear();
+  foreach (vtkIdType id_cell, seed_cells) {
+    if (m_Grid->GetCellType(id_cell) == VTK_TRIANGLE && !m_BoundaryCodes.contains(cell_code->GetValue(id_cell))) {
+      vtkIdType N_pts, *pts;
+      m_Grid->GetCellPoints(id_cell, N_pts, pts);
+      for (int j = 0; j < N_pts; ++j) {
+        enqueueEdge(pts[j], pts[(j + 1)%N_pts]);
+      }
+    }
+  }
+
+  // a swap can undo an earlier one on strongly curved surfaces; this limits the total effort
+  // to what m_MaxNumLoops full sweeps would have been allowed to do
+  int max_swaps = m_MaxNumLoops*m_Part.getNumberOfCells();
+  int N_swaps = 0;
+  while (!m_EdgeQueue.isEmpty() && N_swaps < max_swaps) {
+    QPair<vtkIdType, vtkIdType> edge = m_EdgeQueue.dequeue();
+    m_QueuedEdges.remove(edge);
+
+    // the edge might have been swapped away in the meantime
+    vtkIdType id_cells[2];
+    if (m_Part.edgeCells(edge.first, edge.second, id_cells, 2) != 2) {
+      continue;
+    }
+    vtkIdType id_cell = id_cells[0];
+    if (m_Grid->GetCellType(id_cell) != VTK_TRIANGLE || m_BoundaryCodes.contains(cell_code->GetValue(id_cell))) {
+      continue;
+    }
+    vtkIdType N_pts, *pts;
+    m_Grid->GetCellPoints(id_cell, N_pts, pts);
+    int j_side = -1;
+    for (int j = 0; j < N_pts; ++j) {
+      vtkIdType id_node1 = pts[j];
+      vtkIdType id_node2 = pts[(j + 1)%N_pts];
+      if (min(id_node1, id_node2) == edge.first && max(id_node1, id_node2) == edge.second) {
+        j_side = j;
+        break;
+      }
+    }
+    if (j_side == -1) {
+      EG_BUG;
+    }
+    stencil_t S = getStencil(id_cell, j_side);
+    if (swapWanted(S) && testSwap(S)) {
+      swapStencil(S);
+      ++N_swaps;
+      // only the outer edges of the quad can have become non-Delaunay
+      enqueueEdge(S.id_node[0], S.p1);
+      enqueueEdge(S.p1, S.id_node[1]);
+      enqueueEdge(S.id_node[1], S.p2);
+      enqueueEdge(S.p2, S.id_node[0]);
+    }
+  }
+  m_EdgeQueue.clear();
+  m_QueuedEdges.clear();
+  return N_swaps;
+}
+
 void SwapTriangles::operate()
 {
   if (m_Verbose) cout << "swapping edges for surface triangles ..." << endl;
+  // the connectivity is updated locally after each swap (see MeshPartition::replaceCell)
+  prepareSurfacePartition();
+  if (m_UseWorkQueue) {
+    QVector<vtkIdType> seed_cells;
+    if (!m_SeedNodesSet) {
+      seed_cells.resize(m_Part.getNumberOfCells());
+      for (int i = 0; i < m_Part.getNumberOfCells(); ++i) {
+        seed_cells[i] = m_Part.globalCell(i);
+      }
+    } else {
+      QSet<vtkIdType> cells;
+      foreach (vtkIdType id_node, m_SeedNodes) {
+        if (id_node < m_Grid->GetNumberOfPoints() && m_Part.localNode(id_node) >= 0) {
+          for (int i = 0; i < m_Part.n2cGSize(id_node); ++i) {
+            cells.insert(m_Part.n2cGG(id_node, i));
+          }
+        }
+      }
+      seed_cells.resize(cells.size());
+      qCopy(cells.begin(), cells.end(), seed_cells.begin());
+      qSort(seed_cells);
+    }
+    int N_swaps = swapQueue(seed_cells);
+    if (m_Verbose) cout << "  " << N_swaps << " swaps (" << seed_cells.size() << " seed cells)" << endl;
+    return;
+  }
   long int N_swaps      = 100000000;
   long int N_last_swaps = 100000001;
   int loop = 1;
@@ -27,6 +27,9 @@ class SwapTriangles;
 
 #include "surfaceoperation.h"
 
+#include <QQueue>
+#include <QPair>
+
 /**
   * \todo This class desperately needs a clean-up and optimisation!
   */
@@ -43,6 +46,12 @@ private: // attributes
   int           m_MaxNumLoops;
   double        m_SmallAreaRatio;
   double        m_SurfErrorThreshold;
+  bool          m_UseWorkQueue;
+  bool          m_SeedNodesSet;
+
+  QVector<vtkIdType>                 m_SeedNodes;   ///< nodes of recently modified cells (work-queue mode)
+  QQueue<QPair<vtkIdType, vtkIdType> > m_EdgeQueue;   ///< edges which still have to be checked (work-queue mode)
+  QSet<QPair<vtkIdType, vtkIdType> >   m_QueuedEdges; ///< edges currently in m_EdgeQueue
 
 private: // methods
   
@@ -51,10 +60,27 @@ private: // methods
   
   ///returns true if id_node1 is linked to id_node2
   bool isEdge(vtkIdType id_node1, vtkIdType id_node2);
+
+  ///returns true if the edge of the stencil should be swapped (Delaunay and feature angle criteria)
+  bool swapWanted(const stencil_t &S);
+
+  ///swaps the edge of the stencil and updates the connectivity
+  void swapStencil(const stencil_t &S);
+
+  ///appends an edge to the work queue unless it is queued already
+  void enqueueEdge(vtkIdType id_node1, vtkIdType id_node2);
     
 protected: // methods
   
   int swap();
+
+  /**
+   * Swaps edges until the work queue is empty.
+   * The queue is seeded with the edges of seed_cells; after each swap the four outer edges of the quad are re-checked.
+   * @param seed_cells the cells to start with
+   * @return the number of swaps
+   */
+  int swapQueue(const QVector<vtkIdType> &seed_cells);
   void computeSurfaceErrors(const QVector<vec3_t> &x, int bc, double &err1, double &err2);
   virtual void operate();
 
@@ -68,6 +94,14 @@ public:
   void setSmallAreaSwap(bool b)  { m_SmallAreaSwap = b; }
   void setVerboseOn() { m_Verbose = true; }
   void setVerboseOff() { m_Verbose = false; }
+  void setWorkQueueOn()  { m_UseWorkQueue = true; }
+  void setWorkQueueOff() { m_UseWorkQueue = false; }
+
+  /**
+   * Restrict the work-queue mode to the cells around the given nodes.
+   * Without seed nodes all selected cells are checked once.
+   */
+  void setSeedNodes(const QVector<vtkIdType> &nodes) { m_SeedNodes = nodes; m_SeedNodesSet = true; }
 
 };
 
@@ -138,64 +138,69 @@ void Triangle::setupTriangle()
 
 }
 
-vec3_t Triangle::local3DToGlobal3D(vec3_t r)
+vec3_t Triangle::local3DToGlobal3D(vec3_t r) const
 {
   return m_Xa + m_G*r;
 }
 
-vec3_t Triangle::global3DToLocal3D(vec3_t x)
+vec3_t Triangle::global3DToLocal3D(vec3_t x) const
 {
   vec3_t tmp = x - m_Xa;
   return m_GI*tmp;
 }
 
-vec3_t Triangle::local2DToGlobal3D(vec2_t r)
+vec3_t Triangle::local2DToGlobal3D(vec2_t r) const
 {
   return local3DToGlobal3D(vec3_t(r[0], r[1], 0));
 }
 
-vec2_t Triangle::global3DToLocal2D(vec3_t x)
+vec2_t Triangle::global3DToLocal2D(vec3_t x) const
 {
   vec3_t r = global3DToLocal3D(x);
   return vec2_t(r[0], r[1]);
 }
 
-bool Triangle::projectOnTriangle(vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, int& side, bool restrict_to_triangle)
+bool Triangle::projectOnTriangle(vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, int& side, bool restrict_to_triangle) const
+{
+  return projectOnTriangle(m_Xa, m_Xb, m_Xc, m_G3, xp, xi, ri, d, side, restrict_to_triangle);
+}
+
+bool Triangle::projectOnTriangle(vec3_t xa, vec3_t xb, vec3_t xc, vec3_t g3, vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, int& side, bool restrict_to_triangle)
 {
   side = -1;
-  double scal = (xp - this->m_Xa) * this->m_G3;
+  double scal = (xp - xa) * g3;
   vec3_t x1, x2;
   if (scal > 0) {
-    x1 = xp + this->m_G3;
-    x2 = xp - scal * this->m_G3 - this->m_G3;
+    x1 = xp + g3;
+    x2 = xp - scal * g3 - g3;
   } else {
-    x1 = xp - this->m_G3;
-    x2 = xp - scal * this->m_G3 + this->m_G3;
+    x1 = xp - g3;
+    x2 = xp - scal * g3 + g3;
   }
   // (xi,ri) gets set to the intersection of the line with the plane here!
-  bool intersects_face = GeometryTools::intersectEdgeAndTriangle(this->m_Xa, this->m_Xb, this->m_Xc, x1, x2, xi, ri);
+  bool intersects_face = GeometryTools::intersectEdgeAndTriangle(xa, xb, xc, x1, x2, xi, ri);
   vec3_t xi_free = xi;
   if (intersects_face) {
-    vec3_t dx = xp - this->m_Xa;
-    d = fabs(dx * this->m_G3);
+    vec3_t dx = xp - xa;
+    d = fabs(dx * g3);
   } else {
-    double kab = GeometryTools::intersection(this->m_Xa, this->m_Xb - this->m_Xa, xp, this->m_Xb - this->m_Xa);
-    double kac = GeometryTools::intersection(this->m_Xa, this->m_Xc - this->m_Xa, xp, this->m_Xc - this->m_Xa);
-    double kbc = GeometryTools::intersection(this->m_Xb, this->m_Xc - this->m_Xb, xp, this->m_Xc - this->m_Xb);
+    double kab = GeometryTools::intersection(xa, xb - xa, xp, xb - xa);
+    double kac = GeometryTools::intersection(xa, xc - xa, xp, xc - xa);
+    double kbc = GeometryTools::intersection(xb, xc - xb, xp, xc - xb);
 
-    double dab = (this->m_Xa + kab * (this->m_Xb - this->m_Xa) - xp).abs2();
-    double dac = (this->m_Xa + kac * (this->m_Xc - this->m_Xa) - xp).abs2();
-    double dbc = (this->m_Xb + kbc * (this->m_Xc - this->m_Xb) - xp).abs2();
-    double da = (this->m_Xa - xp).abs2();
-    double db = (this->m_Xb - xp).abs2();
-    double dc = (this->m_Xc - xp).abs2();
+    double dab = (xa + kab * (xb - xa) - xp).abs2();
+    double dac = (xa + kac * (xc - xa) - xp).abs2();
+    double dbc = (xb + kbc * (xc - xb) - xp).abs2();
+    double da = (xa - xp).abs2();
+    double db = (xb - xp).abs2();
+    double dc = (xc - xp).abs2();
 
     bool set = false;
     d = 1e99;//max(max(max(max(max(dab,dac),dbc),da),db),dc);
 
     if (dab < d) {
       if ((kab >= 0) && (kab <= 1)) {
-        xi = this->m_Xa + kab * (this->m_Xb - this->m_Xa);
+        xi = xa + kab * (xb - xa);
         ri = vec3_t(kab, 0, 0);
         d = dab;
         set = true;
@@ -204,7 +209,7 @@ bool Triangle::projectOnTriangle(vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, i
     }
     if (dbc < d) {
       if ((kbc >= 0) && (kbc <= 1)) {
-        xi = this->m_Xb + kbc * (this->m_Xc - this->m_Xb);
+        xi = xb + kbc * (xc - xb);
         ri = vec3_t(1 - kbc, kbc, 0);
         d = dbc;
         set = true;
@@ -213,7 +218,7 @@ bool Triangle::projectOnTriangle(vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, i
     }
     if (dac < d) {
       if ((kac >= 0) && (kac <= 1)) {
-        xi = this->m_Xa + kac * (this->m_Xc - this->m_Xa);
+        xi = xa + kac * (xc - xa);
         ri = vec3_t(0, kac, 0);
         d = dac;
         set = true;
@@ -221,21 +226,21 @@ bool Triangle::projectOnTriangle(vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, i
       }
     }
     if (da < d) {
-      xi = this->m_Xa;
+      xi = xa;
       ri = vec3_t(0, 0);
       d = da;
       set = true;
       side = 3;
     }
     if (db < d) {
-      xi = this->m_Xb;
+      xi = xb;
       ri = vec3_t(1, 0);
       d = db;
       set = true;
       side = 4;
     }
     if (dc < d) {
-      xi = this->m_Xc;
+      xi = xc;
       ri = vec3_t(0, 1);
       d = dc;
       set = true;
@@ -68,35 +68,41 @@ public:
      * @param d Distance of xp to (xi,ri)
      * @return True if (xi,ri) is the result of a direct projection on the triangle, else false.
     */
-  bool projectOnTriangle(vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, int& side, bool restrict_to_triangle);
+  bool projectOnTriangle(vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, int& side, bool restrict_to_triangle) const;
 
-  vec3_t local3DToGlobal3D(vec3_t l_M);
-  vec3_t global3DToLocal3D(vec3_t g_M);
-  vec3_t local2DToGlobal3D(vec2_t l_M);
-  vec2_t global3DToLocal2D(vec3_t g_M);
+  /**
+   * Same as the member version, but for a triangle which is only given by its nodes and its unit normal.
+   * This allows callers to keep a compact representation of many triangles.
+   */
+  static bool projectOnTriangle(vec3_t xa, vec3_t xb, vec3_t xc, vec3_t g3, vec3_t xp, vec3_t &xi, vec3_t &ri, double &d, int& side, bool restrict_to_triangle);
+
+  vec3_t local3DToGlobal3D(vec3_t l_M) const;
+  vec3_t global3DToLocal3D(vec3_t g_M) const;
+  vec3_t local2DToGlobal3D(vec2_t l_M) const;
+  vec2_t global3DToLocal2D(vec3_t g_M) const;
 
   void saveTriangle(QString filename);
 
   bool hasNeighbour(int i) { return m_HasNeighbour[i]; }
   void setNeighbourTrue(int i)  { m_HasNeighbour[i] = true; }
   void setNeighbourFalse(int i) { m_HasNeighbour[i] = false; }
-  vtkIdType idA() { return m_IdA; }
-  vtkIdType idB() { return m_IdB; }
-  vtkIdType idC() { return m_IdC; }
-  vec3_t g1() { return m_G1; }
-  vec3_t g2() { return m_G2; }
-  vec3_t g3() { return m_G3; }
-  vec3_t a() { return m_Xa; }
-  vec3_t b() { return m_Xb; }
-  vec3_t c() { return m_Xc; }
-  vec3_t nA() { return m_NormalA; }
-  vec3_t nB() { return m_NormalB; }
-  vec3_t nC() { return m_NormalC; }
-  vec3_t rNa() { return m_RNormalA; }
-  vec3_t rNb() { return m_RNormalB; }
-  vec3_t rNc() { return m_RNormalC; }
-  double smallestLength() { return m_SmallestLength; }
-  double smallestHeight() { return m_SmallestHeight; }
+  vtkIdType idA() const { return m_IdA; }
+  vtkIdType idB() const { return m_IdB; }
+  vtkIdType idC() const { return m_IdC; }
+  vec3_t g1() const { return m_G1; }
+  vec3_t g2() const { return m_G2; }
+  vec3_t g3() const { return m_G3; }
+  vec3_t a() const { return m_Xa; }
+  vec3_t b() const { return m_Xb; }
+  vec3_t c() const { return m_Xc; }
+  vec3_t nA() const { return m_NormalA; }
+  vec3_t nB() const { return m_NormalB; }
+  vec3_t nC() const { return m_NormalC; }
+  vec3_t rNa() const { return m_RNormalA; }
+  vec3_t rNb() const { return m_RNormalB; }
+  vec3_t rNc() const { return m_RNormalC; }
+  double smallestLength() const { return m_SmallestLength; }
+  double smallestHeight() const { return m_SmallestHeight; }
   void setNormals(vec3_t na, vec3_t nb, vec3_t nc);
 
 
@@ -0,0 +1,408 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#include "trianglestore.h"
+#include "binaryio.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+/// pointers to the arrays of a TriangleStore (or of a gathered block)
+struct arrays_t
+{
+  const double *ax, *ay, *az;
+  const double *ux, *uy, *uz;
+  const double *vx, *vy, *vz;
+  const double *nx, *ny, *nz;
+  const double *uu, *uv, *vv;
+  const double *inv_det, *inv_uu, *inv_vv, *inv_ww;
+};
+
+/// plain C++ lanes (one triangle at a time)
+struct ScalarLanes
+{
+  typedef double reg;
+  typedef bool   mask;
+  enum { width = 1 };
+  static reg  load(const double *p)       { return *p; }
+  static void store(double *p, reg a)     { *p = a; }
+  static reg  set1(double a)              { return a; }
+  static reg  add(reg a, reg b)           { return a + b; }
+  static reg  sub(reg a, reg b)           { return a - b; }
+  static reg  mul(reg a, reg b)           { return a*b; }
+  static reg  min(reg a, reg b)           { return a < b ? a : b; }
+  static reg  max(reg a, reg b)           { return a > b ? a : b; }
+  static mask ge(reg a, reg b)            { return a >= b; }
+  static mask gt(reg a, reg b)            { return a > b; }
+  static mask both(mask a, mask b)        { return a && b; }
+  static reg  select(mask m, reg a, reg b) { return m ? a : b; }
+};
+
+#if defined(__SSE2__)
+/// SSE2 lanes (two triangles per instruction)
+struct Sse2Lanes
+{
+  typedef __m128d reg;
+  typedef __m128d mask;
+  enum { width = 2 };
+  static reg  load(const double *p)       { return _mm_loadu_pd(p); }
+  static void store(double *p, reg a)     { _mm_storeu_pd(p, a); }
+  static reg  set1(double a)              { return _mm_set1_pd(a); }
+  static reg  add(reg a, reg b)           { return _mm_add_pd(a, b); }
+  static reg  sub(reg a, reg b)           { return _mm_sub_pd(a, b); }
+  static reg  mul(reg a, reg b)           { return _mm_mul_pd(a, b); }
+  static reg  min(reg a, reg b)           { return _mm_min_pd(a, b); }
+  static reg  max(reg a, reg b)           { return _mm_max_pd(a, b); }
+  static mask ge(reg a, reg b)            { return _mm_cmpge_pd(a, b); }
+  static mask gt(reg a, reg b)            { return _mm_cmpgt_pd(a, b); }
+  static mask both(mask a, mask b)        { return _mm_and_pd(a, b); }
+  static reg  select(mask m, reg a, reg b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+};
+#endif
+
+#if defined(__AVX__)
+/// AVX lanes (four triangles per instruction)
+struct AvxLanes
+{
+  typedef __m256d reg;
+  typedef __m256d mask;
+  enum { width = 4 };
+  static reg  load(const double *p)       { return _mm256_loadu_pd(p); }
+  static void store(double *p, reg a)     { _mm256_storeu_pd(p, a); }
+  static reg  set1(double a)              { return _mm256_set1_pd(a); }
+  static reg  add(reg a, reg b)           { return _mm256_add_pd(a, b); }
+  static reg  sub(reg a, reg b)           { return _mm256_sub_pd(a, b); }
+  static reg  mul(reg a, reg b)           { return _mm256_mul_pd(a, b); }
+  static reg  min(reg a, reg b)           { return _mm256_min_pd(a, b); }
+  static reg  max(reg a, reg b)           { return _mm256_max_pd(a, b); }
+  static mask ge(reg a, reg b)            { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+  static mask gt(reg a, reg b)            { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  static mask both(mask a, mask b)        { return _mm256_and_pd(a, b); }
+  static reg  select(mask m, reg a, reg b) { return _mm256_blendv_pd(b, a, m); }
+};
+typedef AvxLanes BlockLanes;
+#elif defined(__SSE2__)
+typedef Sse2Lanes BlockLanes;
+#else
+typedef ScalarLanes BlockLanes;
+#endif
+
+/**
+ * Squared distance of a point to L::width triangles starting at i.
+ * If the projection onto the plane is inside the triangle, this is the distance to the plane;
+ * otherwise it is the smallest distance to one of the three edges.
+ */
+template <class L>
+inline void pointTriangleKernel(const arrays_t &T, int i, const vec3_t &x, double *d2)
+{
+  typedef typename L::reg  reg;
+  typedef typename L::mask mask;
+  reg zero = L::set1(0.0);
+  reg one  = L::set1(1.0);
+
+  reg ux = L::load(T.ux + i), uy = L::load(T.uy + i), uz = L::load(T.uz + i);
+  reg vx = L::load(T.vx + i), vy = L::load(T.vy + i), vz = L::load(T.vz + i);
+  reg wx = L::sub(L::set1(x[0]), L::load(T.ax + i));
+  reg wy = L::sub(L::set1(x[1]), L::load(T.ay + i));
+  reg wz = L::sub(L::set1(x[2]), L::load(T.az + i));
+
+  reg wu = L::add(L::add(L::mul(wx, ux), L::mul(wy, uy)), L::mul(wz, uz));
+  reg wv = L::add(L::add(L::mul(wx, vx), L::mul(wy, vy)), L::mul(wz, vz));
+  reg uu = L::load(T.uu + i);
+  reg uv = L::load(T.uv + i);
+  reg vv = L::load(T.vv + i);
+
+  // barycentric coordinates of the projection onto the plane
+  reg inv_det = L::load(T.inv_det + i);
+  reg r = L::mul(L::sub(L::mul(vv, wu), L::mul(uv, wv)), inv_det);
+  reg s = L::mul(L::sub(L::mul(uu, wv), L::mul(uv, wu)), inv_det);
+  mask inside = L::both(L::both(L::ge(r, zero), L::ge(s, zero)), L::both(L::ge(one, L::add(r, s)), L::gt(inv_det, zero)));
+  reg dn = L::add(L::add(L::mul(wx, L::load(T.nx + i)), L::mul(wy, L::load(T.ny + i))), L::mul(wz, L::load(T.nz + i)));
+  reg d2_plane = L::mul(dn, dn);
+
+  // edge a-b
+  reg t  = L::min(one, L::max(zero, L::mul(wu, L::load(T.inv_uu + i))));
+  reg ex = L::sub(wx, L::mul(t, ux));
+  reg ey = L::sub(wy, L::mul(t, uy));
+  reg ez = L::sub(wz, L::mul(t, uz));
+  reg d2_edge = L::add(L::add(L::mul(ex, ex), L::mul(ey, ey)), L::mul(ez, ez));
+
+  // edge a-c
+  t  = L::min(one, L::max(zero, L::mul(wv, L::load(T.inv_vv + i))));
+  ex = L::sub(wx, L::mul(t, vx));
+  ey = L::sub(wy, L::mul(t, vy));
+  ez = L::sub(wz, L::mul(t, vz));
+  d2_edge = L::min(d2_edge, L::add(L::add(L::mul(ex, ex), L::mul(ey, ey)), L::mul(ez, ez)));
+
+  // edge b-c
+  reg qx = L::sub(wx, ux), qy = L::sub(wy, uy), qz = L::sub(wz, uz);
+  reg gx = L::sub(vx, ux), gy = L::sub(vy, uy), gz = L::sub(vz, uz);
+  reg qg = L::add(L::add(L::mul(qx, gx), L::mul(qy, gy)), L::mul(qz, gz));
+  t  = L::min(one, L::max(zero, L::mul(qg, L::load(T.inv_ww + i))));
+  ex = L::sub(qx, L::mul(t, gx));
+  ey = L::sub(qy, L::mul(t, gy));
+  ez = L::sub(qz, L::mul(t, gz));
+  d2_edge = L::min(d2_edge, L::add(L::add(L::mul(ex, ex), L::mul(ey, ey)), L::mul(ez, ez)));
+
+  L::store(d2, L::select(inside, d2_plane, d2_edge));
+}
+
+inline double safeInverse(double a)
+{
+  if (a > 0) {
+    return 1.0/a;
+  }
+  return 0;
+}
+
+}
+
+void TriangleStore::clear()
+{
+  m_Size = 0;
+  m_Ax.clear(); m_Ay.clear(); m_Az.clear();
+  m_Ux.clear(); m_Uy.clear(); m_Uz.clear();
+  m_Vx.clear(); m_Vy.clear(); m_Vz.clear();
+  m_Nx.clear(); m_Ny.clear(); m_Nz.clear();
+  m_UU.clear(); m_UV.clear(); m_VV.clear();
+  m_InvDet.clear();
+  m_InvUU.clear();
+  m_InvVV.clear();
+  m_InvWW.clear();
+}
+
+void TriangleStore::reserve(int N)
+{
+  N += block_size;
+  m_Ax.reserve(N); m_Ay.reserve(N); m_Az.reserve(N);
+  m_Ux.reserve(N); m_Uy.reserve(N); m_Uz.reserve(N);
+  m_Vx.reserve(N); m_Vy.reserve(N); m_Vz.reserve(N);
+  m_Nx.reserve(N); m_Ny.reserve(N); m_Nz.reserve(N);
+  m_UU.reserve(N); m_UV.reserve(N); m_VV.reserve(N);
+  m_InvDet.reserve(N);
+  m_InvUU.reserve(N);
+  m_InvVV.reserve(N);
+  m_InvWW.reserve(N);
+}
+
+void TriangleStore::append(vec3_t a, vec3_t b, vec3_t c)
+{
+  // remove a previous padding
+  m_Ax.resize(m_Size); m_Ay.resize(m_Size); m_Az.resize(m_Size);
+  m_Ux.resize(m_Size); m_Uy.resize(m_Size); m_Uz.resize(m_Size);
+  m_Vx.resize(m_Size); m_Vy.resize(m_Size); m_Vz.resize(m_Size);
+  m_Nx.resize(m_Size); m_Ny.resize(m_Size); m_Nz.resize(m_Size);
+  m_UU.resize(m_Size); m_UV.resize(m_Size); m_VV.resize(m_Size);
+  m_InvDet.resize(m_Size);
+  m_InvUU.resize(m_Size);
+  m_InvVV.resize(m_Size);
+  m_InvWW.resize(m_Size);
+
+  vec3_t u = b - a;
+  vec3_t v = c - a;
+  vec3_t n = u.cross(v);
+  double uu = u*u;
+  double uv = u*v;
+  double vv = v*v;
+  double det = uu*vv - uv*uv;
+  double L = n.abs();
+  if (L > 0) {
+    n *= 1.0/L;
+  } else {
+    n = vec3_t(0, 0, 0);
+  }
+  if (det <= 1e-12*uu*vv) {
+    det = 0;
+  }
+  m_Ax.append(a[0]); m_Ay.append(a[1]); m_Az.append(a[2]);
+  m_Ux.append(u[0]); m_Uy.append(u[1]); m_Uz.append(u[2]);
+  m_Vx.append(v[0]); m_Vy.append(v[1]); m_Vz.append(v[2]);
+  m_Nx.append(n[0]); m_Ny.append(n[1]); m_Nz.append(n[2]);
+  m_UU.append(uu); m_UV.append(uv); m_VV.append(vv);
+  m_InvDet.append(safeInverse(det));
+  m_InvUU.append(safeInverse(uu));
+  m_InvVV.append(safeInverse(vv));
+  m_InvWW.append(safeInverse((v - u)*(v - u)));
+  ++m_Size;
+}
+
+void TriangleStore::finalise()
+{
+  if (m_Size == 0) {
+    return;
+  }
+  int N = m_Size;
+  while (m_Ax.size() % block_size != 0) {
+    m_Ax.append(m_Ax[N-1]); m_Ay.append(m_Ay[N-1]); m_Az.append(m_Az[N-1]);
+    m_Ux.append(m_Ux[N-1]); m_Uy.append(m_Uy[N-1]); m_Uz.append(m_Uz[N-1]);
+    m_Vx.append(m_Vx[N-1]); m_Vy.append(m_Vy[N-1]); m_Vz.append(m_Vz[N-1]);
+    m_Nx.append(m_Nx[N-1]); m_Ny.append(m_Ny[N-1]); m_Nz.append(m_Nz[N-1]);
+    m_UU.append(m_UU[N-1]); m_UV.append(m_UV[N-1]); m_VV.append(m_VV[N-1]);
+    m_InvDet.append(m_InvDet[N-1]);
+    m_InvUU.append(m_InvUU[N-1]);
+    m_InvVV.append(m_InvVV[N-1]);
+    m_InvWW.append(m_InvWW[N-1]);
+  }
+}
+
+void TriangleStore::write(QDataStream &s) const
+{
+  s << qint32(m_Size);
+  writeRawVector(s, m_Ax); writeRawVector(s, m_Ay); writeRawVector(s, m_Az);
+  writeRawVector(s, m_Ux); writeRawVector(s, m_Uy); writeRawVector(s, m_Uz);
+  writeRawVector(s, m_Vx); writeRawVector(s, m_Vy); writeRawVector(s, m_Vz);
+  writeRawVector(s, m_Nx); writeRawVector(s, m_Ny); writeRawVector(s, m_Nz);
+  writeRawVector(s, m_UU); writeRawVector(s, m_UV); writeRawVector(s, m_VV);
+  writeRawVector(s, m_InvDet);
+  writeRawVector(s, m_InvUU);
+  writeRawVector(s, m_InvVV);
+  writeRawVector(s, m_InvWW);
+}
+
+bool TriangleStore::read(QDataStream &s)
+{
+  clear();
+  qint32 size;
+  s >> size;
+  bool ok = true;
+  ok = ok && readRawVector(s, m_Ax) && readRawVector(s, m_Ay) && readRawVector(s, m_Az);
+  ok = ok && readRawVector(s, m_Ux) && readRawVector(s, m_Uy) && readRawVector(s, m_Uz);
+  ok = ok && readRawVector(s, m_Vx) && readRawVector(s, m_Vy) && readRawVector(s, m_Vz);
+  ok = ok && readRawVector(s, m_Nx) && readRawVector(s, m_Ny) && readRawVector(s, m_Nz);
+  ok = ok && readRawVector(s, m_UU) && readRawVector(s, m_UV) && readRawVector(s, m_VV);
+  ok = ok && readRawVector(s, m_InvDet);
+  ok = ok && readRawVector(s, m_InvUU);
+  ok = ok && readRawVector(s, m_InvVV);
+  ok = ok && readRawVector(s, m_InvWW);
+  ok = ok && size >= 0 && size <= m_Ax.size() && m_Ax.size() % block_size == 0;
+  if (!ok) {
+    clear();
+    return false;
+  }
+  m_Size = size;
+  return true;
+}
+
+void TriangleStore::distances2(vec3_t x, int first, int num, double *d2) const
+{
+  if (m_Ax.size() % block_size != 0) {
+    EG_BUG; // finalise has not been called
+  }
+  arrays_t T;
+  T.ax = m_Ax.constData(); T.ay = m_Ay.constData(); T.az = m_Az.constData();
+  T.ux = m_Ux.constData(); T.uy = m_Uy.constData(); T.uz = m_Uz.constData();
+  T.vx = m_Vx.constData(); T.vy = m_Vy.constData(); T.vz = m_Vz.constData();
+  T.nx = m_Nx.constData(); T.ny = m_Ny.constData(); T.nz = m_Nz.constData();
+  T.uu = m_UU.constData(); T.uv = m_UV.constData(); T.vv = m_VV.constData();
+  T.inv_det = m_InvDet.constData();
+  T.inv_uu  = m_InvUU.constData();
+  T.inv_vv  = m_InvVV.constData();
+  T.inv_ww  = m_InvWW.constData();
+  int i = 0;
+  for (; i + BlockLanes::width <= num; i += BlockLanes::width) {
+    pointTriangleKernel<BlockLanes>(T, first + i, x, d2 + i);
+  }
+  for (; i < num; ++i) {
+    pointTriangleKernel<ScalarLanes>(T, first + i, x, d2 + i);
+  }
+}
+
+int TriangleStore::closest(vec3_t x, int first, int num, double &d2_min) const
+{
+  double d2[block_size];
+  int i_min = -1;
+  d2_min = 1e99;
+  for (int i = 0; i < num; i += block_size) {
+    int N = min(int(block_size), num - i);
+    distances2(x, first + i, N, d2);
+    for (int j = 0; j < N; ++j) {
+      if (d2[j] < d2_min) {
+        d2_min = d2[j];
+        i_min = first + i + j;
+      }
+    }
+  }
+  return i_min;
+}
+
+void TriangleStore::distances2(vec3_t x, const QVector<vtkIdType> &triangles, double *d2) const
+{
+  // gather blocks of triangles into local arrays
+  double buffer[19][block_size];
+  arrays_t T;
+  T.ax = buffer[0];  T.ay = buffer[1];  T.az = buffer[2];
+  T.ux = buffer[3];  T.uy = buffer[4];  T.uz = buffer[5];
+  T.vx = buffer[6];  T.vy = buffer[7];  T.vz = buffer[8];
+  T.nx = buffer[9];  T.ny = buffer[10]; T.nz = buffer[11];
+  T.uu = buffer[12]; T.uv = buffer[13]; T.vv = buffer[14];
+  T.inv_det = buffer[15];
+  T.inv_uu  = buffer[16];
+  T.inv_vv  = buffer[17];
+  T.inv_ww  = buffer[18];
+  double d2_block[block_size];
+  for (int i = 0; i < triangles.size(); i += block_size) {
+    int N = min(int(block_size), triangles.size() - i);
+    for (int j = 0; j < block_size; ++j) {
+      vtkIdType id_tri = triangles[i + min(j, N - 1)];
+      buffer[0][j]  = m_Ax[id_tri]; buffer[1][j]  = m_Ay[id_tri]; buffer[2][j]  = m_Az[id_tri];
+      buffer[3][j]  = m_Ux[id_tri]; buffer[4][j]  = m_Uy[id_tri]; buffer[5][j]  = m_Uz[id_tri];
+      buffer[6][j]  = m_Vx[id_tri]; buffer[7][j]  = m_Vy[id_tri]; buffer[8][j]  = m_Vz[id_tri];
+      buffer[9][j]  = m_Nx[id_tri]; buffer[10][j] = m_Ny[id_tri]; buffer[11][j] = m_Nz[id_tri];
+      buffer[12][j] = m_UU[id_tri]; buffer[13][j] = m_UV[id_tri]; buffer[14][j] = m_VV[id_tri];
+      buffer[15][j] = m_InvDet[id_tri];
+      buffer[16][j] = m_InvUU[id_tri];
+      buffer[17][j] = m_InvVV[id_tri];
+      buffer[18][j] = m_InvWW[id_tri];
+    }
+    int j = 0;
+    for (; j + BlockLanes::width <= block_size; j += BlockLanes::width) {
+      pointTriangleKernel<BlockLanes>(T, j, x, d2_block + j);
+    }
+    for (; j < block_size; ++j) {
+      pointTriangleKernel<ScalarLanes>(T, j, x, d2_block + j);
+    }
+    for (j = 0; j < N; ++j) {
+      d2[i + j] = d2_block[j];
+    }
+  }
+}
+
+int TriangleStore::closest(vec3_t x, const QVector<vtkIdType> &triangles, double &d2_min) const
+{
+  QVector<double> d2(triangles.size());
+  distances2(x, triangles, d2.data());
+  int i_min = -1;
+  d2_min = 1e99;
+  for (int i = 0; i < d2.size(); ++i) {
+    if (d2[i] < d2_min) {
+      d2_min = d2[i];
+      i_min = i;
+    }
+  }
+  return i_min;
+}
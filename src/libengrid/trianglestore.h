@@ -0,0 +1,117 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#ifndef TRIANGLESTORE_H
+#define TRIANGLESTORE_H
+
+class TriangleStore;
+
+#include "engrid.h"
+
+#include <QVector>
+#include <QDataStream>
+
+/**
+ * Structure-of-arrays store of triangles for batched point-to-triangle distance queries.
+ * Each coordinate lives in its own (padded) array, so that one point can be checked against
+ * several triangles per instruction (AVX: 4, SSE2: 2 triangles; scalar code otherwise).
+ * The store is padded to a multiple of TriangleStore::block_size with copies of the last triangle.
+ */
+class TriangleStore
+{
+
+public: // static attributes
+
+  static const int block_size = 4;
+
+private: // attributes
+
+  int m_Size;
+
+  QVector<double> m_Ax, m_Ay, m_Az; ///< first node
+  QVector<double> m_Ux, m_Uy, m_Uz; ///< edge from the first to the second node
+  QVector<double> m_Vx, m_Vy, m_Vz; ///< edge from the first to the third node
+  QVector<double> m_Nx, m_Ny, m_Nz; ///< unit normal vector (zero for degenerated triangles)
+  QVector<double> m_UU, m_UV, m_VV; ///< metric coefficients
+  QVector<double> m_InvDet;         ///< 1/(UU*VV - UV^2); zero for degenerated triangles
+  QVector<double> m_InvUU;          ///< 1/UU
+  QVector<double> m_InvVV;          ///< 1/VV
+  QVector<double> m_InvWW;          ///< 1/|V-U|^2
+
+public: // methods
+
+  TriangleStore() { clear(); }
+
+  void clear();
+  void reserve(int N);
+
+  /// add a triangle; finalise has to be called before the store can be used
+  void append(vec3_t a, vec3_t b, vec3_t c);
+
+  /// pad the arrays to a multiple of block_size
+  void finalise();
+
+  int size() const { return m_Size; }
+
+  void write(QDataStream &s) const; ///< write the (finalised) store in the native binary layout
+  bool read(QDataStream &s);        ///< read a store written by write; returns false if the data are corrupt
+
+  /**
+   * Compute the squared distances of a point to a range of triangles.
+   * @param x the point
+   * @param first the first triangle (should be a multiple of block_size for best performance)
+   * @param num the number of triangles
+   * @param d2 on return the squared distances (num entries)
+   */
+  void distances2(vec3_t x, int first, int num, double *d2) const;
+
+  /**
+   * Find the closest triangle of a range.
+   * @param x the point
+   * @param first the first triangle
+   * @param num the number of triangles
+   * @param d2 on return the squared distance of the closest triangle
+   * @return the index of the closest triangle (-1 if num == 0)
+   */
+  int closest(vec3_t x, int first, int num, double &d2) const;
+
+  /**
+   * Compute the squared distances of a point to an arbitrary selection of triangles.
+   * The triangles are gathered into blocks before the batched kernel is applied.
+   * @param x the point
+   * @param triangles the indices of the triangles
+   * @param d2 on return the squared distances (one entry for each entry of triangles)
+   */
+  void distances2(vec3_t x, const QVector<vtkIdType> &triangles, double *d2) const;
+
+  /**
+   * Find the closest triangle of an arbitrary selection.
+   * @param x the point
+   * @param triangles the indices of the triangles to check
+   * @param d2 on return the squared distance of the closest triangle
+   * @return the position in triangles of the closest one (-1 if triangles is empty)
+   */
+  int closest(vec3_t x, const QVector<vtkIdType> &triangles, double &d2) const;
+
+};
+
+#endif // TRIANGLESTORE_H
@@ -0,0 +1,241 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#include "triangletree.h"
+#include "binaryio.h"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+namespace
+{
+
+/// orders triangle indices by one coordinate of their centres
+struct CentreCompare
+{
+  const vec3_t *xc;
+  int i;
+  CentreCompare(const vec3_t *xc, int i) : xc(xc), i(i) {}
+  bool operator()(int t1, int t2) const { return xc[t1][i] < xc[t2][i]; }
+};
+
+}
+
+TriangleTree::TriangleTree()
+{
+  m_MaxLeafSize = 4;
+}
+
+void TriangleTree::build(const QVector<vec3_t> &x, const QVector<int> &tri_nodes)
+{
+  int N = tri_nodes.size()/3;
+  m_Nodes.clear();
+  m_Order.resize(N);
+  m_Position.clear();
+  m_Store.clear();
+  if (N == 0) {
+    return;
+  }
+  QVector<vec3_t> x1(N), x2(N), xc(N);
+  for (int i = 0; i < N; ++i) {
+    const vec3_t &a = x[tri_nodes[3*i]];
+    const vec3_t &b = x[tri_nodes[3*i + 1]];
+    const vec3_t &c = x[tri_nodes[3*i + 2]];
+    for (int k = 0; k < 3; ++k) {
+      x1[i][k] = min(a[k], min(b[k], c[k]));
+      x2[i][k] = max(a[k], max(b[k], c[k]));
+    }
+    xc[i] = 0.5*(x1[i] + x2[i]);
+    m_Order[i] = i;
+  }
+  m_Nodes.reserve(2*(N/m_MaxLeafSize + 1));
+  buildNode(x1, x2, xc, 0, N);
+  m_Nodes.squeeze();
+
+  // the triangles of a leaf are contiguous in the store
+  m_Position.resize(N);
+  m_Store.clear();
+  m_Store.reserve(N);
+  for (int i = 0; i < N; ++i) {
+    int t = m_Order[i];
+    m_Store.append(x[tri_nodes[3*t]], x[tri_nodes[3*t + 1]], x[tri_nodes[3*t + 2]]);
+    m_Position[t] = i;
+  }
+  m_Store.finalise();
+}
+
+int TriangleTree::buildNode(const QVector<vec3_t> &x1, const QVector<vec3_t> &x2, const QVector<vec3_t> &xc, int first, int num)
+{
+  int i_node = m_Nodes.size();
+  m_Nodes.append(node_t());
+  node_t node;
+  node.child1 = -1;
+  node.child2 = -1;
+  node.first  = first;
+  node.num    = num;
+
+  // bounding box of the triangles and of their centres
+  node.x1 = x1[m_Order[first]];
+  node.x2 = x2[m_Order[first]];
+  vec3_t xc1 = xc[m_Order[first]];
+  vec3_t xc2 = xc1;
+  for (int i = first + 1; i < first + num; ++i) {
+    int t = m_Order[i];
+    for (int k = 0; k < 3; ++k) {
+      node.x1[k] = min(node.x1[k], x1[t][k]);
+      node.x2[k] = max(node.x2[k], x2[t][k]);
+      xc1[k] = min(xc1[k], xc[t][k]);
+      xc2[k] = max(xc2[k], xc[t][k]);
+    }
+  }
+
+  // split at the median of the longest extent of the centres
+  if (num > m_MaxLeafSize) {
+    vec3_t D = xc2 - xc1;
+    int i_dir = 0;
+    if (D[1] > D[i_dir]) i_dir = 1;
+    if (D[2] > D[i_dir]) i_dir = 2;
+    if (D[i_dir] > 0) {
+      int *order = m_Order.data();
+      int num1 = num/2;
+      std::nth_element(order + first, order + first + num1, order + first + num, CentreCompare(xc.constData(), i_dir));
+      node.child1 = buildNode(x1, x2, xc, first, num1);
+      node.child2 = buildNode(x1, x2, xc, first + num1, num - num1);
+      node.num = 0;
+    }
+  }
+  m_Nodes[i_node] = node;
+  return i_node;
+}
+
+double TriangleTree::boxDistance2(const node_t &node, const vec3_t &x)
+{
+  double d2 = 0;
+  for (int k = 0; k < 3; ++k) {
+    double dx = 0;
+    if (x[k] < node.x1[k]) {
+      dx = node.x1[k] - x[k];
+    } else if (x[k] > node.x2[k]) {
+      dx = x[k] - node.x2[k];
+    }
+    d2 += dx*dx;
+  }
+  return d2;
+}
+
+int TriangleTree::findClosest(vec3_t x, int hint, double &d) const
+{
+  int id_closest = -1;
+  double d2_min = 1e99;
+  d = 1e99;
+  if (m_Nodes.isEmpty()) {
+    return -1;
+  }
+
+  // the hint provides a tight distance bound from the start
+  if (hint >= 0 && hint < m_Position.size()) {
+    m_Store.distances2(x, m_Position[hint], 1, &d2_min);
+    id_closest = hint;
+  }
+
+  const node_t *nodes = m_Nodes.constData();
+  QVarLengthArray<int, 128> stack;
+  stack.append(0);
+  while (stack.size() > 0) {
+    const node_t &node = nodes[stack[stack.size() - 1]];
+    stack.removeLast();
+    if (boxDistance2(node, x) >= d2_min) {
+      continue;
+    }
+    if (node.child1 < 0) {
+      double d2;
+      int i = m_Store.closest(x, node.first, node.num, d2);
+      if (d2 < d2_min) {
+        d2_min = d2;
+        id_closest = m_Order[i];
+      }
+    } else {
+      // visit the closer child first (it is pushed last)
+      double d1 = boxDistance2(nodes[node.child1], x);
+      double d2 = boxDistance2(nodes[node.child2], x);
+      if (d1 < d2) {
+        stack.append(node.child2);
+        stack.append(node.child1);
+      } else {
+        stack.append(node.child1);
+        stack.append(node.child2);
+      }
+    }
+  }
+  d = sqrt(d2_min);
+  return id_closest;
+}
+
+int TriangleTree::findClosest(vec3_t x, const QVector<vtkIdType> &candidates, double &d) const
+{
+  QVector<vtkIdType> positions(candidates.size());
+  for (int i = 0; i < candidates.size(); ++i) {
+    positions[i] = m_Position[candidates[i]];
+  }
+  double d2;
+  int i = m_Store.closest(x, positions, d2);
+  d = sqrt(d2);
+  if (i < 0) {
+    return -1;
+  }
+  return candidates[i];
+}
+
+void TriangleTree::write(QDataStream &s) const
+{
+  s << qint32(m_MaxLeafSize);
+  writeRawVector(s, m_Nodes);
+  writeRawVector(s, m_Order);
+  writeRawVector(s, m_Position);
+  m_Store.write(s);
+}
+
+bool TriangleTree::read(QDataStream &s)
+{
+  qint32 max_leaf_size;
+  s >> max_leaf_size;
+  m_MaxLeafSize = max_leaf_size;
+  bool ok = readRawVector(s, m_Nodes) && readRawVector(s, m_Order) && readRawVector(s, m_Position) && m_Store.read(s);
+  ok = ok && m_Order.size() == m_Position.size() && m_Store.size() == m_Order.size();
+  for (int i = 0; ok && i < m_Nodes.size(); ++i) {
+    const node_t &node = m_Nodes[i];
+    if (node.child1 >= m_Nodes.size() || node.child2 >= m_Nodes.size() || node.first < 0 || node.num < 0 || node.first + node.num > m_Order.size()) {
+      ok = false;
+    }
+  }
+  for (int i = 0; ok && i < m_Order.size(); ++i) {
+    ok = m_Order[i] >= 0 && m_Order[i] < m_Order.size() && m_Position[i] >= 0 && m_Position[i] < m_Order.size();
+  }
+  if (!ok) {
+    m_Nodes.clear();
+    m_Order.clear();
+    m_Position.clear();
+    m_Store.clear();
+  }
+  return ok;
+}
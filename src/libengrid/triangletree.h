@@ -0,0 +1,106 @@
+// 
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// +                                                                      +
+// + This file is part of enGrid.                                         +
+// +                                                                      +
+// + Copyright 2008-2012 enGits GmbH                                      +
+// +                                                                      +
+// + enGrid is free software: you can redistribute it and/or modify       +
+// + it under the terms of the GNU General Public License as published by +
+// + the Free Software Foundation, either version 3 of the License, or    +
+// + (at your option) any later version.                                  +
+// +                                                                      +
+// + enGrid is distributed in the hope that it will be useful,            +
+// + but WITHOUT ANY WARRANTY; without even the implied warranty of       +
+// + MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        +
+// + GNU General Public License for more details.                         +
+// +                                                                      +
+// + You should have received a copy of the GNU General Public License    +
+// + along with enGrid. If not, see <http://www.gnu.org/licenses/>.       +
+// +                                                                      +
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// 
+#ifndef TRIANGLETREE_H
+#define TRIANGLETREE_H
+
+class TriangleTree;
+
+#include "trianglestore.h"
+
+#include <QVector>
+#include <QDataStream>
+
+/**
+ * Bounding volume hierarchy (axis aligned boxes) over a set of triangles.
+ * The tree is stored in flat arrays; every leaf holds a contiguous range of m_Order.
+ * It answers nearest-triangle queries exactly: sub-trees are only visited if their box is closer
+ * than the best triangle found so far, so no query has to fall back to a scan of all triangles.
+ * The triangles are kept in a TriangleStore in leaf order, so each leaf is checked with one batched call.
+ */
+class TriangleTree
+{
+
+private: // data-types
+
+  struct node_t
+  {
+    vec3_t x1, x2; ///< bounding box
+    int    child1; ///< first child (-1 for a leaf)
+    int    child2; ///< second child (-1 for a leaf)
+    int    first;  ///< first entry in m_Order (leaves only)
+    int    num;    ///< number of triangles (leaves only)
+  };
+
+private: // attributes
+
+  QVector<node_t> m_Nodes;
+  QVector<int>    m_Order;       ///< triangle indices sorted by leaf
+  QVector<int>    m_Position;    ///< position of each triangle in m_Order
+  TriangleStore   m_Store;       ///< the triangles in the order of m_Order
+  int             m_MaxLeafSize;
+
+private: // methods
+
+  int  buildNode(const QVector<vec3_t> &x1, const QVector<vec3_t> &x2, const QVector<vec3_t> &xc, int first, int num);
+  static double boxDistance2(const node_t &node, const vec3_t &x);
+
+public: // methods
+
+  TriangleTree();
+
+  /**
+   * Build the hierarchy.
+   * @param x the node coordinates
+   * @param tri_nodes the nodes (index in x) of the triangles; three for each triangle.
+   *        Indices returned by findClosest refer to the triangles of this list.
+   */
+  void build(const QVector<vec3_t> &x, const QVector<int> &tri_nodes);
+
+  /**
+   * Find the triangle which is closest to a point.
+   * @param x the point
+   * @param hint a triangle which is likely to be close (e.g. the last result), or -1
+   * @param d on return the distance to the closest triangle
+   * @return the index of the closest triangle (-1 if the tree is empty)
+   */
+  int findClosest(vec3_t x, int hint, double &d) const;
+
+  /**
+   * Find the closest triangle out of a list of candidates.
+   * @param x the point
+   * @param candidates the triangles to check
+   * @param d on return the distance to the closest triangle
+   * @return the index of the closest triangle (-1 if there are no candidates)
+   */
+  int findClosest(vec3_t x, const QVector<vtkIdType> &candidates, double &d) const;
+
+  void write(QDataStream &s) const; ///< write the hierarchy in the native binary layout
+  bool read(QDataStream &s);        ///< read a hierarchy written by write; returns false if the data are corrupt
+
+  int  numTriangles() const { return m_Order.size(); }
+  bool isEmpty() const { return m_Nodes.isEmpty(); }
+  void setMaxLeafSize(int N) { m_MaxLeafSize = N; }
+
+};
+
+#endif // TRIANGLETREE_H
@@ -26,6 +26,10 @@
 
 #include <vtkCharArray.h>
 
+#include <QTime>
+
+#include <queue>
+
 UpdateDesiredMeshDensity::UpdateDesiredMeshDensity() : SurfaceOperation()
 {
   EG_TYPENAME;
@@ -38,6 +42,21 @@ UpdateDesiredMeshDensity::UpdateDesiredMeshDensity() : SurfaceOperation()
   m_FeatureResolution2D = 0;
   m_FeatureResolution3D = 0;
   m_FeatureThresholdAngle = deg2rad(45.0);
+  m_InputsRead = false;
+  m_TimeFeatures = 0;
+  m_TimeSources = 0;
+  m_TimeNodes = 0;
+  m_TimeGrowth = 0;
+}
+
+void UpdateDesiredMeshDensity::readInputs()
+{
+  if (m_InputsRead) {
+    return;
+  }
+  m_ELSManager.read();
+  m_AllBCs = GuiMainWindow::pointer()->getAllBoundaryCodes();
+  m_InputsRead = true;
 }
 
 double UpdateDesiredMeshDensity::computeSearchDistance(vtkIdType id_face)
@@ -56,49 +75,6 @@ double UpdateDesiredMeshDensity::computeSearchDistance(vtkIdType id_face)
   return L;
 }
 
-void UpdateDesiredMeshDensity::computeExistingLengths()
-{
-  QSet<int> all_bcs = GuiMainWindow::pointer()->getAllBoundaryCodes();
-  QSet<int> fixed_bcs = all_bcs - m_BoundaryCodes;
-  QVector<double> edge_length(m_Grid->GetNumberOfPoints(), 1e99);
-  QVector<int> edge_count(m_Grid->GetNumberOfPoints(), 0);
-  m_Fixed.fill(false, m_Grid->GetNumberOfPoints());
-  EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
-  for (vtkIdType id_cell = 0; id_cell < m_Grid->GetNumberOfCells(); ++id_cell) {
-    if (isSurface(id_cell, m_Grid)) {
-      if (fixed_bcs.contains(cell_code->GetValue(id_cell))) {
-        vtkIdType N_pts, *pts;
-        m_Grid->GetCellPoints(id_cell, N_pts, pts);
-        QVector<vec3_t> x(N_pts);
-        for (int i = 0; i < N_pts; ++i) {
-          m_Grid->GetPoint(pts[i], x[i].data());
-          m_Fixed[pts[i]] = true;
-        }
-        for (int i = 0; i < N_pts; ++i) {
-          int j = i + 1;
-          if (j >= N_pts) {
-            j = 0;
-          }
-          double L = (x[i] - x[j]).abs();
-          edge_length[pts[i]] = min(edge_length[pts[i]], L);
-          edge_length[pts[j]] = min(edge_length[pts[j]], L);
-          ++edge_count[pts[i]];
-          ++edge_count[pts[j]];
-        }
-      }
-    }
-  }
-  EG_VTKDCN(vtkDoubleArray, characteristic_length_desired,   m_Grid, "node_meshdensity_desired");
-  for (vtkIdType id_node = 0; id_node < m_Grid->GetNumberOfPoints(); ++id_node) {
-    if (edge_count[id_node] > 0) {
-      if (edge_length[id_node] > 1e98) {
-        EG_BUG;
-      }
-      characteristic_length_desired->SetValue(id_node, edge_length[id_node]);
-    }
-  }
-}
-
 void UpdateDesiredMeshDensity::computeFeature(const QList<point_t> points, QVector<double> &cl_pre, double res)
 {
   int N = 0;
@@ -137,223 +113,319 @@ void UpdateDesiredMeshDensity::computeFeature(const QList<point_t> points, QVect
   }
 }
 
-void UpdateDesiredMeshDensity::computeFeature2D(QVector<double> &cl_pre)
+void UpdateDesiredMeshDensity::computeFeatures(QVector<double> &cl_pre)
 {
-  if (m_FeatureResolution2D < 1e-3) {
+  bool features_2d = m_FeatureResolution2D >= 1e-3;
+  bool features_3d = m_FeatureResolution3D >= 1e-3;
+  if (!features_2d && !features_3d) {
     return;
   }
-  QSet<int> bcs = getAllBoundaryCodes(m_Grid);
   EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
-  foreach (int bc, bcs) {
-    QList<point_t> points;
-    for (vtkIdType id_face = 0; id_face < m_Grid->GetNumberOfCells(); ++id_face) {
-      if (isSurface(id_face, m_Grid)) {
-        if (cell_code->GetValue(id_face) == bc) {
-          vec3_t xc = cellCentre(m_Grid, id_face);
-          vtkIdType num_pts, *pts;
-          m_Grid->GetCellPoints(id_face, num_pts, pts);
-          QVector<vec3_t> xn(num_pts + 1);
-          for (int i_pts = 0; i_pts < num_pts; ++i_pts) {
-            m_Grid->GetPoint(pts[i_pts], xn[i_pts].data());
-          }
-          xn[num_pts] = xn[0];
-          for (int i_neigh = 0; i_neigh < m_Part.c2cGSize(id_face); ++i_neigh) {
-            vtkIdType id_neigh = m_Part.c2cGG(id_face, i_neigh);
-            if (id_neigh != -1) {
-              if (cell_code->GetValue(id_neigh) != bc) {
-                point_t P;
-                P.x = 0.5*(xn[i_neigh] + xn[i_neigh + 1]);
-                P.n = xc - xn[i_neigh];
-                vec3_t v = xn[i_neigh + 1] - xn[i_neigh];
-                v.normalise();
-                P.n -= (P.n*v)*v;
-                P.n.normalise();
-                for (int i_pts = 0; i_pts < num_pts; ++i_pts) {
-                  P.idx.append(m_Part.localNode(pts[i_pts]));
-                }
-                P.L = computeSearchDistance(id_face);
-                points.append(P);
-              }
-            }
+  QMap<int, QList<point_t> > points_2d; // one list for each boundary code
+  QList<point_t> points_3d;
+  for (vtkIdType id_face = 0; id_face < m_Grid->GetNumberOfCells(); ++id_face) {
+    if (!isSurface(id_face, m_Grid)) {
+      continue;
+    }
+    int bc = cell_code->GetValue(id_face);
+    vtkIdType num_pts, *pts;
+    m_Grid->GetCellPoints(id_face, num_pts, pts);
+    QList<int> idx;
+    for (int i_pts = 0; i_pts < num_pts; ++i_pts) {
+      idx.append(m_Part.localNode(pts[i_pts]));
+    }
+    double L = computeSearchDistance(id_face);
+    vec3_t xc = cellCentre(m_Grid, id_face);
+    if (features_2d) {
+      QVector<vec3_t> xn(num_pts + 1);
+      for (int i_pts = 0; i_pts < num_pts; ++i_pts) {
+        m_Grid->GetPoint(pts[i_pts], xn[i_pts].data());
+      }
+      xn[num_pts] = xn[0];
+      for (int i_neigh = 0; i_neigh < m_Part.c2cGSize(id_face); ++i_neigh) {
+        vtkIdType id_neigh = m_Part.c2cGG(id_face, i_neigh);
+        if (id_neigh != -1) {
+          if (cell_code->GetValue(id_neigh) != bc) {
+            point_t P;
+            P.x = 0.5*(xn[i_neigh] + xn[i_neigh + 1]);
+            P.n = xc - xn[i_neigh];
+            vec3_t v = xn[i_neigh + 1] - xn[i_neigh];
+            v.normalise();
+            P.n -= (P.n*v)*v;
+            P.n.normalise();
+            P.idx = idx;
+            P.L = L;
+            points_2d[bc].append(P);
           }
         }
       }
     }
-    computeFeature(points, cl_pre, m_FeatureResolution2D);
+    if (features_3d) {
+      point_t P;
+      P.x = xc;
+      P.n = cellNormal(m_Grid, id_face);
+      P.n.normalise();
+      P.n *= -1;
+      P.idx = idx;
+      P.L = L;
+      points_3d.append(P);
+    }
+  }
+  if (features_2d) {
+    foreach (QList<point_t> points, points_2d) {
+      computeFeature(points, cl_pre, m_FeatureResolution2D);
+    }
+  }
+  if (features_3d) {
+    computeFeature(points_3d, cl_pre, m_FeatureResolution3D);
   }
 }
 
-void UpdateDesiredMeshDensity::computeFeature3D(QVector<double> &cl_pre)
+double UpdateDesiredMeshDensity::computeNodeLength(vtkIdType id_node, double cl_pre, double cl_src, vtkIntArray *cell_code, vtkIntArray *characteristic_length_specified)
 {
-  if (m_FeatureResolution3D < 1e-3) {
-    return;
+  // existing lengths of fixed boundaries and boundary codes around the node
+  double L_fixed = 1e99;
+  QList<int> bcs;
+  for (int i_cells = 0; i_cells < m_Part.n2cGSize(id_node); ++i_cells) {
+    vtkIdType id_cell = m_Part.n2cGG(id_node, i_cells);
+    if (!isSurface(id_cell, m_Grid)) {
+      continue;
+    }
+    int bc = cell_code->GetValue(id_cell);
+    if (!bcs.contains(bc)) {
+      bcs.append(bc);
+    }
+    if (m_FixedBCs.contains(bc)) {
+      vtkIdType N_pts, *pts;
+      m_Grid->GetCellPoints(id_cell, N_pts, pts);
+      for (int i = 0; i < N_pts; ++i) {
+        if (pts[i] == id_node) {
+          vec3_t x, x1, x2;
+          m_Grid->GetPoint(id_node, x.data());
+          m_Grid->GetPoint(pts[(i + 1) % N_pts], x1.data());
+          m_Grid->GetPoint(pts[(i + N_pts - 1) % N_pts], x2.data());
+          L_fixed = min(L_fixed, (x - x1).abs());
+          L_fixed = min(L_fixed, (x - x2).abs());
+          break;
+        }
+      }
+    }
   }
-  EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
-  QList<point_t> points;
-  for (vtkIdType id_face = 0; id_face < m_Grid->GetNumberOfCells(); ++id_face) {
-    if (isSurface(id_face, m_Grid)) {
-      vtkIdType num_pts, *pts;
-      m_Grid->GetCellPoints(id_face, num_pts, pts);
-      point_t P;
-      P.x = cellCentre(m_Grid, id_face);
-      P.n = cellNormal(m_Grid, id_face);
-      P.n.normalise();
-      P.n *= -1;
-      for (int i_pts = 0; i_pts < num_pts; ++i_pts) {
-        P.idx.append(m_Part.localNode(pts[i_pts]));
+  m_Fixed[id_node] = L_fixed < 1e98;
+
+  // surface curvature
+  if (m_NodesPerQuarterCircle > 1e-3) {
+    double R = 1e99;
+    foreach (int bc, bcs) {
+      // only the projections of the boundary codes being meshed are used (they are built on first use)
+      if (m_BoundaryCodes.contains(bc)) {
+        R = min(R, GuiMainWindow::pointer()->getSurfProj(bc)->getRadius(id_node));
       }
-      P.L = computeSearchDistance(id_face);
-      points.append(P);
     }
+    cl_pre = min(cl_pre, max(m_MinEdgeLength, 0.5*R*M_PI/m_NodesPerQuarterCircle));
+  }
+
+  // mesh density table
+  double cl = m_MaxEdgeLength;
+  if (m_BoundaryCodes.size() > 0) {
+    int idx = characteristic_length_specified->GetValue(id_node);
+    if (idx != -1) {
+      if (idx >= m_VMDvector.size()) {
+        qWarning()<<"idx="<<idx;
+        qWarning()<<"m_VMDvector.size()="<<m_VMDvector.size();
+        EG_BUG;
+      }
+      cl = m_VMDvector[idx].density;
+    }
+  }
+  if (m_Fixed[id_node]) {
+    cl = L_fixed;
+  }
+  cl = min(cl_pre, cl);
+
+  // edge length sources
+  if (cl_src > 0) {
+    cl = min(cl, cl_src);
   }
-  computeFeature(points, cl_pre, m_FeatureResolution3D);
+
+  cl = max(m_MinEdgeLength, cl);
+  if (cl == 0) {
+    EG_BUG;
+  }
+  return cl;
 }
 
+void UpdateDesiredMeshDensity::limitGrowth(double cl_min, QVector<double> &cl)
+{
+  l2g_t nodes = getPartNodes();
+  l2l_t n2n   = getPartN2N();
+
+  // The nodes were limited by sweeps over all nodes with a threshold starting at cl_min, which grew by the
+  // growth factor after every sweep. In each sweep the nodes at or below the threshold limited all neighbours
+  // above the threshold, and the sweeps stopped as soon as no node above the threshold had a neighbour at
+  // or below it. The same field is computed here by admitting the nodes in the order of their lengths,
+  // so the effort does not depend on the number of sweeps any more.
+  // A lowered node always ends up above the threshold of its sweep; hence all nodes at or below the
+  // threshold are final, and the sweeps stop once every connected set of nodes is either completely
+  // at or below the threshold or completely above it.
+  int N = nodes.size();
+  QVector<int> component(N, -1);
+  QVector<int> num_nodes;
+  for (int i_start = 0; i_start < N; ++i_start) {
+    if (component[i_start] == -1) {
+      int i_comp = num_nodes.size();
+      num_nodes.append(0);
+      QVector<int> front;
+      front.append(i_start);
+      component[i_start] = i_comp;
+      while (!front.isEmpty()) {
+        int i_nodes = front.last();
+        front.pop_back();
+        ++num_nodes[i_comp];
+        for (int j = 0; j < n2n[i_nodes].size(); ++j) {
+          int j_nodes = n2n[i_nodes][j];
+          if (component[j_nodes] == -1) {
+            component[j_nodes] = i_comp;
+            front.append(j_nodes);
+          }
+        }
+      }
+    }
+  }
+
+  typedef pair<double, int> entry_t;
+  priority_queue<entry_t, vector<entry_t>, greater<entry_t> > queue;
+  for (int i_nodes = 0; i_nodes < N; ++i_nodes) {
+    queue.push(entry_t(cl[i_nodes], i_nodes));
+  }
+  QVector<bool> admitted(N, false);
+  QVector<int>  num_admitted(num_nodes.size(), 0);
+  int num_partial = 0; // components which are partly at or below the threshold
+  QVector<int> sources;
+  double threshold = cl_min;
+  while (true) {
+    sources.clear();
+    while (!queue.empty() && queue.top().first <= threshold) {
+      int i_nodes = queue.top().second;
+      bool outdated = queue.top().first > cl[i_nodes];
+      queue.pop();
+      if (outdated || admitted[i_nodes]) {
+        continue;
+      }
+      admitted[i_nodes] = true;
+      sources.append(i_nodes);
+      int i_comp = component[i_nodes];
+      if (num_admitted[i_comp] == 0 && num_nodes[i_comp] > 1) {
+        ++num_partial;
+      }
+      ++num_admitted[i_comp];
+      if (num_admitted[i_comp] == num_nodes[i_comp] && num_nodes[i_comp] > 1) {
+        --num_partial;
+      }
+    }
+    if (num_partial == 0) {
+      break;
+    }
+    foreach (int i_nodes, sources) {
+      double cli = cl[i_nodes];
+      double L_new = min(m_MaxEdgeLength, cli * m_GrowthFactor);
+      for (int j = 0; j < n2n[i_nodes].size(); ++j) {
+        int j_nodes = n2n[i_nodes][j];
+        if (cl[j_nodes] > cli && cl[j_nodes] > threshold && !m_Fixed[nodes[j_nodes]] && L_new < cl[j_nodes]) {
+          if (L_new == 0) {
+            qWarning()<<"m_MaxEdgeLength="<<m_MaxEdgeLength;
+            qWarning()<<"cli="<<cli;
+            qWarning()<<"m_GrowthFactor="<<m_GrowthFactor;
+            qWarning()<<"characteristic_length_desired->GetValue(nodes[j_nodes])="<<cl[j_nodes];
+            qWarning()<<"L_new="<<L_new;
+            EG_BUG;
+          }
+          cl[j_nodes] = L_new;
+          queue.push(entry_t(L_new, j_nodes));
+        }
+      }
+    }
+    threshold *= m_GrowthFactor;
+  }
+}
 
 void UpdateDesiredMeshDensity::operate()
 {
-  m_ELSManager.read();
-  EG_VTKDCC(vtkIntArray, cell_code, m_Grid, "cell_code");
-  
+  readInputs();
+  // the boundary codes might have changed since the last call
+  m_FixedBCs = m_AllBCs - m_BoundaryCodes;
   if (m_OnlySurfaceCells) {
-    setAllSurfaceCells();
+    prepareSurfacePartition();
   } else {
     setAllCells();
   }
   l2g_t  nodes = getPartNodes();
-  l2g_t  cells = getPartCells();
   l2l_t  n2n   = getPartN2N();
 
-  /*
-  QMap<int, double> feature_res;
-  QSet<int> bcs = getAllBoundaryCodes(m_Grid);
-  foreach (int bc, bcs) {
-    feature_res[bc] = computeFeature2D(bc);
-    feature_res[bc] = min(feature_res[bc], computeFeature3D(bc));
-  }
-  */
-
+  EG_VTKDCC(vtkIntArray,    cell_code,                       m_Grid, "cell_code");
   EG_VTKDCN(vtkDoubleArray, characteristic_length_desired,   m_Grid, "node_meshdensity_desired");
   EG_VTKDCN(vtkIntArray,    characteristic_length_specified, m_Grid, "node_specified_density");
 
-  QVector<vec3_t> normals(cells.size(), vec3_t(0,0,0));
-  QVector<vec3_t> centres(cells.size(), vec3_t(0,0,0));
-  QVector<double> cl_pre(nodes.size(), 1e99);
-
-  computeExistingLengths();
+  m_TimeFeatures = 0;
+  m_TimeSources = 0;
+  m_TimeNodes = 0;
+  m_TimeGrowth = 0;
   if (m_BoundaryCodes.size() == 0) {
     return;
   }
 
-  if (m_NodesPerQuarterCircle > 1e-3) {
-    QVector<double> R(nodes.size(), 1e99);
-    foreach (vtkIdType id_cell, cells) {
-      vtkIdType N_pts, *pts;
-      m_Grid->GetCellPoints(id_cell, N_pts, pts);
-      int bc = cell_code->GetValue(id_cell);
-      for (int i = 0; i < N_pts; ++i) {
-        int i_nodes = m_Part.localNode(pts[i]);
-        R[i_nodes] = min(R[i_nodes], GuiMainWindow::pointer()->getSurfProj(bc)->getRadius(pts[i]));
-      }
-    }
-    for (int i_nodes = 0; i_nodes < nodes.size(); ++i_nodes) {
-      if (cl_pre[i_nodes] == 0) {
-        EG_BUG;
-      }
-      cl_pre[i_nodes] = max(m_MinEdgeLength, min(cl_pre[i_nodes], 0.5*R[i_nodes]*M_PI/m_NodesPerQuarterCircle));
-    }
-  }
-
   // cells across branches
-  computeFeature2D(cl_pre);
-  computeFeature3D(cl_pre);
+  QTime start = QTime::currentTime();
+  QVector<double> cl_pre(nodes.size(), 1e99);
+  computeFeatures(cl_pre);
+  m_TimeFeatures = 1e-3*start.msecsTo(QTime::currentTime());
+
+  // edge length sources for all nodes in one batch
+  start = QTime::currentTime();
+  QVector<vec3_t> x(nodes.size());
+  for (int i_nodes = 0; i_nodes < nodes.size(); ++i_nodes) {
+    m_Grid->GetPoint(nodes[i_nodes], x[i_nodes].data());
+  }
+  QVector<double> cl_src;
+  m_ELSManager.minEdgeLength(x, cl_src);
+  m_TimeSources = 1e-3*start.msecsTo(QTime::currentTime());
 
-  // set everything to desired mesh density and find maximal mesh-density
+  // all other node contributions in one loop; find the smallest length on the selected boundaries
+  start = QTime::currentTime();
+  m_Fixed.fill(false, m_Grid->GetNumberOfPoints());
   double cl_min = 1e99;
-  int i_nodes_min = -1;
+  bool found = false;
   for (int i_nodes = 0; i_nodes < nodes.size(); ++i_nodes) {
     vtkIdType id_node = nodes[i_nodes];
-    double cl = m_MaxEdgeLength;
-    if (m_BoundaryCodes.size() > 0) {
-      int idx = characteristic_length_specified->GetValue(id_node);
-      if (idx != -1) {
-        if (idx >= m_VMDvector.size()) {
-          qWarning()<<"idx="<<idx;
-          qWarning()<<"m_VMDvector.size()="<<m_VMDvector.size();
-          EG_BUG;
-        }
-        cl = m_VMDvector[idx].density;
-      }
-    }
-    if (m_Fixed[id_node]) {
-      cl = characteristic_length_desired->GetValue(id_node);
+    if (id_node < m_FixedNodes.size() && m_FixedNodes[id_node]) {
+      m_Fixed[id_node] = true;
+    } else {
+      characteristic_length_desired->SetValue(id_node, computeNodeLength(id_node, cl_pre[i_nodes], cl_src[i_nodes], cell_code, characteristic_length_specified));
     }
-    cl = min(cl_pre[i_nodes], cl);
-    vec3_t x;
-    m_Grid->GetPoint(id_node, x.data());
-    double cl_src = m_ELSManager.minEdgeLength(x);
-    if (cl_src > 0) {
-      cl = min(cl, cl_src);
-    }
-    
-    cl = max(m_MinEdgeLength, cl);
-
-    if(cl == 0) {
-      EG_BUG;
-    }
-    characteristic_length_desired->SetValue(id_node, cl);
-    
+    double cl = characteristic_length_desired->GetValue(id_node);
     if (cl < cl_min) {
       for (int i = 0; i < m_Part.n2bcGSize(id_node); ++i) {
         if (m_BoundaryCodes.contains(m_Part.n2bcG(id_node, i))) {
           cl_min = cl;
-          i_nodes_min = i_nodes;
+          found = true;
           break;
         }
       }
     }
   }
-  if (i_nodes_min == -1) {
+  m_TimeNodes = 1e-3*start.msecsTo(QTime::currentTime());
+  if (!found) {
     EG_ERR_RETURN("There are no edges that need improving.")
   }
 
-  // start from smallest characteristic length and loop as long as nodes are updated
-  int num_updated = 0;
-
-  do {
-    num_updated = 0;
-    for (int i_nodes = 0; i_nodes < nodes.size(); ++i_nodes) {
-      double cli = characteristic_length_desired->GetValue(nodes[i_nodes]);
-      if (cli <= cl_min) {
-        vec3_t xi;
-        m_Grid->GetPoint(nodes[i_nodes], xi.data());
-        for (int j = 0; j < n2n[i_nodes].size(); ++j) {
-          int j_nodes = n2n[i_nodes][j];
-          double clj = characteristic_length_desired->GetValue(nodes[j_nodes]);
-          if (clj > cli && clj > cl_min) {
-            vec3_t xj;
-            m_Grid->GetPoint(nodes[j_nodes], xj.data());
-            ++num_updated;
-            double L_new = min(m_MaxEdgeLength, cli * m_GrowthFactor);
-            if (!m_Fixed[nodes[j_nodes]]) {
-              
-              double cl_min = min(characteristic_length_desired->GetValue(nodes[j_nodes]), L_new);
-              if(cl_min==0) {
-                qWarning()<<"m_MaxEdgeLength="<<m_MaxEdgeLength;
-                qWarning()<<"cli="<<cli;
-                qWarning()<<"m_GrowthFactor="<<m_GrowthFactor;
-                qWarning()<<"characteristic_length_desired->GetValue(nodes[j_nodes])="<<characteristic_length_desired->GetValue(nodes[j_nodes]);
-                qWarning()<<"L_new="<<L_new;
-                EG_BUG;
-              }
-              characteristic_length_desired->SetValue(nodes[j_nodes], cl_min);
-              
-            }
-          }
-        }
-      }
-    }
-    cl_min *= m_GrowthFactor;
-  } while (num_updated > 0);
-
+  start = QTime::currentTime();
+  QVector<double> cl(nodes.size());
+  for (int i_nodes = 0; i_nodes < nodes.size(); ++i_nodes) {
+    cl[i_nodes] = characteristic_length_desired->GetValue(nodes[i_nodes]);
+  }
+  limitGrowth(cl_min, cl);
+  for (int i_nodes = 0; i_nodes < nodes.size(); ++i_nodes) {
+    characteristic_length_desired->SetValue(nodes[i_nodes], cl[i_nodes]);
+  }
+  m_TimeGrowth = 1e-3*start.msecsTo(QTime::currentTime());
 }
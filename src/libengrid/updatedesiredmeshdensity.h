@@ -56,22 +56,65 @@ private: //attributes
   double                      m_FeatureThresholdAngle;
   QVector<double>             m_FeatureSize;
   QVector<bool>               m_Fixed;
+  QVector<bool>               m_FixedNodes;   ///< nodes which keep their current desired length (see fixNodes)
   EdgeLengthSourceManager     m_ELSManager;
   bool                        m_OnlySurfaceCells;
+  bool                        m_InputsRead;   ///< edge length sources and boundary codes have been read
+  QSet<int>                   m_AllBCs;       ///< all boundary codes of the grid (see readInputs)
+  QSet<int>                   m_FixedBCs;     ///< boundary codes which are not re-meshed (updated for every call)
+  double                      m_TimeFeatures; ///< seconds spent on the feature resolution (last call)
+  double                      m_TimeSources;  ///< seconds spent on the edge length sources (last call)
+  double                      m_TimeNodes;    ///< seconds spent on the node contributions (last call)
+  double                      m_TimeGrowth;   ///< seconds spent on limiting the growth (last call)
 
 protected: // methods
 
   void   computeFeature(const QList<point_t> points, QVector<double> &cl_pre, double res);
-  void   computeFeature2D(QVector<double> &cl_pre);
-  void   computeFeature3D(QVector<double> &cl_pre);
+
+  /**
+   * Collect the feature points for the 2D and the 3D feature resolution in one loop through
+   * all surface faces and lower the pre-computed lengths accordingly.
+   * @param cl_pre the pre-computed characteristic lengths (local node indices)
+   */
+  void   computeFeatures(QVector<double> &cl_pre);
+
   double computeSearchDistance(vtkIdType id_face);
-  void   computeExistingLengths();
+
+  /**
+   * Compute the desired characteristic length of a single node.
+   * This combines the existing lengths of fixed boundaries, the surface curvature, the mesh density table,
+   * the edge length sources and the limits for the edge length.
+   * @param id_node the node
+   * @param cl_pre the pre-computed characteristic length (feature resolution) of the node
+   * @param cl_src the minimal edge length of the edge length sources at the node
+   * @param cell_code the boundary codes of the cells
+   * @param characteristic_length_specified the mesh density table entries of the nodes
+   * @return the desired characteristic length
+   */
+  double computeNodeLength(vtkIdType id_node, double cl_pre, double cl_src, vtkIntArray *cell_code, vtkIntArray *characteristic_length_specified);
+
+  /**
+   * Limit the growth of the characteristic length between neighbouring nodes (by the cell growth factor).
+   * @param cl_min the smallest characteristic length of a node on the selected boundaries
+   * @param cl the characteristic lengths (local node indices); they will be lowered where necessary
+   */
+  void limitGrowth(double cl_min, QVector<double> &cl);
 
 
 public: //methods
 
   UpdateDesiredMeshDensity();
   virtual void operate();
+  void readInputs(); ///< read everything which does not change between two calls (only once; called by operate)
+
+  /**
+   * Keep the current desired length of some nodes.
+   * The lengths of these nodes are not recomputed, but they still limit the growth of the lengths around them.
+   * Nodes beyond the end of the vector are not fixed (the grid might grow after this call).
+   * @param fixnodes true for all nodes which should keep their desired length
+   */
+  void fixNodes(const QVector<bool> &fixnodes) { m_FixedNodes = fixnodes; }
+
   void setVertexMeshDensityVector(QVector <VertexMeshDensity> const & vmd) { m_VMDvector = vmd; }
   void setMaxEdgeLength(double l) { m_MaxEdgeLength = l; }
   void setMinEdgeLength(double l) { m_MinEdgeLength = l; }
@@ -83,6 +126,11 @@ public: //methods
   void setFeatureResolution3D(double n) { m_FeatureResolution3D = n; }
   void setFeatureThresholdAngle(double a) { m_FeatureThresholdAngle = a; }
 
+  double timeFeatures() const { return m_TimeFeatures; } ///< seconds spent on the feature resolution (last call)
+  double timeSources()  const { return m_TimeSources; }  ///< seconds spent on the edge length sources (last call)
+  double timeNodes()    const { return m_TimeNodes; }    ///< seconds spent on the node contributions (last call)
+  double timeGrowth()   const { return m_TimeGrowth; }   ///< seconds spent on limiting the growth (last call)
+
 };
 
 #endif
@@ -56,7 +56,7 @@ bool VertexMeshDensity::operator==(const VertexMeshDensity & VMD) const
   }
 }
 
-int VertexMeshDensity::findSmallestVMD( QVector <VertexMeshDensity> vector)
+int VertexMeshDensity::findSmallestVMD(const QVector<VertexMeshDensity> &vector)
 {
   int ret = -1;
   double Lmin = 0;
@@ -63,7 +63,7 @@ public: // methods
   
   void setNodes(QString str);/// set nodeset by passing a string of the form "id1,id2,..."
 
-  int findSmallestVMD( QVector <VertexMeshDensity> vector);
+  int findSmallestVMD(const QVector<VertexMeshDensity> &vector);
 };
 
 /// ostream operator to print out a VertexMeshDensity object